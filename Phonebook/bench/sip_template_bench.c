@@ -0,0 +1,219 @@
+// bench/sip_template_bench.c - Times the precompiled 200 OK replies against snprintf formatting
+//
+// Not part of the package: the OpenWrt Makefile never compiles this file.
+// Build and run on the build host (or cross-compile for a node), from the
+// Phonebook directory:
+//
+//   gcc -O2 -Isrc -o /tmp/sip_template_bench bench/sip_template_bench.c
+//       src/sip_core/sip_template.c src/sip_core/sip_message.c
+//       src/log_manager/log_manager.c -lpthread
+//   /tmp/sip_template_bench [iterations]
+//
+// Only the building of the reply into a MAX_SIP_MSG_LEN buffer is timed. Both
+// paths start from a request that is already parsed, and nothing is sent.
+// - snprintf: the formatting half of send_sip_response(), copied below, fed
+//   the header strings process_parsed_sip_message() copies out of the request
+// - template: sip_template_render() / sip_template_render_expires(), as
+//   sip_core.c calls them
+// Each reply is also checked byte-for-byte between the two paths.
+#include "sip_core/sip_template.h"
+#include <time.h>
+
+#define BENCH_DEFAULT_ITERATIONS 2000000
+#define BENCH_RUNS 3
+#define BENCH_REGISTER_EXPIRES 3600
+
+// Formatting half of send_sip_response() (sip_core.c), minus the send
+static int format_response(char *response_buffer, const char *status_line, const char *call_id,
+                           const char *cseq, const char *from_hdr, const char *to_hdr,
+                           const char *via_hdr, const char *contact_hdr, const char *extra_headers) {
+    int len = 0;
+    int result;
+
+    result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "%s\r\n", status_line);
+    if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+    len += result;
+    if (*via_hdr) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "Via: %s\r\n", via_hdr);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (*from_hdr) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "From: %s\r\n", from_hdr);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (*to_hdr) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "To: %s\r\n", to_hdr);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (*call_id) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "Call-ID: %s\r\n", call_id);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (*cseq) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "CSeq: %s\r\n", cseq);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (contact_hdr && *contact_hdr) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "Contact: %s\r\n", contact_hdr);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    if (extra_headers && *extra_headers) {
+        result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "%s\r\n", extra_headers);
+        if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+        len += result;
+    }
+    result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "Content-Length: %d\r\n", 0);
+    if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+    len += result;
+    result = snprintf(response_buffer + len, MAX_SIP_MSG_LEN - len, "\r\n");
+    if (result < 0 || result >= (int)(MAX_SIP_MSG_LEN - len)) return -1;
+    len += result;
+    return len;
+}
+
+// Same text as SIP_ALLOW_HEADER in sip_core.c
+#define BENCH_ALLOW_HEADER "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REGISTER, SUBSCRIBE, NOTIFY, REFER, INFO, MESSAGE, UPDATE"
+
+static const char options_request[] =
+    "OPTIONS sip:localnode.local.mesh SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.54.12.7:5060;branch=z9hG4bK1853402466;rport\r\n"
+    "From: \"441530\" <sip:441530@localnode.local.mesh>;tag=2116744376\r\n"
+    "To: <sip:localnode.local.mesh>\r\n"
+    "Call-ID: 0_2953617425@10.54.12.7\r\n"
+    "CSeq: 2 OPTIONS\r\n"
+    "Contact: <sip:441530@10.54.12.7:5060>\r\n"
+    "Max-Forwards: 70\r\n"
+    "User-Agent: Yealink SIP-T48S 66.86.0.15\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static const char register_request[] =
+    "REGISTER sip:localnode.local.mesh SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.54.12.7:5060;branch=z9hG4bK2387916012;rport\r\n"
+    "From: \"441530\" <sip:441530@localnode.local.mesh>;tag=3876541829\r\n"
+    "To: \"441530\" <sip:441530@localnode.local.mesh>\r\n"
+    "Call-ID: 0_1184632211@10.54.12.7\r\n"
+    "CSeq: 17 REGISTER\r\n"
+    "Contact: <sip:441530@10.54.12.7:5060>;reg-id=1\r\n"
+    "Max-Forwards: 70\r\n"
+    "User-Agent: Yealink SIP-T48S 66.86.0.15\r\n"
+    "Expires: 3600\r\n"
+    "Allow: INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, OPTIONS, INFO, SUBSCRIBE, UPDATE\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+typedef struct {
+    const char *name;
+    const char *request;
+    const sip_response_template_t *template;
+    int expires;                // < 0: sip_template_render(), else sip_template_render_expires()
+} BenchCase;
+
+// What process_parsed_sip_message() copies out of the request before replying
+typedef struct {
+    char via_hdr[MAX_CONTACT_URI_LEN * 2];
+    char from_hdr[MAX_CONTACT_URI_LEN];
+    char to_hdr[MAX_CONTACT_URI_LEN];
+    char call_id_hdr[MAX_CONTACT_URI_LEN];
+    char cseq_hdr[MAX_CONTACT_URI_LEN];
+    char contact_hdr[MAX_CONTACT_URI_LEN];
+} CopiedHeaders;
+
+// The snprintf path for one reply. A REGISTER reply carries the granted
+// expires twice (Expires header, Contact parameter), formatted per request.
+static int build_with_snprintf(const BenchCase *bc, const CopiedHeaders *h, char *out) {
+    if (bc->expires < 0) {
+        return format_response(out, "SIP/2.0 200 OK", h->call_id_hdr, h->cseq_hdr, h->from_hdr, h->to_hdr,
+                               h->via_hdr, NULL, BENCH_ALLOW_HEADER);
+    }
+    char contact[MAX_CONTACT_URI_LEN + 24];
+    char expires_header[32];
+    snprintf(contact, sizeof(contact), "%s;expires=%d", h->contact_hdr, bc->expires);
+    snprintf(expires_header, sizeof(expires_header), "Expires: %d", bc->expires);
+    return format_response(out, "SIP/2.0 200 OK", h->call_id_hdr, h->cseq_hdr, h->from_hdr, h->to_hdr,
+                           h->via_hdr, contact, expires_header);
+}
+
+static int build_with_template(const BenchCase *bc, const sip_msg_t *msg, char *out) {
+    return bc->expires < 0
+        ? sip_template_render(bc->template, msg, out, MAX_SIP_MSG_LEN)
+        : sip_template_render_expires(bc->template, msg, bc->expires, out, MAX_SIP_MSG_LEN);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_case(const BenchCase *bc, long iterations) {
+    sip_msg_t msg;
+    if (sip_msg_parse(&msg, bc->request, strlen(bc->request)) != 0) {
+        fprintf(stderr, "%s: request does not parse\n", bc->name);
+        return;
+    }
+
+    // The request's Contact carries no ;expires, so the snprintf path only appends one
+    CopiedHeaders h;
+    sip_msg_copy_all_headers(&msg, SIP_HDR_VIA, h.via_hdr, sizeof(h.via_hdr));
+    sip_msg_copy_header(&msg, SIP_HDR_FROM, h.from_hdr, sizeof(h.from_hdr));
+    sip_msg_copy_header(&msg, SIP_HDR_TO, h.to_hdr, sizeof(h.to_hdr));
+    sip_msg_copy_header(&msg, SIP_HDR_CALL_ID, h.call_id_hdr, sizeof(h.call_id_hdr));
+    sip_msg_copy_header(&msg, SIP_HDR_CSEQ, h.cseq_hdr, sizeof(h.cseq_hdr));
+    sip_msg_copy_header(&msg, SIP_HDR_CONTACT, h.contact_hdr, sizeof(h.contact_hdr));
+
+    char before[MAX_SIP_MSG_LEN], after[MAX_SIP_MSG_LEN];
+    int before_len = build_with_snprintf(bc, &h, before);
+    int after_len = build_with_template(bc, &msg, after);
+    int identical = before_len > 0 && before_len == after_len && memcmp(before, after, before_len) == 0;
+    printf("%s: identical=%d len=%d\n", bc->name, identical, after_len);
+
+    volatile int sink = 0; // Keeps either loop from being optimised away
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double t0 = now_ns();
+        for (long i = 0; i < iterations; i++) {
+            sink += build_with_snprintf(bc, &h, before);
+        }
+        double t1 = now_ns();
+        for (long i = 0; i < iterations; i++) {
+            sink += build_with_template(bc, &msg, after);
+        }
+        double t2 = now_ns();
+        double snprintf_ns = (t1 - t0) / iterations;
+        double template_ns = (t2 - t1) / iterations;
+        printf("  snprintf %.1f ns/reply   template %.1f ns/reply   speedup %.1fx\n",
+               snprintf_ns, template_ns, snprintf_ns / template_ns);
+    }
+    (void)sink;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    // Compiled as sip_core_init() does
+    static sip_response_template_t options_ok_template, register_ok_template;
+    if (sip_template_compile(&options_ok_template, "SIP/2.0 200 OK", BENCH_ALLOW_HEADER, 0) != 0 ||
+        sip_template_compile(&register_ok_template, "SIP/2.0 200 OK", NULL, SIP_TEMPLATE_ECHO_CONTACT) != 0) {
+        fprintf(stderr, "template compile failed\n");
+        return 1;
+    }
+
+    const BenchCase cases[] = {
+        { "OPTIONS 200 OK", options_request, &options_ok_template, -1 },
+        { "REGISTER 200 OK", register_request, &register_ok_template, BENCH_REGISTER_EXPIRES },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        run_case(&cases[i], iterations);
+    }
+    return 0;
+}
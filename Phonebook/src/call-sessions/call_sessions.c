@@ -1,142 +1,514 @@
 #include "call_sessions.h"
 #include "../common.h" // For logging macros
 #include "../file_utils/file_utils.h" // For json_write_escaped
+#include "../config_loader/config_loader.h" // For g_max_call_sessions
+#include <stdint.h>
 
 #define MODULE_NAME "SESSION"
 
-CallSession* find_call_session_by_callid(const char *call_id) {
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (call_sessions[i].in_use &&
-            strcmp(call_sessions[i].call_id, call_id) == 0) {
-            return &call_sessions[i];
+#define CALL_SESSION_CHUNK 16 // Sessions allocated per pool growth step
+
+typedef struct {
+    uint32_t hash;          // Call-ID hash (cached for probing and backward-shift delete)
+    CallSession *session;   // NULL = empty slot
+} SessionSlot;
+
+// One stripe of the session table. With SIP worker threads each worker owns
+// the shard its Call-IDs hash to, so the shard mutex is only ever contended
+// by the passive safety thread and the JSON export, never by another worker.
+typedef struct {
+    pthread_mutex_t mutex;
+    CallSession *chunks[(MAX_CALL_SESSIONS_LIMIT + CALL_SESSION_CHUNK - 1) / CALL_SESSION_CHUNK];
+    int num_chunks;
+    int num_allocated;
+    CallSession **free_sessions; // Stack of free pool entries
+    int num_free;
+    SessionSlot *index_slots;    // Power-of-two sized, load factor <= 0.5
+    uint32_t index_mask;
+    int capacity;
+    int active;
+} SessionShard;
+
+static SessionShard shards[CALL_SESSION_MAX_SHARDS];
+static int num_shards = 0;
+static int session_capacity = 0;
+static int active_sessions = 0;
+static pthread_mutex_t export_mutex = PTHREAD_MUTEX_INITIALIZER; // One writer of the temp file at a time
+
+static void write_active_calls_json(void);
+
+static uint32_t hash_call_id(const char *call_id) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (const char *p = call_id; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// High bits pick the shard; the low bits already pick the index slot
+static int shard_of_hash(uint32_t h) {
+    return num_shards > 1 ? (int)((h >> 24) % (uint32_t)num_shards) : 0;
+}
+
+int call_sessions_shard_of(const char *call_id) {
+    return shard_of_hash(hash_call_id(call_id ? call_id : ""));
+}
+
+int call_sessions_shard_count(void) {
+    return num_shards;
+}
+
+// Add another chunk of sessions to the free stack, up to the shard capacity
+static int grow_session_pool(SessionShard *sh) {
+    if (sh->num_allocated >= sh->capacity) {
+        return -1;
+    }
+    int count = sh->capacity - sh->num_allocated;
+    if (count > CALL_SESSION_CHUNK) count = CALL_SESSION_CHUNK;
+
+    CallSession *chunk = calloc(count, sizeof(CallSession));
+    if (!chunk) {
+        LOG_ERROR("Call Sessions: Failed to grow session pool by %d.", count);
+        return -1;
+    }
+    sh->chunks[sh->num_chunks++] = chunk;
+    sh->num_allocated += count;
+    for (int i = count - 1; i >= 0; i--) {
+        sh->free_sessions[sh->num_free++] = &chunk[i];
+    }
+    LOG_DEBUG("Call Sessions: Shard %d pool grown to %d sessions.", (int)(sh - shards), sh->num_allocated);
+    return 0;
+}
+
+static CallSession *index_find(const SessionShard *sh, uint32_t h, const char *call_id, const char *from_tag) {
+    if (!sh->index_slots) {
+        return NULL;
+    }
+    for (uint32_t i = h & sh->index_mask; sh->index_slots[i].session; i = (i + 1) & sh->index_mask) {
+        CallSession *s = sh->index_slots[i].session;
+        if (sh->index_slots[i].hash == h && strcmp(s->call_id, call_id) == 0 &&
+            (!from_tag || strcmp(s->from_tag, from_tag) == 0)) {
+            return s;
         }
     }
     return NULL;
 }
 
-CallSession* create_call_session() {
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (!call_sessions[i].in_use) {
-            call_sessions[i].in_use = 1;
-            call_sessions[i].state = CALL_STATE_FREE;
-            call_sessions[i].creation_time = time(NULL); // For passive cleanup
-            memset(call_sessions[i].call_id, 0, sizeof(call_sessions[i].call_id));
-            memset(call_sessions[i].cseq, 0, sizeof(call_sessions[i].cseq));
-            memset(call_sessions[i].from_tag, 0, sizeof(call_sessions[i].from_tag));
-            memset(call_sessions[i].to_tag, 0, sizeof(call_sessions[i].to_tag));
-            memset(&call_sessions[i].caller_addr, 0, sizeof(struct sockaddr_in));
-            memset(&call_sessions[i].callee_addr, 0, sizeof(struct sockaddr_in));
-            memset(&call_sessions[i].original_caller_addr, 0, sizeof(struct sockaddr_in));
-            // Clear call details fields
-            memset(call_sessions[i].caller_user_id, 0, sizeof(call_sessions[i].caller_user_id));
-            memset(call_sessions[i].caller_display_name, 0, sizeof(call_sessions[i].caller_display_name));
-            memset(call_sessions[i].callee_user_id, 0, sizeof(call_sessions[i].callee_user_id));
-            memset(call_sessions[i].callee_display_name, 0, sizeof(call_sessions[i].callee_display_name));
-            memset(call_sessions[i].codec, 0, sizeof(call_sessions[i].codec));
-            memset(call_sessions[i].callee_hostname, 0, sizeof(call_sessions[i].callee_hostname));
-            LOG_DEBUG("Call Sessions: Created new call session at index %d.", i);
-            return &call_sessions[i];
+static void index_insert(SessionShard *sh, uint32_t h, CallSession *session) {
+    uint32_t i = h & sh->index_mask;
+    while (sh->index_slots[i].session) {
+        i = (i + 1) & sh->index_mask;
+    }
+    sh->index_slots[i].hash = h;
+    sh->index_slots[i].session = session;
+}
+
+// Linear-probing delete with backward shift, so no tombstones accumulate
+static void index_remove(SessionShard *sh, CallSession *session) {
+    SessionSlot *slots = sh->index_slots;
+    uint32_t mask = sh->index_mask;
+    uint32_t i = hash_call_id(session->call_id) & mask;
+    while (slots[i].session && slots[i].session != session) {
+        i = (i + 1) & mask;
+    }
+    if (!slots[i].session) {
+        return;
+    }
+
+    for (uint32_t j = (i + 1) & mask; slots[j].session; j = (j + 1) & mask) {
+        uint32_t home = slots[j].hash & mask;
+        // Move j back into the hole at i unless its home lies cyclically in (i, j]
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            slots[i] = slots[j];
+            i = j;
         }
     }
-    LOG_WARN("Call Sessions: Max call sessions reached (%d), cannot create new session.",
-                MAX_CALL_SESSIONS);
-    return NULL;
+    slots[i].session = NULL;
+}
+
+// Unindex and return to the free stack; fields are reset on reuse. Caller holds the shard mutex.
+static void release_session(SessionShard *sh, CallSession *session) {
+    index_remove(sh, session);
+    session->in_use = 0;
+    session->state = CALL_STATE_FREE;
+    sh->free_sessions[sh->num_free++] = session;
+    sh->active--;
+    __atomic_fetch_sub(&active_sessions, 1, __ATOMIC_RELAXED);
+}
+
+// Sessions are numbered across a shard's chunks in allocation order
+static CallSession *pool_entry(const SessionShard *sh, int idx) {
+    return &sh->chunks[idx / CALL_SESSION_CHUNK][idx % CALL_SESSION_CHUNK];
+}
+
+static CallSession *find_session(const char *call_id, const char *from_tag) {
+    if (!call_id || num_shards == 0) {
+        return NULL;
+    }
+    uint32_t h = hash_call_id(call_id);
+    SessionShard *sh = &shards[shard_of_hash(h)];
+    pthread_mutex_lock(&sh->mutex);
+    CallSession *session = index_find(sh, h, call_id, from_tag);
+    pthread_mutex_unlock(&sh->mutex);
+    return session;
+}
+
+CallSession* find_call_session_by_callid(const char *call_id) {
+    return find_session(call_id, NULL);
+}
+
+CallSession* find_call_session_by_dialog(const char *call_id, const char *from_tag) {
+    return find_session(call_id, from_tag ? from_tag : "");
+}
+
+CallSession* create_call_session(const CallSession *init) {
+    uint32_t h = hash_call_id(init->call_id);
+    SessionShard *sh = num_shards > 0 ? &shards[shard_of_hash(h)] : NULL;
+    if (!sh) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sh->mutex);
+
+    if (!sh->index_slots || sh->active >= sh->capacity ||
+        (sh->num_free == 0 && grow_session_pool(sh) != 0)) {
+        pthread_mutex_unlock(&sh->mutex);
+        LOG_WARN("Call Sessions: Max call sessions reached (%d), cannot create new session.",
+                    session_capacity);
+        return NULL;
+    }
+
+    CallSession *session = sh->free_sessions[--sh->num_free];
+    *session = *init;
+    session->in_use = 1;
+    session->creation_time = time(NULL); // For passive cleanup
+
+    index_insert(sh, h, session);
+    sh->active++;
+    int active = __atomic_add_fetch(&active_sessions, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&sh->mutex);
+
+    LOG_DEBUG("Call Sessions: Created new call session for Call-ID %s (%d active).",
+                session->call_id, active);
+    return session;
+}
+
+// The owning SIP thread reads its sessions unlocked; writes take the shard
+// lock so the active-calls snapshot copies whole sessions
+void call_session_set_state(CallSession *session, CallState state) {
+    if (!session || num_shards == 0) {
+        return;
+    }
+    SessionShard *sh = &shards[call_sessions_shard_of(session->call_id)];
+    pthread_mutex_lock(&sh->mutex);
+    if (session->in_use) {
+        session->state = state;
+    }
+    pthread_mutex_unlock(&sh->mutex);
 }
 
 void terminate_call_session(CallSession *session) {
-    if (session && session->in_use) {
+    if (!session || num_shards == 0) {
+        return;
+    }
+    // The Call-ID never changes while the session is in use, so it names the owning shard
+    SessionShard *sh = &shards[call_sessions_shard_of(session->call_id)];
+    pthread_mutex_lock(&sh->mutex);
+    if (session->in_use) {
         LOG_INFO("Call Sessions: Terminating call session Call-ID: %s", session->call_id);
-        session->in_use = 0;
-        session->state = CALL_STATE_FREE;
-        memset(session->call_id, 0, sizeof(session->call_id));
-        memset(session->cseq, 0, sizeof(session->cseq));
-        memset(session->from_tag, 0, sizeof(session->from_tag));
-        memset(session->to_tag, 0, sizeof(session->to_tag));
-        memset(&session->caller_addr, 0, sizeof(struct sockaddr_in));
-        memset(&session->callee_addr, 0, sizeof(struct sockaddr_in));
-        memset(&session->original_caller_addr, 0, sizeof(struct sockaddr_in));
-        // Clear call details fields
-        memset(session->caller_user_id, 0, sizeof(session->caller_user_id));
-        memset(session->caller_display_name, 0, sizeof(session->caller_display_name));
-        memset(session->callee_user_id, 0, sizeof(session->callee_user_id));
-        memset(session->callee_display_name, 0, sizeof(session->callee_display_name));
-        memset(session->codec, 0, sizeof(session->codec));
-        memset(session->callee_hostname, 0, sizeof(session->callee_hostname));
+        release_session(sh, session);
     }
+    pthread_mutex_unlock(&sh->mutex);
+}
+
+static int init_shard(SessionShard *sh, int capacity) {
+    pthread_mutex_init(&sh->mutex, NULL);
+    sh->capacity = capacity;
+
+    uint32_t index_size = 1;
+    while (index_size < (uint32_t)capacity * 2) {
+        index_size <<= 1;
+    }
+
+    sh->index_slots = calloc(index_size, sizeof(SessionSlot));
+    sh->free_sessions = calloc(capacity, sizeof(CallSession *));
+    if (!sh->index_slots || !sh->free_sessions) {
+        free(sh->index_slots);
+        free(sh->free_sessions);
+        sh->index_slots = NULL;
+        sh->free_sessions = NULL;
+        sh->capacity = 0;
+        return -1;
+    }
+    sh->index_mask = index_size - 1;
+    grow_session_pool(sh);
+    return 0;
 }
 
 void init_call_sessions() {
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        call_sessions[i].in_use = 0;
-        call_sessions[i].state = CALL_STATE_FREE;
+    // One shard per SIP worker so a worker never waits on another worker's dialogs
+    num_shards = g_sip_worker_threads > 1 ? g_sip_worker_threads : 1;
+    if (num_shards > CALL_SESSION_MAX_SHARDS) num_shards = CALL_SESSION_MAX_SHARDS;
+
+    int per_shard = (g_max_call_sessions + num_shards - 1) / num_shards;
+    session_capacity = 0;
+    for (int i = 0; i < num_shards; i++) {
+        if (init_shard(&shards[i], per_shard) != 0) {
+            LOG_ERROR("Call Sessions: Failed to allocate session table for %d sessions.", per_shard);
+        }
+        session_capacity += shards[i].capacity;
     }
-    LOG_INFO("Initialized call session table (max %d sessions).",
-                MAX_CALL_SESSIONS);
+    active_sessions = 0;
+
+    LOG_INFO("Initialized call session table (max %d sessions, %d shard%s).",
+                session_capacity, num_shards, num_shards == 1 ? "" : "s");
 
     // Reset the exported active-calls file to match our empty table. /tmp is
     // tmpfs that survives a service restart (not a reboot), so without this a
     // stale active_calls.json from a previous process instance would keep being
     // served -- showing phantom calls -- until the next real call event.
-    export_active_calls_json();
+    write_active_calls_json();
+}
+
+// Lock-free; also called from the crash handler
+int get_active_call_count(void) {
+    return __atomic_load_n(&active_sessions, __ATOMIC_RELAXED);
+}
+
+int get_call_session_capacity(void) {
+    return session_capacity;
+}
+
+int cleanup_stale_call_sessions(time_t max_age_seconds) {
+    time_t now = time(NULL);
+    int cleaned_count = 0;
+
+    for (int s = 0; s < num_shards; s++) {
+        SessionShard *sh = &shards[s];
+        pthread_mutex_lock(&sh->mutex);
+        for (int i = 0; i < sh->num_allocated; i++) {
+            CallSession *session = pool_entry(sh, i);
+            if (!session->in_use) continue;
+
+            time_t session_age = now - session->creation_time;
+            if (session_age > max_age_seconds) {
+                LOG_INFO("Cleaning up stale call session: %s (age: %ld seconds)",
+                         session->call_id, (long)session_age);
+                release_session(sh, session);
+                cleaned_count++;
+            }
+        }
+        pthread_mutex_unlock(&sh->mutex);
+    }
+
+    return cleaned_count;
 }
 
-// Export active calls to JSON file for CGI access
-// Uses atomic write (temp+rename) to prevent CGI readers from seeing partial JSON
-void export_active_calls_json() {
+static void write_session_json(FILE *f, const CallSession *session) {
+    const char *state_str = "UNKNOWN";
+    switch (session->state) {
+        case CALL_STATE_INVITE_SENT: state_str = "INVITE_SENT"; break;
+        case CALL_STATE_RINGING: state_str = "RINGING"; break;
+        case CALL_STATE_ESTABLISHED: state_str = "ESTABLISHED"; break;
+        case CALL_STATE_TERMINATING: state_str = "TERMINATING"; break;
+        default: state_str = "UNKNOWN"; break;
+    }
+
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"caller_user_id\": \""); json_write_escaped(f, session->caller_user_id); fprintf(f, "\",\n");
+    fprintf(f, "      \"caller_display_name\": \""); json_write_escaped(f, session->caller_display_name); fprintf(f, "\",\n");
+    fprintf(f, "      \"callee_user_id\": \""); json_write_escaped(f, session->callee_user_id); fprintf(f, "\",\n");
+    fprintf(f, "      \"callee_display_name\": \""); json_write_escaped(f, session->callee_display_name); fprintf(f, "\",\n");
+    fprintf(f, "      \"codec\": \""); json_write_escaped(f, session->codec); fprintf(f, "\",\n");
+    fprintf(f, "      \"callee_hostname\": \""); json_write_escaped(f, session->callee_hostname); fprintf(f, "\",\n");
+    fprintf(f, "      \"state\": \"%s\",\n", state_str);
+    fprintf(f, "      \"call_id\": \""); json_write_escaped(f, session->call_id); fprintf(f, "\"\n");
+    fprintf(f, "    }");
+}
+
+// Copy every in-use session out of all shards at once. Shards are locked in
+// index order (nothing else holds two). Sessions are only written under their
+// shard lock (create_call_session, call_session_set_state), so the snapshot
+// is consistent.
+static CallSession *snapshot_active_sessions(int *count_out) {
+    for (int s = 0; s < num_shards; s++) {
+        pthread_mutex_lock(&shards[s].mutex);
+    }
+
+    int total = 0;
+    for (int s = 0; s < num_shards; s++) {
+        total += shards[s].active;
+    }
+    CallSession *snapshot = total > 0 ? malloc(total * sizeof(CallSession)) : NULL;
+
+    int count = 0;
+    if (snapshot) {
+        for (int s = 0; s < num_shards; s++) {
+            const SessionShard *sh = &shards[s];
+            for (int i = 0; i < sh->num_allocated && count < total; i++) {
+                const CallSession *session = pool_entry(sh, i);
+                if (session->in_use && session->state != CALL_STATE_FREE) {
+                    snapshot[count++] = *session;
+                }
+            }
+        }
+    } else if (total > 0) {
+        LOG_ERROR("Failed to allocate active calls snapshot (%d sessions).", total);
+    }
+
+    for (int s = num_shards - 1; s >= 0; s--) {
+        pthread_mutex_unlock(&shards[s].mutex);
+    }
+
+    *count_out = count;
+    return snapshot;
+}
+
+// Write active calls to JSON file for CGI access
+// Uses atomic write (temp+rename) to prevent CGI readers from seeing partial JSON.
+// Rendered from a snapshot, so no session lock is held during file I/O.
+static void write_active_calls_json(void) {
     const char *json_path = "/tmp/active_calls.json";
     const char *temp_path = "/tmp/active_calls.json.tmp";
 
+    pthread_mutex_lock(&export_mutex);
+
+    int call_count = 0;
+    CallSession *snapshot = snapshot_active_sessions(&call_count);
+
     FILE *f = fopen(temp_path, "w");
     if (!f) {
         LOG_ERROR("Failed to open %s for writing: %s", temp_path, strerror(errno));
+        pthread_mutex_unlock(&export_mutex);
+        free(snapshot);
         return;
     }
 
     fprintf(f, "{\n  \"calls\": [\n");
-
-    int call_count = 0;
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (call_sessions[i].in_use && call_sessions[i].state != CALL_STATE_FREE) {
-            if (call_count > 0) {
-                fprintf(f, ",\n");
-            }
-
-            const char *state_str = "UNKNOWN";
-            switch (call_sessions[i].state) {
-                case CALL_STATE_INVITE_SENT: state_str = "INVITE_SENT"; break;
-                case CALL_STATE_RINGING: state_str = "RINGING"; break;
-                case CALL_STATE_ESTABLISHED: state_str = "ESTABLISHED"; break;
-                case CALL_STATE_TERMINATING: state_str = "TERMINATING"; break;
-                default: state_str = "UNKNOWN"; break;
-            }
-
-            fprintf(f, "    {\n");
-            fprintf(f, "      \"caller_user_id\": \""); json_write_escaped(f, call_sessions[i].caller_user_id); fprintf(f, "\",\n");
-            fprintf(f, "      \"caller_display_name\": \""); json_write_escaped(f, call_sessions[i].caller_display_name); fprintf(f, "\",\n");
-            fprintf(f, "      \"callee_user_id\": \""); json_write_escaped(f, call_sessions[i].callee_user_id); fprintf(f, "\",\n");
-            fprintf(f, "      \"callee_display_name\": \""); json_write_escaped(f, call_sessions[i].callee_display_name); fprintf(f, "\",\n");
-            fprintf(f, "      \"codec\": \""); json_write_escaped(f, call_sessions[i].codec); fprintf(f, "\",\n");
-            fprintf(f, "      \"callee_hostname\": \""); json_write_escaped(f, call_sessions[i].callee_hostname); fprintf(f, "\",\n");
-            fprintf(f, "      \"state\": \"%s\",\n", state_str);
-            fprintf(f, "      \"call_id\": \""); json_write_escaped(f, call_sessions[i].call_id); fprintf(f, "\"\n");
-            fprintf(f, "    }");
-
-            call_count++;
+    for (int i = 0; i < call_count; i++) {
+        if (i > 0) {
+            fprintf(f, ",\n");
         }
+        write_session_json(f, &snapshot[i]);
     }
-
     fprintf(f, "\n  ],\n");
     fprintf(f, "  \"total_active_calls\": %d\n", call_count);
     fprintf(f, "}\n");
 
     fclose(f);
+    free(snapshot);
 
     // Atomic rename: replace destination with completed temp file
-    if (rename(temp_path, json_path) != 0) {
+    int rc = rename(temp_path, json_path);
+    if (rc != 0) {
         LOG_ERROR("Failed to atomically publish active calls JSON: %s", strerror(errno));
         remove(temp_path); // Clean up temp file
-        return;
     }
+    pthread_mutex_unlock(&export_mutex);
+
+    if (rc == 0) {
+        LOG_DEBUG("Exported %d active calls to %s (atomic write)", call_count, json_path);
+    }
+}
+
+// --- Background publisher ---
+// Call-state changes only bump calls_generation. The publisher thread wakes on
+// that, waits out the rest of ACTIVE_CALLS_PUBLISH_INTERVAL_MS since its last
+// write so a burst (INVITE, 180, 200) becomes one file write, and renders the
+// latest state. Call setup never waits on file I/O.
+
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publish_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long calls_generation = 0;   // Guarded by publish_mutex
+static bool publisher_running = false;       // Guarded by publish_mutex
+static pthread_t publisher_tid;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *active_calls_publisher_thread(void *arg) {
+    (void)arg;
+    unsigned long published = 0; // Changes marked before the thread got here still get written
+    uint64_t last_write_ms = 0;
+
+    pthread_mutex_lock(&publish_mutex);
+    for (;;) {
+        while (publisher_running && calls_generation == published) {
+            pthread_cond_wait(&publish_cond, &publish_mutex);
+        }
+        if (calls_generation == published) {
+            break; // Stopped with nothing left to write
+        }
+        bool stopping = !publisher_running;
+        pthread_mutex_unlock(&publish_mutex);
+
+        // Coalesce: changes arriving during this wait go out with this write
+        uint64_t now = monotonic_ms();
+        uint64_t due = last_write_ms + ACTIVE_CALLS_PUBLISH_INTERVAL_MS;
+        if (!stopping && last_write_ms != 0 && now < due) {
+            struct timespec delay = { 0, (long)(due - now) * 1000000L };
+            nanosleep(&delay, NULL);
+        }
+
+        pthread_mutex_lock(&publish_mutex);
+        unsigned long generation = calls_generation;
+        pthread_mutex_unlock(&publish_mutex);
+
+        write_active_calls_json();
+        last_write_ms = monotonic_ms();
+
+        pthread_mutex_lock(&publish_mutex);
+        published = generation;
+    }
+    pthread_mutex_unlock(&publish_mutex);
+    return NULL;
+}
 
-    LOG_DEBUG("Exported %d active calls to %s (atomic write)", call_count, json_path);
-}
\ No newline at end of file
+void mark_active_calls_dirty(void) {
+    pthread_mutex_lock(&publish_mutex);
+    calls_generation++;
+    bool running = publisher_running;
+    if (running) {
+        pthread_cond_signal(&publish_cond);
+    }
+    pthread_mutex_unlock(&publish_mutex);
+
+    // No publisher (not started or failed to start): write it ourselves
+    if (!running) {
+        write_active_calls_json();
+    }
+}
+
+int start_active_calls_publisher(void) {
+    pthread_mutex_lock(&publish_mutex);
+    publisher_running = true;
+    pthread_mutex_unlock(&publish_mutex);
+
+    if (pthread_create(&publisher_tid, NULL, active_calls_publisher_thread, NULL) != 0) {
+        LOG_ERROR("Failed to create active calls publisher thread; exporting synchronously.");
+        pthread_mutex_lock(&publish_mutex);
+        publisher_running = false;
+        pthread_mutex_unlock(&publish_mutex);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes any pending change before returning
+void stop_active_calls_publisher(void) {
+    pthread_mutex_lock(&publish_mutex);
+    bool running = publisher_running;
+    publisher_running = false;
+    pthread_cond_signal(&publish_cond);
+    pthread_mutex_unlock(&publish_mutex);
+
+    if (running) {
+        pthread_join(publisher_tid, NULL);
+    }
+}
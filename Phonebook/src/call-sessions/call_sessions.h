@@ -2,13 +2,43 @@
 #ifndef CALL_SESSIONS_H
 #define CALL_SESSIONS_H
 
-#include "../common.h" 
+#include "../common.h"
+
+// Call sessions live in a pool that grows in chunks up to g_max_call_sessions
+// and are indexed by an open-addressing hash on Call-ID. Dialogs that share a
+// Call-ID are told apart by the From tag. Session pointers stay valid until
+// terminate_call_session().
+// The table is split into one shard per SIP worker thread (a single shard when
+// SIP_WORKER_THREADS is 0), chosen by the Call-ID hash, each with its own lock.
+
+#define CALL_SESSION_MAX_SHARDS SIP_WORKERS_MAX
 
 // Call Session Management Prototypes
 CallSession* find_call_session_by_callid(const char *call_id);
-CallSession* create_call_session();
+CallSession* find_call_session_by_dialog(const char *call_id, const char *from_tag);
+// init carries the Call-ID, From tag and dialog details; they are copied in
+// under the shard lock, so the active-calls export never sees a half-filled session
+CallSession* create_call_session(const CallSession *init);
+void call_session_set_state(CallSession *session, CallState state);
 void terminate_call_session(CallSession *session);
 void init_call_sessions();
-void export_active_calls_json(); 
 
-#endif // CALL_SESSIONS_H
\ No newline at end of file
+// /tmp/active_calls.json is written by a background publisher, at most once per
+// ACTIVE_CALLS_PUBLISH_INTERVAL_MS. Call-state changes only mark it dirty.
+#define ACTIVE_CALLS_PUBLISH_INTERVAL_MS 250
+void mark_active_calls_dirty(void);
+int start_active_calls_publisher(void);
+void stop_active_calls_publisher(void);
+
+int get_active_call_count(void);
+int get_call_session_capacity(void);
+
+// Shard owning a Call-ID, in [0, call_sessions_shard_count()); the SIP
+// dispatcher steers each datagram to the worker with the same index
+int call_sessions_shard_of(const char *call_id);
+int call_sessions_shard_count(void);
+
+// Terminate sessions older than max_age_seconds; returns how many were freed
+int cleanup_stale_call_sessions(time_t max_age_seconds);
+
+#endif // CALL_SESSIONS_H
@@ -31,7 +31,8 @@
 #define AREDN_PHONEBOOK_VERSION "1.4.5"
 #define APP_NAME "AREDN-Phonebook"
 #define SIP_PORT 5060
-#define MAX_SIP_MSG_LEN 2048
+#define MAX_SIP_MSG_LEN 2048                // Messages the server builds itself
+#define SIP_MAX_MESSAGE_SIZE_LIMIT 65535    // Upper bound for SIP_MAX_MESSAGE_SIZE (received/proxied messages)
 
 // --- Specific Max Lengths for CSV Fields ---
 #define MAX_FIRST_NAME_LEN 20
@@ -58,7 +59,9 @@
 #define PID_FILE_PATH "/tmp/sip-proxy.pid"
 
 #define MAX_REGISTERED_USERS 256
-#define MAX_CALL_SESSIONS 10
+#define DEFAULT_MAX_CALL_SESSIONS 64   // Overridable with MAX_CALL_SESSIONS in phonebook.conf
+#define MAX_CALL_SESSIONS_LIMIT 1024
+#define SIP_WORKERS_MAX 4              // Upper bound for SIP_WORKER_THREADS in phonebook.conf
 
 #define AREDN_MESH_DOMAIN "local.mesh"
 
@@ -66,11 +69,12 @@
 #define BACKGROUND_TASK_NICE_VALUE 10
 
 // Phonebook Fetcher settings (Flash-friendly with temp downloads)
-#define PB_CSV_TEMP_PATH "/tmp/phonebook_download.csv"
 #define PB_CSV_PATH "/www/arednstack/phonebook.csv"
 #define PB_XML_BASE_PATH "/tmp/phonebook.xml"
 #define PB_XML_PUBLIC_PATH "/www/arednstack/phonebook_generic_direct.xml"
 #define PB_LAST_GOOD_CSV_HASH_PATH "/www/arednstack/phonebook.csv.hash"
+#define PB_HTTP_VALIDATORS_PATH "/www/arednstack/phonebook.csv.validators" // ETag/Last-Modified per server
+#define REGISTRATION_SNAPSHOT_PATH "/tmp/phonebook_registrations.bin" // tmpfs: survives restarts, not reboots
 
 #define HASH_LENGTH 16
 
@@ -143,14 +147,12 @@ extern ConfigurableServer g_phonebook_servers_list[MAX_PB_SERVERS];
 extern int g_num_phonebook_servers;
 
 // These are defined in main.c
-extern RegisteredUser registered_users[MAX_REGISTERED_USERS];
 // TODO: Future release - merge num_registered_users and num_directory_entries into single counter
 // Current separation tracks "planned" (CSV) vs "unexpected" (dynamic) phones but adds complexity
 // without clear operational benefit for AREDN mesh networks.
 extern int num_registered_users; // Count of active dynamic registrations (NOT in CSV)
 extern int num_directory_entries; // Count of entries populated from CSV directory
 extern char g_server_ip[64]; // Global server IP for UAC (populated at startup)
-extern CallSession call_sessions[MAX_CALL_SESSIONS];
 
 // Thread IDs (defined in main.c, used by passive safety)
 extern pthread_t fetcher_tid;
@@ -215,12 +217,11 @@ RegisteredUser* find_registered_user(const char *user_id);
 RegisteredUser* add_or_update_registered_user(const char *user_id, const char *display_name, int expires); // Simplified parameters
 RegisteredUser* add_csv_user_to_registered_users_table(const char *user_id_numeric, const char *display_name);
 void init_registered_users_table();
-void populate_registered_users_from_csv(const char *filepath);
 void load_directory_from_xml(const char *filepath); // Deprecated but retained prototype
 
 // Call Sessions
 CallSession* find_call_session_by_callid(const char *call_id);
-CallSession* create_call_session();
+CallSession* create_call_session(const CallSession *init);
 void terminate_call_session(CallSession *session);
 void init_call_sessions();
 
@@ -17,6 +17,19 @@ int g_phone_test_interval_seconds = 60; // Default: 60 seconds
 int g_phone_call_test_enabled = 0;
 int g_phone_ping_count = 5;      // ICMP ping count (default: 5)
 int g_phone_options_count = 5;   // SIP OPTIONS count (default: 5)
+int g_max_call_sessions = DEFAULT_MAX_CALL_SESSIONS; // Concurrent call capacity
+int g_sip_worker_threads = 0; // Default: SIP handled in the main loop
+int g_registration_max_expires = 3600; // Default: 1 hour
+int g_sip_max_message_size = 8192; // Default: room for video/multi-codec SDP
+int g_sip_tcp_enabled = 1; // Default: listen on TCP as well as UDP
+int g_sip_overload_queue_depth = 64; // Default: four full receive batches behind
+int g_sip_overload_latency_ms = 10; // Default: 10 ms per message on average
+int g_sip_overload_retry_after = 30; // Default: phones retry after 30-60 seconds
+int g_sip_rate_limit_keepalive = 10; // Default: 10 REGISTER/OPTIONS per second per source
+int g_sip_rate_limit_other = 100; // Default: 100 other SIP messages per second per source
+int g_sip_rate_limit_503 = 0; // Default: drop excess silently
+int g_registration_expires_jitter_pct = 0; // Default: grant Expires as is
+int g_registration_snapshot_seconds = 30; // Default: checkpoint registrations every 30 s
 ConfigurableServer g_phonebook_servers_list[MAX_PB_SERVERS];
 int g_num_phonebook_servers = 0; // Will be populated by the loader
 
@@ -41,6 +54,10 @@ int g_topology_crawler_interval_seconds = 3600; // Default: 3600 seconds (1 hour
 int g_topology_node_inactive_timeout_seconds = 3600;    // Default: 3600 seconds (1 hour) - mark nodes as INACTIVE
 int g_topology_node_delete_timeout_seconds = 2592000;  // Default: 2592000 seconds (30 days) - delete nodes completely
 
+// DNS cache configuration
+int g_dns_cache_ttl_seconds = 60;              // Default: 60 seconds for resolved names
+int g_dns_negative_ttl_seconds = 15;           // Default: 15 seconds for names that did not resolve
+
 int load_configuration(const char *config_filepath) {
     FILE *fp = fopen(config_filepath, "r");
     if (!fp) {
@@ -118,6 +135,110 @@ int load_configuration(const char *config_filepath) {
             } else {
                 LOG_WARN("Invalid PHONE_OPTIONS_COUNT value '%s'. Using default %d.", value, g_phone_options_count);
             }
+        } else if (strcmp(key, "MAX_CALL_SESSIONS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 1 && parsed_value <= MAX_CALL_SESSIONS_LIMIT) {
+                g_max_call_sessions = parsed_value;
+                LOG_DEBUG("Config: MAX_CALL_SESSIONS = %d", g_max_call_sessions);
+            } else {
+                LOG_WARN("Invalid MAX_CALL_SESSIONS value '%s'. Using default %d.", value, g_max_call_sessions);
+            }
+        } else if (strcmp(key, "SIP_WORKER_THREADS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= SIP_WORKERS_MAX) {
+                g_sip_worker_threads = parsed_value;
+                LOG_DEBUG("Config: SIP_WORKER_THREADS = %d", g_sip_worker_threads);
+            } else {
+                LOG_WARN("Invalid SIP_WORKER_THREADS value '%s'. Using default %d.", value, g_sip_worker_threads);
+            }
+        } else if (strcmp(key, "REGISTRATION_MAX_EXPIRES") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 60 && parsed_value <= 86400) {
+                g_registration_max_expires = parsed_value;
+                LOG_DEBUG("Config: REGISTRATION_MAX_EXPIRES = %d", g_registration_max_expires);
+            } else {
+                LOG_WARN("Invalid REGISTRATION_MAX_EXPIRES value '%s'. Using default %d.", value, g_registration_max_expires);
+            }
+        } else if (strcmp(key, "REGISTRATION_EXPIRES_JITTER") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 50) {
+                g_registration_expires_jitter_pct = parsed_value;
+                LOG_DEBUG("Config: REGISTRATION_EXPIRES_JITTER = %d", g_registration_expires_jitter_pct);
+            } else {
+                LOG_WARN("Invalid REGISTRATION_EXPIRES_JITTER value '%s'. Using default %d.", value, g_registration_expires_jitter_pct);
+            }
+        } else if (strcmp(key, "SIP_MAX_MESSAGE_SIZE") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= MAX_SIP_MSG_LEN && parsed_value <= SIP_MAX_MESSAGE_SIZE_LIMIT) {
+                g_sip_max_message_size = parsed_value;
+                LOG_DEBUG("Config: SIP_MAX_MESSAGE_SIZE = %d", g_sip_max_message_size);
+            } else {
+                LOG_WARN("Invalid SIP_MAX_MESSAGE_SIZE value '%s'. Using default %d.", value, g_sip_max_message_size);
+            }
+        } else if (strcmp(key, "SIP_TCP_ENABLED") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value == 0 || parsed_value == 1) {
+                g_sip_tcp_enabled = parsed_value;
+                LOG_DEBUG("Config: SIP_TCP_ENABLED = %d", g_sip_tcp_enabled);
+            } else {
+                LOG_WARN("Invalid SIP_TCP_ENABLED value '%s'. Using default %d.", value, g_sip_tcp_enabled);
+            }
+        } else if (strcmp(key, "SIP_OVERLOAD_QUEUE_DEPTH") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 4096) {
+                g_sip_overload_queue_depth = parsed_value;
+                LOG_DEBUG("Config: SIP_OVERLOAD_QUEUE_DEPTH = %d", g_sip_overload_queue_depth);
+            } else {
+                LOG_WARN("Invalid SIP_OVERLOAD_QUEUE_DEPTH value '%s'. Using default %d.", value, g_sip_overload_queue_depth);
+            }
+        } else if (strcmp(key, "SIP_OVERLOAD_LATENCY_MS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 1000) {
+                g_sip_overload_latency_ms = parsed_value;
+                LOG_DEBUG("Config: SIP_OVERLOAD_LATENCY_MS = %d", g_sip_overload_latency_ms);
+            } else {
+                LOG_WARN("Invalid SIP_OVERLOAD_LATENCY_MS value '%s'. Using default %d.", value, g_sip_overload_latency_ms);
+            }
+        } else if (strcmp(key, "SIP_OVERLOAD_RETRY_AFTER") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 1 && parsed_value <= 3600) {
+                g_sip_overload_retry_after = parsed_value;
+                LOG_DEBUG("Config: SIP_OVERLOAD_RETRY_AFTER = %d", g_sip_overload_retry_after);
+            } else {
+                LOG_WARN("Invalid SIP_OVERLOAD_RETRY_AFTER value '%s'. Using default %d.", value, g_sip_overload_retry_after);
+            }
+        } else if (strcmp(key, "SIP_RATE_LIMIT_KEEPALIVE") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 1000) {
+                g_sip_rate_limit_keepalive = parsed_value;
+                LOG_DEBUG("Config: SIP_RATE_LIMIT_KEEPALIVE = %d", g_sip_rate_limit_keepalive);
+            } else {
+                LOG_WARN("Invalid SIP_RATE_LIMIT_KEEPALIVE value '%s'. Using default %d.", value, g_sip_rate_limit_keepalive);
+            }
+        } else if (strcmp(key, "SIP_RATE_LIMIT_OTHER") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 10000) {
+                g_sip_rate_limit_other = parsed_value;
+                LOG_DEBUG("Config: SIP_RATE_LIMIT_OTHER = %d", g_sip_rate_limit_other);
+            } else {
+                LOG_WARN("Invalid SIP_RATE_LIMIT_OTHER value '%s'. Using default %d.", value, g_sip_rate_limit_other);
+            }
+        } else if (strcmp(key, "SIP_RATE_LIMIT_503") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value == 0 || parsed_value == 1) {
+                g_sip_rate_limit_503 = parsed_value;
+                LOG_DEBUG("Config: SIP_RATE_LIMIT_503 = %d", g_sip_rate_limit_503);
+            } else {
+                LOG_WARN("Invalid SIP_RATE_LIMIT_503 value '%s'. Using default %d.", value, g_sip_rate_limit_503);
+            }
+        } else if (strcmp(key, "REGISTRATION_SNAPSHOT_SECONDS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 3600) {
+                g_registration_snapshot_seconds = parsed_value;
+                LOG_DEBUG("Config: REGISTRATION_SNAPSHOT_SECONDS = %d", g_registration_snapshot_seconds);
+            } else {
+                LOG_WARN("Invalid REGISTRATION_SNAPSHOT_SECONDS value '%s'. Using default %d.", value, g_registration_snapshot_seconds);
+            }
         } else if (strcmp(key, "PHONEBOOK_SERVER") == 0) {
             if (current_server_idx < MAX_PB_SERVERS) {
                 // strtok modifies the string, so it's good if value is a copy or you don't need it later.
@@ -256,6 +377,22 @@ int load_configuration(const char *config_filepath) {
             } else {
                 LOG_WARN("Invalid TOPOLOGY_NODE_DELETE_TIMEOUT_SECONDS value '%s'. Using default %d.", value, g_topology_node_delete_timeout_seconds);
             }
+        } else if (strcmp(key, "DNS_CACHE_TTL_SECONDS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 3600) { // 0 disables positive caching
+                g_dns_cache_ttl_seconds = parsed_value;
+                LOG_DEBUG("Config: DNS_CACHE_TTL_SECONDS = %d", g_dns_cache_ttl_seconds);
+            } else {
+                LOG_WARN("Invalid DNS_CACHE_TTL_SECONDS value '%s'. Using default %d.", value, g_dns_cache_ttl_seconds);
+            }
+        } else if (strcmp(key, "DNS_NEGATIVE_TTL_SECONDS") == 0) {
+            int parsed_value = atoi(value);
+            if (parsed_value >= 0 && parsed_value <= 600) { // 0 disables negative caching
+                g_dns_negative_ttl_seconds = parsed_value;
+                LOG_DEBUG("Config: DNS_NEGATIVE_TTL_SECONDS = %d", g_dns_negative_ttl_seconds);
+            } else {
+                LOG_WARN("Invalid DNS_NEGATIVE_TTL_SECONDS value '%s'. Using default %d.", value, g_dns_negative_ttl_seconds);
+            }
         } else {
             LOG_WARN("Unknown configuration key: '%s'. Skipping.", key);
         }
@@ -11,6 +11,19 @@ extern int g_phone_test_interval_seconds;
 extern int g_phone_call_test_enabled;
 extern int g_phone_ping_count;      // ICMP ping count
 extern int g_phone_options_count;   // SIP OPTIONS count
+extern int g_max_call_sessions;     // Call session table capacity
+extern int g_sip_worker_threads;    // SIP worker threads (0 = process in the main loop)
+extern int g_registration_max_expires;      // Longest registration granted (seconds)
+extern int g_registration_expires_jitter_pct; // Granted Expires shortened by up to this percentage
+extern int g_registration_snapshot_seconds;  // Registration checkpoint interval (0 = disabled)
+extern int g_sip_max_message_size;  // Largest SIP message accepted or proxied (bytes)
+extern int g_sip_tcp_enabled;       // Listen for SIP over TCP on SIP_PORT
+extern int g_sip_overload_queue_depth;  // Backlog that starts shedding REGISTER/OPTIONS (0 = off)
+extern int g_sip_overload_latency_ms;   // Average per-message processing time that does the same (0 = off)
+extern int g_sip_overload_retry_after;  // Base Retry-After of the 503 sent while shedding (seconds)
+extern int g_sip_rate_limit_keepalive;  // REGISTER/OPTIONS per second per source IP (0 = unlimited)
+extern int g_sip_rate_limit_other;      // Other SIP messages per second per source IP (0 = unlimited)
+extern int g_sip_rate_limit_503;        // Answer excess requests with 503 instead of dropping them
 extern ConfigurableServer g_phonebook_servers_list[MAX_PB_SERVERS];
 extern int g_num_phonebook_servers;
 
@@ -35,6 +48,10 @@ extern int g_topology_crawler_interval_seconds; // Crawler interval in seconds
 extern int g_topology_node_inactive_timeout_seconds; // Mark node INACTIVE after this many seconds unseen (default: 3600 = 1 hour)
 extern int g_topology_node_delete_timeout_seconds;   // Delete node completely after this many seconds unseen (default: 2592000 = 30 days)
 
+// DNS cache configuration
+extern int g_dns_cache_ttl_seconds;         // Max lifetime of a resolved hostname (0 = no caching)
+extern int g_dns_negative_ttl_seconds;      // Lifetime of a failed lookup (0 = no negative caching)
+
 /**
  * @brief Loads configuration parameters from a specified file.
  *
@@ -1,9 +1,16 @@
 #define MODULE_NAME "CSV" // Define MODULE_NAME at the top of the file
+#define _GNU_SOURCE // For strcasestr
 
 #include "csv_processor.h"
 #include "../common.h" // This includes necessary system headers and core types
 #include "../config_loader/config_loader.h" // For g_phonebook_servers_list, g_num_phonebook_servers
 #include "../file_utils/file_utils.h"
+#include "../user_manager/user_manager.h" // The pipeline rebuilds the directory
+#include <strings.h> // For strcasecmp
+#include <poll.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <zlib.h> // Streaming inflate of gzip bodies
 
 // Note: Global extern declarations are now in common.h
 
@@ -73,133 +80,459 @@ static void xml_escape(const char *in, char *out, size_t out_sz) {
     out[o] = '\0';
 }
 
-int csv_processor_calculate_file_conceptual_hash(const char *filepath, char *output_hash_str, size_t hash_str_len) {
-    FILE *fp = fopen(filepath, "rb");
-    if (!fp) {
-        LOG_ERROR("Failed to open '%s' to calculate hash. Error: %s", filepath, strerror(errno));
-        return 1;
+void csv_hash_init(csv_hash_t *h) {
+    h->state = 14695981039346656037ULL; // FNV-1a 64-bit offset basis
+}
+
+void csv_hash_update(csv_hash_t *h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t state = h->state;
+    for (size_t i = 0; i < len; i++) {
+        state ^= p[i];
+        state *= 1099511628211ULL;
     }
+    h->state = state;
+}
 
-    unsigned long checksum = 0;
-    char buffer[4096];
-    size_t bytesRead = 0;
+void csv_hash_final_hex(const csv_hash_t *h, char *out, size_t out_len) {
+    snprintf(out, out_len, "%016llX", (unsigned long long)h->state);
+}
 
-    LOG_DEBUG("Starting hash calculation for '%s'.", filepath);
-    while ((bytesRead = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-        for (size_t i = 0; i < bytesRead; i++) {
-            checksum = (checksum << 1) + (unsigned char)buffer[i];
-        }
-        LOG_DEBUG("Read %zu bytes for hash calculation.", bytesRead);
+// The first line is a header if it names the columns ("First,Last,...")
+static bool is_header_row(const char *line, int ln) {
+    return ln == 1 && (strstr(line, "First") != NULL || strstr(line, "FIRST") != NULL);
+}
+
+// A data row has at least 4 columns and a non-empty telephone number (4th column)
+static bool is_valid_data_row(const char *line) {
+    // Count lines that have at least 3 commas (4 columns minimum)
+    int comma_count = 0;
+    for (const char *p = line; *p; p++) {
+        if (*p == ',') comma_count++;
+    }
+    if (comma_count < 3) {
+        return false;
     }
 
-    if (ferror(fp)) {
-        LOG_ERROR("Error reading file '%s' for hash calculation. Error: %s", filepath, strerror(errno));
-        fclose(fp);
-        return 1;
+    const char *tel = line;
+    for (int i = 0; i < 3; i++) {
+        tel = strchr(tel, ',') + 1;
     }
+    return *tel && *tel != '\r' && *tel != '\n';
+}
 
-    snprintf(output_hash_str, hash_str_len, "%0*lX", (int)(hash_str_len - 1), checksum);
-    output_hash_str[hash_str_len - 1] = '\0';
+// --- HTTP response handling ---
+
+typedef struct {
+    char etag[PB_HTTP_VALIDATOR_LEN];
+    char last_modified[PB_HTTP_VALIDATOR_LEN];
+} http_validators_t;
+
+// Validators each server sent with the phonebook now on flash, indexed like
+// g_phonebook_servers_list, and those of the last 200 response
+static http_validators_t server_validators[MAX_PB_SERVERS];
+static http_validators_t response_validators;
+static int response_server = -1;
+
+enum { BODY_UNTIL_CLOSE, BODY_CONTENT_LENGTH, BODY_CHUNKED };
+enum { CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER };
+
+// Removes the HTTP/1.1 message framing from the body as it arrives
+typedef struct {
+    int framing;
+    size_t remaining;        // Content-Length left, or bytes left in the current chunk
+    int chunk_state;
+    char size_line[24];      // Chunk size in hex; extensions are dropped
+    size_t size_line_len;
+    size_t trailer_line_len;
+    bool complete;
+    size_t wire_bytes;       // Body as sent, after de-chunking
+    size_t payload_bytes;    // CSV handed to the pipeline, after inflating
+    bool gzip;               // Content-Encoding: gzip, or a .gz path
+    bool inflating;          // inflater initialised
+    bool gzip_ended;         // At the end of a gzip member
+    z_stream inflater;
+} http_body_t;
+
+// Copies a header value without surrounding whitespace. False if it does not fit.
+static bool copy_header_value(const char *value, char *out, size_t out_len) {
+    while (*value == ' ' || *value == '\t') value++;
+    size_t len = strlen(value);
+    while (len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t')) len--;
+    if (len >= out_len) {
+        return false;
+    }
+    memcpy(out, value, len);
+    out[len] = '\0';
+    return true;
+}
 
-    LOG_DEBUG("Calculated conceptual hash for '%s': %s", filepath, output_hash_str);
-    fclose(fp);
+// Picks the body framing and the cache validators out of the header lines
+// (status line excluded; modified in place). Returns 0, or 1 if malformed.
+static int parse_response_headers(char *headers, http_body_t *body, http_validators_t *validators) {
+    bool chunked = false, have_length = false;
+    char *line = headers;
+    while (*line) {
+        char *end = strstr(line, "\r\n");
+        if (end) *end = '\0';
+        char *colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            char *value = colon + 1;
+            if (strcasecmp(line, "Content-Length") == 0) {
+                char *num_end;
+                errno = 0;
+                unsigned long long n = strtoull(value, &num_end, 10);
+                if (errno || num_end == value) {
+                    LOG_ERROR("Malformed Content-Length header: '%s'.", value);
+                    return 1;
+                }
+                body->remaining = (size_t)n;
+                have_length = true;
+            } else if (strcasecmp(line, "Content-Encoding") == 0) {
+                if (strcasestr(value, "gzip")) {
+                    body->gzip = true;
+                } else if (!strcasestr(value, "identity")) {
+                    LOG_ERROR("Unsupported Content-Encoding '%s'.", value);
+                    return 1;
+                }
+            } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+                chunked = chunked || strcasestr(value, "chunked") != NULL;
+            } else if (strcasecmp(line, "ETag") == 0) {
+                if (!copy_header_value(value, validators->etag, sizeof(validators->etag))) {
+                    LOG_DEBUG("ETag longer than %d bytes ignored.", PB_HTTP_VALIDATOR_LEN - 1);
+                }
+            } else if (strcasecmp(line, "Last-Modified") == 0) {
+                if (!copy_header_value(value, validators->last_modified, sizeof(validators->last_modified))) {
+                    LOG_DEBUG("Last-Modified longer than %d bytes ignored.", PB_HTTP_VALIDATOR_LEN - 1);
+                }
+            }
+        }
+        if (!end) break;
+        line = end + 2;
+    }
+
+    // Chunked takes precedence over Content-Length (RFC 9112 6.3)
+    if (chunked) {
+        body->framing = BODY_CHUNKED;
+        body->remaining = 0;
+    } else if (have_length) {
+        body->framing = BODY_CONTENT_LENGTH;
+        body->complete = (body->remaining == 0);
+    } else {
+        body->framing = BODY_UNTIL_CLOSE;
+    }
     return 0;
 }
 
-int csv_processor_validate_csv(const char *filepath, int *row_count) {
-    FILE *fp = fopen(filepath, "r");
-    if (!fp) {
-        LOG_ERROR("Failed to open CSV file '%s' for validation. Error: %s", filepath, strerror(errno));
-        return 1;
+// Hands body bytes to the pipeline, inflating them first if the body is
+// gzip. The inflater holds one 32 KB window whatever the phonebook size, and
+// the pipeline's PB_CSV_MAX_BYTES cap bounds what a small body can expand to.
+static int body_deliver(http_body_t *b, const char *data, size_t len, phonebook_pipeline_t *pipeline) {
+    b->wire_bytes += len;
+    if (!b->gzip) {
+        b->payload_bytes += len;
+        return phonebook_pipeline_feed(pipeline, data, len);
+    }
+    if (!b->inflating) {
+        if (inflateInit2(&b->inflater, 16 + MAX_WBITS) != Z_OK) { // 16: expect the gzip wrapper
+            LOG_ERROR("Failed to initialise gzip inflater.");
+            return 1;
+        }
+        b->inflating = true;
     }
 
-    char line[2048];
-    int line_count = 0;
-    int valid_data_rows = 0;
-
-    while (fgets(line, sizeof(line), fp)) {
-        line_count++;
+    unsigned char out[2048];
+    b->inflater.next_in = (Bytef *)data;
+    b->inflater.avail_in = (uInt)len;
+    do {
+        if (b->gzip_ended) {
+            if (b->inflater.avail_in == 0) {
+                break; // Only reset once another member's bytes arrive
+            }
+            // Concatenated gzip members decode as one body (RFC 1952 2.2)
+            inflateReset(&b->inflater);
+            b->gzip_ended = false;
+        }
+        b->inflater.next_out = out;
+        b->inflater.avail_out = sizeof(out);
+        int rc = inflate(&b->inflater, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+            LOG_ERROR("Corrupt gzip body: %s", b->inflater.msg ? b->inflater.msg : "inflate error");
+            return 1;
+        }
+        size_t produced = sizeof(out) - b->inflater.avail_out;
+        b->payload_bytes += produced;
+        if (produced && phonebook_pipeline_feed(pipeline, (const char *)out, produced) != 0) {
+            return 1;
+        }
+        if (rc == Z_STREAM_END) {
+            b->gzip_ended = true;
+        } else if (rc == Z_BUF_ERROR) {
+            break; // No progress possible until more input arrives
+        }
+    } while (b->inflater.avail_in > 0 || b->inflater.avail_out == 0);
+    return 0;
+}
 
-        // Skip header row (first line with "First" or similar header text)
-        if (line_count == 1) {
-            // Check if this looks like a header (contains "First" or starts with expected pattern)
-            if (strstr(line, "First") != NULL || strstr(line, "FIRST") != NULL) {
-                LOG_DEBUG("Detected CSV header row: %.*s", (int)strcspn(line, "\r\n"), line);
-                continue;
+// Passes the payload in data on to the pipeline. Returns 0, or 1 on a
+// malformed chunk or if the pipeline refused the data.
+static int http_body_feed(http_body_t *b, const char *data, size_t len, phonebook_pipeline_t *pipeline) {
+    if (b->framing != BODY_CHUNKED) {
+        if (b->framing == BODY_CONTENT_LENGTH) {
+            if (len > b->remaining) {
+                LOG_DEBUG("Ignoring %zu bytes past Content-Length.", len - b->remaining);
+                len = b->remaining;
             }
+            b->remaining -= len;
+            b->complete = (b->remaining == 0);
         }
+        return body_deliver(b, data, len, pipeline);
+    }
 
-        // Count lines that have at least 3 commas (4 columns minimum)
-        int comma_count = 0;
-        for (const char *p = line; *p; p++) {
-            if (*p == ',') comma_count++;
-        }
-
-        if (comma_count >= 3) {
-            // Parse to verify we have a non-empty telephone number (4th column)
-            char *cols[4] = {NULL};
-            char line_copy[2048];
-            strncpy(line_copy, line, sizeof(line_copy) - 1);
-            line_copy[sizeof(line_copy) - 1] = '\0';
-
-            char *p = line_copy;
-            for (int i = 0; i < 4; i++) {
-                if (i < 3) {
-                    char *c = strchr(p, ',');
-                    if (c) {
-                        *c = '\0';
-                        cols[i] = p;
-                        p = c + 1;
-                    } else {
-                        cols[i] = p;
-                        p = NULL;
-                    }
-                } else {
-                    cols[i] = p;
+    while (len > 0 && !b->complete) {
+        switch (b->chunk_state) {
+        case CHUNK_SIZE: {
+            char c = *data++;
+            len--;
+            if (c != '\n') {
+                if (b->size_line_len < sizeof(b->size_line) - 1) {
+                    b->size_line[b->size_line_len++] = c;
                 }
-                if (!p && i < 3) break;
+                break;
             }
-
-            // Validate 4th column (telephone) is non-empty
-            if (cols[3] && *cols[3] && *cols[3] != '\r' && *cols[3] != '\n') {
-                valid_data_rows++;
+            b->size_line[b->size_line_len] = '\0';
+            b->size_line_len = 0;
+            char *hex_end;
+            errno = 0;
+            unsigned long long size = strtoull(b->size_line, &hex_end, 16);
+            if (errno || hex_end == b->size_line ||
+                (*hex_end != ';' && *hex_end != '\r' && *hex_end != ' ' && *hex_end != '\0')) {
+                LOG_ERROR("Malformed chunk size line: '%s'.", b->size_line);
+                return 1;
+            }
+            b->remaining = (size_t)size;
+            b->chunk_state = size ? CHUNK_DATA : CHUNK_TRAILER;
+            break;
+        }
+        case CHUNK_DATA: {
+            size_t take = len < b->remaining ? len : b->remaining;
+            if (body_deliver(b, data, take, pipeline) != 0) {
+                return 1;
+            }
+            b->remaining -= take;
+            data += take;
+            len -= take;
+            if (b->remaining == 0) {
+                b->chunk_state = CHUNK_DATA_END;
             }
+            break;
+        }
+        case CHUNK_DATA_END: // CRLF closing the chunk data
+            if (*data == '\n') {
+                b->chunk_state = CHUNK_SIZE;
+            } else if (*data != '\r') {
+                LOG_ERROR("Chunk data not followed by CRLF.");
+                return 1;
+            }
+            data++;
+            len--;
+            break;
+        case CHUNK_TRAILER: // Trailer fields up to an empty line; all ignored
+            if (*data == '\n') {
+                b->complete = (b->trailer_line_len == 0);
+                b->trailer_line_len = 0;
+            } else if (*data != '\r') {
+                b->trailer_line_len++;
+            }
+            data++;
+            len--;
+            break;
         }
     }
+    return 0;
+}
 
+void csv_processor_load_validators(void) {
+    FILE *fp = fopen(PB_HTTP_VALIDATORS_PATH, "r");
+    if (!fp) {
+        LOG_DEBUG("No stored HTTP validators at '%s'. First fetch will be unconditional.", PB_HTTP_VALIDATORS_PATH);
+        return;
+    }
+    // One line per server: host \t port \t path \t ETag \t Last-Modified
+    char line[MAX_SERVER_HOST_LEN + MAX_SERVER_PORT_LEN + MAX_SERVER_PATH_LEN + 2 * PB_HTTP_VALIDATOR_LEN + 8];
+    int loaded = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *rest = line;
+        char *host = strsep(&rest, "\t");
+        char *port = strsep(&rest, "\t");
+        char *path = strsep(&rest, "\t");
+        char *etag = strsep(&rest, "\t");
+        char *last_modified = strsep(&rest, "\t");
+        if (!last_modified) {
+            continue;
+        }
+        // Validators of a server no longer configured (or moved) are dropped
+        for (int i = 0; i < g_num_phonebook_servers; i++) {
+            const ConfigurableServer *s = &g_phonebook_servers_list[i];
+            if (strcmp(s->host, host) == 0 && strcmp(s->port, port) == 0 && strcmp(s->path, path) == 0) {
+                copy_header_value(etag, server_validators[i].etag, sizeof(server_validators[i].etag));
+                copy_header_value(last_modified, server_validators[i].last_modified,
+                                  sizeof(server_validators[i].last_modified));
+                loaded++;
+                break;
+            }
+        }
+    }
     fclose(fp);
+    LOG_INFO("Loaded HTTP validators for %d phonebook server(s).", loaded);
+}
 
-    if (row_count) {
-        *row_count = valid_data_rows;
+void csv_processor_keep_validators(void) {
+    if (response_server < 0) {
+        return;
     }
+    http_validators_t *kept = &server_validators[response_server];
+    response_server = -1;
+    if (memcmp(kept, &response_validators, sizeof(*kept)) == 0) {
+        return; // Already on flash
+    }
+    *kept = response_validators;
 
-    // Require at least 1 valid data row
-    if (valid_data_rows < 1) {
-        LOG_ERROR("CSV validation failed: file has %d total lines but only %d valid data rows",
-                 line_count, valid_data_rows);
-        return 1;
+    // Small file, rewritten only when a server's validators change
+    char tmp_path[MAX_CONFIG_PATH_LEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", PB_HTTP_VALIDATORS_PATH);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        LOG_ERROR("Failed to open '%s' for writing: %s", tmp_path, strerror(errno));
+        return;
     }
+    for (int i = 0; i < g_num_phonebook_servers; i++) {
+        const ConfigurableServer *s = &g_phonebook_servers_list[i];
+        const http_validators_t *v = &server_validators[i];
+        if (v->etag[0] || v->last_modified[0]) {
+            fprintf(fp, "%s\t%s\t%s\t%s\t%s\n", s->host, s->port, s->path, v->etag, v->last_modified);
+        }
+    }
+    bool ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp_path, PB_HTTP_VALIDATORS_PATH) != 0) {
+        LOG_ERROR("Failed to write HTTP validators to '%s': %s", PB_HTTP_VALIDATORS_PATH, strerror(errno));
+        remove(tmp_path);
+        return;
+    }
+    LOG_DEBUG("Flash write: HTTP validators updated (ETag '%s', Last-Modified '%s').",
+              kept->etag, kept->last_modified);
+}
 
-    LOG_INFO("CSV validation passed: %d valid entries found in '%s'", valid_data_rows, filepath);
-    return 0;
+// --- Mirror race ---
+// Each fetch races the configured mirrors, Happy Eyeballs style (RFC 8305):
+// connects start in order of preference, PB_RACE_STAGGER_MS apart or as soon
+// as the previous attempt fails, and the first mirror to answer 200 (or 304)
+// wins. The others are closed before any body is read, so one slow or dead
+// mirror costs at most a stagger step, and a healthy preferred mirror usually
+// answers before a second one is even contacted.
+
+#define PB_RACE_STAGGER_MS   250
+#define PB_RACE_TIMEOUT_MS   10000 // Per mirror, for the connect and the response headers
+#define PB_BODY_TIMEOUT_SEC  10    // Per read once the winner streams its body
+#define PB_LATENCY_EWMA_DIV  4     // Each new sample moves the average by 1/4
+
+typedef struct {
+    unsigned int latency_ms;       // Smoothed time to response headers; 0 = never measured
+    unsigned int consecutive_failures;
+    unsigned int wins;
+} mirror_stats_t;
+
+static mirror_stats_t mirror_stats[MAX_PB_SERVERS]; // Indexed like g_phonebook_servers_list
+
+enum { ATTEMPT_RESOLVED, ATTEMPT_CONNECTING, ATTEMPT_READING_HEADERS, ATTEMPT_CLOSED };
+
+typedef struct {
+    int server;
+    int state;
+    int sock;
+    struct addrinfo *addrs;
+    struct addrinfo *next_addr;
+    uint64_t started_ms;
+    bool conditional;              // Validators were sent with the request
+    int http_status_code;
+    char header_buffer[4096];      // Status line, headers and the first body bytes
+    size_t header_buffer_len;
+} mirror_attempt_t;
+
+static mirror_attempt_t attempts[MAX_PB_SERVERS]; // In launch order; fetcher thread only
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-// Helper function to attempt download from a given host/port/path
-static int attempt_download(const char* host, const char* port, const char* path) {
-    LOG_INFO("Attempting CSV download from %s:%s%s", host, port, path);
-    struct addrinfo hints = { .ai_family=AF_UNSPEC, .ai_socktype=SOCK_STREAM },
-                    *res, *rp;
-    int sock = -1, rv;
-    int reuse_addr = 1;
+static void update_latency(mirror_stats_t *s, unsigned int sample_ms) {
+    if (s->latency_ms == 0) {
+        s->latency_ms = sample_ms ? sample_ms : 1;
+    } else {
+        int delta = (int)sample_ms - (int)s->latency_ms;
+        s->latency_ms += delta / PB_LATENCY_EWMA_DIV;
+    }
+}
 
-    LOG_DEBUG("Resolving hostname '%s'...", host);
-    if ((rv = getaddrinfo(host, port, &hints, &res)) != 0) {
-        LOG_INFO("DNS resolution for %s failed: %s", host, gai_strerror(rv));
-        return 1;
+// Healthy mirrors first, fastest first; never-measured ones after the
+// measured healthy ones; failing ones last, least failing first.
+// Ties keep the configured order.
+static bool mirror_preferred(int a, int b) {
+    const mirror_stats_t *sa = &mirror_stats[a], *sb = &mirror_stats[b];
+    if (sa->consecutive_failures != sb->consecutive_failures) {
+        return sa->consecutive_failures < sb->consecutive_failures;
+    }
+    if ((sa->latency_ms == 0) != (sb->latency_ms == 0)) {
+        return sa->latency_ms != 0;
+    }
+    return sa->latency_ms < sb->latency_ms;
+}
+
+static int order_mirrors(int *order) {
+    int n = 0;
+    for (int i = 0; i < g_num_phonebook_servers; i++) {
+        int j = n++;
+        while (j > 0 && mirror_preferred(i, order[j - 1])) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
     }
-    LOG_DEBUG("Hostname '%s' resolved. Attempting to connect...", host);
+    return n;
+}
+
+static void attempt_close(mirror_attempt_t *a) {
+    if (a->sock >= 0) {
+        close(a->sock);
+        a->sock = -1;
+    }
+    if (a->addrs) {
+        freeaddrinfo(a->addrs);
+        a->addrs = NULL;
+    }
+    a->state = ATTEMPT_CLOSED;
+}
 
-    for (rp = res; rp; rp = rp->ai_next) {
+// Mirror lost, failed or timed out: closes the attempt and books it
+static void attempt_fail(mirror_attempt_t *a) {
+    attempt_close(a);
+    mirror_stats[a->server].consecutive_failures++;
+}
+
+// Starts a non-blocking connect to the next resolved address. 0 if one is in progress.
+static int attempt_connect_next(mirror_attempt_t *a) {
+    const ConfigurableServer *server = &g_phonebook_servers_list[a->server];
+    if (a->sock >= 0) {
+        close(a->sock);
+        a->sock = -1;
+    }
+    for (; a->next_addr; a->next_addr = a->next_addr->ai_next) {
+        struct addrinfo *rp = a->next_addr;
         char ip_str[INET6_ADDRSTRLEN];
         void *addr;
         if (rp->ai_family == AF_INET) {
@@ -208,307 +541,658 @@ static int attempt_download(const char* host, const char* port, const char* path
             addr = &((struct sockaddr_in6 *)rp->ai_addr)->sin6_addr;
         }
         inet_ntop(rp->ai_family, addr, ip_str, sizeof(ip_str));
-        LOG_DEBUG("Trying to connect to IP:Port %s:%s (Family: %d, Type: %d, Protocol: %d)", ip_str, port, rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        LOG_DEBUG("Trying to connect to IP:Port %s:%s (Family: %d, Type: %d, Protocol: %d)", ip_str, server->port, rp->ai_family, rp->ai_socktype, rp->ai_protocol);
 
-        sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sock < 0) {
+        a->sock = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, rp->ai_protocol);
+        if (a->sock < 0) {
             LOG_DEBUG("Failed to create socket for address family %d: %s. Trying next...", rp->ai_family, strerror(errno));
             continue;
         }
-
-        if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr)) < 0) {
-            LOG_WARN("setsockopt(SO_REUSEADDR) failed for client socket: %s", strerror(errno));
-        }
-
-        struct sockaddr_in client_bind_addr = {0};
-        client_bind_addr.sin_family = AF_INET;
-        client_bind_addr.sin_addr.s_addr = INADDR_ANY;
-        client_bind_addr.sin_port = 0;
-
-        if (bind(sock, (const struct sockaddr *)&client_bind_addr, sizeof(client_bind_addr)) < 0) {
-            LOG_ERROR("Failed to bind client socket to ephemeral port: %s", strerror(errno));
-            close(sock);
-            sock = -1;
-            continue;
-        }
-        LOG_DEBUG("Client socket bound to ephemeral port.");
-
-        if (connect(sock, rp->ai_addr, rp->ai_addrlen) == 0) {
-            LOG_DEBUG("Successfully connected to %s:%s.", ip_str, port);
-            break;
+        if (connect(a->sock, rp->ai_addr, rp->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            a->next_addr = rp->ai_next;
+            a->state = ATTEMPT_CONNECTING;
+            return 0;
         }
-        LOG_DEBUG("Connection failed to %s:%s: %s. Trying next address...", ip_str, port, strerror(errno));
-        close(sock);
-        sock = -1;
+        LOG_DEBUG("Connection failed to %s:%s: %s. Trying next address...", ip_str, server->port, strerror(errno));
+        close(a->sock);
+        a->sock = -1;
     }
-    freeaddrinfo(res);
+    return 1;
+}
 
-    // Set socket timeouts to prevent indefinite blocking
-    if (sock >= 0) {
-        struct timeval sock_tv;
-        sock_tv.tv_sec = 10;
-        sock_tv.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &sock_tv, sizeof(sock_tv));
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &sock_tv, sizeof(sock_tv));
+// getaddrinfo() blocks, so every mirror is resolved before the race starts
+// rather than while other attempts are waiting in poll()
+static int attempt_resolve(mirror_attempt_t *a, int server_index) {
+    const ConfigurableServer *server = &g_phonebook_servers_list[server_index];
+    memset(a, 0, sizeof(*a));
+    a->server = server_index;
+    a->sock = -1;
+
+    struct addrinfo hints = { .ai_family=AF_UNSPEC, .ai_socktype=SOCK_STREAM };
+    int rv;
+    LOG_DEBUG("Resolving hostname '%s'...", server->host);
+    if ((rv = getaddrinfo(server->host, server->port, &hints, &a->addrs)) != 0) {
+        LOG_INFO("DNS resolution for %s failed: %s", server->host, gai_strerror(rv));
+        a->addrs = NULL;
+        attempt_fail(a);
+        return 1;
     }
+    a->next_addr = a->addrs;
+    a->state = ATTEMPT_RESOLVED;
+    return 0;
+}
 
-    if (sock < 0) {
-        LOG_INFO("Could not connect to %s:%s. No usable address found or all connections failed.", host, port);
+static int attempt_start(mirror_attempt_t *a) {
+    const ConfigurableServer *server = &g_phonebook_servers_list[a->server];
+    if (a->state != ATTEMPT_RESOLVED) {
         return 1;
     }
-    LOG_DEBUG("Connection established. Preparing HTTP GET request.");
+    a->started_ms = now_ms();
+    LOG_INFO("Attempting CSV download from %s:%s%s", server->host, server->port, server->path);
+    if (attempt_connect_next(a) != 0) {
+        LOG_INFO("Could not connect to %s:%s. No usable address found or all connections failed.", server->host, server->port);
+        attempt_fail(a);
+        return 1;
+    }
+    return 0;
+}
+
+static int attempt_send_request(mirror_attempt_t *a) {
+    const ConfigurableServer *server = &g_phonebook_servers_list[a->server];
 
-    char req[512];
-    int n_req = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+    // Conditional GET: a server whose copy has not changed since the one on
+    // flash answers 304 with no body
+    const http_validators_t *known = &server_validators[a->server];
+    char conditions[2 * PB_HTTP_VALIDATOR_LEN + 48] = "";
+    int n_cond = 0;
+    if (known->etag[0]) {
+        n_cond += snprintf(conditions + n_cond, sizeof(conditions) - n_cond, "If-None-Match: %s\r\n", known->etag);
+    }
+    if (known->last_modified[0]) {
+        n_cond += snprintf(conditions + n_cond, sizeof(conditions) - n_cond, "If-Modified-Since: %s\r\n", known->last_modified);
+    }
+    a->conditional = (n_cond > 0);
+
+    char req[1024];
+    int n_req = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip\r\n%sConnection: close\r\n\r\n", server->path, server->host, conditions);
     if (n_req >= (int)sizeof(req) || n_req < 0) {
         LOG_ERROR("HTTP request string too long or snprintf error, requested size %d, buffer size %zu.", n_req, sizeof(req));
-        close(sock);
         return 1;
     }
-    ssize_t sent_bytes = send(sock, req, n_req, 0);
-    if (sent_bytes < 0) {
-        LOG_ERROR("Failed to send HTTP GET request to %s:%s: %s", host, port, strerror(errno));
-        close(sock);
+    // A fresh connection takes a request this small in one go
+    ssize_t sent_bytes = send(a->sock, req, n_req, MSG_NOSIGNAL);
+    if (sent_bytes != n_req) {
+        LOG_ERROR("Failed to send HTTP GET request to %s:%s: %s", server->host, server->port,
+                  sent_bytes < 0 ? strerror(errno) : "short write");
         return 1;
     }
     LOG_DEBUG("Sent %zd bytes HTTP GET request:\n%s", sent_bytes, req);
+    a->state = ATTEMPT_READING_HEADERS;
+    return 0;
+}
 
-    FILE *fp = fopen(PB_CSV_TEMP_PATH, "wb");
-    if (!fp) {
-        LOG_ERROR("Failed to open temp file %s for writing: %s", PB_CSV_TEMP_PATH, strerror(errno));
-        close(sock);
-        return 1;
+// Returns 1 once the headers are complete and the status parsed, 0 if more
+// data is needed, -1 on failure.
+static int attempt_read_headers(mirror_attempt_t *a) {
+    size_t room = sizeof(a->header_buffer) - 1 - a->header_buffer_len;
+    ssize_t len_read = read(a->sock, a->header_buffer + a->header_buffer_len, room);
+    if (len_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        LOG_ERROR("Error reading from socket during download: %s", strerror(errno));
+        return -1;
+    }
+    if (len_read == 0) {
+        LOG_ERROR("HTTP response was too short or malformed; no complete status line/headers found. Received %zu bytes.", a->header_buffer_len);
+        return -1;
+    }
+    LOG_DEBUG("Received %zd bytes from socket.", len_read);
+    a->header_buffer_len += len_read;
+    a->header_buffer[a->header_buffer_len] = '\0';
+
+    char *end_of_line = strstr(a->header_buffer, "\r\n");
+    if (!end_of_line || !strstr(a->header_buffer, "\r\n\r\n")) {
+        if (a->header_buffer_len >= sizeof(a->header_buffer) - 1) {
+            LOG_ERROR("HTTP header too large or missing end of headers (\\r\\n\\r\\n). Header buffer exhausted.");
+            return -1;
+        }
+        LOG_DEBUG("Partial HTTP header received (%zu bytes). Waiting for more data for status line/body split.", a->header_buffer_len);
+        return 0;
     }
-    LOG_DEBUG("Temporary file '%s' opened for writing downloaded CSV.", PB_CSV_TEMP_PATH);
 
-    char buf[4096];
-    ssize_t len_read;
-    int http_status_code = 0;
-    size_t total_bytes_read = 0;
-    bool status_line_read = false;
-    char header_buffer[4096] = {0};
-    size_t header_buffer_len = 0;
-
-    LOG_DEBUG("Starting HTTP response read loop. Writing to %s.", PB_CSV_TEMP_PATH);
-    while ((len_read = read(sock, buf, sizeof(buf))) > 0) {
-        // if (!keep_running) { // REMOVED
-        //     LOG_WARN("Download interrupted by shutdown signal. Read %zd bytes.", len_read);
-        //     break;
-        // }
-        LOG_DEBUG("Received %zd bytes from socket.", len_read);
+    size_t status_line_len = end_of_line - a->header_buffer;
+    char status_line[256];
+    snprintf(status_line, sizeof status_line, "%.*s", (int)status_line_len, a->header_buffer);
+    LOG_DEBUG("Received complete HTTP Status Line: '%s'", status_line);
+    if (sscanf(status_line, "HTTP/%*f %d", &a->http_status_code) != 1) {
+        LOG_ERROR("Failed to parse HTTP status code from '%s'.", status_line);
+        return -1;
+    }
+    if (a->http_status_code != 200 && !(a->http_status_code == 304 && a->conditional)) {
+        LOG_ERROR("HTTP download failed with status code %d: '%s'.", a->http_status_code, status_line);
+        return -1;
+    }
+    LOG_DEBUG("Parsed HTTP Status Code: %d. Headers received.", a->http_status_code);
+    return 1;
+}
 
-        if (!status_line_read) {
-            size_t copy_len = (header_buffer_len + len_read < sizeof(header_buffer)) ? len_read : (sizeof(header_buffer) - header_buffer_len -1);
-            memcpy(header_buffer + header_buffer_len, buf, copy_len);
-            header_buffer_len += copy_len;
-            header_buffer[header_buffer_len] = '\0';
-
-            char *end_of_line = strstr(header_buffer, "\r\n");
-            char *body_start = strstr(header_buffer, "\r\n\r\n");
-
-            if (end_of_line && body_start) {
-                size_t status_line_len = end_of_line - header_buffer;
-                char status_line[256] = {0};
-                strncpy(status_line, header_buffer, (status_line_len < sizeof(status_line)-1) ? status_line_len : sizeof(status_line)-1);
-                status_line[sizeof(status_line)-1] = '\0';
-
-                LOG_DEBUG("Received complete HTTP Status Line: '%s'", status_line);
-                if (sscanf(status_line, "HTTP/%*f %d", &http_status_code) != 1) {
-                    LOG_ERROR("Failed to parse HTTP status code from '%s'.", status_line);
-                    fclose(fp); close(sock); remove(PB_CSV_TEMP_PATH); return 1;
-                }
+// Advances one attempt on a poll() event. Returns 1 if it won the race.
+static int attempt_handle_event(mirror_attempt_t *a, short revents) {
+    if (a->state == ATTEMPT_CONNECTING) {
+        int so_error = 0;
+        socklen_t so_len = sizeof(so_error);
+        if (getsockopt(a->sock, SOL_SOCKET, SO_ERROR, &so_error, &so_len) != 0 || so_error != 0) {
+            LOG_DEBUG("Connection failed to %s:%s: %s. Trying next address...",
+                      g_phonebook_servers_list[a->server].host, g_phonebook_servers_list[a->server].port,
+                      strerror(so_error ? so_error : errno));
+            if (attempt_connect_next(a) != 0) {
+                LOG_INFO("Could not connect to %s:%s. No usable address found or all connections failed.",
+                         g_phonebook_servers_list[a->server].host, g_phonebook_servers_list[a->server].port);
+                attempt_fail(a);
+            }
+            return 0;
+        }
+        LOG_DEBUG("Connection established. Preparing HTTP GET request.");
+        if (attempt_send_request(a) != 0) {
+            attempt_fail(a);
+        }
+        return 0;
+    }
+    if (a->state == ATTEMPT_READING_HEADERS && (revents & (POLLIN | POLLHUP | POLLERR))) {
+        int rc = attempt_read_headers(a);
+        if (rc < 0) {
+            attempt_fail(a);
+        }
+        return rc > 0;
+    }
+    return 0;
+}
 
-                if (http_status_code != 200) {
-                    LOG_ERROR("HTTP download failed with status code %d: '%s'.", http_status_code, status_line);
-                    fclose(fp); close(sock); remove(PB_CSV_TEMP_PATH); return 1;
-                }
-                LOG_DEBUG("Parsed HTTP Status Code: %d. Headers received.", http_status_code);
-                status_line_read = true;
-
-                size_t header_len_total = body_start - header_buffer + 4;
-                if (len_read > header_len_total) {
-                     fwrite(buf + header_len_total, 1, len_read - header_len_total, fp);
-                     total_bytes_read += (size_t)(len_read - header_len_total);
-                     LOG_DEBUG("Wrote %zu bytes (body part of initial chunk) to CSV. Total: %zu.", (size_t)(len_read - header_len_total), total_bytes_read);
-                }
-            } else if (header_buffer_len >= sizeof(header_buffer) -1) {
-                LOG_ERROR("HTTP header too large or missing end of headers (\\r\\n\\r\\n). Header buffer exhausted.");
-                fclose(fp); close(sock); remove(PB_CSV_TEMP_PATH); return 1;
-            } else {
-                 LOG_DEBUG("Partial HTTP header received (%zu bytes). Waiting for more data for status line/body split.", header_buffer_len);
+// Races the mirrors in order[]. Returns the attempt that won, with its
+// socket open and the response headers in its buffer, or NULL if all failed.
+static mirror_attempt_t *race_mirrors(const int *order, int n) {
+    int launched = 0;
+    uint64_t next_launch_ms = now_ms();
+    mirror_attempt_t *winner = NULL;
+
+    for (int i = 0; i < n; i++) {
+        attempt_resolve(&attempts[i], order[i]);
+    }
+
+    while (!winner) {
+        uint64_t now = now_ms();
+        int in_flight = 0;
+        for (int i = 0; i < launched; i++) {
+            if (attempts[i].state != ATTEMPT_CLOSED) {
+                in_flight++;
+            }
+        }
+
+        // Launch the next mirror when its stagger step is due, or right away
+        // if nothing is in flight any more
+        while (launched < n && (now >= next_launch_ms || in_flight == 0)) {
+            if (attempt_start(&attempts[launched]) == 0) {
+                in_flight++;
+                next_launch_ms = now + PB_RACE_STAGGER_MS;
+                launched++;
+                break;
+            }
+            launched++;
+        }
+        if (in_flight == 0) {
+            return NULL;
+        }
+
+        struct pollfd pfds[MAX_PB_SERVERS];
+        mirror_attempt_t *polled[MAX_PB_SERVERS];
+        int nfds = 0;
+        uint64_t wake_ms = (launched < n) ? next_launch_ms : UINT64_MAX;
+        for (int i = 0; i < launched; i++) {
+            mirror_attempt_t *a = &attempts[i];
+            if (a->state == ATTEMPT_CLOSED) {
+                continue;
+            }
+            pfds[nfds].fd = a->sock;
+            pfds[nfds].events = (a->state == ATTEMPT_CONNECTING) ? POLLOUT : POLLIN;
+            pfds[nfds].revents = 0;
+            polled[nfds++] = a;
+            if (a->started_ms + PB_RACE_TIMEOUT_MS < wake_ms) {
+                wake_ms = a->started_ms + PB_RACE_TIMEOUT_MS;
+            }
+        }
+
+        int timeout = (wake_ms > now) ? (int)(wake_ms - now) : 0;
+        if (poll(pfds, nfds, timeout) < 0 && errno != EINTR) {
+            LOG_ERROR("poll() failed during phonebook download: %s", strerror(errno));
+            break;
+        }
+
+        now = now_ms();
+        for (int i = 0; i < nfds && !winner; i++) {
+            mirror_attempt_t *a = polled[i];
+            if (pfds[i].revents && attempt_handle_event(a, pfds[i].revents)) {
+                winner = a;
+            } else if (a->state != ATTEMPT_CLOSED && now >= a->started_ms + PB_RACE_TIMEOUT_MS) {
+                LOG_INFO("Server %s did not answer within %d ms.", g_phonebook_servers_list[a->server].host, PB_RACE_TIMEOUT_MS);
+                attempt_fail(a);
+            }
+            if (a->state == ATTEMPT_CLOSED) {
+                next_launch_ms = now; // Its turn goes to the next mirror
             }
-        } else {
-            fwrite(buf, 1, len_read, fp);
-            total_bytes_read += len_read;
-            LOG_DEBUG("Appended %zd bytes to CSV. Total: %zu.", len_read, total_bytes_read);
         }
     }
-    fclose(fp);
-    close(sock);
 
-    if (len_read < 0) {
+    // Mirrors still in flight lost: they are at least as slow as the winner was.
+    // Ones never launched only hold their resolved addresses.
+    uint64_t now = now_ms();
+    for (int i = 0; i < n; i++) {
+        mirror_attempt_t *a = &attempts[i];
+        if (a == winner || a->state == ATTEMPT_CLOSED) {
+            continue;
+        }
+        if (a->state == ATTEMPT_RESOLVED) {
+            attempt_close(a);
+            continue;
+        }
+        mirror_stats_t *s = &mirror_stats[a->server];
+        unsigned int elapsed = (unsigned int)(now - a->started_ms);
+        if (elapsed > s->latency_ms) {
+            update_latency(s, elapsed);
+        }
+        attempt_close(a);
+    }
+    if (winner) {
+        mirror_stats_t *s = &mirror_stats[winner->server];
+        update_latency(s, (unsigned int)(now - winner->started_ms));
+        s->consecutive_failures = 0;
+        s->wins++;
+        LOG_INFO("Server %s answered first (HTTP %d) in %u ms; smoothed latency %u ms, %u wins.",
+                 g_phonebook_servers_list[winner->server].host, winner->http_status_code,
+                 (unsigned int)(now - winner->started_ms), s->latency_ms, s->wins);
+    }
+    return winner;
+}
+
+static int read_body(mirror_attempt_t *a, http_body_t *body, phonebook_pipeline_t *pipeline) {
+    const ConfigurableServer *server = &g_phonebook_servers_list[a->server];
+
+    // The race is over: plain blocking reads, each bounded by a timeout
+    int flags = fcntl(a->sock, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(a->sock, F_SETFL, flags & ~O_NONBLOCK);
+    }
+    struct timeval sock_tv = { .tv_sec = PB_BODY_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt(a->sock, SOL_SOCKET, SO_RCVTIMEO, &sock_tv, sizeof(sock_tv));
+
+    // The body starts after the blank line; the first bytes may already be in the header buffer
+    char *end_of_line = strstr(a->header_buffer, "\r\n");
+    char *body_start = strstr(a->header_buffer, "\r\n\r\n");
+    size_t header_len_total = body_start - a->header_buffer + 4;
+    size_t body_in_header = a->header_buffer_len - header_len_total;
+    http_validators_t received = {0};
+    body_start[2] = '\0';
+    if (parse_response_headers(end_of_line + 2, body, &received) != 0) {
+        return PB_DOWNLOAD_FAILED;
+    }
+    // A .csv.gz mirror path serves the compressed file as is
+    size_t path_len = strlen(server->path);
+    if (path_len > 3 && strcasecmp(server->path + path_len - 3, ".gz") == 0) {
+        body->gzip = true;
+    }
+    if (http_body_feed(body, a->header_buffer + header_len_total, body_in_header, pipeline) != 0) {
+        return PB_DOWNLOAD_FAILED;
+    }
+    LOG_DEBUG("Response body framing: %s%s.", body->gzip ? "gzip, " : "", body->framing == BODY_CHUNKED ? "chunked" :
+              body->framing == BODY_CONTENT_LENGTH ? "Content-Length" : "until close");
+
+    char buf[4096];
+    ssize_t len_read = 0;
+    LOG_DEBUG("Starting HTTP response read loop. Feeding the phonebook pipeline.");
+    // Stop as soon as the framing says the body is complete
+    while (!body->complete && (len_read = read(a->sock, buf, sizeof(buf))) > 0) {
+        LOG_DEBUG("Received %zd bytes from socket.", len_read);
+        if (http_body_feed(body, buf, len_read, pipeline) != 0) {
+            return PB_DOWNLOAD_FAILED;
+        }
+    }
+    size_t total_bytes_read = body->payload_bytes;
+
+    if (!body->complete && len_read < 0) {
         LOG_ERROR("Error reading from socket during download: %s", strerror(errno));
-        remove(PB_CSV_TEMP_PATH);
-        return 1;
-    } else if (total_bytes_read == 0 && http_status_code == 200) {
+        return PB_DOWNLOAD_FAILED;
+    } else if (body->framing != BODY_UNTIL_CLOSE && !body->complete) {
+        LOG_ERROR("Connection closed before the end of the body (%zu bytes received). Refusing truncated phonebook.", total_bytes_read);
+        return PB_DOWNLOAD_FAILED;
+    } else if (body->gzip && !body->gzip_ended) {
+        LOG_ERROR("gzip body ended early (%zu bytes received). Refusing truncated phonebook.", body->wire_bytes);
+        return PB_DOWNLOAD_FAILED;
+    } else if (total_bytes_read == 0) {
         LOG_ERROR("Downloaded CSV is empty (0 bytes body). Refusing to accept empty phonebook.");
-        remove(PB_CSV_TEMP_PATH);
-        return 1;
-    } else if (!status_line_read) {
-        LOG_ERROR("HTTP response was too short or malformed; no complete status line/headers found. Received %zu bytes.", total_bytes_read);
-        remove(PB_CSV_TEMP_PATH);
-        return 1;
-    } else if (http_status_code != 200) {
-        LOG_ERROR("HTTP download failed: Invalid status code %d. File not saved. Final bytes: %zu.", http_status_code, total_bytes_read);
-        remove(PB_CSV_TEMP_PATH);
-        return 1;
+        return PB_DOWNLOAD_FAILED;
     }
 
     // Validate that we have at least a minimal CSV (header row minimum: "First,Last,Call,Phone\n" ~ 25 bytes)
     if (total_bytes_read < 25) {
         LOG_ERROR("Downloaded CSV too small (%zu bytes). Likely header-only or corrupted. Refusing to accept.", total_bytes_read);
-        remove(PB_CSV_TEMP_PATH);
-        return 1;
+        return PB_DOWNLOAD_FAILED;
     }
 
-    LOG_INFO("CSV downloaded successfully to %s. Total bytes: %zu.", PB_CSV_TEMP_PATH, total_bytes_read);
-    LOG_DEBUG("Finished CSV download process for %s:%s%s.", host, port, path);
-    return 0;
+    // Kept once the caller has this copy on flash
+    response_validators = received;
+    response_server = a->server;
+
+    if (body->gzip) {
+        LOG_INFO("CSV downloaded successfully. Total bytes: %zu (%zu gzip-compressed on the wire).", total_bytes_read, body->wire_bytes);
+    } else {
+        LOG_INFO("CSV downloaded successfully. Total bytes: %zu.", total_bytes_read);
+    }
+    LOG_DEBUG("Finished CSV download process for %s:%s%s.", server->host, server->port, server->path);
+    return PB_DOWNLOAD_OK;
 }
 
+// Streams the winner's body into the pipeline
+static int download_body(mirror_attempt_t *a, phonebook_pipeline_t *pipeline) {
+    http_body_t body = {0};
+    int result = read_body(a, &body, pipeline);
+    if (body.inflating) {
+        inflateEnd(&body.inflater);
+    }
+    return result;
+}
 
-int csv_processor_download_csv(void) {
-    for (int i = 0; i < g_num_phonebook_servers; i++) {
-        const ConfigurableServer *current_server = &g_phonebook_servers_list[i];
-        LOG_INFO("Attempting download from server %d: %s", i + 1, current_server->host);
-        if (attempt_download(current_server->host, current_server->port, current_server->path) == 0) {
+
+int csv_processor_download_csv(phonebook_pipeline_t *p) {
+    int order[MAX_PB_SERVERS];
+    int n = order_mirrors(order);
+    response_server = -1;
+
+    while (n > 0) {
+        mirror_attempt_t *winner = race_mirrors(order, n);
+        if (!winner) {
+            break;
+        }
+        const ConfigurableServer *current_server = &g_phonebook_servers_list[winner->server];
+        if (winner->http_status_code == 304) {
+            LOG_INFO("Phonebook on %s:%s%s not modified (HTTP 304).", current_server->host, current_server->port, current_server->path);
+            attempt_close(winner);
+            return PB_DOWNLOAD_NOT_MODIFIED;
+        }
+        if (phonebook_pipeline_begin(p, true) != 0) {
+            attempt_close(winner);
+            return PB_DOWNLOAD_FAILED;
+        }
+        int result = download_body(winner, p);
+        attempt_close(winner);
+        if (result == PB_DOWNLOAD_OK) {
             LOG_INFO("Download successful from server %s.", current_server->host);
-            return 0;
-        } else {
-            LOG_WARN("Download failed from server %s. Trying next server.", current_server->host);
+            return PB_DOWNLOAD_OK;
+        }
+        phonebook_pipeline_abort(p);
+        mirror_stats[winner->server].consecutive_failures++;
+        LOG_WARN("Download failed from server %s. Racing the remaining servers.", current_server->host);
+
+        // Race again without it
+        int kept = 0;
+        for (int i = 0; i < n; i++) {
+            if (order[i] != winner->server) {
+                order[kept++] = order[i];
+            }
         }
+        n = kept;
     }
     LOG_ERROR("All configured phonebook servers failed to provide CSV. Download failed completely.");
-    return 1;
+    return PB_DOWNLOAD_FAILED;
 }
 
 
-int csv_processor_convert_csv_to_xml_and_get_path(char *output_path, size_t output_path_len) {
-    LOG_INFO("Starting CSV to XML conversion from %s...", PB_CSV_PATH);
-    if (access(PB_CSV_PATH, R_OK) != 0) {
-        LOG_ERROR("CSV file %s not found or not readable. Error: %s", PB_CSV_PATH, strerror(errno));
-        return 1;
+static void render_xml_header(FILE *xml) {
+    fprintf(xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<YealinkIPPhoneDirectory>\n");
+}
+
+// Append the <DirectoryEntry> for one CSV line (modified in place)
+static void render_xml_row(FILE *xml, char *line, int ln) {
+    int line_len = strcspn(line, "\r\n");
+    LOG_DEBUG("Processing line %d: '%.*s...'", ln,
+             (line_len > 30) ? 30 : line_len, line);
+
+    char *cols[4] = {NULL};
+    char *p = line;
+    for (int i = 0; i < 4; i++) {
+        if (i < 3) {
+            char *c = strchr(p, ',');
+            if (c) {
+                *c = '\0';
+                cols[i] = p;
+                p = c + 1;
+            } else {
+                cols[i] = p;
+                p = NULL;
+            }
+        } else {
+            cols[i] = p;
+        }
+        if (!p && i < 3) {
+            LOG_WARN("Line %d has fewer than 4 columns. Missing column %d and subsequent. Line: '%.*s'", ln, i+1, (int)strcspn(line, "\r\n"), line);
+            break;
+        }
     }
 
-    strncpy(output_path, PB_XML_BASE_PATH, output_path_len - 1);
-    output_path[output_path_len - 1] = '\0';
+    if (cols[3]) {
+        char *e = strchr(cols[3], ',');
+        if (e) *e = '\0';
+        cols[3][strcspn(cols[3], "\r\n")] = '\0';
+    }
 
-    FILE *xml = fopen(output_path, "w");
-    if (!xml) {
-        LOG_ERROR("Failed to open base xml file for writing '%s'. Error: %s", output_path, strerror(errno));
-        return 1;
+    if (!cols[3] || !*cols[3]) {
+        LOG_WARN("Skipping line %d due to missing or empty Telephone number (column 4). Line: '%.*s'", ln, (int)strcspn(line, "\r\n"), line);
+        return;
     }
 
-    FILE *csv = fopen(PB_CSV_PATH, "r");
-    if (!csv) {
-        LOG_ERROR("Failed to open CSV for reading '%s'. Error: %s", PB_CSV_PATH, strerror(errno));
-        fclose(xml);
-        remove(output_path);
+    char s0[MAX_FIRST_NAME_LEN] = {0};
+    char s1[MAX_NAME_LEN] = {0};
+    char s2[MAX_CALLSIGN_LEN] = {0};
+    sanitize_utf8(cols[0] ? cols[0] : "", s0, sizeof(s0));
+    sanitize_utf8(cols[1] ? cols[1] : "", s1, sizeof(s1));
+    sanitize_utf8(cols[2] ? cols[2] : "", s2, sizeof(s2));
+
+    // Adjust buffer size calculation based on new max lengths, plus overhead for spaces and parentheses
+    char full_name_raw[MAX_FIRST_NAME_LEN + MAX_NAME_LEN + MAX_CALLSIGN_LEN + 5]; // +5 for " ()" and null
+    if (s0[0] && s1[0] && s2[0]) {
+        snprintf(full_name_raw, sizeof(full_name_raw), "%s %s (%s)", s0, s1, s2);
+    } else if (s0[0] && s1[0]) {
+        snprintf(full_name_raw, sizeof(full_name_raw), "%s %s", s0, s1);
+    } else if (s0[0]) {
+        strncpy(full_name_raw, s0, sizeof(full_name_raw) - 1);
+        full_name_raw[sizeof(full_name_raw) - 1] = '\0';
+    } else {
+        strncpy(full_name_raw, "Unnamed", sizeof(full_name_raw) - 1);
+        full_name_raw[sizeof(full_name_raw) - 1] = '\0';
+    }
+
+    // The esc_name buffer size remains generous as XML escaping can greatly expand string length
+    char esc_name[MAX_DISPLAY_NAME_LEN * 4 + 32];
+    xml_escape(full_name_raw, esc_name, sizeof(esc_name));
+
+    fprintf(xml, "  <DirectoryEntry>\n    <Name>%s</Name>\n    <Telephone>%s</Telephone>\n  </DirectoryEntry>\n",
+            esc_name, cols[3]);
+    LOG_DEBUG("Added XML entry for Telephone: '%s'", cols[3]);
+}
+
+int phonebook_pipeline_begin(phonebook_pipeline_t *p, bool keep_body) {
+    memset(p, 0, sizeof(*p));
+    csv_hash_init(&p->hash);
+    p->keep_body = keep_body;
+
+    p->xml = fopen(PB_XML_BASE_PATH, "w");
+    if (!p->xml) {
+        LOG_ERROR("Failed to open base xml file for writing '%s'. Error: %s", PB_XML_BASE_PATH, strerror(errno));
         return 1;
     }
+    render_xml_header(p->xml);
 
-    fprintf(xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<YealinkIPPhoneDirectory>\n");
-    char line[2048];
-    int ln = 0;
-    LOG_DEBUG("Starting CSV parsing loop. Current line number: %d.", ln);
-    while (fgets(line, sizeof(line), csv)) {
-        ln++;
-        // Detect header row: check for "First"/"FIRST" (same logic as csv_processor_validate_csv)
-        if (ln == 1 && (strstr(line, "First") != NULL || strstr(line, "FIRST") != NULL)) {
-            LOG_DEBUG("Detected CSV header row (line %d): '%.*s'", ln, (int)strcspn(line, "\r\n"), line);
-            continue;
+    directory_build_begin();
+    p->building_directory = true;
+    return 0;
+}
+
+// One complete line: count it, render it and add it to the directory.
+// Both of the latter split the line in place, so XML gets a copy.
+static void pipeline_process_line(phonebook_pipeline_t *p) {
+    p->line[p->line_len] = '\0';
+    p->line_len = 0;
+    p->line_no++;
+
+    if (is_header_row(p->line, p->line_no)) {
+        LOG_DEBUG("Detected CSV header row: %.*s", (int)strcspn(p->line, "\r\n"), p->line);
+    } else {
+        if (is_valid_data_row(p->line)) {
+            p->valid_rows++;
         }
+        memcpy(p->scratch, p->line, sizeof(p->scratch));
+        render_xml_row(p->xml, p->scratch, p->line_no);
+    }
+    // The directory has no header row: all rows are data
+    directory_build_add_csv_row(p->line, p->line_no);
+}
 
-        int line_len = strcspn(line, "\r\n");
-        LOG_DEBUG("Processing line %d: '%.*s...'", ln,
-                 (line_len > 30) ? 30 : line_len, line);
-
-        char *cols[4] = {NULL};
-        char *p = line;
-        for (int i = 0; i < 4; i++) {
-            if (i < 3) {
-                char *c = strchr(p, ',');
-                if (c) {
-                    *c = '\0';
-                    cols[i] = p;
-                    p = c + 1;
-                } else {
-                    cols[i] = p;
-                    p = NULL;
-                }
-            } else {
-                cols[i] = p;
-            }
-            if (!p && i < 3) {
-                LOG_WARN("Line %d has fewer than 4 columns. Missing column %d and subsequent. Line: '%.*s'", ln, i+1, (int)strcspn(line, "\r\n"), line);
-                break;
+int phonebook_pipeline_feed(phonebook_pipeline_t *p, const char *data, size_t len) {
+    if (p->failed) {
+        return 1;
+    }
+    csv_hash_update(&p->hash, data, len);
+    p->total_bytes += len;
+
+    if (p->keep_body) {
+        if (p->body_len + len > PB_CSV_MAX_BYTES) {
+            LOG_ERROR("Phonebook larger than %d bytes. Refusing to accept it.", PB_CSV_MAX_BYTES);
+            p->failed = true;
+            return 1;
+        }
+        if (p->body_len + len > p->body_cap) {
+            size_t new_cap = p->body_cap ? p->body_cap : 16384;
+            while (new_cap < p->body_len + len) new_cap *= 2;
+            char *grown = realloc(p->body, new_cap);
+            if (!grown) {
+                LOG_ERROR("Out of memory buffering the phonebook (%zu bytes).", new_cap);
+                p->failed = true;
+                return 1;
             }
+            p->body = grown;
+            p->body_cap = new_cap;
         }
+        memcpy(p->body + p->body_len, data, len);
+        p->body_len += len;
+    }
 
-        if (cols[3]) {
-            char *e = strchr(cols[3], ',');
-            if (e) *e = '\0';
-            cols[3][strcspn(cols[3], "\r\n")] = '\0';
+    // Split into lines the way fgets() into a 2048-byte buffer would
+    while (len > 0) {
+        size_t room = sizeof(p->line) - 1 - p->line_len;
+        const char *nl = memchr(data, '\n', len < room ? len : room);
+        size_t take = nl ? (size_t)(nl - data) + 1 : (len < room ? len : room);
+        memcpy(p->line + p->line_len, data, take);
+        p->line_len += take;
+        data += take;
+        len -= take;
+        if (nl || p->line_len == sizeof(p->line) - 1) {
+            pipeline_process_line(p);
         }
+    }
+    return 0;
+}
 
-        if (!cols[3] || !*cols[3]) {
-            LOG_WARN("Skipping line %d due to missing or empty Telephone number (column 4). Line: '%.*s'", ln, (int)strcspn(line, "\r\n"), line);
-            continue;
+int phonebook_pipeline_finish(phonebook_pipeline_t *p) {
+    if (p->line_len > 0) {
+        pipeline_process_line(p); // Last line without a newline
+    }
+    if (p->xml) {
+        fflush(p->xml);
+        fsync(fileno(p->xml));
+        if (fclose(p->xml) != 0) {
+            p->failed = true;
         }
+        p->xml = NULL;
+    }
+    if (p->failed) {
+        return 1;
+    }
 
-        char s0[MAX_FIRST_NAME_LEN] = {0};
-        char s1[MAX_NAME_LEN] = {0};
-        char s2[MAX_CALLSIGN_LEN] = {0};
-        sanitize_utf8(cols[0] ? cols[0] : "", s0, sizeof(s0));
-        sanitize_utf8(cols[1] ? cols[1] : "", s1, sizeof(s1));
-        sanitize_utf8(cols[2] ? cols[2] : "", s2, sizeof(s2));
-
-        // Adjust buffer size calculation based on new max lengths, plus overhead for spaces and parentheses
-        char full_name_raw[MAX_FIRST_NAME_LEN + MAX_NAME_LEN + MAX_CALLSIGN_LEN + 5]; // +5 for " ()" and null
-        if (s0[0] && s1[0] && s2[0]) {
-            snprintf(full_name_raw, sizeof(full_name_raw), "%s %s (%s)", s0, s1, s2);
-        } else if (s0[0] && s1[0]) {
-            snprintf(full_name_raw, sizeof(full_name_raw), "%s %s", s0, s1);
-        } else if (s0[0]) {
-            strncpy(full_name_raw, s0, sizeof(full_name_raw) - 1);
-            full_name_raw[sizeof(full_name_raw) - 1] = '\0';
-        } else {
-            strncpy(full_name_raw, "Unnamed", sizeof(full_name_raw) - 1);
-            full_name_raw[sizeof(full_name_raw) - 1] = '\0';
-        }
+    // Require at least 1 valid data row
+    if (p->valid_rows < 1) {
+        LOG_ERROR("CSV validation failed: %d total lines but only %d valid data rows",
+                 p->line_no, p->valid_rows);
+        return 1;
+    }
+    LOG_INFO("CSV validation passed: %d valid entries found", p->valid_rows);
+    return 0;
+}
 
-        // The esc_name buffer size remains generous as XML escaping can greatly expand string length
-        char esc_name[MAX_DISPLAY_NAME_LEN * 4 + 32];
-        xml_escape(full_name_raw, esc_name, sizeof(esc_name));
+int phonebook_pipeline_commit_directory(phonebook_pipeline_t *p) {
+    p->building_directory = false;
+    return directory_build_commit();
+}
 
-        fprintf(xml, "  <DirectoryEntry>\n    <Name>%s</Name>\n    <Telephone>%s</Telephone>\n  </DirectoryEntry>\n",
-                esc_name, cols[3]);
-        LOG_DEBUG("Added XML entry for Telephone: '%s'", cols[3]);
+void phonebook_pipeline_abort(phonebook_pipeline_t *p) {
+    if (p->building_directory) {
+        directory_build_abort();
+        p->building_directory = false;
     }
+    if (p->xml) {
+        fclose(p->xml);
+        p->xml = NULL;
+    }
+    remove(PB_XML_BASE_PATH);
+    phonebook_pipeline_release(p);
+}
+
+void phonebook_pipeline_release(phonebook_pipeline_t *p) {
+    free(p->body);
+    p->body = NULL;
+    p->body_len = 0;
+    p->body_cap = 0;
+}
 
-    if (ferror(csv)) {
-        LOG_ERROR("Error reading CSV file '%s' during conversion. Error: %s", PB_CSV_PATH, strerror(errno));
-        fclose(csv);
-        fclose(xml);
-        remove(output_path);
+int phonebook_pipeline_save_body(const phonebook_pipeline_t *p, const char *path) {
+    // Write aside and rename: a power cut never leaves a half-written phonebook on flash
+    char tmp_path[MAX_CONFIG_PATH_LEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        LOG_ERROR("Failed to open '%s' for writing: %s", tmp_path, strerror(errno));
+        return 1;
+    }
+    bool ok = fwrite(p->body, 1, p->body_len, fp) == p->body_len && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        LOG_ERROR("Failed to write phonebook to '%s': %s", path, strerror(errno));
+        remove(tmp_path);
         return 1;
     }
+    return 0;
+}
 
-    fclose(csv);
-    fflush(xml);
-    fsync(fileno(xml));
-    fclose(xml);
-    LOG_INFO("XML conversion successful. Output: %s.", output_path);
-    LOG_DEBUG("Finished CSV to XML conversion process.");
+int csv_processor_load_file(const char *filepath, phonebook_pipeline_t *p) {
+    FILE *fp = fopen(filepath, "rb");
+    if (!fp) {
+        LOG_ERROR("Failed to open CSV file '%s'. Error: %s", filepath, strerror(errno));
+        return 1;
+    }
+    if (phonebook_pipeline_begin(p, false) != 0) {
+        fclose(fp);
+        return 1;
+    }
+
+    char buffer[2048];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        phonebook_pipeline_feed(p, buffer, n);
+    }
+    bool read_error = ferror(fp);
+    fclose(fp);
+    if (read_error) {
+        LOG_ERROR("Error reading CSV file '%s'.", filepath);
+        phonebook_pipeline_abort(p);
+        return 1;
+    }
     return 0;
 }
@@ -2,18 +2,81 @@
 #define CSV_PROCESSOR_H
 
 #include "../common.h" 
+#include <stdint.h>
 
-// Function to download CSV from URL to PB_CSV_PATH
-int csv_processor_download_csv(void);
+// Phonebook content hash: 64-bit FNV-1a, fed incrementally as bytes arrive.
+// Every byte stays in the state, so an edit anywhere in the file changes it.
+// Rendered as HASH_LENGTH hex digits.
+typedef struct {
+    uint64_t state;
+} csv_hash_t;
 
-// Function to convert CSV to XML and get path to temp XML file
-int csv_processor_convert_csv_to_xml_and_get_path(char *output_path, size_t output_path_len);
+void csv_hash_init(csv_hash_t *h);
+void csv_hash_update(csv_hash_t *h, const void *data, size_t len);
+void csv_hash_final_hex(const csv_hash_t *h, char *out, size_t out_len);
 
-// Function to calculate a conceptual hash of a file
-int csv_processor_calculate_file_conceptual_hash(const char *filepath, char *output_hash_str, size_t hash_str_len);
+#define PB_CSV_MAX_BYTES (1024 * 1024) // Largest phonebook accepted
 
-// Function to validate CSV file has minimum viable content
-// Returns 0 if valid, 1 if invalid
-int csv_processor_validate_csv(const char *filepath, int *row_count);
+// Single-pass phonebook pipeline. Bytes are fed in once, in chunks of any
+// size, and in the same pass are hashed, split into rows, counted by the
+// validator, added to the directory being rebuilt (user_manager) and rendered
+// as XML to PB_XML_BASE_PATH. With keep_body the raw CSV is also kept in RAM,
+// so it can be written to flash only if it changed.
+// begin -> feed... -> finish, then commit_directory + release, or abort.
+// begin claims the directory rebuild, so it must always be matched by
+// commit_directory or abort.
+typedef struct {
+    csv_hash_t hash;
+    bool keep_body;
+    char *body;
+    size_t body_len;
+    size_t body_cap;
+    size_t total_bytes;
+    char line[2048];            // Row being assembled across chunks
+    size_t line_len;
+    char scratch[2048];         // Copy of the row for the XML renderer
+    int line_no;
+    int valid_rows;
+    FILE *xml;
+    bool building_directory;
+    bool failed;
+} phonebook_pipeline_t;
+
+int phonebook_pipeline_begin(phonebook_pipeline_t *p, bool keep_body);
+int phonebook_pipeline_feed(phonebook_pipeline_t *p, const char *data, size_t len);
+// Flushes the last row and closes the XML. 0 if the CSV has at least one valid row.
+int phonebook_pipeline_finish(phonebook_pipeline_t *p);
+// Swaps the rebuilt directory in; returns the number of directory entries
+int phonebook_pipeline_commit_directory(phonebook_pipeline_t *p);
+// Drops the directory rebuild, the XML and the body
+void phonebook_pipeline_abort(phonebook_pipeline_t *p);
+void phonebook_pipeline_release(phonebook_pipeline_t *p); // Frees the body
+// Writes the kept body to path (aside, then renamed into place)
+int phonebook_pipeline_save_body(const phonebook_pipeline_t *p, const char *path);
+
+// csv_processor_download_csv() results
+#define PB_DOWNLOAD_OK            0
+#define PB_DOWNLOAD_FAILED        1
+#define PB_DOWNLOAD_NOT_MODIFIED  2
+
+// Download the CSV from the first configured server that answers, straight
+// into the pipeline (begun here, with the body kept). On PB_DOWNLOAD_OK the
+// caller owns the open pipeline and calls phonebook_pipeline_finish().
+// Requests are conditional when the server's validators are known; its 304
+// gives PB_DOWNLOAD_NOT_MODIFIED with the pipeline already aborted.
+// Content-Length, chunked and close-delimited bodies are accepted.
+int csv_processor_download_csv(phonebook_pipeline_t *p);
+
+#define PB_HTTP_VALIDATOR_LEN 128 // Longer ETag / Last-Modified values are not kept
+
+// ETag and Last-Modified of each server, for conditional GETs. Load them only
+// when the phonebook on flash is in service. Keep them once the download just
+// taken is on flash and published; they are written to PB_HTTP_VALIDATORS_PATH
+// only when they change.
+void csv_processor_load_validators(void);
+void csv_processor_keep_validators(void);
+
+// Feed a CSV file on disk through the pipeline (begun here, body not kept)
+int csv_processor_load_file(const char *filepath, phonebook_pipeline_t *p);
 
 #endif
\ No newline at end of file
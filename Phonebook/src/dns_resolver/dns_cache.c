@@ -0,0 +1,172 @@
+// dns_resolver/dns_cache.c - Shared TTL-aware hostname cache with negative caching
+#include "dns_cache.h"
+#include "../config_loader/config_loader.h" // For g_dns_cache_ttl_seconds, g_dns_negative_ttl_seconds
+#include "mesh_hosts.h"                       // First choice for mesh hostnames
+#include <strings.h> // For strcasecmp
+
+#define MODULE_NAME "DNS_CACHE"
+
+typedef struct {
+    bool in_use;
+    bool negative;
+    time_t expires;          // CLOCK_MONOTONIC seconds
+    struct in_addr addr;
+    char name[DNS_CACHE_MAX_NAME_LEN];
+} DnsCacheEntry;
+
+static DnsCacheEntry cache[DNS_CACHE_SETS][DNS_CACHE_WAYS];
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dns_cache_stats_t cache_stats;
+
+static time_t now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+// FNV-1a over the lower-cased name; DNS names compare case-insensitively
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p; p++) {
+        h ^= (uint8_t)tolower((unsigned char)*p);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+dns_cache_result_t dns_cache_lookup(const char *hostname, struct in_addr *addr) {
+    if (!hostname || strlen(hostname) >= DNS_CACHE_MAX_NAME_LEN) {
+        return DNS_CACHE_MISS;
+    }
+
+    DnsCacheEntry *set = cache[hash_name(hostname) % DNS_CACHE_SETS];
+    time_t now = now_s();
+    dns_cache_result_t result = DNS_CACHE_MISS;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (int i = 0; i < DNS_CACHE_WAYS; i++) {
+        DnsCacheEntry *e = &set[i];
+        if (!e->in_use || strcasecmp(e->name, hostname) != 0) continue;
+
+        if (e->expires <= now) {
+            e->in_use = false;
+            cache_stats.entries--;
+            break;
+        }
+        if (e->negative) {
+            result = DNS_CACHE_NEGATIVE_HIT;
+        } else {
+            result = DNS_CACHE_HIT;
+            if (addr) *addr = e->addr;
+        }
+        break;
+    }
+
+    if (result == DNS_CACHE_HIT) cache_stats.hits++;
+    else if (result == DNS_CACHE_NEGATIVE_HIT) cache_stats.negative_hits++;
+    else cache_stats.misses++;
+    pthread_mutex_unlock(&cache_mutex);
+
+    return result;
+}
+
+void dns_cache_store(const char *hostname, const struct in_addr *addr, uint32_t ttl) {
+    if (!hostname || strlen(hostname) >= DNS_CACHE_MAX_NAME_LEN) {
+        return;
+    }
+
+    // dnsmasq answers local.mesh names with TTL 0, so 0 means "use the configured TTL"
+    int effective_ttl;
+    if (addr) {
+        effective_ttl = g_dns_cache_ttl_seconds;
+        if (ttl > 0 && ttl < (uint32_t)effective_ttl) effective_ttl = (int)ttl;
+    } else {
+        effective_ttl = g_dns_negative_ttl_seconds;
+    }
+    if (effective_ttl <= 0) {
+        return;
+    }
+
+    DnsCacheEntry *set = cache[hash_name(hostname) % DNS_CACHE_SETS];
+    time_t now = now_s();
+
+    pthread_mutex_lock(&cache_mutex);
+
+    // Reuse the slot for this name, else a free/expired one, else evict the soonest to expire
+    DnsCacheEntry *slot = NULL;
+    for (int i = 0; i < DNS_CACHE_WAYS; i++) {
+        if (set[i].in_use && strcasecmp(set[i].name, hostname) == 0) {
+            slot = &set[i];
+            break;
+        }
+    }
+    if (!slot) {
+        for (int i = 0; i < DNS_CACHE_WAYS; i++) {
+            if (!set[i].in_use || set[i].expires <= now) {
+                slot = &set[i];
+                break;
+            }
+            if (!slot || set[i].expires < slot->expires) {
+                slot = &set[i];
+            }
+        }
+        if (slot->in_use && slot->expires > now) {
+            cache_stats.evictions++;
+        }
+        if (!slot->in_use) {
+            cache_stats.entries++;
+        }
+    }
+
+    slot->in_use = true;
+    slot->negative = (addr == NULL);
+    slot->expires = now + effective_ttl;
+    if (addr) slot->addr = *addr;
+    snprintf(slot->name, sizeof(slot->name), "%s", hostname);
+
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+int dns_cache_resolve(const char *hostname, struct in_addr *addr) {
+    if (mesh_hosts_lookup(hostname, addr) == 0) {
+        return 0; // Advertised by arednlink; dnsmasq would give the same answer
+    }
+
+    switch (dns_cache_lookup(hostname, addr)) {
+        case DNS_CACHE_HIT:          return 0;
+        case DNS_CACHE_NEGATIVE_HIT: return -1;
+        case DNS_CACHE_MISS:         break;
+    }
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *res = NULL;
+
+    int status = getaddrinfo(hostname, NULL, &hints, &res);
+    if (status != 0) {
+        LOG_DEBUG("Failed to resolve %s: %s", hostname, gai_strerror(status));
+        // Only cache definitive answers; a resolver hiccup should not hide a phone
+        if (status == EAI_NONAME
+#ifdef EAI_NODATA
+            || status == EAI_NODATA
+#endif
+            ) {
+            dns_cache_store(hostname, NULL, 0);
+        }
+        return -1;
+    }
+
+    struct in_addr resolved = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+
+    dns_cache_store(hostname, &resolved, 0);
+    if (addr) *addr = resolved;
+    return 0;
+}
+
+void dns_cache_get_stats(dns_cache_stats_t *stats) {
+    pthread_mutex_lock(&cache_mutex);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&cache_mutex);
+}
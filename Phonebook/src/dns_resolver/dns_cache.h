@@ -0,0 +1,46 @@
+// dns_resolver/dns_cache.h
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// Shared in-process cache for "<phone>.local.mesh" lookups.
+// Every module that resolves a phone hostname goes through here so a
+// phonebook cycle, a bulk test run and INVITE routing share one set of
+// answers instead of each hitting dnsmasq for the same names.
+// Fixed-size set-associative table (no allocation), one mutex, safe to
+// call from any thread. Failed lookups are cached for a shorter TTL.
+
+#define DNS_CACHE_SETS          128
+#define DNS_CACHE_WAYS          4    // Entries per set; DNS_CACHE_SETS * DNS_CACHE_WAYS total
+#define DNS_CACHE_MAX_NAME_LEN  64   // Longer names bypass the cache
+
+typedef enum {
+    DNS_CACHE_MISS = 0,
+    DNS_CACHE_HIT,           // addr filled in
+    DNS_CACHE_NEGATIVE_HIT   // name recently failed to resolve
+} dns_cache_result_t;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long negative_hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    int entries;
+} dns_cache_stats_t;
+
+dns_cache_result_t dns_cache_lookup(const char *hostname, struct in_addr *addr);
+
+// Store an answer. addr == NULL records a negative entry. ttl is the DNS
+// answer TTL (0 = unknown); it is capped at DNS_CACHE_TTL_SECONDS.
+void dns_cache_store(const char *hostname, const struct in_addr *addr, uint32_t ttl);
+
+// Blocking helper for worker threads: the arednlink host table first, then
+// the cache, getaddrinfo() on a miss.
+// Returns 0 and fills addr on success, -1 if the name does not resolve.
+int dns_cache_resolve(const char *hostname, struct in_addr *addr);
+
+void dns_cache_get_stats(dns_cache_stats_t *stats);
+
+#endif // DNS_CACHE_H
@@ -0,0 +1,349 @@
+// dns_resolver/dns_resolver.c - Non-blocking A-record resolver driven by the SIP main loop
+#include "dns_resolver.h"
+#include <fcntl.h>
+#include <strings.h> // For strcasecmp
+
+#define MODULE_NAME "DNS_RESOLVER"
+
+#define DNS_PORT            53
+#define DNS_HEADER_LEN      12
+#define DNS_MAX_NAME_LEN    253
+#define DNS_MAX_UDP_LEN     512
+#define DNS_TYPE_A          1
+#define DNS_CLASS_IN        1
+#define DNS_RCODE_NXDOMAIN  3
+#define RESOLV_CONF_PATH    "/etc/resolv.conf"
+
+typedef struct {
+    bool in_use;
+    uint16_t id;
+    int attempts;
+    uint64_t next_send_ms;
+    char qname[DNS_MAX_NAME_LEN + 1];
+    dns_resolver_cb_t cb;
+    void *arg;
+} PendingQuery;
+
+// Per thread: the main loop and each SIP worker own a separate resolver socket
+static __thread PendingQuery pending[DNS_RESOLVER_MAX_PENDING];
+static __thread int dns_sockfd = -1;
+static __thread uint16_t next_query_id = 0;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// First IPv4 "nameserver" line of resolv.conf, falling back to the local dnsmasq
+static void load_nameserver(struct sockaddr_in *ns) {
+    memset(ns, 0, sizeof(*ns));
+    ns->sin_family = AF_INET;
+    ns->sin_port = htons(DNS_PORT);
+    ns->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    FILE *fp = fopen(RESOLV_CONF_PATH, "r");
+    if (!fp) {
+        LOG_DEBUG("Cannot open %s, using 127.0.0.1", RESOLV_CONF_PATH);
+        return;
+    }
+
+    char line[256];
+    char addr[64];
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, " nameserver %63s", addr) == 1 &&
+            inet_pton(AF_INET, addr, &ns->sin_addr) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+int dns_resolver_init(void) {
+    struct sockaddr_in ns;
+    load_nameserver(&ns);
+
+    dns_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (dns_sockfd < 0) {
+        LOG_ERROR("Failed to create DNS socket: %s", strerror(errno));
+        return -1;
+    }
+
+    int flags = fcntl(dns_sockfd, F_GETFL, 0);
+    if (flags < 0 || fcntl(dns_sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        LOG_ERROR("Failed to make DNS socket non-blocking: %s", strerror(errno));
+        close(dns_sockfd);
+        dns_sockfd = -1;
+        return -1;
+    }
+
+    // connect() so the kernel drops datagrams from anyone but the nameserver
+    if (connect(dns_sockfd, (struct sockaddr *)&ns, sizeof(ns)) < 0) {
+        LOG_ERROR("Failed to connect DNS socket to %s: %s", sockaddr_to_ip_str(&ns), strerror(errno));
+        close(dns_sockfd);
+        dns_sockfd = -1;
+        return -1;
+    }
+
+    memset(pending, 0, sizeof(pending));
+    next_query_id = (uint16_t)(time(NULL) ^ getpid() ^ (uintptr_t)&dns_sockfd);
+
+    LOG_INFO("Asynchronous DNS resolver using nameserver %s", sockaddr_to_ip_str(&ns));
+    return 0;
+}
+
+void dns_resolver_shutdown(void) {
+    if (dns_sockfd >= 0) {
+        close(dns_sockfd);
+        dns_sockfd = -1;
+    }
+}
+
+int dns_resolver_get_fd(void) {
+    return dns_sockfd;
+}
+
+const char *dns_resolve_status_str(dns_resolve_status_t status) {
+    switch (status) {
+        case DNS_RESOLVE_OK:        return "ok";
+        case DNS_RESOLVE_NOT_FOUND: return "not found";
+        case DNS_RESOLVE_TIMEOUT:   return "timeout";
+        case DNS_RESOLVE_ERROR:     return "error";
+        default:                    return "unknown";
+    }
+}
+
+// Encode "a.b.c" as length-prefixed labels. Returns bytes written or -1.
+static int encode_qname(const char *name, uint8_t *out, size_t out_len) {
+    size_t pos = 0;
+    const char *label = name;
+
+    while (*label) {
+        const char *dot = strchr(label, '.');
+        size_t label_len = dot ? (size_t)(dot - label) : strlen(label);
+        if (label_len == 0 || label_len > 63 || pos + 1 + label_len >= out_len) {
+            return -1;
+        }
+        out[pos++] = (uint8_t)label_len;
+        memcpy(out + pos, label, label_len);
+        pos += label_len;
+        if (!dot) break;
+        label = dot + 1;
+    }
+
+    if (pos + 1 > out_len) return -1;
+    out[pos++] = 0;
+    return (int)pos;
+}
+
+static int send_query(const PendingQuery *q) {
+    uint8_t pkt[DNS_HEADER_LEN + DNS_MAX_NAME_LEN + 2 + 4];
+    memset(pkt, 0, DNS_HEADER_LEN);
+    pkt[0] = q->id >> 8;
+    pkt[1] = q->id & 0xFF;
+    pkt[2] = 0x01; // RD
+    pkt[5] = 1;    // QDCOUNT
+
+    int name_len = encode_qname(q->qname, pkt + DNS_HEADER_LEN, sizeof(pkt) - DNS_HEADER_LEN - 4);
+    if (name_len < 0) {
+        LOG_WARN("Cannot encode hostname '%s'", q->qname);
+        return -1;
+    }
+
+    size_t len = DNS_HEADER_LEN + name_len;
+    pkt[len++] = 0; pkt[len++] = DNS_TYPE_A;
+    pkt[len++] = 0; pkt[len++] = DNS_CLASS_IN;
+
+    // A connected UDP socket reports an earlier ICMP unreachable on the next send; retry once
+    ssize_t sent = send(dns_sockfd, pkt, len, 0);
+    if (sent < 0 && errno == ECONNREFUSED) {
+        sent = send(dns_sockfd, pkt, len, 0);
+    }
+    if (sent < 0) {
+        LOG_WARN("DNS query for '%s' not sent: %s", q->qname, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int dns_resolver_query_a(const char *hostname, dns_resolver_cb_t cb, void *arg) {
+    if (dns_sockfd < 0 || !hostname || !cb || strlen(hostname) > DNS_MAX_NAME_LEN) {
+        return -1;
+    }
+
+    PendingQuery *q = NULL;
+    for (int i = 0; i < DNS_RESOLVER_MAX_PENDING; i++) {
+        if (!pending[i].in_use) {
+            q = &pending[i];
+            break;
+        }
+    }
+    if (!q) {
+        LOG_WARN("DNS pending table full (%d), cannot resolve '%s'", DNS_RESOLVER_MAX_PENDING, hostname);
+        return -1;
+    }
+
+    memset(q, 0, sizeof(*q));
+    strncpy(q->qname, hostname, sizeof(q->qname) - 1);
+    q->id = next_query_id++;
+    q->cb = cb;
+    q->arg = arg;
+    q->attempts = 1;
+    q->next_send_ms = now_ms() + DNS_RESOLVER_RETRY_MS;
+
+    if (send_query(q) != 0) {
+        return -1;
+    }
+    q->in_use = true;
+    LOG_DEBUG("DNS query %u for '%s' sent", q->id, q->qname);
+    return 0;
+}
+
+// Release the slot before invoking the callback so it may queue new queries
+static void complete_query(PendingQuery *q, dns_resolve_status_t status,
+                           const struct in_addr *addr, uint32_t ttl) {
+    dns_resolver_cb_t cb = q->cb;
+    void *arg = q->arg;
+    q->in_use = false;
+    cb(arg, status, addr, ttl);
+}
+
+// Decode a (possibly compressed) name at *off into out; advances *off past it
+static int read_name(const uint8_t *buf, size_t len, size_t *off, char *out, size_t out_len) {
+    size_t pos = *off;
+    size_t out_pos = 0;
+    bool jumped = false;
+    int hops = 0;
+
+    while (pos < len) {
+        uint8_t label_len = buf[pos];
+        if (label_len == 0) {
+            if (!jumped) *off = pos + 1;
+            if (out_len > 0) out[out_pos < out_len ? out_pos : out_len - 1] = '\0';
+            return 0;
+        }
+        if ((label_len & 0xC0) == 0xC0) {
+            if (pos + 1 >= len || ++hops > 16) return -1;
+            if (!jumped) *off = pos + 2;
+            jumped = true;
+            pos = ((label_len & 0x3F) << 8) | buf[pos + 1];
+            continue;
+        }
+        if (pos + 1 + label_len > len) return -1;
+        if (out_pos > 0 && out_pos < out_len) out[out_pos++] = '.';
+        for (int i = 0; i < label_len && out_pos < out_len; i++) {
+            out[out_pos++] = (char)buf[pos + 1 + i];
+        }
+        pos += 1 + label_len;
+    }
+    return -1;
+}
+
+static void handle_answer(const uint8_t *buf, size_t len) {
+    if (len < DNS_HEADER_LEN) return;
+
+    uint16_t id = (buf[0] << 8) | buf[1];
+    PendingQuery *q = NULL;
+    for (int i = 0; i < DNS_RESOLVER_MAX_PENDING; i++) {
+        if (pending[i].in_use && pending[i].id == id) {
+            q = &pending[i];
+            break;
+        }
+    }
+    if (!q) {
+        LOG_DEBUG("Ignoring DNS answer with unknown id %u (late retransmit?)", id);
+        return;
+    }
+
+    bool is_response = buf[2] & 0x80;
+    int rcode = buf[3] & 0x0F;
+    uint16_t qdcount = (buf[4] << 8) | buf[5];
+    uint16_t ancount = (buf[6] << 8) | buf[7];
+    if (!is_response || qdcount != 1) return;
+
+    size_t off = DNS_HEADER_LEN;
+    char name[DNS_MAX_NAME_LEN + 1];
+    if (read_name(buf, len, &off, name, sizeof(name)) != 0 || off + 4 > len) return;
+    if (strcasecmp(name, q->qname) != 0) {
+        LOG_DEBUG("DNS answer %u is for '%s', expected '%s'; ignoring", id, name, q->qname);
+        return;
+    }
+    off += 4;
+
+    if (rcode == DNS_RCODE_NXDOMAIN) {
+        complete_query(q, DNS_RESOLVE_NOT_FOUND, NULL, 0);
+        return;
+    }
+    if (rcode != 0) {
+        LOG_DEBUG("DNS query '%s' failed with rcode %d", q->qname, rcode);
+        complete_query(q, DNS_RESOLVE_ERROR, NULL, 0);
+        return;
+    }
+
+    // Walk answers (CNAMEs first, then the A record we asked for)
+    for (int i = 0; i < ancount; i++) {
+        if (read_name(buf, len, &off, name, sizeof(name)) != 0 || off + 10 > len) break;
+        uint16_t type = (buf[off] << 8) | buf[off + 1];
+        uint16_t class = (buf[off + 2] << 8) | buf[off + 3];
+        uint32_t ttl = ((uint32_t)buf[off + 4] << 24) | ((uint32_t)buf[off + 5] << 16) |
+                       ((uint32_t)buf[off + 6] << 8) | buf[off + 7];
+        uint16_t rdlen = (buf[off + 8] << 8) | buf[off + 9];
+        off += 10;
+        if (off + rdlen > len) break;
+
+        if (type == DNS_TYPE_A && class == DNS_CLASS_IN && rdlen == 4) {
+            struct in_addr addr;
+            memcpy(&addr.s_addr, buf + off, 4);
+            complete_query(q, DNS_RESOLVE_OK, &addr, ttl);
+            return;
+        }
+        off += rdlen;
+    }
+
+    complete_query(q, DNS_RESOLVE_NOT_FOUND, NULL, 0);
+}
+
+void dns_resolver_handle_readable(void) {
+    uint8_t buf[DNS_MAX_UDP_LEN];
+    ssize_t n;
+
+    // Drain everything queued; the socket is non-blocking
+    while ((n = recv(dns_sockfd, buf, sizeof(buf), 0)) > 0) {
+        handle_answer(buf, (size_t)n);
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        LOG_WARN("DNS socket recv failed: %s", strerror(errno));
+    }
+}
+
+void dns_resolver_process_timeouts(void) {
+    uint64_t now = now_ms();
+
+    for (int i = 0; i < DNS_RESOLVER_MAX_PENDING; i++) {
+        PendingQuery *q = &pending[i];
+        if (!q->in_use || now < q->next_send_ms) continue;
+
+        if (q->attempts >= DNS_RESOLVER_MAX_ATTEMPTS) {
+            LOG_WARN("DNS query for '%s' timed out after %d attempts", q->qname, q->attempts);
+            complete_query(q, DNS_RESOLVE_TIMEOUT, NULL, 0);
+            continue;
+        }
+
+        q->attempts++;
+        q->next_send_ms = now + DNS_RESOLVER_RETRY_MS;
+        LOG_DEBUG("Resending DNS query for '%s' (attempt %d)", q->qname, q->attempts);
+        send_query(q); // A failed resend just waits for the next retry/timeout
+    }
+}
+
+int dns_resolver_next_timeout_ms(void) {
+    uint64_t now = now_ms();
+    int64_t best = -1;
+
+    for (int i = 0; i < DNS_RESOLVER_MAX_PENDING; i++) {
+        if (!pending[i].in_use) continue;
+        int64_t due = pending[i].next_send_ms > now ? (int64_t)(pending[i].next_send_ms - now) : 0;
+        if (best < 0 || due < best) best = due;
+    }
+    return (int)best;
+}
@@ -0,0 +1,49 @@
+// dns_resolver/dns_resolver.h
+#ifndef DNS_RESOLVER_H
+#define DNS_RESOLVER_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// Non-blocking A-record resolver for the SIP main loop.
+// Queries go out as raw UDP datagrams to the local dnsmasq (first IPv4
+// nameserver in /etc/resolv.conf, 127.0.0.1 otherwise). The caller watches
+// dns_resolver_get_fd(), calls dns_resolver_handle_readable() when it fires
+// and dns_resolver_process_timeouts() once dns_resolver_next_timeout_ms() elapses.
+// Resolver state is per thread: each thread that drives a SIP loop (the main
+// loop, or every SIP worker) calls dns_resolver_init() and uses only its own
+// socket and pending table. Callbacks fire on the thread that queued them.
+
+#define DNS_RESOLVER_MAX_PENDING    16   // Concurrent outstanding queries
+#define DNS_RESOLVER_RETRY_MS       1000 // Resend interval for unanswered queries
+#define DNS_RESOLVER_MAX_ATTEMPTS   3    // Give up after this many sends
+
+typedef enum {
+    DNS_RESOLVE_OK = 0,
+    DNS_RESOLVE_NOT_FOUND,  // NXDOMAIN or no A record in the answer
+    DNS_RESOLVE_TIMEOUT,
+    DNS_RESOLVE_ERROR       // SERVFAIL/REFUSED or malformed answer
+} dns_resolve_status_t;
+
+// Completion callback. addr is only valid for DNS_RESOLVE_OK; ttl is the
+// answer TTL in seconds (0 when unknown).
+typedef void (*dns_resolver_cb_t)(void *arg, dns_resolve_status_t status,
+                                  const struct in_addr *addr, uint32_t ttl);
+
+int dns_resolver_init(void);
+void dns_resolver_shutdown(void);
+int dns_resolver_get_fd(void);
+
+// Queue an A query. Returns 0 if queued (cb fires exactly once later),
+// -1 if the pending table is full or the query could not be sent.
+int dns_resolver_query_a(const char *hostname, dns_resolver_cb_t cb, void *arg);
+
+void dns_resolver_handle_readable(void);
+void dns_resolver_process_timeouts(void);
+
+// Milliseconds until the next retry/timeout is due, or -1 if nothing is pending
+int dns_resolver_next_timeout_ms(void);
+
+const char *dns_resolve_status_str(dns_resolve_status_t status);
+
+#endif // DNS_RESOLVER_H
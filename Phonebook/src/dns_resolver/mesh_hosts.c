@@ -0,0 +1,448 @@
+// dns_resolver/mesh_hosts.c - arednlink host files as an in-memory name table
+#include "mesh_hosts.h"
+#include <dirent.h>
+#include <strings.h> // For strcasecmp, strncasecmp
+#include <sys/inotify.h>
+
+#define MODULE_NAME "MESH_HOSTS"
+
+#define MESH_SUFFIX  "." AREDN_MESH_DOMAIN
+#define WATCH_MASK   (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct {
+    char name[MESH_HOSTS_MAX_NAME_LEN];  // As advertised: "1234", "lan.NODE", ...
+    struct in_addr addr;
+    struct in_addr advertiser;           // ##<ip>## block the line appeared in
+    uint32_t hash;
+    int32_t next_in_bucket;
+    int32_t next_in_file;                // Doubles as the free-list link
+} HostEntry;
+
+typedef struct {
+    bool in_use;
+    char name[MESH_HOSTS_MAX_NAME_LEN];
+    int32_t head;                        // Entries loaded from this file, -1 if none
+} HostFile;
+
+typedef struct {
+    char name[MESH_HOSTS_MAX_NAME_LEN];
+    struct in_addr addr;
+    struct in_addr advertiser;
+} ParsedHost;
+
+// Entries live in one array grown by doubling. Links are indices, so growing
+// does not invalidate them. Readers and the main loop share hosts_mutex, but
+// files are parsed before it is taken: a reload holds it only to relink.
+// Only the main loop changes files[], so it may read it without the mutex.
+static HostEntry *entries = NULL;
+static int32_t capacity = 0;
+static int32_t free_head = -1;
+static int32_t buckets[MESH_HOSTS_BUCKETS];
+static HostFile files[MESH_HOSTS_MAX_FILES];
+static int num_hosts = 0;
+static pthread_mutex_t hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Main loop only
+static int inotify_fd = -1;
+static int watch_wd = -1;
+static uint64_t next_scan_ms = 0;
+static char changed_files[MESH_HOSTS_MAX_FILES][MESH_HOSTS_MAX_NAME_LEN];
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a over the lower-cased name; hostnames compare case-insensitively
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)tolower((unsigned char)name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the number of hosts parsed into *out (caller frees), or -1 if the file cannot be read
+static int parse_host_file(const char *file_name, ParsedHost **out) {
+    char path[sizeof(MESH_HOSTS_DIR) + MESH_HOSTS_MAX_NAME_LEN + 1];
+    snprintf(path, sizeof(path), "%s/%s", MESH_HOSTS_DIR, file_name);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    ParsedHost *hosts = NULL;
+    int count = 0;
+    int cap = 0;
+    struct in_addr advertiser = { 0 };
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        // Block header line: "##<advertiser_mesh_ip>##"
+        if (line[0] == '#' && line[1] == '#') {
+            char block_ip[64];
+            if (sscanf(line, "##%63[^#]##", block_ip) != 1 || inet_pton(AF_INET, block_ip, &advertiser) != 1) {
+                advertiser.s_addr = 0;
+            }
+            continue;
+        }
+
+        // Format: "IP\tHOSTNAME" (simple hosts format)
+        char ip[32], name[256];
+        struct in_addr addr;
+        if (sscanf(line, "%31s %255s", ip, name) != 2 || inet_pton(AF_INET, ip, &addr) != 1) {
+            continue;
+        }
+        // Some names are advertised fully qualified; store them the way lookups strip them
+        size_t name_len = strlen(name);
+        size_t suffix_len = strlen(MESH_SUFFIX);
+        if (name_len > suffix_len && strcasecmp(name + name_len - suffix_len, MESH_SUFFIX) == 0) {
+            name_len -= suffix_len;
+            name[name_len] = '\0';
+        }
+        if (name_len >= MESH_HOSTS_MAX_NAME_LEN) {
+            continue;
+        }
+
+        if (count == cap) {
+            int new_cap = cap ? cap * 2 : 64;
+            ParsedHost *grown = realloc(hosts, (size_t)new_cap * sizeof(ParsedHost));
+            if (!grown) {
+                LOG_WARN("Out of memory reading '%s'; keeping the first %d hosts.", path, count);
+                break;
+            }
+            hosts = grown;
+            cap = new_cap;
+        }
+        ParsedHost *h = &hosts[count++];
+        snprintf(h->name, sizeof(h->name), "%s", name);
+        h->addr = addr;
+        h->advertiser = advertiser;
+    }
+    fclose(fp);
+    *out = hosts;
+    return count;
+}
+
+// Caller holds hosts_mutex. -1 when the table cannot grow.
+static int32_t alloc_entry(void) {
+    if (free_head < 0) {
+        int32_t new_cap = capacity ? capacity * 2 : 256;
+        HostEntry *grown = realloc(entries, (size_t)new_cap * sizeof(HostEntry));
+        if (!grown) {
+            return -1;
+        }
+        entries = grown;
+        for (int32_t i = new_cap - 1; i >= capacity; i--) {
+            entries[i].next_in_file = free_head;
+            free_head = i;
+        }
+        capacity = new_cap;
+    }
+    int32_t i = free_head;
+    free_head = entries[i].next_in_file;
+    return i;
+}
+
+// Caller holds hosts_mutex
+static void clear_file_entries(HostFile *f) {
+    int32_t i = f->head;
+    while (i >= 0) {
+        HostEntry *e = &entries[i];
+        int32_t *link = &buckets[e->hash & (MESH_HOSTS_BUCKETS - 1)];
+        while (*link != i) {
+            link = &entries[*link].next_in_bucket;
+        }
+        *link = e->next_in_bucket;
+
+        int32_t next = e->next_in_file;
+        e->next_in_file = free_head;
+        free_head = i;
+        num_hosts--;
+        i = next;
+    }
+    f->head = -1;
+}
+
+static HostFile *find_file(const char *file_name) {
+    for (int i = 0; i < MESH_HOSTS_MAX_FILES; i++) {
+        if (files[i].in_use && strcmp(files[i].name, file_name) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+// Swap one file's hosts for a freshly parsed set; count 0 forgets the file
+static void replace_file_hosts(const char *file_name, const ParsedHost *hosts, int count) {
+    HostFile *f = find_file(file_name);
+    if (!f && count == 0) {
+        return;
+    }
+    if (!f) {
+        for (int i = 0; i < MESH_HOSTS_MAX_FILES && !f; i++) {
+            if (!files[i].in_use) f = &files[i];
+        }
+        if (!f) {
+            LOG_WARN("More than %d host files in %s; ignoring '%s'.", MESH_HOSTS_MAX_FILES, MESH_HOSTS_DIR, file_name);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&hosts_mutex);
+    if (!f->in_use) {
+        f->in_use = true;
+        f->head = -1;
+        snprintf(f->name, sizeof(f->name), "%s", file_name);
+    }
+    clear_file_entries(f);
+    for (int n = 0; n < count; n++) {
+        int32_t i = alloc_entry();
+        if (i < 0) {
+            LOG_WARN("Out of memory loading mesh hosts; '%s' is incomplete.", file_name);
+            break;
+        }
+        HostEntry *e = &entries[i];
+        memcpy(e->name, hosts[n].name, sizeof(e->name));
+        e->addr = hosts[n].addr;
+        e->advertiser = hosts[n].advertiser;
+        e->hash = hash_name(e->name, strlen(e->name));
+        int32_t *bucket = &buckets[e->hash & (MESH_HOSTS_BUCKETS - 1)];
+        e->next_in_bucket = *bucket;
+        *bucket = i;
+        e->next_in_file = f->head;
+        f->head = i;
+        num_hosts++;
+    }
+    if (count == 0) {
+        f->in_use = false;
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+}
+
+// Re-read one file; a file that can no longer be opened is forgotten
+static void reload_file(const char *file_name) {
+    if (strlen(file_name) >= MESH_HOSTS_MAX_NAME_LEN) {
+        return;
+    }
+    ParsedHost *hosts = NULL;
+    int count = parse_host_file(file_name, &hosts);
+    replace_file_hosts(file_name, hosts, count > 0 ? count : 0);
+    free(hosts);
+}
+
+static void forget_all_files(void) {
+    for (int i = 0; i < MESH_HOSTS_MAX_FILES; i++) {
+        if (files[i].in_use) {
+            replace_file_hosts(files[i].name, NULL, 0);
+        }
+    }
+}
+
+static void rescan_all(void) {
+    DIR *dir = opendir(MESH_HOSTS_DIR);
+    if (!dir) {
+        forget_all_files();
+        return;
+    }
+
+    bool seen[MESH_HOSTS_MAX_FILES] = { false };
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        reload_file(entry->d_name);
+        HostFile *f = find_file(entry->d_name);
+        if (f) seen[f - files] = true;
+    }
+    closedir(dir);
+
+    for (int i = 0; i < MESH_HOSTS_MAX_FILES; i++) {
+        if (files[i].in_use && !seen[i]) {
+            replace_file_hosts(files[i].name, NULL, 0);
+        }
+    }
+}
+
+// Watch first, then scan: a change between the two is then never missed
+static void start_watch(void) {
+    next_scan_ms = now_ms() + MESH_HOSTS_RESCAN_MS;
+    if (inotify_fd >= 0) {
+        watch_wd = inotify_add_watch(inotify_fd, MESH_HOSTS_DIR, WATCH_MASK);
+        if (watch_wd < 0) {
+            LOG_DEBUG("Cannot watch %s yet: %s", MESH_HOSTS_DIR, strerror(errno));
+            forget_all_files();
+            return;
+        }
+    }
+    rescan_all();
+    LOG_INFO("Loaded %d mesh hosts from %s%s.", mesh_hosts_count(), MESH_HOSTS_DIR,
+             inotify_fd >= 0 ? "" : " (polling)");
+}
+
+int mesh_hosts_init(void) {
+    pthread_mutex_lock(&hosts_mutex);
+    for (int i = 0; i < MESH_HOSTS_BUCKETS; i++) {
+        buckets[i] = -1;
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        LOG_WARN("inotify unavailable (%s); rescanning %s every %d s.", strerror(errno),
+                 MESH_HOSTS_DIR, MESH_HOSTS_RESCAN_MS / 1000);
+    }
+    start_watch();
+    return inotify_fd >= 0 ? 0 : -1;
+}
+
+void mesh_hosts_shutdown(void) {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+        watch_wd = -1;
+    }
+    pthread_mutex_lock(&hosts_mutex);
+    free(entries);
+    entries = NULL;
+    capacity = 0;
+    free_head = -1;
+    num_hosts = 0;
+    memset(files, 0, sizeof(files));
+    for (int i = 0; i < MESH_HOSTS_BUCKETS; i++) {
+        buckets[i] = -1;
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+}
+
+int mesh_hosts_get_fd(void) {
+    return inotify_fd;
+}
+
+void mesh_hosts_handle_readable(void) {
+    // Collect the names first: one rewrite usually produces several events per file
+    char buf[2048] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int num_changed = 0;
+    bool rescan = false;
+    bool watch_lost = false;
+
+    for (;;) {
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                rescan = true;
+                continue;
+            }
+            if (ev->wd != watch_wd) continue;
+            if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                watch_lost = true;
+                continue;
+            }
+            if (ev->len == 0 || ev->name[0] == '.' || strlen(ev->name) >= MESH_HOSTS_MAX_NAME_LEN) continue;
+
+            bool known = false;
+            for (int i = 0; i < num_changed && !known; i++) {
+                known = (strcmp(changed_files[i], ev->name) == 0);
+            }
+            if (known) continue;
+            if (num_changed == MESH_HOSTS_MAX_FILES) {
+                rescan = true;
+                continue;
+            }
+            snprintf(changed_files[num_changed++], MESH_HOSTS_MAX_NAME_LEN, "%s", ev->name);
+        }
+    }
+
+    if (watch_lost) {
+        // arednlink restarted and recreated the directory, or it went away
+        LOG_INFO("%s disappeared; waiting for it to come back.", MESH_HOSTS_DIR);
+        inotify_rm_watch(inotify_fd, watch_wd);
+        watch_wd = -1;
+        forget_all_files();
+        next_scan_ms = now_ms();
+        return;
+    }
+    if (rescan) {
+        rescan_all();
+        return;
+    }
+    for (int i = 0; i < num_changed; i++) {
+        reload_file(changed_files[i]);
+    }
+    LOG_DEBUG("Reloaded %d host files; %d mesh hosts known.", num_changed, mesh_hosts_count());
+}
+
+int mesh_hosts_next_timeout_ms(void) {
+    if (inotify_fd >= 0 && watch_wd >= 0) {
+        return -1;
+    }
+    uint64_t now = now_ms();
+    return next_scan_ms > now ? (int)(next_scan_ms - now) : 0;
+}
+
+void mesh_hosts_process(void) {
+    if (mesh_hosts_next_timeout_ms() == 0) {
+        start_watch();
+    }
+}
+
+int mesh_hosts_lookup(const char *hostname, struct in_addr *addr) {
+    if (!hostname) {
+        return -1;
+    }
+    size_t len = strlen(hostname);
+    size_t suffix_len = strlen(MESH_SUFFIX);
+    if (len > suffix_len && strcasecmp(hostname + len - suffix_len, MESH_SUFFIX) == 0) {
+        len -= suffix_len;
+    }
+    if (len == 0 || len >= MESH_HOSTS_MAX_NAME_LEN) {
+        return -1;
+    }
+
+    uint32_t h = hash_name(hostname, len);
+    int result = -1;
+    pthread_mutex_lock(&hosts_mutex);
+    if (entries) {
+        for (int32_t i = buckets[h & (MESH_HOSTS_BUCKETS - 1)]; i >= 0; i = entries[i].next_in_bucket) {
+            const HostEntry *e = &entries[i];
+            if (e->hash == h && strncasecmp(e->name, hostname, len) == 0 && e->name[len] == '\0') {
+                if (addr) *addr = e->addr;
+                result = 0;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+    return result;
+}
+
+int mesh_hosts_list_advertised_by(struct in_addr advertiser, MeshHost *out, int max) {
+    int count = 0;
+    pthread_mutex_lock(&hosts_mutex);
+    for (int f = 0; f < MESH_HOSTS_MAX_FILES && count < max; f++) {
+        if (!files[f].in_use) continue;
+        for (int32_t i = files[f].head; i >= 0 && count < max; i = entries[i].next_in_file) {
+            if (entries[i].advertiser.s_addr == advertiser.s_addr) {
+                memcpy(out[count].name, entries[i].name, sizeof(out[count].name));
+                out[count].addr = entries[i].addr;
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+    return count;
+}
+
+int mesh_hosts_count(void) {
+    pthread_mutex_lock(&hosts_mutex);
+    int count = num_hosts;
+    pthread_mutex_unlock(&hosts_mutex);
+    return count;
+}
@@ -0,0 +1,51 @@
+// dns_resolver/mesh_hosts.h
+#ifndef MESH_HOSTS_H
+#define MESH_HOSTS_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// In-memory copy of the arednlink host database.
+// arednlink shards the hosts advertised on the mesh across index files in
+// MESH_HOSTS_DIR, each holding "##<advertiser_ip>##" blocks of
+// "<ip>\t<hostname>" lines. dnsmasq answers <hostname>.local.mesh from the
+// same files, so reading them directly turns a phone lookup into a hash probe
+// with no I/O. DNS stays the fallback for names not found here.
+// The main loop owns the inotify descriptor: it calls mesh_hosts_handle_readable()
+// when it fires, and only the files that changed are re-parsed. While the
+// directory does not exist yet (arednlink not up) or inotify is unavailable,
+// mesh_hosts_process() retries/rescans every MESH_HOSTS_RESCAN_MS.
+// Lookups are safe from any thread.
+
+#define MESH_HOSTS_DIR            "/var/run/arednlink/hosts"
+#define MESH_HOSTS_BUCKETS        1024  // Power of two
+#define MESH_HOSTS_MAX_FILES      64    // Index files tracked
+#define MESH_HOSTS_MAX_NAME_LEN   64    // Longer hostnames are skipped
+#define MESH_HOSTS_RESCAN_MS      30000
+
+typedef struct {
+    char name[MESH_HOSTS_MAX_NAME_LEN];
+    struct in_addr addr;
+} MeshHost;
+
+// Loads the files and starts watching. Returns -1 only if no inotify
+// descriptor could be created; the table then refreshes by rescanning.
+int mesh_hosts_init(void);
+void mesh_hosts_shutdown(void);
+int mesh_hosts_get_fd(void);
+void mesh_hosts_handle_readable(void);
+
+// Milliseconds until the next watch retry or rescan, or -1 if none is needed
+int mesh_hosts_next_timeout_ms(void);
+void mesh_hosts_process(void);
+
+// hostname may carry the ".local.mesh" suffix. Returns 0 and fills addr if
+// the mesh advertises the name, -1 if not (resolve it through DNS instead).
+int mesh_hosts_lookup(const char *hostname, struct in_addr *addr);
+
+// Copy up to max of the hosts advertised by the node at advertiser. Returns the count.
+int mesh_hosts_list_advertised_by(struct in_addr advertiser, MeshHost *out, int max);
+
+int mesh_hosts_count(void);
+
+#endif // MESH_HOSTS_H
@@ -0,0 +1,246 @@
+// event_loop/event_loop.c - epoll/timerfd/signalfd/eventfd reactor for the SIP main loop
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+#define MODULE_NAME "EVENT_LOOP"
+
+typedef struct {
+    bool in_use;
+    int fd;
+    event_loop_fd_cb_t cb;
+    void *arg;
+} FdHandler;
+
+typedef struct {
+    event_loop_next_timeout_fn_t next_timeout;
+    event_loop_expire_fn_t expire;
+} TimerSource;
+
+typedef struct {
+    int signo;
+    event_loop_signal_cb_t cb;
+} SignalHandler;
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int signal_fd = -1;
+static int wake_fd = -1;
+
+static FdHandler handlers[EVENT_LOOP_MAX_FDS];
+static TimerSource timer_sources[EVENT_LOOP_MAX_TIMERS];
+static int num_timer_sources = 0;
+static SignalHandler signal_handlers[EVENT_LOOP_MAX_SIGNALS];
+static int num_signal_handlers = 0;
+static sigset_t signal_mask;
+
+static void on_timer(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        LOG_WARN("timerfd read failed: %s", strerror(errno));
+    }
+    for (int i = 0; i < num_timer_sources; i++) {
+        timer_sources[i].expire();
+    }
+}
+
+static void on_wakeup(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    uint64_t count;
+    // Nothing else to do: the timer is re-armed on every pass through the loop
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LOG_WARN("eventfd read failed: %s", strerror(errno));
+    }
+}
+
+static void on_signal(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+        for (int i = 0; i < num_signal_handlers; i++) {
+            if (signal_handlers[i].signo == (int)info.ssi_signo) {
+                signal_handlers[i].cb((int)info.ssi_signo);
+            }
+        }
+    }
+}
+
+// Arm the timerfd for the earliest pending timer source, or disarm it
+static void arm_timer(void) {
+    int next_ms = -1;
+    for (int i = 0; i < num_timer_sources; i++) {
+        int ms = timer_sources[i].next_timeout();
+        if (ms >= 0 && (next_ms < 0 || ms < next_ms)) {
+            next_ms = ms;
+        }
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (next_ms == 0) {
+        spec.it_value.tv_nsec = 1; // Already due; an all-zero it_value would disarm
+    } else if (next_ms > 0) {
+        spec.it_value.tv_sec = next_ms / 1000;
+        spec.it_value.tv_nsec = (long)(next_ms % 1000) * 1000000L;
+    }
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) < 0) {
+        LOG_ERROR("timerfd_settime failed: %s", strerror(errno));
+    }
+}
+
+int event_loop_init(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOG_ERROR("epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (timer_fd < 0 || wake_fd < 0) {
+        LOG_ERROR("timerfd/eventfd creation failed: %s", strerror(errno));
+        event_loop_shutdown();
+        return -1;
+    }
+    if (event_loop_add_fd(timer_fd, EPOLLIN, on_timer, NULL) != 0 ||
+        event_loop_add_fd(wake_fd, EPOLLIN, on_wakeup, NULL) != 0) {
+        event_loop_shutdown();
+        return -1;
+    }
+    sigemptyset(&signal_mask);
+    LOG_DEBUG("Event loop initialized (epoll fd %d).", epoll_fd);
+    return 0;
+}
+
+void event_loop_shutdown(void) {
+    if (signal_fd >= 0) close(signal_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    if (timer_fd >= 0) close(timer_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+    signal_fd = wake_fd = timer_fd = epoll_fd = -1;
+    memset(handlers, 0, sizeof(handlers));
+    num_timer_sources = 0;
+    num_signal_handlers = 0;
+}
+
+int event_loop_add_fd(int fd, uint32_t events, event_loop_fd_cb_t cb, void *arg) {
+    if (epoll_fd < 0 || fd < 0 || !cb) {
+        return -1;
+    }
+    FdHandler *h = NULL;
+    for (int i = 0; i < EVENT_LOOP_MAX_FDS; i++) {
+        if (!handlers[i].in_use) {
+            h = &handlers[i];
+            break;
+        }
+    }
+    if (!h) {
+        LOG_ERROR("No free event loop slot for fd %d.", fd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = h;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR("epoll_ctl(ADD, %d) failed: %s", fd, strerror(errno));
+        return -1;
+    }
+    h->in_use = true;
+    h->fd = fd;
+    h->cb = cb;
+    h->arg = arg;
+    return 0;
+}
+
+int event_loop_remove_fd(int fd) {
+    for (int i = 0; i < EVENT_LOOP_MAX_FDS; i++) {
+        if (handlers[i].in_use && handlers[i].fd == fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            handlers[i].in_use = false; // Events already fetched for it are skipped
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int event_loop_add_timer_source(event_loop_next_timeout_fn_t next_timeout, event_loop_expire_fn_t expire) {
+    if (num_timer_sources >= EVENT_LOOP_MAX_TIMERS || !next_timeout || !expire) {
+        return -1;
+    }
+    timer_sources[num_timer_sources].next_timeout = next_timeout;
+    timer_sources[num_timer_sources].expire = expire;
+    num_timer_sources++;
+    return 0;
+}
+
+int event_loop_add_signal(int signo, event_loop_signal_cb_t cb) {
+    if (epoll_fd < 0 || num_signal_handlers >= EVENT_LOOP_MAX_SIGNALS || !cb) {
+        return -1;
+    }
+
+    sigset_t one;
+    sigemptyset(&one);
+    sigaddset(&one, signo);
+    pthread_sigmask(SIG_BLOCK, &one, NULL);
+    sigaddset(&signal_mask, signo);
+
+    if (signal_fd < 0) {
+        signal_fd = signalfd(-1, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0 || event_loop_add_fd(signal_fd, EPOLLIN, on_signal, NULL) != 0) {
+            LOG_ERROR("signalfd setup failed: %s", strerror(errno));
+            if (signal_fd >= 0) close(signal_fd);
+            signal_fd = -1;
+            sigdelset(&signal_mask, signo);
+            pthread_sigmask(SIG_UNBLOCK, &one, NULL);
+            return -1;
+        }
+    } else if (signalfd(signal_fd, &signal_mask, 0) < 0) {
+        LOG_ERROR("signalfd update for signal %d failed: %s", signo, strerror(errno));
+        sigdelset(&signal_mask, signo);
+        pthread_sigmask(SIG_UNBLOCK, &one, NULL);
+        return -1;
+    }
+
+    signal_handlers[num_signal_handlers].signo = signo;
+    signal_handlers[num_signal_handlers].cb = cb;
+    num_signal_handlers++;
+    return 0;
+}
+
+void event_loop_wakeup(void) {
+    if (wake_fd >= 0) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARN("eventfd write failed: %s", strerror(errno));
+        }
+    }
+}
+
+int event_loop_run(volatile sig_atomic_t *keep_running) {
+    struct epoll_event events[EVENT_LOOP_MAX_FDS];
+
+    while (*keep_running) {
+        arm_timer();
+
+        int n = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_FDS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue; // A signal that still has a sigaction() handler
+            }
+            LOG_ERROR("epoll_wait() error: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            FdHandler *h = events[i].data.ptr;
+            if (h->in_use) {
+                h->cb(h->fd, events[i].events, h->arg);
+            }
+        }
+    }
+    return 0;
+}
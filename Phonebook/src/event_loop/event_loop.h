@@ -0,0 +1,49 @@
+// event_loop/event_loop.h
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// epoll reactor for the SIP main thread.
+// Sockets are registered with a callback and dispatched when readable.
+// Timer sources report how long until they next need to run; one timerfd
+// is armed for the earliest of them, so the loop sleeps until there is
+// actual work instead of polling. Signals arrive through a signalfd and
+// other threads can wake the loop through an eventfd.
+// Everything except event_loop_wakeup() must be called from the loop thread.
+
+#define EVENT_LOOP_MAX_FDS      48  // SIP_TCP_MAX_CONNECTIONS plus the loop's own sockets
+#define EVENT_LOOP_MAX_TIMERS   8
+#define EVENT_LOOP_MAX_SIGNALS  8
+
+typedef void (*event_loop_fd_cb_t)(int fd, uint32_t events, void *arg);
+typedef void (*event_loop_signal_cb_t)(int signo);
+
+// Milliseconds until the source next needs to run, or -1 if it has nothing pending
+typedef int (*event_loop_next_timeout_fn_t)(void);
+// Run whatever is due; called whenever the timer fires
+typedef void (*event_loop_expire_fn_t)(void);
+
+int event_loop_init(void);
+void event_loop_shutdown(void);
+
+// events is an EPOLLIN/EPOLLOUT mask. Returns 0 on success, -1 on failure.
+int event_loop_add_fd(int fd, uint32_t events, event_loop_fd_cb_t cb, void *arg);
+int event_loop_remove_fd(int fd);
+
+int event_loop_add_timer_source(event_loop_next_timeout_fn_t next_timeout, event_loop_expire_fn_t expire);
+
+// Route signo to cb through the signalfd. Blocks signo in the calling thread;
+// worker threads must already have it blocked. Returns -1 if signalfd is
+// unavailable, in which case the caller keeps its sigaction() handlers.
+int event_loop_add_signal(int signo, event_loop_signal_cb_t cb);
+
+// Thread-safe: make the loop re-evaluate its timers (e.g. after another
+// thread changed state that a timer source reports on)
+void event_loop_wakeup(void);
+
+// Dispatch events until *keep_running goes false. Returns 0, or -1 on epoll failure.
+int event_loop_run(volatile sig_atomic_t *keep_running);
+
+#endif // EVENT_LOOP_H
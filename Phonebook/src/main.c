@@ -19,6 +19,16 @@
 // It's good practice to include specific module headers for their prototypes,
 // even if common.h might also declare some. This helps with modularity.
 #include "sip_core/sip_core.h"          // For process_incoming_sip_message, etc.
+#include "sip_core/sip_transport.h"     // For batched SIP socket I/O
+#include "sip_core/sip_tcp.h"           // SIP over TCP listener and connections
+#include "sip_core/sip_overload.h"      // Backlog and latency for overload control
+#include "sip_core/sip_priority.h"      // Method lanes within a receive batch
+#include "sip_core/sip_ratelimit.h"     // Per-source token buckets
+#include "dns_resolver/dns_resolver.h"  // For non-blocking INVITE routing lookups
+#include "dns_resolver/mesh_hosts.h"    // arednlink host files, consulted before DNS
+#include "event_loop/event_loop.h"      // epoll reactor driving the main loop
+#include "sip_workers/sip_workers.h"    // Optional Call-ID sharded SIP worker threads
+#include <sys/epoll.h>                  // For EPOLLIN
 #include "phonebook_fetcher/phonebook_fetcher.h" // For phonebook_fetcher_thread, etc.
 #include "status_updater/status_updater.h"   // For status_updater_thread, etc.
 #include "user_manager/user_manager.h"   // For user management functions
@@ -34,9 +44,10 @@
 // Define MODULE_NAME specific to main.c
 #define MODULE_NAME "MAIN"
 
-// Global arrays for registered users and call sessions (DEFINED here)
-RegisteredUser registered_users[MAX_REGISTERED_USERS];
-CallSession call_sessions[MAX_CALL_SESSIONS];
+// Registered users live in user_manager.c; call sessions live in call_sessions.c
+
+// Datagrams drained from the SIP socket per wakeup (static: too large for the stack)
+static sip_datagram_t sip_rx_batch[SIP_BATCH_MAX];
 
 // Other global variables (DEFINED here)
 volatile sig_atomic_t g_keep_running = 1; // Global shutdown flag for graceful termination
@@ -73,9 +84,87 @@ void shutdown_signal_handler(int sig) {
     g_keep_running = 0;
 }
 
+// Event loop callbacks (main thread)
+static void on_shutdown_signal(int signo) {
+    LOG_INFO("Received signal %d, shutting down.", signo);
+    g_keep_running = 0;
+}
+
+// Relay the webhook reload request to the fetcher via condvar
+static void on_reload_signal(int signo) {
+    (void)signo;
+    phonebook_reload_requested = 1; // The fetcher thread resets it
+    pthread_mutex_lock(&fetcher_wake_mutex);
+    pthread_cond_signal(&fetcher_wake_cond);
+    pthread_mutex_unlock(&fetcher_wake_mutex);
+}
+
+// Drain what is queued on the SIP socket and answer it all in one sendmmsg()
+static void on_sip_readable(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    int count = sip_transport_recv_batch(fd, sip_rx_batch, SIP_BATCH_MAX);
+    if (count < 0) {
+        LOG_ERROR("recvmmsg failed on SIP socket: %s", strerror(errno));
+        return;
+    }
+
+    // Over-rate sources are turned away before anything is parsed (their len becomes 0)
+    sip_ratelimit_filter(fd, sip_rx_batch, count);
+
+    // Hangups and call setup first, keepalives last
+    int order[SIP_BATCH_MAX];
+    sip_priority_order(sip_rx_batch, count, order);
+
+    // Worker mode: steer each datagram to the worker owning its Call-ID, one wakeup per worker
+    if (sip_workers_enabled()) {
+        sip_overload_note_backlog(count, sip_workers_queued());
+        for (int i = 0; i < count; i++) {
+            sip_workers_dispatch(&sip_rx_batch[order[i]]);
+        }
+        sip_workers_kick();
+        return;
+    }
+
+    sip_overload_note_backlog(count, 0);
+    uint64_t started_us = sip_overload_now_us();
+    sip_transport_begin_batch();
+    for (int i = 0; i < count; i++) {
+        const sip_datagram_t *d = &sip_rx_batch[order[i]];
+        process_incoming_sip_message(fd, d->buffer, d->len, &d->addr, d->addr_len);
+    }
+    sip_transport_flush();
+    sip_overload_note_processing(started_us, count);
+}
+
+static void on_dns_readable(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    dns_resolver_handle_readable();
+}
+
+static void on_mesh_hosts_readable(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    mesh_hosts_handle_readable();
+}
+
+static void on_softphone_readable(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    char softphone_buffer[MAX_SIP_MSG_LEN];
+    ssize_t n = recvfrom(fd, softphone_buffer, sizeof(softphone_buffer) - 1, 0, NULL, NULL);
+    if (n > 0) {
+        softphone_buffer[n] = '\0';
+        softphone_process_response(softphone_buffer, n);
+    } else if (n < 0) {
+        LOG_ERROR("recvfrom failed on softphone socket.");
+    }
+}
+
+static void softphone_timer_expired(void) {
+    softphone_check_timeout();
+}
+
 // sockaddr_to_ip_str prototype is in common.h, definition remains here
 const char* sockaddr_to_ip_str(const struct sockaddr_in* addr) {
-    static char ip_str[INET_ADDRSTRLEN];
+    static __thread char ip_str[INET_ADDRSTRLEN]; // Per thread: SIP workers log concurrently
     if (addr == NULL) return "NULL_ADDR";
     inet_ntop(AF_INET, &(addr->sin_addr), ip_str, sizeof(ip_str));
     return ip_str;
@@ -150,14 +239,8 @@ static int get_server_ip(char *ip_buffer, size_t buffer_size) {
 
 int main(int argc, char *argv[]) {
     int sockfd;
-    struct sockaddr_in servaddr, cliaddr; // Defined here
-    char buffer[MAX_SIP_MSG_LEN]; // Max SIP message length
-    socklen_t len; // socklen_t defined in common.h through sys/socket.h
-    ssize_t n;
-    fd_set readfds;
-    struct timeval tv;
+    struct sockaddr_in servaddr; // Defined here
     int reuse_addr = 1;
-    int retval;
 
     log_init(APP_NAME); // APP_NAME is defined in common.h
     LOG_INFO("Starting main function for %s process (PID %d).", MODULE_NAME, getpid());
@@ -185,7 +268,7 @@ int main(int argc, char *argv[]) {
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = shutdown_signal_handler;
     sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0; // No SA_RESTART — allow select/sleep to be interrupted
+    sa.sa_flags = 0; // No SA_RESTART — allow epoll_wait/sleep to be interrupted
     sigaction(SIGTERM, &sa, NULL);
     sigaction(SIGINT, &sa, NULL);
     LOG_INFO("Registered SIGTERM/SIGINT handlers for graceful shutdown");
@@ -286,6 +369,21 @@ int main(int argc, char *argv[]) {
     }
     LOG_DEBUG("Existing public XML file checked/deleted.");
 
+    // Before any worker thread starts: passive safety and health reporting read the table
+    LOG_INFO("Initializing call sessions table...");
+    init_call_sessions();
+    start_active_calls_publisher(); // Falls back to synchronous export on failure
+    LOG_DEBUG("Call sessions table initialized.");
+
+    // Before the fetcher merges in the directory and before port 5060 opens
+    init_registered_users_table();
+    if (g_registration_snapshot_seconds > 0) {
+        registration_snapshot_load();
+    }
+
+    // Before the topology crawler starts: it harvests phones from this table
+    mesh_hosts_init(); // Falls back to periodic rescans without inotify
+
     // Block signals in worker threads - only main thread should handle signals
     sigset_t block_mask, old_mask;
     sigemptyset(&block_mask);
@@ -345,12 +443,18 @@ int main(int argc, char *argv[]) {
     LOG_INFO("Health reporter thread launched.");
     LOG_DEBUG("Health reporter thread TID: %lu", (unsigned long)health_reporter_tid);
 
-    // Restore signal mask for main thread (worker threads inherit blocked mask)
-    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
-
-    LOG_INFO("Initializing call sessions table...");
-    init_call_sessions();
-    LOG_DEBUG("Call sessions table initialized.");
+    // The main thread keeps the signals blocked too: they are read from a signalfd
+    if (event_loop_init() != 0) {
+        LOG_ERROR("Event loop init failed.");
+        return EXIT_FAILURE;
+    }
+    if (event_loop_add_signal(SIGTERM, on_shutdown_signal) != 0 ||
+        event_loop_add_signal(SIGINT, on_shutdown_signal) != 0 ||
+        event_loop_add_signal(SIGUSR1, on_reload_signal) != 0) {
+        // Fall back to the sigaction() handlers; they interrupt epoll_wait() with EINTR
+        LOG_WARN("signalfd unavailable; using signal handlers in the main thread.");
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    }
 
     LOG_INFO("Creating SIP UDP socket...");
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
@@ -377,6 +481,26 @@ int main(int argc, char *argv[]) {
     }
     LOG_INFO("Successfully bound to UDP port %d.", SIP_PORT);
 
+    if (sip_core_init() != 0) {
+        LOG_ERROR("SIP response templates could not be compiled.");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < SIP_BATCH_MAX; i++) {
+        if (sip_datagram_alloc(&sip_rx_batch[i]) != 0) {
+            LOG_ERROR("Failed to allocate SIP receive buffers (%d bytes each).", g_sip_max_message_size);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // INVITE routing resolves callee hostnames through this; the main loop never blocks on DNS
+    if (dns_resolver_init() != 0) {
+        LOG_ERROR("DNS resolver init failed. INVITEs will be rejected with 503.");
+    }
+
+    if (g_sip_worker_threads > 0 && sip_workers_start(sockfd, g_sip_worker_threads) != 0) {
+        LOG_WARN("No SIP worker threads started; processing SIP in the main loop.");
+    }
+
     // Phase 5: Initialize softphone module (after SIP server is bound)
     LOG_INFO("[MAIN] Initializing softphone module");
     int have_server_ip = 0;
@@ -398,75 +522,34 @@ int main(int argc, char *argv[]) {
     syslog(6, "[MAIN_LOOP] Server listening on UDP port %d", SIP_PORT);
     syslog(6, "[MAIN_LOOP] Entering main loop");
 
-    int timeout_count = 0; // Counter for select timeout logging
-
-    while (g_keep_running) { // Check shutdown flag for graceful termination
-        len = sizeof(cliaddr);
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-
-        // Phase 5: Add softphone socket to select if initialized
-        int max_fd = sockfd;
-        if (have_server_ip && softphone_get_sockfd() >= 0) {
-            FD_SET(softphone_get_sockfd(), &readfds);
-            if (softphone_get_sockfd() > max_fd) {
-                max_fd = softphone_get_sockfd();
-            }
-        }
-
-        tv.tv_sec = 1; tv.tv_usec = 0;
-        retval = select(max_fd + 1, &readfds, NULL, NULL, &tv);
-
-        // Check if SIGUSR1 set the reload flag — relay to fetcher via condvar
-        if (phonebook_reload_requested) {
-            pthread_mutex_lock(&fetcher_wake_mutex);
-            pthread_cond_signal(&fetcher_wake_cond);
-            pthread_mutex_unlock(&fetcher_wake_mutex);
-            // Don't reset the flag here — the fetcher thread resets it
-        }
-
-        if (retval < 0) {
-            if (errno == EINTR) {
-                syslog(7, "[MAIN_LOOP] select() interrupted by signal (EINTR), continuing...");
-                continue; // Signal interrupted select, continue loop
-            }
-            LOG_ERROR("select() error: %s", strerror(errno));
-            break; // Exit on real select error
-        } else if (retval == 0) {
-            // Timeout - no activity
-            continue;
-        }
-
-        // Handle SIP server socket
-        if (FD_ISSET(sockfd, &readfds)) {
-            n = recvfrom(sockfd, buffer, MAX_SIP_MSG_LEN - 1, 0,
-                         (struct sockaddr*)&cliaddr, &len);
-            if (n < 0) {
-                // if (errno == EINTR) continue; // REMOVED
-                LOG_ERROR("recvfrom failed on SIP socket.");
-                continue;
-            }
-            buffer[n] = '\0';
-
-            process_incoming_sip_message(sockfd, buffer, n, &cliaddr, len);
-        }
-
-        // Phase 5: Handle softphone socket responses
-        if (have_server_ip && softphone_get_sockfd() >= 0 && FD_ISSET(softphone_get_sockfd(), &readfds)) {
-            char softphone_buffer[MAX_SIP_MSG_LEN];
-            n = recvfrom(softphone_get_sockfd(), softphone_buffer, sizeof(softphone_buffer) - 1, 0, NULL, NULL);
-            if (n > 0) {
-                softphone_buffer[n] = '\0';
-                softphone_process_response(softphone_buffer, n);
-            } else if (n < 0) {
-                LOG_ERROR("recvfrom failed on softphone socket.");
-            }
+    if (event_loop_add_fd(sockfd, EPOLLIN, on_sip_readable, NULL) != 0) {
+        LOG_ERROR("Failed to register SIP socket with the event loop.");
+        return EXIT_FAILURE;
+    }
+    event_loop_add_timer_source(registration_expiry_next_timeout_ms, registration_expiry_process);
+    event_loop_add_timer_source(registration_snapshot_next_timeout_ms, registration_snapshot_process);
+    if (g_sip_tcp_enabled) {
+        if (sip_tcp_start(sockfd) == 0) {
+            event_loop_add_timer_source(sip_tcp_next_timeout_ms, sip_tcp_process_timeouts);
+        } else {
+            LOG_WARN("SIP over TCP unavailable; serving UDP only.");
         }
+    }
+    if (dns_resolver_get_fd() >= 0) {
+        event_loop_add_fd(dns_resolver_get_fd(), EPOLLIN, on_dns_readable, NULL);
+        event_loop_add_timer_source(dns_resolver_next_timeout_ms, dns_resolver_process_timeouts);
+    }
+    if (mesh_hosts_get_fd() >= 0) {
+        event_loop_add_fd(mesh_hosts_get_fd(), EPOLLIN, on_mesh_hosts_readable, NULL);
+    }
+    event_loop_add_timer_source(mesh_hosts_next_timeout_ms, mesh_hosts_process);
+    if (have_server_ip && softphone_get_sockfd() >= 0) {
+        event_loop_add_fd(softphone_get_sockfd(), EPOLLIN, on_softphone_readable, NULL);
+        event_loop_add_timer_source(softphone_next_timeout_ms, softphone_timer_expired);
+    }
 
-        // Phase 5: Check softphone timeout periodically (every select cycle)
-        if (have_server_ip) {
-            softphone_check_timeout();
-        }
+    if (event_loop_run(&g_keep_running) != 0) {
+        LOG_ERROR("Event loop failed; shutting down.");
     }
 
     // Graceful shutdown sequence
@@ -478,6 +561,14 @@ int main(int argc, char *argv[]) {
         softphone_shutdown();
     }
 
+    sip_workers_stop();
+    sip_tcp_stop(); // After the workers: they may still be sending
+    if (g_registration_snapshot_seconds > 0) {
+        registration_snapshot_save(); // After the workers: no REGISTER is in flight
+    }
+    stop_active_calls_publisher(); // Flushes the last call-state change
+    dns_resolver_shutdown();
+    event_loop_shutdown();
     close(sockfd);
     LOG_INFO("SIP socket closed");
 
@@ -531,6 +622,7 @@ int main(int argc, char *argv[]) {
     }
 
     LOG_INFO("All worker threads terminated successfully");
+    mesh_hosts_shutdown(); // Last reader gone
 
     // Shutdown health monitoring system
     LOG_INFO("Shutting down software health monitoring system...");
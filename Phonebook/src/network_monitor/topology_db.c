@@ -8,6 +8,7 @@
 #include "http_client.h"
 #include "../common.h"
 #include "../file_utils/file_utils.h"
+#include "../dns_resolver/mesh_hosts.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -20,7 +21,6 @@
 #include <arpa/inet.h>
 #include <math.h>
 #include <time.h>
-#include <dirent.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -34,6 +34,8 @@ static int g_connection_count = 0;
 static pthread_mutex_t g_topology_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool g_initialized = false;
 
+#define TOPOLOGY_MAX_HOSTS_PER_ROUTER 256  // Hosts one router advertises
+
 // IP to hostname mapping (for tunnel IPs and all interfaces)
 #define MAX_IP_MAPPINGS 2000
 typedef struct {
@@ -908,137 +910,82 @@ static int fetch_lqm_links_from_host(const char *hostname, char *neighbors_buf,
 }
 
 /**
- * Helper: Fetch phones for a specific router from Babel host files
+ * Helper: Fetch phones for a specific router from the arednlink host table
  * Positions phones 100m from their router at deterministic angles
  */
 static int fetch_phones_for_router(const char *router_hostname, const char *router_lat, const char *router_lon) {
     int phone_count = 0;
 
     // Resolve router hostname to mesh IP for advertiser matching
-    struct hostent *he = gethostbyname2((router_hostname + strspn(router_hostname, " \t")), AF_INET);
-    if (!he) {
-        return 0;
+    const char *router_name = router_hostname + strspn(router_hostname, " \t");
+    struct in_addr router_addr;
+    if (mesh_hosts_lookup(router_name, &router_addr) != 0) {
+        struct hostent *he = gethostbyname2(router_name, AF_INET);
+        if (!he || he->h_addr_list[0] == NULL) {
+            return 0;
+        }
+        memcpy(&router_addr, he->h_addr_list[0], sizeof(router_addr));
     }
 
-    struct in_addr **addr_list = (struct in_addr **)he->h_addr_list;
-    if (addr_list[0] == NULL) {
+    // Hosts come from the in-memory copy of the arednlink host files
+    // (/var/run/arednlink/hosts/) kept by mesh_hosts.c. Those files hold one
+    // "##<router_mesh_ip>##" block per advertising router; we want the
+    // phones (numeric hostnames) in our router's block.
+    MeshHost *hosts = malloc(TOPOLOGY_MAX_HOSTS_PER_ROUTER * sizeof(MeshHost));
+    if (!hosts) {
         return 0;
     }
+    int host_count = mesh_hosts_list_advertised_by(router_addr, hosts, TOPOLOGY_MAX_HOSTS_PER_ROUTER);
 
-    char router_mesh_ip[32];
-    snprintf(router_mesh_ip, sizeof(router_mesh_ip), "%s", inet_ntoa(*addr_list[0]));
-
-    // Read arednlink host files (/var/run/arednlink/hosts/).
-    //
-    // AREDN 4.x (post-OLSR arednlink) changed this layout: instead of one file
-    // per router named by its mesh IP, host data is now sharded across index
-    // files (0, 1, 2, ...), each containing multiple per-advertiser blocks:
-    //
-    //     ##<router_mesh_ip>##
-    //     <router_mesh_ip>\t<ROUTER-NAME>
-    //     <ip>\t<alias>
-    //     <ip>\t<phone_number>          <- phones = numeric hostnames
-    //     <blank line>
-    //     ##<next_router_mesh_ip>##
-    //     ...
-    //
-    // So we can no longer key off the filename; we track the current block's
-    // ##<ip>## header and only harvest phones while inside our router's block.
-    DIR *hosts_dir = opendir("/var/run/arednlink/hosts");
-    if (hosts_dir) {
-        struct dirent *entry;
-        while ((entry = readdir(hosts_dir)) != NULL) {
-            // Skip "." and ".."
-            if (entry->d_name[0] == '.') continue;
-
-            // Build full path to host file
-            char host_file_path[512];
-            snprintf(host_file_path, sizeof(host_file_path), "/var/run/arednlink/hosts/%s", entry->d_name);
-
-            // Open and read the host file
-            FILE *host_fp = fopen(host_file_path, "r");
-            if (!host_fp) continue;
-
-            bool in_router_block = false;  // currently inside our router's ##ip## block?
-            char line[1024];
-            while (fgets(line, sizeof(line), host_fp)) {
-                // Block header line: "##<advertiser_mesh_ip>##"
-                if (line[0] == '#' && line[1] == '#') {
-                    char block_ip[64];
-                    if (sscanf(line, "##%63[^#]##", block_ip) == 1) {
-                        in_router_block = (strcmp(block_ip, router_mesh_ip) == 0);
-                    } else {
-                        in_router_block = false;
-                    }
-                    continue;
-                }
-
-                // Skip blank lines but stay within the current block
-                if (line[0] == '\n' || line[0] == '\0') continue;
-
-                // Only harvest phones from our router's block
-                if (!in_router_block) continue;
-
-                // Format: "IP\tHOSTNAME" (simple hosts format)
-                char device_ip[32], device_name[256];
-                int parsed = sscanf(line, "%31s %255s", device_ip, device_name);
-
-                if (parsed != 2) continue;
-
-                // Strip prefixes from device name
-                char clean_device_name[256];
-                strip_hostname_prefix_internal(device_name, clean_device_name, sizeof(clean_device_name));
-
-                // Check if this is a phone (numeric hostname)
-                bool is_numeric = true;
-                bool has_digits = false;
-                for (char *p = clean_device_name; *p; p++) {
-                    if (isdigit((unsigned char)*p)) {
-                        has_digits = true;
-                    } else if (*p != '-') {
-                        is_numeric = false;
-                        break;
-                    }
-                }
-
-                if (!is_numeric || !has_digits || strlen(clean_device_name) < 4) {
-                    continue;  // Not a phone
-                }
+    for (int h = 0; h < host_count; h++) {
+        // Strip prefixes from device name
+        char clean_device_name[256];
+        strip_hostname_prefix_internal(hosts[h].name, clean_device_name, sizeof(clean_device_name));
 
-                char phone_lat_str[32] = "";
-                char phone_lon_str[32] = "";
+        // Check if this is a phone (numeric hostname)
+        bool is_numeric = true;
+        bool has_digits = false;
+        for (char *p = clean_device_name; *p; p++) {
+            if (isdigit((unsigned char)*p)) {
+                has_digits = true;
+            } else if (*p != '-') {
+                is_numeric = false;
+                break;
+            }
+        }
 
-                if (strlen(router_lat) > 0 && strlen(router_lon) > 0) {
-                    int angle = get_phone_angle(clean_device_name);
-                    double r_lat = atof(router_lat);
-                    double r_lon = atof(router_lon);
-                    double phone_lat, phone_lon;
+        if (!is_numeric || !has_digits || strlen(clean_device_name) < 4) {
+            continue;  // Not a phone
+        }
 
-                    offset_coordinates(r_lat, r_lon, 100.0, angle, &phone_lat, &phone_lon);
+        char phone_lat_str[32] = "";
+        char phone_lon_str[32] = "";
 
-                    snprintf(phone_lat_str, sizeof(phone_lat_str), "%.7f", phone_lat);
-                    snprintf(phone_lon_str, sizeof(phone_lon_str), "%.7f", phone_lon);
-                }
+        if (strlen(router_lat) > 0 && strlen(router_lon) > 0) {
+            int angle = get_phone_angle(clean_device_name);
+            double r_lat = atof(router_lat);
+            double r_lon = atof(router_lon);
+            double phone_lat, phone_lon;
 
-                int add_result = topology_db_add_node(clean_device_name, "phone",
-                                                      strlen(phone_lat_str) > 0 ? phone_lat_str : NULL,
-                                                      strlen(phone_lon_str) > 0 ? phone_lon_str : NULL,
-                                                      "ONLINE");
-                if (add_result == 0) {
-                    topology_db_add_connection(router_hostname, clean_device_name, 0.1);
-                    phone_count++;
-                }
-            }
+            offset_coordinates(r_lat, r_lon, 100.0, angle, &phone_lat, &phone_lon);
 
-            fclose(host_fp);
+            snprintf(phone_lat_str, sizeof(phone_lat_str), "%.7f", phone_lat);
+            snprintf(phone_lon_str, sizeof(phone_lon_str), "%.7f", phone_lon);
         }
-        closedir(hosts_dir);
 
-        if (phone_count > 0) {
-            LOG_INFO("Added %d phones for router %s from arednlink hosts", phone_count, router_hostname);
+        int add_result = topology_db_add_node(clean_device_name, "phone",
+                                              strlen(phone_lat_str) > 0 ? phone_lat_str : NULL,
+                                              strlen(phone_lon_str) > 0 ? phone_lon_str : NULL,
+                                              "ONLINE");
+        if (add_result == 0) {
+            topology_db_add_connection(router_hostname, clean_device_name, 0.1);
+            phone_count++;
         }
-    } else {
-        LOG_DEBUG("Could not open /var/run/arednlink/hosts directory");
+    }
+    free(hosts);
+
+    if (phone_count > 0) {
+        LOG_INFO("Added %d phones for router %s from arednlink hosts", phone_count, router_hostname);
     }
 
     return phone_count;
@@ -6,6 +6,7 @@
 
 #include "traceroute.h"
 #include "../common.h"
+#include "../dns_resolver/dns_cache.h"
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -269,21 +270,14 @@ int traceroute_to_phone(const char *phone_number, int max_hops,
     char hostname[128];
     snprintf(hostname, sizeof(hostname), "%s.%s", phone_number, AREDN_MESH_DOMAIN);
 
-    struct addrinfo hints = {0};
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-    struct addrinfo *res = NULL;
-
-    int status = getaddrinfo(hostname, NULL, &hints, &res);
-    if (status != 0) {
-        LOG_WARN("Failed to resolve %s: %s", hostname, gai_strerror(status));
+    struct sockaddr_in target_addr;
+    memset(&target_addr, 0, sizeof(target_addr));
+    target_addr.sin_family = AF_INET;
+    if (dns_cache_resolve(hostname, &target_addr.sin_addr) != 0) {
+        LOG_WARN("Failed to resolve %s", hostname);
         return -1;
     }
 
-    struct sockaddr_in target_addr;
-    memcpy(&target_addr, res->ai_addr, sizeof(target_addr));
-    freeaddrinfo(res);
-
     char target_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &target_addr.sin_addr, target_ip, sizeof(target_ip));
     LOG_INFO("Resolved %s to %s", phone_number, target_ip);
@@ -22,27 +22,13 @@ volatile sig_atomic_t g_updater_restart_requested = 0;
 
 // 1. CALL SESSION CLEANUP - Remove stale call sessions that consume resources
 void passive_cleanup_stale_call_sessions(void) {
-    time_t now = time(NULL);
-    int cleaned_count = 0;
-
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (call_sessions[i].in_use) {
-            // Clean up sessions older than 24 hours (safety net for truly lost BYE)
-            // With Record-Route enabled, BYE messages should route through proxy
-            // This timeout is only a safety net for exceptional cases
-            time_t session_age = now - call_sessions[i].creation_time;
-
-            if (session_age > 86400) { // 24 hours = 86400 seconds
-                LOG_INFO("Cleaning up stale call session: %s (age: %ld seconds)",
-                         call_sessions[i].call_id, session_age);
-                terminate_call_session(&call_sessions[i]);
-                export_active_calls_json();
-                cleaned_count++;
-            }
-        }
-    }
+    // Clean up sessions older than 24 hours (safety net for truly lost BYE)
+    // With Record-Route enabled, BYE messages should route through proxy
+    // This timeout is only a safety net for exceptional cases
+    int cleaned_count = cleanup_stale_call_sessions(86400); // 24 hours = 86400 seconds
 
     if (cleaned_count > 0) {
+        mark_active_calls_dirty();
         LOG_INFO("Passive cleanup freed %d stale call sessions", cleaned_count);
     }
 }
@@ -59,28 +45,24 @@ void enable_graceful_degradation_if_needed(void) {
     last_check = now;
 
     // Count active call sessions
-    int active_calls = 0;
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (call_sessions[i].in_use) {
-            active_calls++;
-        }
-    }
+    int active_calls = get_active_call_count();
+    int max_calls = get_call_session_capacity();
 
     // If approaching call session limits, reduce background activity
-    if (active_calls > (MAX_CALL_SESSIONS * 0.8)) {
+    if (active_calls > (max_calls * 0.8)) {
         // Double phonebook fetch interval to reduce background load
         if (g_pb_interval_seconds < 7200) { // Don't exceed 2 hours
             g_pb_interval_seconds *= 2;
             LOG_INFO("High call load detected (%d/%d), reducing phonebook fetch frequency to %d seconds",
-                     active_calls, MAX_CALL_SESSIONS, g_pb_interval_seconds);
+                     active_calls, max_calls, g_pb_interval_seconds);
         }
     }
     // Restore normal interval when load decreases
-    else if (active_calls < (MAX_CALL_SESSIONS * 0.5)) {
+    else if (active_calls < (max_calls * 0.5)) {
         if (g_pb_interval_seconds > 1800) { // Restore to minimum 30 minutes
             g_pb_interval_seconds = 1800;
             LOG_INFO("Call load normalized (%d/%d), restored phonebook fetch frequency",
-                     active_calls, MAX_CALL_SESSIONS);
+                     active_calls, max_calls);
         }
     }
 }
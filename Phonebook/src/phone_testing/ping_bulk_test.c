@@ -8,13 +8,18 @@
 #include "../config_loader/config_loader.h"
 #include "../passive_safety/passive_safety.h"
 #include "../software_health/software_health.h"
+#include "../dns_resolver/dns_cache.h"
 #include "../softphone/softphone.h"
+#include "../user_manager/user_manager.h"
 #include "ping_test.h"
 #include <netdb.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+// Copy of the user table for one test cycle, so the walk never holds registered_users_mutex
+static RegisteredUser bulk_test_users[MAX_REGISTERED_USERS];
+
 void *ping_bulk_test_thread(void *arg) {
     (void)arg;
 
@@ -97,34 +102,16 @@ void *ping_bulk_test_thread(void *arg) {
         float total_avg_rtt = 0.0;  // Sum of average RTTs for calculating overall average
         int rtt_count = 0;          // Count of phones with valid RTT measurements
 
-        // Lock the user table to count total users first
-        pthread_mutex_lock(&registered_users_mutex);
-
-        // Count total registered users (for estimation if no previous cycle data)
-        for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-            if (registered_users[i].user_id[0] != '\0') {
-                total_users++;
-            }
-        }
-
-        pthread_mutex_unlock(&registered_users_mutex);
+        // Snapshot the user table; registrations arriving mid-cycle are picked up next cycle
+        int user_count = snapshot_registered_users(bulk_test_users, MAX_REGISTERED_USERS);
 
         // Initialize header with previous cycle's online phone count for accurate display
         // This shows correct "X of Y" during the test cycle
         phone_ping_update_header(0, prev_phones_online, g_phone_test_interval_seconds);
         LOG_DEBUG("Initialized header with %d reachable phones (from previous cycle)", prev_phones_online);
 
-        // Reset counters and lock for main testing loop
-        total_users = 0;
-        pthread_mutex_lock(&registered_users_mutex);
-
-        for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-            RegisteredUser *user = &registered_users[i];
-
-            // Skip empty slots
-            if (user->user_id[0] == '\0') {
-                continue;
-            }
+        for (int i = 0; i < user_count; i++) {
+            RegisteredUser *user = &bulk_test_users[i];
 
             total_users++;
 
@@ -132,33 +119,20 @@ void *ping_bulk_test_thread(void *arg) {
             char hostname[MAX_USER_ID_LEN + sizeof(AREDN_MESH_DOMAIN) + 2];
             snprintf(hostname, sizeof(hostname), "%s.%s", user->user_id, AREDN_MESH_DOMAIN);
 
-            // Check DNS resolution
-            struct addrinfo hints = {0};
-            hints.ai_family = AF_INET;
-            hints.ai_socktype = SOCK_DGRAM;
-            struct addrinfo *res = NULL;
-
-            int gai_status = getaddrinfo(hostname, NULL, &hints, &res);
+            // Check DNS resolution (shared cache; the status updater resolves the same names)
+            struct in_addr resolved_addr;
 
-            if (gai_status == 0) {
+            if (dns_cache_resolve(hostname, &resolved_addr) == 0) {
                 // DNS resolved - node is reachable
                 dns_resolved++;
 
                 // Get IP address for logging
                 char ip_str[INET_ADDRSTRLEN] = "unknown";
-                if (res && res->ai_family == AF_INET) {
-                    struct sockaddr_in *addr = (struct sockaddr_in *)res->ai_addr;
-                    inet_ntop(AF_INET, &addr->sin_addr, ip_str, sizeof(ip_str));
-                }
+                inet_ntop(AF_INET, &resolved_addr, ip_str, sizeof(ip_str));
 
                 LOG_DEBUG("[%d/%d] Testing %s (%s) - DNS resolved to %s",
                          dns_resolved, total_users, user->user_id, user->display_name, ip_str);
 
-                freeaddrinfo(res);
-
-                // Release mutex before testing (tests may take time)
-                pthread_mutex_unlock(&registered_users_mutex);
-
                 // Initialize result variables
                 char ping_status[16] = "UNKNOWN";
                 float ping_rtt = 0.0;
@@ -218,8 +192,6 @@ void *ping_bulk_test_thread(void *arg) {
                             fflush(results_file);
                         }
 
-                        // Re-acquire mutex and continue to next user
-                        pthread_mutex_lock(&registered_users_mutex);
                         continue;
                     }
                 } else {
@@ -369,8 +341,6 @@ void *ping_bulk_test_thread(void *arg) {
                             fflush(results_file);
                         }
 
-                        // Re-acquire mutex and continue to next user
-                        pthread_mutex_lock(&registered_users_mutex);
                         continue;
                     } else {
                         snprintf(options_status, sizeof(options_status), "OFFLINE");
@@ -483,17 +453,12 @@ void *ping_bulk_test_thread(void *arg) {
                     fflush(results_file);
                 }
 
-                // Re-acquire mutex for next iteration
-                pthread_mutex_lock(&registered_users_mutex);
-
             } else {
                 // DNS failed - node not reachable (don't log to reduce noise)
                 dns_failed++;
             }
         }
 
-        pthread_mutex_unlock(&registered_users_mutex);
-
         // Close results file
         if (results_file) {
             fclose(results_file);
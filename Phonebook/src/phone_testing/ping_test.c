@@ -3,6 +3,7 @@
 
 #include "ping_test.h"
 #include "../common.h"
+#include "../dns_resolver/dns_cache.h"
 #include <math.h>
 #include <sys/time.h>
 #include <errno.h>
@@ -106,21 +107,13 @@ static int resolve_phone_to_ip(const char *phone_number, char *ip_address, size_
     char hostname[128];
     snprintf(hostname, sizeof(hostname), "%s.%s", phone_number, AREDN_MESH_DOMAIN);
 
-    struct addrinfo hints = {0};
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_RAW;
-    struct addrinfo *res = NULL;
-
-    int status = getaddrinfo(hostname, NULL, &hints, &res);
-    if (status != 0) {
-        LOG_WARN("Failed to resolve %s: %s", hostname, gai_strerror(status));
+    struct in_addr resolved_addr;
+    if (dns_cache_resolve(hostname, &resolved_addr) != 0) {
+        LOG_WARN("Failed to resolve %s", hostname);
         return -1;
     }
 
-    struct sockaddr_in *ipv4 = (struct sockaddr_in *)res->ai_addr;
-    inet_ntop(AF_INET, &(ipv4->sin_addr), ip_address, ip_size);
-
-    freeaddrinfo(res);
+    inet_ntop(AF_INET, &resolved_addr, ip_address, ip_size);
     LOG_DEBUG("Resolved %s to %s", hostname, ip_address);
     return 0;
 }
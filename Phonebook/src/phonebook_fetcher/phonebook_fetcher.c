@@ -66,6 +66,7 @@ int publish_phonebook_xml(const char *source_filepath) {
 }
 
 static bool initial_population_done = false;
+static phonebook_pipeline_t pipeline; // Fetcher thread only; too large for the stack
 
 void *phonebook_fetcher_thread(void *arg) {
     (void)arg;
@@ -78,7 +79,16 @@ void *phonebook_fetcher_thread(void *arg) {
     // Emergency boot sequence: Load existing phonebook immediately if available
     if (access(PB_CSV_PATH, F_OK) == 0) {
         LOG_INFO("Found existing phonebook CSV at '%s'. Loading immediately for service availability.", PB_CSV_PATH);
-        populate_registered_users_from_csv(PB_CSV_PATH);
+        // One read of the file builds both the directory and the XML
+        bool have_xml = false;
+        if (csv_processor_load_file(PB_CSV_PATH, &pipeline) == 0) {
+            have_xml = (phonebook_pipeline_finish(&pipeline) == 0);
+            phonebook_pipeline_commit_directory(&pipeline);
+            phonebook_pipeline_release(&pipeline);
+        }
+        if (have_xml) {
+            csv_processor_load_validators(); // A 304 may now stand for this copy
+        }
         LOG_INFO("Emergency boot: SIP user database loaded from persistent storage. Directory entries: %d.", num_directory_entries);
         initial_population_done = true;
 
@@ -108,10 +118,9 @@ void *phonebook_fetcher_thread(void *arg) {
 
         LOG_INFO("Health metrics updated: emergency boot with %d entries", num_directory_entries);
 
-        // Convert to XML for web interface
-        char existing_xml_temp_path[MAX_CONFIG_PATH_LEN];
-        if (csv_processor_convert_csv_to_xml_and_get_path(existing_xml_temp_path, sizeof(existing_xml_temp_path)) == 0) {
-            publish_phonebook_xml(existing_xml_temp_path);
+        // XML for the web interface, rendered in the same pass
+        if (have_xml) {
+            publish_phonebook_xml(PB_XML_BASE_PATH);
             LOG_INFO("Emergency boot: XML phonebook published from existing data.");
         }
     } else {
@@ -124,7 +133,14 @@ void *phonebook_fetcher_thread(void *arg) {
         char new_csv_hash[HASH_LENGTH + 1]; // HASH_LENGTH from common.h
         char last_good_csv_hash[HASH_LENGTH + 1];
 
-        if (csv_processor_download_csv() != 0) {
+        // One pass over the downloaded bytes hashes them, validates the rows,
+        // builds the new directory off to the side and renders the XML
+        int download_result = csv_processor_download_csv(&pipeline);
+        if (download_result == PB_DOWNLOAD_NOT_MODIFIED) {
+            LOG_DEBUG("Server copy unchanged since last good fetch. No download needed.");
+            goto end_fetcher_cycle;
+        }
+        if (download_result != PB_DOWNLOAD_OK) {
             LOG_ERROR("CSV download failed. Skipping this cycle.");
 
             // Update health metrics: mark fetch as failed
@@ -138,21 +154,14 @@ void *phonebook_fetcher_thread(void *arg) {
             goto end_fetcher_cycle;
         }
 
-        // Calculate hash of downloaded temp file (in RAM)
-        if (csv_processor_calculate_file_conceptual_hash(PB_CSV_TEMP_PATH, new_csv_hash, sizeof(new_csv_hash)) != 0) {
-            LOG_ERROR("Failed to calculate hash for downloaded CSV. Skipping this cycle.");
-            remove(PB_CSV_TEMP_PATH); // Clean up temp file
-            goto end_fetcher_cycle;
-        }
-
         // VALIDATE CSV BEFORE ANY DESTRUCTIVE OPERATIONS
-        int valid_row_count = 0;
-        if (csv_processor_validate_csv(PB_CSV_TEMP_PATH, &valid_row_count) != 0) {
+        if (phonebook_pipeline_finish(&pipeline) != 0) {
             LOG_ERROR("Downloaded CSV failed validation. Refusing to accept invalid phonebook data.");
-            remove(PB_CSV_TEMP_PATH); // Clean up invalid temp file
+            phonebook_pipeline_abort(&pipeline);
             goto end_fetcher_cycle;
         }
-        LOG_INFO("CSV validation passed: %d valid entries in downloaded file", valid_row_count);
+        LOG_INFO("CSV validation passed: %d valid entries in downloaded file", pipeline.valid_rows);
+        csv_hash_final_hex(&pipeline.hash, new_csv_hash, sizeof(new_csv_hash));
 
         // Read existing hash from flash (only if we have persistent data)
         FILE *hash_fp = fopen(PB_LAST_GOOD_CSV_HASH_PATH, "r");
@@ -174,55 +183,45 @@ void *phonebook_fetcher_thread(void *arg) {
         // Flash-friendly comparison: Only write to flash if data actually changed
         if (strcmp(new_csv_hash, last_good_csv_hash) == 0 && initial_population_done) {
             LOG_DEBUG("Downloaded CSV is identical to flash copy. No flash write needed - preserving flash lifespan.");
-            remove(PB_CSV_TEMP_PATH); // Clean up unchanged temp file
+            csv_processor_keep_validators(); // This server's copy matches flash; next fetch can be conditional
+            phonebook_pipeline_abort(&pipeline); // Keep the live directory and published XML
             goto end_fetcher_cycle;
         }
 
-        // CRITICAL: Copy validated temp to persistent BEFORE any destructive operations
-        // This ensures persistent storage has good data before we nuke the user table
+        // CRITICAL: Persist the validated CSV BEFORE swapping in the new directory
         if (!initial_population_done) {
             LOG_INFO("Initial population required. Persisting validated CSV to storage.");
         } else {
             LOG_INFO("CSV content changed. Updating persistent storage with validated data (flash write).");
         }
 
-        // Ensure the persistent storage directory exists before copying
+        // Ensure the persistent storage directory exists before writing
         char csv_dir_copy[MAX_CONFIG_PATH_LEN];
         strncpy(csv_dir_copy, PB_CSV_PATH, sizeof(csv_dir_copy) - 1);
         csv_dir_copy[sizeof(csv_dir_copy) - 1] = '\0';
         char *csv_dir = dirname(csv_dir_copy);
         if (file_utils_ensure_directory_exists(csv_dir) != 0) {
             LOG_ERROR("Failed to create directory '%s' for persistent CSV storage", csv_dir);
-            remove(PB_CSV_TEMP_PATH); // Clean up temp file
+            phonebook_pipeline_abort(&pipeline);
             goto end_fetcher_cycle;
         }
 
-        // Cross-filesystem move: copy validated temp file to flash
-        if (file_utils_copy_file(PB_CSV_TEMP_PATH, PB_CSV_PATH) != 0) {
-            LOG_ERROR("Failed to copy validated temp CSV to persistent storage");
-            remove(PB_CSV_TEMP_PATH); // Clean up temp file
+        // The only write of the CSV: from RAM straight to flash
+        if (phonebook_pipeline_save_body(&pipeline, PB_CSV_PATH) != 0) {
+            LOG_ERROR("Failed to write validated CSV to persistent storage");
+            phonebook_pipeline_abort(&pipeline);
             goto end_fetcher_cycle;
         }
-        LOG_INFO("Validated CSV successfully copied to persistent storage.");
-        remove(PB_CSV_TEMP_PATH); // Clean up temp file after successful copy
+        LOG_INFO("Validated CSV successfully written to persistent storage.");
 
-        // Now populate users from PERSISTENT CSV (this will clear the table, but persistent is validated)
-        LOG_DEBUG("Populating SIP users from validated persistent CSV.");
-        populate_registered_users_from_csv(PB_CSV_PATH);
+        // Swap in the directory built during the download
+        phonebook_pipeline_commit_directory(&pipeline);
+        phonebook_pipeline_release(&pipeline);
         LOG_DEBUG("SIP user database populated from CSV. Total directory entries: %d.", num_directory_entries);
         initial_population_done = true;
 
-        // Generate XML from the persistent CSV path for publishing
-        LOG_DEBUG("Initiating XML conversion...");
-        char fetched_xml_temp_path[MAX_CONFIG_PATH_LEN];
-        if (csv_processor_convert_csv_to_xml_and_get_path(fetched_xml_temp_path, sizeof(fetched_xml_temp_path)) != 0) {
-            LOG_ERROR("XML conversion failed. But persistent storage is intact - service remains available.");
-            goto end_fetcher_cycle;
-        }
-        LOG_INFO("XML conversion successful.");
-
-        // Try to publish the XML
-        if (publish_phonebook_xml(fetched_xml_temp_path) != 0) {
+        // Publish the XML rendered during the download
+        if (publish_phonebook_xml(PB_XML_BASE_PATH) != 0) {
             LOG_ERROR("XML publish failed. But persistent storage is intact - service remains available.");
             goto end_fetcher_cycle;
         }
@@ -240,6 +239,7 @@ void *phonebook_fetcher_thread(void *arg) {
         } else {
             LOG_DEBUG("Hash unchanged, skipping flash write for hash file.");
         }
+        csv_processor_keep_validators();
 
         // Update health metrics: successful fetch
         extern service_metrics_t g_service_metrics;
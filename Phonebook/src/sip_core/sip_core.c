@@ -1,27 +1,20 @@
+#define _GNU_SOURCE // For strcasestr
 #include "sip_core.h"
 #include "../common.h" // This now includes all necessary headers and types
 #include "../user_manager/user_manager.h" // For RegisteredUser, find_registered_user, etc.
 #include "../call-sessions/call_sessions.h" // For CallSession, create_call_session, find_call_session_by_callid, etc.
+#include "sip_message.h" // For the one-pass SIP header index
+#include "../dns_resolver/dns_resolver.h" // For non-blocking callee lookups
+#include "../dns_resolver/dns_cache.h" // For the shared hostname cache
+#include "../dns_resolver/mesh_hosts.h" // arednlink host table, tried before DNS
+#include "../config_loader/config_loader.h" // For g_sip_max_message_size
+#include "sip_overload.h" // For shedding REGISTER/OPTIONS under load
 
 #define MODULE_NAME "SIP"
 
 // Note: Global extern declarations are now in common.h
 
 
-int extract_sip_header(const char *msg, const char *hdr, char *buf, size_t len) {
-    char *start = strstr(msg, hdr);
-    if (!start) { buf[0] = '\0'; return 0; }
-    start += strlen(hdr);
-    while (*start == ' ' || *start == '\t') start++;
-    char *end = strstr(start, "\r\n");
-    if (!end) end = strstr(start, "\n");
-    size_t l = end ? (size_t)(end - start) : strlen(start);
-    if (l >= len) l = len - 1;
-    memcpy(buf, start, l);
-    buf[l] = '\0';
-    return 1;
-}
-
 int parse_user_id_from_uri(const char *uri, char *buf, size_t len) {
     const char *start = uri;
     const char *lt = strchr(start, '<');
@@ -91,14 +84,13 @@ void extract_display_name_from_header(const char *header_value, const char *user
 // Extract codec from SDP body
 // Parses m=audio line and a=rtpmap lines to determine codec name
 // Example SDP: m=audio 8000 RTP/AVP 0 8 -> codec 0 -> PCMU
-void extract_codec_from_sdp(const char *sip_message, char *codec_out, size_t codec_out_len) {
-    // Find SDP body (after "\r\n\r\n")
-    const char *body = strstr(sip_message, "\r\n\r\n");
-    if (!body) {
+void extract_codec_from_sdp(const sip_msg_t *msg, char *codec_out, size_t codec_out_len) {
+    // SDP body starts after the blank line located by the tokenizer
+    if (msg->body_len == 0) {
         codec_out[0] = '\0';
         return;
     }
-    body += 4; // Skip past "\r\n\r\n"
+    const char *body = msg->buf + msg->body_off; // Receive buffer is NUL-terminated
 
     // Find m=audio line
     const char *m_audio = strstr(body, "m=audio");
@@ -166,198 +158,92 @@ void extract_codec_from_sdp(const char *sip_message, char *codec_out, size_t cod
     }
 }
 
-void get_first_line(const char *msg, char *buf, size_t len) {
-    const char *end = strstr(msg, "\r\n");
-    if (end) {
-        size_t line_len = end - msg;
-        if (line_len >= len) line_len = len - 1;
-        memcpy(buf, msg, line_len);
-        buf[line_len] = '\0';
-    } else {
-        strncpy(buf, msg, len - 1);
-        buf[len - 1] = '\0';
-    }
+// Line ending that follows a header line in the original buffer (CRLF or bare LF)
+static uint32_t header_line_end(const sip_msg_t *msg, const sip_hdr_t *h) {
+    uint32_t end = h->line_off + h->line_len;
+    if (end < msg->len && msg->buf[end] == '\r') end++;
+    if (end < msg->len && msg->buf[end] == '\n') end++;
+    return end;
 }
 
-void get_sip_method(const char *msg, char *buf, size_t len) {
-    const char *end = strchr(msg, ' ');
-    if (end) {
-        size_t method_len = end - msg;
-        if (method_len >= len) method_len = len - 1;
-        memcpy(buf, msg, method_len);
-        buf[method_len] = '\0';
-    } else {
-        buf[0] = '\0';
-    }
-}
-
-// Helper function to add Record-Route header to a SIP response
-void add_record_route_to_response(const char *original_msg, char *output_buffer, size_t output_buffer_size) {
-    if (g_server_ip[0] == '\0') {
-        // No server IP available, just copy original
-        strncpy(output_buffer, original_msg, output_buffer_size - 1);
-        output_buffer[output_buffer_size - 1] = '\0';
-        return;
-    }
-
-    // Find the first line (status line)
-    const char *first_line_end = strstr(original_msg, "\r\n");
-    if (!first_line_end) {
-        strncpy(output_buffer, original_msg, output_buffer_size - 1);
-        output_buffer[output_buffer_size - 1] = '\0';
-        return;
-    }
-
-    // Copy status line
-    size_t first_line_len = first_line_end - original_msg + 2; // Include \r\n
-    if (first_line_len >= output_buffer_size) {
-        LOG_ERROR("Buffer too small for response status line");
-        return;
+// Splice a Record-Route header in after the status line of a response
+int splice_response_with_record_route(const sip_msg_t *msg, sip_splice_t *sp) {
+    sip_splice_init(sp);
+    if (g_server_ip[0] == '\0' || msg->headers_off >= msg->len) {
+        // No server IP available (or no headers), send the original as-is
+        return sip_splice_append(sp, msg->buf, msg->len);
     }
-    memcpy(output_buffer, original_msg, first_line_len);
-    output_buffer[first_line_len] = '\0';
-    int written = first_line_len;
 
-    // Add Record-Route header right after status line
-    int result = snprintf(output_buffer + written, output_buffer_size - written,
-                          "Record-Route: <sip:%s:%d;lr>\r\n", g_server_ip, SIP_PORT);
-    if (result < 0 || result >= (int)(output_buffer_size - written)) {
-        LOG_ERROR("Buffer overflow adding Record-Route to response");
-        return;
-    }
-    written += result;
-
-    // Copy the rest of the message (headers + body)
-    const char *rest = first_line_end + 2; // Skip past status line's \r\n
-    size_t rest_len = strlen(rest);
-    if (written + rest_len >= output_buffer_size) {
-        LOG_ERROR("Buffer overflow copying rest of response");
-        return;
+    if (sip_splice_append(sp, msg->buf, msg->headers_off) != 0 ||
+        sip_splice_appendf(sp, "Record-Route: <sip:%s:%d;lr>\r\n", g_server_ip, SIP_PORT) != 0 ||
+        sip_splice_append(sp, msg->buf + msg->headers_off, msg->len - msg->headers_off) != 0) {
+        LOG_ERROR("SIP: Response too large to add Record-Route.");
+        return -1;
     }
-    memcpy(output_buffer + written, rest, rest_len);
-    output_buffer[written + rest_len] = '\0';
 
     LOG_DEBUG("Added Record-Route to response");
+    return 0;
 }
 
-void reconstruct_invite_message(const char *original_msg, const char *new_request_line_uri,
-                                char *output_buffer, size_t output_buffer_size) {
-    char method[32];
-    char original_first_line[MAX_SIP_MSG_LEN];
-    get_first_line(original_msg, original_first_line, sizeof(original_first_line));
-    get_sip_method(original_first_line, method, sizeof(method));
-    const char *sip_version_str = strstr(original_first_line, "SIP/2.0");
-    const char *version = sip_version_str ? sip_version_str : "SIP/2.0";
-
-    int written = 0;
-    int result = snprintf(output_buffer + written, output_buffer_size - written,
-                           "%s %s %s\r\n", method, new_request_line_uri, version);
-    if (result < 0 || result >= (int)(output_buffer_size - written)) {
-        LOG_ERROR("SIP: reconstruct_invite_message: Initial line buffer overflow.");
-        output_buffer[output_buffer_size - 1] = '\0';
-        return;
-    }
-    written += result;
-
-    const char *headers_start = strstr(original_msg, "\r\n");
-    if (headers_start) {
-        headers_start += 2;
-
-        const char *body_start = strstr(headers_start, "\r\n\r\n");
-        int content_length = 0;
-        if (body_start) {
-            body_start += 4;
-            content_length = strlen(body_start);
-        }
-
-        const char *current_pos = headers_start;
+int splice_invite_message(const sip_msg_t *msg, const char *new_request_line_uri, sip_splice_t *sp) {
+    sip_splice_init(sp);
 
-        while (current_pos && strncmp(current_pos, "\r\n", 2) != 0 && written < (int)output_buffer_size) {
-            const char *line_end = strstr(current_pos, "\r\n");
-            if (!line_end) line_end = current_pos + strlen(current_pos);
+    // SIP version is whatever follows the Request-URI on the start line
+    const char *version = "SIP/2.0";
+    int version_len = 7;
+    uint32_t version_off = msg->uri_off + msg->uri_len + 1;
+    if (version_off < msg->start_line_len) {
+        version = msg->buf + version_off;
+        version_len = (int)(msg->start_line_len - version_off);
+    }
 
-            if (strncasecmp(current_pos, "Content-Length:", 15) == 0) {
-                 current_pos = line_end + 2;
-                 continue;
-            }
+    if (sip_splice_appendf(sp, "%.*s %s %.*s\r\n", (int)msg->method_len, msg->buf,
+                           new_request_line_uri, version_len, version) != 0) {
+        LOG_ERROR("SIP: splice_invite_message: Request line too long.");
+        return -1;
+    }
 
-            size_t copy_len = line_end - current_pos;
-            if (written + copy_len + 2 < output_buffer_size) {
-                memcpy(output_buffer + written, current_pos, copy_len);
-                written += copy_len;
-                memcpy(output_buffer + written, "\r\n", 2);
-                written += 2;
-                output_buffer[written] = '\0';
-            } else {
-                LOG_WARN("SIP: reconstruct_invite_message: Output buffer overflow during header copy.");
-                written = (int)output_buffer_size - 1;
-                output_buffer[written] = '\0';
-                break;
-            }
-            current_pos = line_end + 2;
+    // Every indexed header except Content-Length, which is recomputed below.
+    // Adjacent header lines collapse into a single segment of the original buffer.
+    for (int i = 0; i < msg->hdr_count; i++) {
+        const sip_hdr_t *h = &msg->hdrs[i];
+        if (h->id == SIP_HDR_CONTENT_LENGTH) {
+            continue;
         }
-
-        // Add Record-Route header to force all in-dialog messages (including BYE) through proxy
-        if (g_server_ip[0] != '\0') {
-            if (written + 100 >= (int)output_buffer_size) {
-                LOG_WARN("SIP: reconstruct_invite_message: Not enough space for Record-Route header.");
-                output_buffer[output_buffer_size - 1] = '\0';
-                return;
-            }
-            result = snprintf(output_buffer + written, output_buffer_size - written,
-                              "Record-Route: <sip:%s:%d;lr>\r\n", g_server_ip, SIP_PORT);
-            if (result < 0 || result >= (int)(output_buffer_size - written)) {
-                LOG_ERROR("SIP: reconstruct_invite_message: Record-Route header buffer overflow.");
-                output_buffer[output_buffer_size - 1] = '\0';
-                return;
-            }
-            written += result;
-            LOG_DEBUG("Added Record-Route: <sip:%s:%d;lr>", g_server_ip, SIP_PORT);
+        if (sip_splice_append(sp, msg->buf + h->line_off, header_line_end(msg, h) - h->line_off) != 0) {
+            LOG_WARN("SIP: splice_invite_message: Too many header segments.");
+            return -1;
         }
+    }
 
-        if (written + 20 >= (int)output_buffer_size) {
-             LOG_WARN("SIP: reconstruct_invite_message: Not enough space for Content-Length header or final CRLF.");
-             output_buffer[output_buffer_size - 1] = '\0';
-             return;
+    // Add Record-Route header to force all in-dialog messages (including BYE) through proxy
+    if (g_server_ip[0] != '\0') {
+        if (sip_splice_appendf(sp, "Record-Route: <sip:%s:%d;lr>\r\n", g_server_ip, SIP_PORT) != 0) {
+            LOG_ERROR("SIP: splice_invite_message: No room for Record-Route header.");
+            return -1;
         }
+        LOG_DEBUG("Added Record-Route: <sip:%s:%d;lr>", g_server_ip, SIP_PORT);
+    }
 
-        result = snprintf(output_buffer + written, output_buffer_size - written,
-                            "Content-Length: %d\r\n", content_length);
-        if (result < 0 || result >= (int)(output_buffer_size - written)) {
-            LOG_ERROR("SIP: reconstruct_invite_message: Content-Length header buffer overflow.");
-            output_buffer[output_buffer_size - 1] = '\0';
-            return;
-        }
-        written += result;
-
-        result = snprintf(output_buffer + written, output_buffer_size - written, "\r\n");
-        if (result < 0 || result >= (int)(output_buffer_size - written)) {
-            LOG_ERROR("SIP: reconstruct_invite_message: Final CRLF buffer overflow.");
-            output_buffer[output_buffer_size - 1] = '\0';
-            return;
-        }
-        written += result;
+    if (sip_splice_appendf(sp, "Content-Length: %u\r\n\r\n", (unsigned)msg->body_len) != 0 ||
+        sip_splice_append(sp, msg->buf + msg->body_off, msg->body_len) != 0) {
+        LOG_ERROR("SIP: splice_invite_message: Message too large.");
+        return -1;
+    }
+    return 0;
+}
 
 
-        if (body_start && *body_start && written < (int)output_buffer_size) {
-            size_t to_copy = strlen(body_start);
-            if (written + to_copy >= (int)output_buffer_size) {
-                to_copy = output_buffer_size - written - 1;
-            }
-            memcpy(output_buffer + written, body_start, to_copy);
-            output_buffer[written + to_copy] = '\0';
-        } else if (written < (int)output_buffer_size) {
-            output_buffer[written] = '\0';
-        } else {
-            LOG_ERROR("SIP: reconstruct_invite_message buffer overflow at end; truncating.");
-            output_buffer[output_buffer_size - 1] = '\0';
-        }
-    } else {
-        output_buffer[written] = '\0';
+// Remember a locally generated response so a retransmitted request is answered from it
+static void record_sent_response(const char *via, size_t via_len, const char *cseq, size_t cseq_len,
+                                 const char *response, int len) {
+    sip_txn_key_t key;
+    if (sip_txn_key_from_values(via, via_len, cseq, cseq_len, &key) == 0) {
+        struct iovec iov = { .iov_base = (void *)response, .iov_len = (size_t)len };
+        sip_txn_record_response(&key, &iov, 1);
     }
 }
 
-
 void send_sip_response(int sockfd,
                        const struct sockaddr_in *dest_addr,
                        socklen_t dest_len,
@@ -447,8 +333,8 @@ buffer_overflow:
     response_buffer[len] = '\0';
 
 end_send:;
-    ssize_t sent_bytes = sendto(sockfd, response_buffer, len, 0,
-                                 (const struct sockaddr*)dest_addr, dest_len);
+    record_sent_response(via_hdr, strlen(via_hdr), cseq, strlen(cseq), response_buffer, len);
+    ssize_t sent_bytes = sip_transport_send(sockfd, dest_addr, dest_len, response_buffer, len);
     if (sent_bytes < 0) {
         LOG_ERROR("SIP: Error sending SIP response to %s:%d.",
                     sockaddr_to_ip_str(dest_addr),
@@ -461,13 +347,84 @@ end_send:;
     }
 }
 
+// --- Precompiled replies for the high-volume requests ---
+
+#define SIP_ALLOW_HEADER "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REGISTER, SUBSCRIBE, NOTIFY, REFER, INFO, MESSAGE, UPDATE"
+
+static sip_response_template_t options_ok_template;
+static sip_response_template_t register_ok_template;
+static sip_response_template_t overload_template;
+
+int sip_core_init(void) {
+    if (sip_template_compile(&options_ok_template, "SIP/2.0 200 OK", SIP_ALLOW_HEADER, 0) != 0 ||
+        sip_template_compile(&register_ok_template, "SIP/2.0 200 OK", NULL,
+                             SIP_TEMPLATE_ECHO_CONTACT) != 0 ||
+        sip_template_compile(&overload_template, "SIP/2.0 503 Service Unavailable", NULL, 0) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// expires < 0: the template carries no Expires line
+static void send_templated_response(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                                    const sip_response_template_t *t, const sip_msg_t *req, int expires) {
+    char response_buffer[MAX_SIP_MSG_LEN];
+    int len = expires < 0 ? sip_template_render(t, req, response_buffer, sizeof(response_buffer))
+                          : sip_template_render_expires(t, req, expires, response_buffer, sizeof(response_buffer));
+    if (len < 0) {
+        LOG_ERROR("SIP: Templated response does not fit in %d bytes; not sent.", MAX_SIP_MSG_LEN);
+        return;
+    }
+
+    sip_txn_key_t key;
+    if (sip_txn_key_from_msg(req, &key) == 0) {
+        struct iovec iov = { .iov_base = response_buffer, .iov_len = (size_t)len };
+        sip_txn_record_response(&key, &iov, 1);
+    }
+    ssize_t sent_bytes = sip_transport_send(sockfd, dest_addr, dest_len, response_buffer, len);
+    if (sent_bytes < 0) {
+        LOG_ERROR("SIP: Error sending SIP response to %s:%d.",
+                    sockaddr_to_ip_str(dest_addr),
+                    ntohs(dest_addr->sin_port));
+    } else {
+        LOG_DEBUG("SIP: Sent SIP response to %s:%d (bytes: %zd):\n%.*s",
+                    sockaddr_to_ip_str(dest_addr),
+                    ntohs(dest_addr->sin_port),
+                    sent_bytes, len, response_buffer);
+    }
+}
+
+// 503 + Retry-After for a request shed under overload. Not recorded as a
+// transaction: a retransmission is simply shed again, which is just as cheap.
+static void send_overload_response(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                                   const sip_msg_t *req) {
+    char response_buffer[MAX_SIP_MSG_LEN];
+    int len = sip_template_render_retry_after(&overload_template, req, sip_overload_retry_after(),
+                                              response_buffer, sizeof(response_buffer));
+    if (len < 0) {
+        LOG_ERROR("SIP: 503 response does not fit in %d bytes; not sent.", MAX_SIP_MSG_LEN);
+        return;
+    }
+    if (sip_transport_send(sockfd, dest_addr, dest_len, response_buffer, len) < 0) {
+        LOG_ERROR("SIP: Error sending 503 to %s:%d.", sockaddr_to_ip_str(dest_addr), ntohs(dest_addr->sin_port));
+    }
+}
+
+void send_retry_later_response(int sockfd, const char *buffer, ssize_t n,
+                               const struct sockaddr_in *dest_addr, socklen_t dest_len) {
+    sip_msg_t msg;
+    if (n < 10 || sip_msg_parse(&msg, buffer, (size_t)n) != 0 || msg.is_response) {
+        return;
+    }
+    send_overload_response(sockfd, dest_addr, dest_len, &msg);
+}
+
 void send_sip_message(int sockfd,
                       const struct sockaddr_in *dest_addr,
                       socklen_t dest_len,
                       const char *msg)
 {
-    ssize_t sent_bytes = sendto(sockfd, msg, strlen(msg), 0,
-                                 (const struct sockaddr*)dest_addr, dest_len);
+    ssize_t sent_bytes = sip_transport_send(sockfd, dest_addr, dest_len, msg, strlen(msg));
     if (sent_bytes < 0) {
         LOG_ERROR("SIP: Error proxying SIP message to %s:%d.",
                     sockaddr_to_ip_str(dest_addr),
@@ -480,6 +437,24 @@ void send_sip_message(int sockfd,
     }
 }
 
+void send_sip_splice(int sockfd,
+                     const struct sockaddr_in *dest_addr,
+                     socklen_t dest_len,
+                     const sip_splice_t *sp)
+{
+    ssize_t sent_bytes = sip_transport_sendv(sockfd, dest_addr, dest_len, sp->iov, sp->iovcnt);
+    if (sent_bytes < 0) {
+        LOG_ERROR("SIP: Error proxying SIP message to %s:%d.",
+                    sockaddr_to_ip_str(dest_addr),
+                    ntohs(dest_addr->sin_port));
+    } else {
+        LOG_DEBUG("Proxied SIP message to %s:%d (bytes: %zd, segments: %d)",
+                    sockaddr_to_ip_str(dest_addr),
+                    ntohs(dest_addr->sin_port),
+                    sent_bytes, sp->iovcnt);
+    }
+}
+
 void send_response_to_registered(int sockfd,
     const char *user_id,
     const struct sockaddr_in *cliaddr, socklen_t cli_len,
@@ -506,72 +481,339 @@ void send_response_to_registered(int sockfd,
                       extra_hdrs, body);
 }
 
+// --- INVITEs parked while the callee hostname is being resolved ---
+
+#define MAX_PENDING_INVITES DNS_RESOLVER_MAX_PENDING
+
+typedef struct {
+    bool in_use;
+    int sockfd;
+    struct sockaddr_in cliaddr;
+    socklen_t cli_len;
+    bool cancelled; // CANCEL arrived; slot stays owned by the resolver until its callback
+    char hostname[MAX_USER_ID_LEN + sizeof(AREDN_MESH_DOMAIN) + 1];
+    char call_id[MAX_CONTACT_URI_LEN];
+    char *buffer;  // Copy of the INVITE, up to SIP_MAX_MESSAGE_SIZE
+    sip_msg_t msg; // Index into buffer above
+} PendingInvite;
+
+// Owned by the thread running the SIP loop; each worker gets its own table on first use
+static __thread PendingInvite *pending_invites = NULL;
+
+static PendingInvite *find_pending_invite(const char *call_id) {
+    if (!pending_invites) {
+        return NULL;
+    }
+    for (int i = 0; i < MAX_PENDING_INVITES; i++) {
+        if (pending_invites[i].in_use && !pending_invites[i].cancelled &&
+            strcmp(pending_invites[i].call_id, call_id) == 0) {
+            return &pending_invites[i];
+        }
+    }
+    return NULL;
+}
+
+static void release_pending_invite(PendingInvite *p) {
+    free(p->buffer);
+    p->buffer = NULL;
+    p->in_use = false;
+}
+
+static PendingInvite *park_invite(int sockfd, const char *buffer, ssize_t n,
+                                  const struct sockaddr_in *cliaddr, socklen_t cli_len,
+                                  const char *call_id, const char *hostname) {
+    if (n <= 0 || n > g_sip_max_message_size) {
+        return NULL;
+    }
+    if (!pending_invites) {
+        pending_invites = calloc(MAX_PENDING_INVITES, sizeof(PendingInvite));
+        if (!pending_invites) {
+            LOG_ERROR("Failed to allocate pending INVITE table.");
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < MAX_PENDING_INVITES; i++) {
+        PendingInvite *p = &pending_invites[i];
+        if (p->in_use) continue;
+
+        p->buffer = malloc((size_t)n + 1);
+        if (!p->buffer) {
+            return NULL;
+        }
+        memcpy(p->buffer, buffer, n);
+        p->buffer[n] = '\0';
+        if (sip_msg_parse(&p->msg, p->buffer, (size_t)n) != 0) {
+            free(p->buffer);
+            p->buffer = NULL;
+            return NULL;
+        }
+        p->sockfd = sockfd;
+        memcpy(&p->cliaddr, cliaddr, sizeof(p->cliaddr));
+        p->cli_len = cli_len;
+        p->cancelled = false;
+        snprintf(p->call_id, sizeof(p->call_id), "%s", call_id);
+        snprintf(p->hostname, sizeof(p->hostname), "%s", hostname);
+        p->in_use = true;
+        return p;
+    }
+
+    LOG_WARN("Pending INVITE table full (%d).", MAX_PENDING_INVITES);
+    return NULL;
+}
+
+// Rewrite the Request-URI to the resolved callee and forward the INVITE
+static void proxy_invite_to_callee(int sockfd, const sip_msg_t *msg, const CallSession *session) {
+    char new_request_line_uri[MAX_CONTACT_URI_LEN];
+    snprintf(new_request_line_uri, sizeof(new_request_line_uri),
+             "sip:%s@%s:%d", session->callee_user_id, sockaddr_to_ip_str(&session->callee_addr), SIP_PORT);
+
+    sip_splice_t proxied_invite;
+    if (splice_invite_message(msg, new_request_line_uri, &proxied_invite) != 0) {
+        return;
+    }
+
+    send_sip_splice(sockfd, &session->callee_addr, sizeof(session->callee_addr), &proxied_invite);
+    LOG_INFO("Proxied INVITE for Call-ID %s from %s to %s.",
+                session->call_id, session->caller_user_id, session->callee_user_id);
+}
+
+// Final response to a parked INVITE that will not be proxied
+static void reject_invite(int sockfd, const sip_msg_t *msg,
+                          const struct sockaddr_in *cliaddr, socklen_t cli_len,
+                          const char *status_line) {
+    char via_hdr[MAX_CONTACT_URI_LEN * 2] = "";
+    char from_hdr[MAX_CONTACT_URI_LEN]    = "";
+    char to_hdr[MAX_CONTACT_URI_LEN]      = "";
+    char call_id_hdr[MAX_CONTACT_URI_LEN] = "";
+    char cseq_hdr[MAX_CONTACT_URI_LEN]    = "";
+
+    sip_msg_copy_all_headers(msg, SIP_HDR_VIA, via_hdr, sizeof(via_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_FROM, from_hdr, sizeof(from_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_TO, to_hdr, sizeof(to_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, call_id_hdr, sizeof(call_id_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_CSEQ, cseq_hdr, sizeof(cseq_hdr));
+
+    send_sip_response(sockfd, cliaddr, cli_len, status_line,
+                      call_id_hdr, cseq_hdr, from_hdr, to_hdr, via_hdr,
+                      NULL, NULL, NULL);
+}
+
+// Second half of INVITE handling, run once the callee address is known (or not)
+static void route_invite(int sockfd, const sip_msg_t *msg,
+                         const struct sockaddr_in *cliaddr, socklen_t cli_len,
+                         const struct in_addr *callee_ip) {
+    char from_hdr[MAX_CONTACT_URI_LEN] = "";
+    char to_hdr[MAX_CONTACT_URI_LEN]   = "";
+    sip_msg_copy_header(msg, SIP_HDR_FROM, from_hdr, sizeof(from_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_TO, to_hdr, sizeof(to_hdr));
+
+    char uri[MAX_CONTACT_URI_LEN] = "";
+    char from_user_id[MAX_USER_ID_LEN] = "";
+    char from_tag[64] = "";
+    char to_user_id[MAX_USER_ID_LEN] = "";
+
+    extract_uri_from_header(from_hdr, uri, sizeof(uri));
+    parse_user_id_from_uri(uri, from_user_id, sizeof(from_user_id));
+    extract_tag_from_header(from_hdr, from_tag, sizeof(from_tag));
+    extract_uri_from_header(to_hdr, uri, sizeof(uri));
+    parse_user_id_from_uri(uri, to_user_id, sizeof(to_user_id));
+
+    char hostname_to_resolve[MAX_USER_ID_LEN + sizeof(AREDN_MESH_DOMAIN) + 1];
+    snprintf(hostname_to_resolve, sizeof(hostname_to_resolve), "%s.%s", to_user_id, AREDN_MESH_DOMAIN);
+
+    if (!callee_ip) {
+        LOG_INFO("INVITE failed: Callee %s hostname '%s' could not be resolved.", to_user_id, hostname_to_resolve);
+        reject_invite(sockfd, msg, cliaddr, cli_len, "SIP/2.0 404 Not Found");
+        return;
+    }
+
+    struct sockaddr_in resolved_callee_addr;
+    memset(&resolved_callee_addr, 0, sizeof(resolved_callee_addr));
+    resolved_callee_addr.sin_family = AF_INET;
+    resolved_callee_addr.sin_addr = *callee_ip;
+    resolved_callee_addr.sin_port = htons(SIP_PORT);
+    LOG_INFO("Resolved callee '%s' (%s) to IP %s", to_user_id, hostname_to_resolve, sockaddr_to_ip_str(&resolved_callee_addr));
+
+    // The dialog is filled in here and handed to create_call_session whole
+    CallSession details;
+    memset(&details, 0, sizeof(details));
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, details.call_id, sizeof(details.call_id));
+    snprintf(details.from_tag, sizeof(details.from_tag), "%s", from_tag);
+
+    // Same dialog already proxied (retransmission or re-INVITE): reuse it
+    CallSession *session = find_call_session_by_dialog(details.call_id, from_tag);
+    if (session) {
+        LOG_DEBUG("INVITE for existing dialog Call-ID %s; forwarding without a new session.", details.call_id);
+        proxy_invite_to_callee(sockfd, msg, session);
+        return;
+    }
+
+    sip_msg_copy_header(msg, SIP_HDR_CSEQ, details.cseq, sizeof(details.cseq));
+
+    memcpy(&details.original_caller_addr, cliaddr, cli_len);
+    memcpy(&details.callee_addr, &resolved_callee_addr, sizeof(resolved_callee_addr));
+
+    // Populate call details for dashboard display
+    snprintf(details.caller_user_id, sizeof(details.caller_user_id), "%s", from_user_id);
+    snprintf(details.callee_user_id, sizeof(details.callee_user_id), "%s", to_user_id);
+
+    // Extract display names from From and To headers
+    extract_display_name_from_header(from_hdr, from_user_id,
+                                     details.caller_display_name,
+                                     sizeof(details.caller_display_name));
+    extract_display_name_from_header(to_hdr, to_user_id,
+                                     details.callee_display_name,
+                                     sizeof(details.callee_display_name));
+
+    // Extract codec from SDP body
+    extract_codec_from_sdp(msg, details.codec, sizeof(details.codec));
+
+    // Store callee hostname for traceroute
+    snprintf(details.callee_hostname, sizeof(details.callee_hostname), "%s", hostname_to_resolve);
+
+    details.state = CALL_STATE_INVITE_SENT;
+
+    session = create_call_session(&details);
+    if (!session) {
+        LOG_INFO("INVITE failed: Max call sessions reached.");
+        reject_invite(sockfd, msg, cliaddr, cli_len, "SIP/2.0 503 Service Unavailable");
+        return;
+    }
+
+    LOG_DEBUG("Callee '%s' target: %s:%d",
+                to_user_id, sockaddr_to_ip_str(&session->callee_addr), ntohs(session->callee_addr.sin_port));
+    mark_active_calls_dirty();
+
+    proxy_invite_to_callee(sockfd, msg, session);
+}
+
+// Resolver callback: resume the parked INVITE with the lookup result
+static void resume_pending_invite(void *arg, dns_resolve_status_t status,
+                                  const struct in_addr *addr, uint32_t ttl) {
+    PendingInvite *p = (PendingInvite *)arg;
+    if (!p->in_use) {
+        return;
+    }
+
+    // Share definitive answers with the other resolver users; timeouts are not cached
+    if (status == DNS_RESOLVE_OK) {
+        dns_cache_store(p->hostname, addr, ttl);
+    } else if (status == DNS_RESOLVE_NOT_FOUND) {
+        dns_cache_store(p->hostname, NULL, 0);
+    }
+    if (p->cancelled) {
+        LOG_DEBUG("Dropping cancelled INVITE for Call-ID %s after lookup.", p->call_id);
+        release_pending_invite(p);
+        return;
+    }
+
+    if (status != DNS_RESOLVE_OK) {
+        LOG_DEBUG("Callee lookup for Call-ID %s finished: %s", p->call_id, dns_resolve_status_str(status));
+    }
+    route_invite(p->sockfd, &p->msg, &p->cliaddr, p->cli_len, status == DNS_RESOLVE_OK ? addr : NULL);
+    release_pending_invite(p);
+}
+
 void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
                                   const struct sockaddr_in *cliaddr, socklen_t cli_len) {
-    char first_line[MAX_SIP_MSG_LEN];
-    get_first_line(buffer, first_line, sizeof(first_line));
+    if (n < 10) {
+        return;
+    }
 
-    if (n < 10 || strlen(first_line) == 0) {
+    // Index the start line and all headers in a single pass; everything below reads from it
+    sip_msg_t msg;
+    if (sip_msg_parse(&msg, buffer, (size_t)n) != 0) {
+        LOG_DEBUG("Received malformed SIP start line from %s:%d. Ignoring.",
+                    sockaddr_to_ip_str(cliaddr), ntohs(cliaddr->sin_port));
         return;
     }
+    process_parsed_sip_message(sockfd, &msg, cliaddr, cli_len);
+}
+
+void process_parsed_sip_message(int sockfd, const sip_msg_t *msg,
+                                const struct sockaddr_in *cliaddr, socklen_t cli_len) {
+    const char *buffer = msg->buf;
+    ssize_t n = (ssize_t)msg->len;
+
+    // Under overload, REGISTER/OPTIONS are turned away before any header is copied
+    if (sip_overload_should_shed(msg)) {
+        send_overload_response(sockfd, cliaddr, cli_len, msg);
+        return;
+    }
+
+    char first_line[256];
+    sip_msg_copy_start_line(msg, first_line, sizeof(first_line));
 
-    char via_hdr[MAX_CONTACT_URI_LEN]     = "";
+    char via_hdr[MAX_CONTACT_URI_LEN * 2] = ""; // All Via values, joined (multi-valued)
     char from_hdr[MAX_CONTACT_URI_LEN]    = "";
     char to_hdr[MAX_CONTACT_URI_LEN]      = "";
     char call_id_hdr[MAX_CONTACT_URI_LEN] = "";
     char cseq_hdr[MAX_CONTACT_URI_LEN]    = "";
     char contact_hdr[MAX_CONTACT_URI_LEN] = ""; // Still extract for parsing REGISTER/INVITE
 
-    extract_sip_header(buffer, "Via:", via_hdr, sizeof(via_hdr));
-    extract_sip_header(buffer, "From:", from_hdr, sizeof(from_hdr));
-    extract_sip_header(buffer, "To:", to_hdr, sizeof(to_hdr));
-    extract_sip_header(buffer, "Call-ID:", call_id_hdr, sizeof(call_id_hdr));
-    extract_sip_header(buffer, "CSeq:", cseq_hdr, sizeof(cseq_hdr));
-    extract_sip_header(buffer, "Contact:", contact_hdr, sizeof(contact_hdr));
+    sip_msg_copy_all_headers(msg, SIP_HDR_VIA, via_hdr, sizeof(via_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_FROM, from_hdr, sizeof(from_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_TO, to_hdr, sizeof(to_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, call_id_hdr, sizeof(call_id_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_CSEQ, cseq_hdr, sizeof(cseq_hdr));
+    sip_msg_copy_header(msg, SIP_HDR_CONTACT, contact_hdr, sizeof(contact_hdr));
 
 
-    if (strncmp(first_line, "SIP/2.0", 7) == 0) {
+    if (msg->is_response) {
         LOG_INFO("Received SIP Response: %s", first_line);
 
         CallSession *session = find_call_session_by_callid(call_id_hdr);
         if (session) {
             LOG_DEBUG("Matching session found for response: %s", session->call_id);
 
+            // No Via of our own is added, so the top Via is the caller's request transaction
+            sip_txn_key_t txn_key;
+            bool have_txn_key = sip_txn_key_from_msg(msg, &txn_key) == 0;
+
             // For INVITE responses, add Record-Route header before forwarding
             if (strstr(cseq_hdr, "INVITE")) {
-                char modified_response[MAX_SIP_MSG_LEN];
-                add_record_route_to_response(buffer, modified_response, sizeof(modified_response));
-                send_sip_message(sockfd, &session->original_caller_addr, sizeof(session->original_caller_addr), modified_response);
+                sip_splice_t modified_response;
+                if (splice_response_with_record_route(msg, &modified_response) == 0) {
+                    if (have_txn_key) {
+                        sip_txn_record_response(&txn_key, modified_response.iov, modified_response.iovcnt);
+                    }
+                    send_sip_splice(sockfd, &session->original_caller_addr, sizeof(session->original_caller_addr), &modified_response);
+                }
                 LOG_DEBUG("Proxied INVITE response with Record-Route for Call-ID %s to original caller (%s:%d).",
                             session->call_id, sockaddr_to_ip_str(&session->original_caller_addr),
                             ntohs(session->original_caller_addr.sin_port));
             } else {
                 // For non-INVITE responses, forward as-is
+                if (have_txn_key) {
+                    struct iovec iov = { .iov_base = (void *)buffer, .iov_len = (size_t)n };
+                    sip_txn_record_response(&txn_key, &iov, 1);
+                }
                 send_sip_message(sockfd, &session->original_caller_addr, sizeof(session->original_caller_addr), buffer);
                 LOG_DEBUG("Proxied response for Call-ID %s to original caller (%s:%d).",
                             session->call_id, sockaddr_to_ip_str(&session->original_caller_addr),
                             ntohs(session->original_caller_addr.sin_port));
             }
 
-            if (strstr(first_line, "200 OK") && strstr(cseq_hdr, "INVITE")) {
-                session->state = CALL_STATE_ESTABLISHED;
+            if (msg->status_code == 200 && strstr(cseq_hdr, "INVITE")) {
+                call_session_set_state(session, CALL_STATE_ESTABLISHED);
                 LOG_INFO("Call-ID %s state changed to ESTABLISHED.", session->call_id);
-                export_active_calls_json();
-            } else if (strstr(first_line, "4") == first_line + 8 || strstr(first_line, "5") == first_line + 8 || strstr(first_line, "6") == first_line + 8) {
+                mark_active_calls_dirty();
+            } else if (msg->status_code >= 400 && msg->status_code < 700) {
                 LOG_WARN("Received error response for Call-ID %s: %s", session->call_id, first_line);
                 terminate_call_session(session);
-                export_active_calls_json();
-            } else if (strstr(first_line, "180 Ringing") || strstr(first_line, "183 Session Progress")) {
-                session->state = CALL_STATE_RINGING;
+                mark_active_calls_dirty();
+            } else if (msg->status_code == 180 || msg->status_code == 183) {
+                call_session_set_state(session, CALL_STATE_RINGING);
                 LOG_INFO("Call-ID %s state changed to RINGING.", session->call_id);
-                export_active_calls_json();
+                mark_active_calls_dirty();
             }
         } else {
             LOG_WARN("SIP response received with no matching call session: %s", call_id_hdr);
         }
     } else {
         char method[32];
-        get_sip_method(first_line, method, sizeof(method));
+        sip_msg_copy_method(msg, method, sizeof(method));
         if (!*method) {
             LOG_DEBUG("Received invalid SIP request format from %s:%d. Ignoring.",
                         sockaddr_to_ip_str(cliaddr),
@@ -580,6 +822,11 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
         }
         LOG_DEBUG("Identified incoming as SIP Request: %s.", method);
 
+        // Retransmissions are answered from the transaction table and go no further
+        if (sip_txn_on_request(sockfd, msg, cliaddr, cli_len) == SIP_TXN_ABSORBED) {
+            return;
+        }
+
         char from_uri[MAX_CONTACT_URI_LEN] = "";
         char from_user_id[MAX_USER_ID_LEN] = "";
         char from_tag[64] = "";
@@ -595,10 +842,16 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
 
 
         if (strcmp(method, "REGISTER") == 0) {
+            // Contact ";expires=" wins over the Expires header (RFC 3261 10.2.1.1); neither means the server default
+            int requested = -1;
+            const char *contact_expires = strcasestr(contact_hdr, ";expires=");
             char expires_hdr[32] = "";
-            extract_sip_header(buffer, "Expires:", expires_hdr,
-                               sizeof(expires_hdr));
-            int expires = atoi(expires_hdr);
+            if (contact_expires) {
+                requested = atoi(contact_expires + strlen(";expires="));
+            } else if (sip_msg_copy_header(msg, SIP_HDR_EXPIRES, expires_hdr, sizeof(expires_hdr)) && expires_hdr[0]) {
+                requested = atoi(expires_hdr);
+            }
+            int expires = registration_grant_expires(requested);
 
             char display_name[MAX_DISPLAY_NAME_LEN] = "";
             extract_display_name_from_header(from_hdr, from_user_id, display_name, sizeof(display_name));
@@ -606,14 +859,8 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
             // Call simplified add_or_update_registered_user
             add_or_update_registered_user(from_user_id, display_name, expires);
 
-            send_response_to_registered(sockfd,
-                                        from_user_id,
-                                        cliaddr, cli_len,
-                                        "SIP/2.0 200 OK",
-                                        call_id_hdr, cseq_hdr,
-                                        from_hdr, to_hdr, via_hdr,
-                                        contact_hdr, // Respond with client's Contact
-                                        "Expires: 3600", NULL); // Default expiry is fine
+            // 200 OK echoing the client's Contact with the Expires actually granted
+            send_templated_response(sockfd, cliaddr, cli_len, &register_ok_template, msg, expires);
             LOG_INFO("REGISTER processed for user %s from %s:%d. Expires: %d.",
                         from_user_id, sockaddr_to_ip_str(cliaddr),
                         ntohs(cliaddr->sin_port), expires);
@@ -621,45 +868,46 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
         } else if (strcmp(method, "INVITE") == 0) {
             LOG_INFO("Received INVITE for %s from %s.", to_user_id, from_user_id);
 
-            // Route based on DNS resolution (works for both local and remote phones)
-            struct sockaddr_in resolved_callee_addr;
-            memset(&resolved_callee_addr, 0, sizeof(resolved_callee_addr));
-            resolved_callee_addr.sin_family = AF_INET;
+            // Retransmissions of an INVITE that is still resolving are absorbed here
+            if (find_pending_invite(call_id_hdr)) {
+                LOG_DEBUG("INVITE retransmission for Call-ID %s while callee lookup is pending. Ignoring.", call_id_hdr);
+                return;
+            }
 
+            // Route based on the callee's mesh address (works for both local and remote phones).
+            // A name in the arednlink host table or a cached answer routes immediately;
+            // otherwise the DNS lookup is asynchronous: park the INVITE and resume it
+            // from the resolver callback.
             char hostname_to_resolve[MAX_USER_ID_LEN + sizeof(AREDN_MESH_DOMAIN) + 1];
             snprintf(hostname_to_resolve, sizeof(hostname_to_resolve), "%s.%s", to_user_id, AREDN_MESH_DOMAIN);
 
-            struct addrinfo hints, *res;
-            int status;
-            bool resolved = false;
-
-            memset(&hints, 0, sizeof hints);
-            hints.ai_family = AF_INET;
-            hints.ai_socktype = SOCK_DGRAM;
-
-            if ((status = getaddrinfo(hostname_to_resolve, NULL, &hints, &res)) != 0) {
-                LOG_ERROR("getaddrinfo for %s failed: %s", hostname_to_resolve, gai_strerror(status));
-            } else {
-                struct sockaddr_in *ipv4 = (struct sockaddr_in *)res->ai_addr;
-                if (inet_pton(AF_INET, sockaddr_to_ip_str(ipv4), &resolved_callee_addr.sin_addr) > 0) {
-                    resolved = true;
-                    LOG_INFO("Resolved callee '%s' (%s) to IP %s", to_user_id, hostname_to_resolve, sockaddr_to_ip_str(ipv4));
-                }
-                freeaddrinfo(res);
+            struct in_addr cached_addr;
+            dns_cache_result_t cached = DNS_CACHE_HIT;
+            if (mesh_hosts_lookup(hostname_to_resolve, &cached_addr) != 0) {
+                cached = dns_cache_lookup(hostname_to_resolve, &cached_addr);
             }
-
-            if (!resolved) {
-                LOG_INFO("INVITE failed: Callee %s hostname '%s' could not be resolved.", to_user_id, hostname_to_resolve);
-                send_response_to_registered(sockfd, from_user_id, cliaddr, cli_len,
-                                            "SIP/2.0 404 Not Found", call_id_hdr, cseq_hdr,
-                                            from_hdr, to_hdr, via_hdr, NULL, NULL, NULL);
+            if (cached != DNS_CACHE_MISS) {
+                if (cached == DNS_CACHE_HIT) {
+                    send_response_to_registered(sockfd,
+                                                from_user_id,
+                                                cliaddr, cli_len,
+                                                "SIP/2.0 100 Trying",
+                                                call_id_hdr, cseq_hdr,
+                                                from_hdr, to_hdr, via_hdr,
+                                                NULL,
+                                                NULL, NULL);
+                    LOG_INFO("Sent 100 Trying for Call-ID %s.", call_id_hdr);
+                }
+                route_invite(sockfd, msg, cliaddr, cli_len, cached == DNS_CACHE_HIT ? &cached_addr : NULL);
                 return;
             }
-            resolved_callee_addr.sin_port = htons(SIP_PORT);
 
-            CallSession *session = create_call_session();
-            if (!session) {
-                LOG_INFO("INVITE failed: Max call sessions reached.");
+            PendingInvite *pending = park_invite(sockfd, buffer, n, cliaddr, cli_len, call_id_hdr, hostname_to_resolve);
+            if (!pending || dns_resolver_query_a(hostname_to_resolve, resume_pending_invite, pending) != 0) {
+                if (pending) {
+                    release_pending_invite(pending);
+                }
+                LOG_WARN("INVITE failed: Cannot start lookup of '%s' for Call-ID %s.", hostname_to_resolve, call_id_hdr);
                 send_response_to_registered(sockfd,
                                             from_user_id,
                                             cliaddr, cli_len,
@@ -669,40 +917,8 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
                                             NULL, NULL, NULL);
                 return;
             }
-            strncpy(session->call_id, call_id_hdr, sizeof(session->call_id) - 1);
-            session->call_id[sizeof(session->call_id) - 1] = '\0';
-            strncpy(session->cseq, cseq_hdr, sizeof(session->cseq) - 1);
-            session->cseq[sizeof(session->cseq) - 1] = '\0';
-            strncpy(session->from_tag, from_tag, sizeof(session->from_tag) - 1);
-            session->from_tag[sizeof(session->from_tag) - 1] = '\0';
-
-            memcpy(&session->original_caller_addr, cliaddr, cli_len);
-            memcpy(&session->callee_addr, &resolved_callee_addr, sizeof(resolved_callee_addr));
-
-            // Populate call details for dashboard display
-            strncpy(session->caller_user_id, from_user_id, sizeof(session->caller_user_id) - 1);
-            session->caller_user_id[sizeof(session->caller_user_id) - 1] = '\0';
-            strncpy(session->callee_user_id, to_user_id, sizeof(session->callee_user_id) - 1);
-            session->callee_user_id[sizeof(session->callee_user_id) - 1] = '\0';
-
-            // Extract display names from From and To headers
-            extract_display_name_from_header(from_hdr, from_user_id,
-                                             session->caller_display_name,
-                                             sizeof(session->caller_display_name));
-            extract_display_name_from_header(to_hdr, to_user_id,
-                                             session->callee_display_name,
-                                             sizeof(session->callee_display_name));
-
-            // Extract codec from SDP body
-            extract_codec_from_sdp(buffer, session->codec, sizeof(session->codec));
-
-            // Store callee hostname for traceroute
-            strncpy(session->callee_hostname, hostname_to_resolve, sizeof(session->callee_hostname) - 1);
-            session->callee_hostname[sizeof(session->callee_hostname) - 1] = '\0';
-
-            LOG_DEBUG("Callee '%s' target: %s:%d",
-                        to_user_id, sockaddr_to_ip_str(&session->callee_addr), ntohs(session->callee_addr.sin_port));
 
+            // 100 Trying right away stops the caller retransmitting while we resolve
             send_response_to_registered(sockfd,
                                         from_user_id,
                                         cliaddr, cli_len,
@@ -711,26 +927,13 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
                                         from_hdr, to_hdr, via_hdr,
                                         NULL,
                                         NULL, NULL);
-            LOG_INFO("Sent 100 Trying for Call-ID %s.", session->call_id);
-            session->state = CALL_STATE_INVITE_SENT;
-            export_active_calls_json();
-
-            char new_request_line_uri[MAX_CONTACT_URI_LEN];
-            snprintf(new_request_line_uri, sizeof(new_request_line_uri),
-                     "sip:%s@%s:%d", to_user_id, sockaddr_to_ip_str(&resolved_callee_addr), SIP_PORT);
-
-            char proxied_invite[MAX_SIP_MSG_LEN];
-            reconstruct_invite_message(buffer, new_request_line_uri, proxied_invite, sizeof(proxied_invite));
-
-            send_sip_message(sockfd, &session->callee_addr, sizeof(session->callee_addr), proxied_invite);
-            LOG_INFO("Proxied INVITE for Call-ID %s from %s to %s.",
-                        session->call_id, from_user_id, to_user_id);
+            LOG_INFO("Sent 100 Trying for Call-ID %s, resolving '%s'.", call_id_hdr, hostname_to_resolve);
 
         } else if (strcmp(method, "BYE") == 0) {
             LOG_INFO("Received BYE for Call-ID %s.", call_id_hdr);
             CallSession *session = find_call_session_by_callid(call_id_hdr);
             if (session) {
-                session->state = CALL_STATE_TERMINATING;
+                call_session_set_state(session, CALL_STATE_TERMINATING);
 
                 struct sockaddr_in other_party_addr;
                 bool is_caller_sending_bye = (strcmp(sockaddr_to_ip_str(&session->original_caller_addr), sockaddr_to_ip_str(cliaddr)) == 0 &&
@@ -759,7 +962,7 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
                                             NULL, NULL, NULL);
                 LOG_INFO("BYE processed and session %s terminated.", session->call_id);
                 terminate_call_session(session);
-                export_active_calls_json();
+                mark_active_calls_dirty();
             } else {
                 LOG_INFO("BYE failed: No matching call session for Call-ID %s.", call_id_hdr);
                 send_response_to_registered(sockfd,
@@ -773,8 +976,22 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
 
         } else if (strcmp(method, "CANCEL") == 0) {
             LOG_INFO("Received CANCEL for Call-ID %s.", call_id_hdr);
+            PendingInvite *pending = find_pending_invite(call_id_hdr);
             CallSession *session = find_call_session_by_callid(call_id_hdr);
-            if (session &&
+            if (pending) {
+                // INVITE never left the proxy: answer it here, drop it once the lookup completes
+                pending->cancelled = true;
+                send_response_to_registered(sockfd,
+                                            from_user_id,
+                                            cliaddr, cli_len,
+                                            "SIP/2.0 200 OK",
+                                            call_id_hdr, cseq_hdr,
+                                            from_hdr, to_hdr, via_hdr,
+                                            NULL, NULL, NULL);
+                reject_invite(sockfd, &pending->msg, &pending->cliaddr, pending->cli_len,
+                              "SIP/2.0 487 Request Terminated");
+                LOG_INFO("CANCEL processed for Call-ID %s while callee lookup was pending.", call_id_hdr);
+            } else if (session &&
                (session->state == CALL_STATE_INVITE_SENT ||
                 session->state == CALL_STATE_RINGING)) {
 
@@ -792,7 +1009,7 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
                                             NULL, NULL, NULL);
                 LOG_INFO("CANCEL processed and session %s terminated.", session->call_id);
                 terminate_call_session(session);
-                export_active_calls_json();
+                mark_active_calls_dirty();
             } else {
                 LOG_INFO("CANCEL failed: No matching call session or invalid state for Call-ID %s.", call_id_hdr);
                 send_response_to_registered(sockfd,
@@ -806,15 +1023,8 @@ void process_incoming_sip_message(int sockfd, const char *buffer, ssize_t n,
 
         } else if (strcmp(method, "OPTIONS") == 0) {
             LOG_INFO("Received OPTIONS from %s:%d. Responding 200 OK.", sockaddr_to_ip_str(cliaddr), ntohs(cliaddr->sin_port));
-            send_response_to_registered(sockfd,
-                                        from_user_id,
-                                        cliaddr, cli_len,
-                                        "SIP/2.0 200 OK",
-                                        call_id_hdr, cseq_hdr,
-                                        from_hdr, to_hdr, via_hdr,
-                                        NULL, // No specific contact URI to echo back for OPTIONS
-                                        "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REGISTER, SUBSCRIBE, NOTIFY, REFER, INFO, MESSAGE, UPDATE",
-                                        NULL);
+            // Keepalives from every phone: the bulk of our traffic, so no per-reply formatting
+            send_templated_response(sockfd, cliaddr, cli_len, &options_ok_template, msg, -1);
 
         } else if (strcmp(method, "ACK") == 0) {
             LOG_INFO("Received ACK for Call-ID %s.", call_id_hdr);
@@ -0,0 +1,230 @@
+// sip_core/sip_message.c - One-pass SIP message tokenizer
+#include "sip_message.h"
+#include "../common.h"
+#include <strings.h> // For strncasecmp
+
+#define MODULE_NAME "SIP_MSG"
+
+// Header names are case-insensitive (RFC 3261 7.3.1); compact forms are single letters
+static sip_hdr_id_t classify_header_name(const char *name, size_t len) {
+    if (len == 1) {
+        switch (tolower((unsigned char)name[0])) {
+            case 'v': return SIP_HDR_VIA;
+            case 'f': return SIP_HDR_FROM;
+            case 't': return SIP_HDR_TO;
+            case 'i': return SIP_HDR_CALL_ID;
+            case 'm': return SIP_HDR_CONTACT;
+            case 'l': return SIP_HDR_CONTENT_LENGTH;
+            default:  return SIP_HDR_OTHER;
+        }
+    }
+
+    switch (len) {
+        case 2:  if (strncasecmp(name, "To", 2) == 0) return SIP_HDR_TO; break;
+        case 3:  if (strncasecmp(name, "Via", 3) == 0) return SIP_HDR_VIA; break;
+        case 4:
+            if (strncasecmp(name, "From", 4) == 0) return SIP_HDR_FROM;
+            if (strncasecmp(name, "CSeq", 4) == 0) return SIP_HDR_CSEQ;
+            break;
+        case 7:
+            if (strncasecmp(name, "Call-ID", 7) == 0) return SIP_HDR_CALL_ID;
+            if (strncasecmp(name, "Contact", 7) == 0) return SIP_HDR_CONTACT;
+            if (strncasecmp(name, "Expires", 7) == 0) return SIP_HDR_EXPIRES;
+            break;
+        case 12: if (strncasecmp(name, "Record-Route", 12) == 0) return SIP_HDR_RECORD_ROUTE; break;
+        case 14: if (strncasecmp(name, "Content-Length", 14) == 0) return SIP_HDR_CONTENT_LENGTH; break;
+        default: break;
+    }
+    return SIP_HDR_OTHER;
+}
+
+// Returns the offset of the next line start; *content_end is the end of the line content
+static uint32_t next_line(const char *buf, uint32_t pos, uint32_t len, uint32_t *content_end) {
+    const char *nl = memchr(buf + pos, '\n', len - pos);
+    if (!nl) {
+        *content_end = len;
+        return len;
+    }
+    uint32_t nl_off = (uint32_t)(nl - buf);
+    *content_end = (nl_off > pos && buf[nl_off - 1] == '\r') ? nl_off - 1 : nl_off;
+    return nl_off + 1;
+}
+
+static int parse_start_line(sip_msg_t *msg) {
+    const char *line = msg->buf;
+    uint32_t line_len = msg->start_line_len;
+
+    if (line_len >= 12 && strncmp(line, "SIP/2.0 ", 8) == 0) {
+        if (!isdigit((unsigned char)line[8]) || !isdigit((unsigned char)line[9]) ||
+            !isdigit((unsigned char)line[10])) {
+            return -1;
+        }
+        msg->is_response = true;
+        msg->status_code = (line[8] - '0') * 100 + (line[9] - '0') * 10 + (line[10] - '0');
+        return 0;
+    }
+
+    const char *sp1 = memchr(line, ' ', line_len);
+    if (!sp1 || sp1 == line) {
+        return -1;
+    }
+    msg->is_response = false;
+    msg->method_len = (uint32_t)(sp1 - line);
+    msg->uri_off = msg->method_len + 1;
+
+    const char *uri = line + msg->uri_off;
+    const char *sp2 = memchr(uri, ' ', line_len - msg->uri_off);
+    msg->uri_len = sp2 ? (uint32_t)(sp2 - uri) : line_len - msg->uri_off;
+    return 0;
+}
+
+int sip_msg_parse(sip_msg_t *msg, const char *buf, size_t len) {
+    msg->buf = buf;
+    msg->len = (uint32_t)len;
+    msg->is_response = false;
+    msg->status_code = 0;
+    msg->method_len = 0;
+    msg->uri_off = 0;
+    msg->uri_len = 0;
+    msg->hdr_count = 0;
+    memset(msg->first, -1, sizeof(msg->first));
+
+    uint32_t content_end;
+    uint32_t pos = next_line(buf, 0, msg->len, &content_end);
+    msg->start_line_len = content_end;
+    msg->headers_off = pos;
+    msg->body_off = msg->len;
+    msg->body_len = 0;
+
+    if (msg->start_line_len == 0 || parse_start_line(msg) != 0) {
+        return -1;
+    }
+
+    sip_hdr_t *prev = NULL;
+    while (pos < msg->len) {
+        uint32_t line_start = pos;
+        pos = next_line(buf, pos, msg->len, &content_end);
+
+        // Blank line: end of headers
+        if (content_end == line_start) {
+            msg->body_off = pos;
+            msg->body_len = msg->len - pos;
+            break;
+        }
+
+        // Folded continuation of the previous header (RFC 3261 7.3.1)
+        if (buf[line_start] == ' ' || buf[line_start] == '\t') {
+            if (prev) {
+                uint32_t end = content_end;
+                while (end > line_start && (buf[end - 1] == ' ' || buf[end - 1] == '\t')) end--;
+                prev->line_len = content_end - prev->line_off;
+                if (end > line_start) {
+                    if (prev->value_len == 0) {
+                        uint32_t v = line_start;
+                        while (v < end && (buf[v] == ' ' || buf[v] == '\t')) v++;
+                        prev->value_off = v;
+                    }
+                    prev->value_len = end - prev->value_off;
+                }
+            }
+            continue;
+        }
+
+        const char *colon = memchr(buf + line_start, ':', content_end - line_start);
+        if (!colon) {
+            LOG_DEBUG("Ignoring malformed header line at offset %u", line_start);
+            prev = NULL;
+            continue;
+        }
+
+        if (msg->hdr_count >= SIP_MSG_MAX_HEADERS) {
+            LOG_DEBUG("Header table full (%d), ignoring remaining headers", SIP_MSG_MAX_HEADERS);
+            prev = NULL;
+            continue;
+        }
+
+        uint32_t name_end = (uint32_t)(colon - buf);
+        while (name_end > line_start && (buf[name_end - 1] == ' ' || buf[name_end - 1] == '\t')) name_end--;
+
+        uint32_t value_off = (uint32_t)(colon - buf) + 1;
+        while (value_off < content_end && (buf[value_off] == ' ' || buf[value_off] == '\t')) value_off++;
+        uint32_t value_end = content_end;
+        while (value_end > value_off && (buf[value_end - 1] == ' ' || buf[value_end - 1] == '\t')) value_end--;
+
+        sip_hdr_t *h = &msg->hdrs[msg->hdr_count];
+        h->id = classify_header_name(buf + line_start, name_end - line_start);
+        h->line_off = line_start;
+        h->line_len = content_end - line_start;
+        h->value_off = value_off;
+        h->value_len = value_end - value_off;
+
+        if (msg->first[h->id] < 0) {
+            msg->first[h->id] = (int8_t)msg->hdr_count;
+        }
+        msg->hdr_count++;
+        prev = h;
+    }
+
+    return 0;
+}
+
+const sip_hdr_t *sip_msg_header(const sip_msg_t *msg, sip_hdr_id_t id) {
+    int idx = msg->first[id];
+    return idx >= 0 ? &msg->hdrs[idx] : NULL;
+}
+
+const sip_hdr_t *sip_msg_next_header(const sip_msg_t *msg, const sip_hdr_t *prev) {
+    for (const sip_hdr_t *h = prev + 1; h < msg->hdrs + msg->hdr_count; h++) {
+        if (h->id == prev->id) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+static size_t copy_span(const char *src, size_t src_len, char *buf, size_t len) {
+    if (len == 0) return 0;
+    if (src_len >= len) src_len = len - 1;
+    memcpy(buf, src, src_len);
+    buf[src_len] = '\0';
+    return src_len;
+}
+
+int sip_msg_copy_header(const sip_msg_t *msg, sip_hdr_id_t id, char *buf, size_t len) {
+    const sip_hdr_t *h = sip_msg_header(msg, id);
+    if (!h) {
+        if (len > 0) buf[0] = '\0';
+        return 0;
+    }
+    copy_span(msg->buf + h->value_off, h->value_len, buf, len);
+    return 1;
+}
+
+int sip_msg_copy_all_headers(const sip_msg_t *msg, sip_hdr_id_t id, char *buf, size_t len) {
+    size_t written = 0;
+    int count = 0;
+    if (len > 0) buf[0] = '\0';
+
+    for (const sip_hdr_t *h = sip_msg_header(msg, id); h; h = sip_msg_next_header(msg, h)) {
+        if (count > 0) {
+            if (written + 2 >= len) break;
+            memcpy(buf + written, ", ", 2);
+            written += 2;
+        }
+        written += copy_span(msg->buf + h->value_off, h->value_len, buf + written, len - written);
+        count++;
+        if (written + 1 >= len) {
+            LOG_DEBUG("Joined header values truncated at %zu bytes", written);
+            break;
+        }
+    }
+    return count;
+}
+
+void sip_msg_copy_start_line(const sip_msg_t *msg, char *buf, size_t len) {
+    copy_span(msg->buf, msg->start_line_len, buf, len);
+}
+
+void sip_msg_copy_method(const sip_msg_t *msg, char *buf, size_t len) {
+    copy_span(msg->buf, msg->method_len, buf, len);
+}
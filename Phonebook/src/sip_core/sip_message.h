@@ -0,0 +1,79 @@
+// sip_core/sip_message.h
+#ifndef SIP_MESSAGE_H
+#define SIP_MESSAGE_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// One-pass SIP message index.
+// sip_msg_parse() walks the datagram exactly once and records the start line
+// and every header as offset/length pairs into the original buffer. Nothing
+// is copied; consumers read header values straight from the table instead of
+// re-scanning the whole message with strstr() for every header they need.
+
+#define SIP_MSG_MAX_HEADERS 64
+
+// Headers the proxy and softphone care about. Everything else is indexed as
+// SIP_HDR_OTHER so it can still be iterated (e.g. when re-emitting a message).
+typedef enum {
+    SIP_HDR_OTHER = 0,
+    SIP_HDR_VIA,             // compact form: v
+    SIP_HDR_FROM,            // compact form: f
+    SIP_HDR_TO,              // compact form: t
+    SIP_HDR_CALL_ID,         // compact form: i
+    SIP_HDR_CSEQ,
+    SIP_HDR_CONTACT,         // compact form: m
+    SIP_HDR_EXPIRES,
+    SIP_HDR_CONTENT_LENGTH,  // compact form: l
+    SIP_HDR_RECORD_ROUTE,
+    SIP_HDR_ID_COUNT
+} sip_hdr_id_t;
+
+typedef struct {
+    sip_hdr_id_t id;
+    uint32_t line_off;   // Start of the header line (header name)
+    uint32_t line_len;   // Whole header line incl. folded continuations, excl. line ending
+    uint32_t value_off;  // Start of the value (after ':' and leading whitespace)
+    uint32_t value_len;  // Value length, trailing whitespace trimmed
+} sip_hdr_t;
+
+typedef struct {
+    const char *buf;         // Original message (not owned, must outlive the index)
+    uint32_t len;
+    uint32_t start_line_len; // Start line length, excl. line ending
+    bool is_response;
+    int status_code;         // Responses only
+    uint32_t method_len;     // Requests only: method starts at offset 0
+    uint32_t uri_off;        // Requests only: Request-URI
+    uint32_t uri_len;
+    uint32_t headers_off;    // First header line
+    uint32_t body_off;       // First byte after the blank line (== len if none)
+    uint32_t body_len;
+    int hdr_count;
+    sip_hdr_t hdrs[SIP_MSG_MAX_HEADERS];
+    int8_t first[SIP_HDR_ID_COUNT];  // Index of first header with that id, or -1
+} sip_msg_t;
+
+// Build the index. Returns 0 on success, -1 if the start line is missing or malformed.
+// Headers beyond SIP_MSG_MAX_HEADERS are ignored (logged at debug level).
+int sip_msg_parse(sip_msg_t *msg, const char *buf, size_t len);
+
+// First header with the given id, or NULL
+const sip_hdr_t *sip_msg_header(const sip_msg_t *msg, sip_hdr_id_t id);
+
+// Next header with the same id as prev (e.g. further Via lines), or NULL
+const sip_hdr_t *sip_msg_next_header(const sip_msg_t *msg, const sip_hdr_t *prev);
+
+// Copy the first value of a header into buf (NUL-terminated, truncated to fit).
+// Returns 1 if found, 0 if not (buf is set to "").
+int sip_msg_copy_header(const sip_msg_t *msg, sip_hdr_id_t id, char *buf, size_t len);
+
+// Copy all values of a multi-valued header (e.g. every Via line) joined with ", ".
+// Returns the number of header lines copied.
+int sip_msg_copy_all_headers(const sip_msg_t *msg, sip_hdr_id_t id, char *buf, size_t len);
+
+// Copy the start line / method into buf (NUL-terminated, truncated to fit)
+void sip_msg_copy_start_line(const sip_msg_t *msg, char *buf, size_t len);
+void sip_msg_copy_method(const sip_msg_t *msg, char *buf, size_t len);
+
+#endif // SIP_MESSAGE_H
@@ -0,0 +1,130 @@
+// sip_core/sip_overload.c - Backlog and latency driven shedding of REGISTER/OPTIONS
+#include "sip_overload.h"
+#include "sip_transport.h"                // For SIP_BATCH_MAX
+#include "../config_loader/config_loader.h"
+
+#define MODULE_NAME "SIP_OVERLOAD"
+
+// Written with relaxed atomics from the main loop and the workers. A lost
+// latency sample under a race only delays the average by one batch.
+static bool overloaded = false;
+static int backlog_run = 0;         // Main loop only
+static int backlog = 0;
+static int max_backlog = 0;
+static unsigned latency_scaled = 0; // Average << SIP_OVERLOAD_EWMA_SHIFT, keeps sub-8 us samples
+static unsigned long long episodes = 0;
+static unsigned long long shed_register = 0;
+static unsigned long long shed_options = 0;
+
+uint64_t sip_overload_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// A threshold of 0 disables that signal
+static bool above(unsigned value, unsigned threshold) {
+    return threshold > 0 && value >= threshold;
+}
+
+static bool below_half(unsigned value, unsigned threshold) {
+    return threshold == 0 || value < threshold / 2;
+}
+
+static void evaluate(void) {
+    unsigned depth = (unsigned)__atomic_load_n(&backlog, __ATOMIC_RELAXED);
+    unsigned latency = __atomic_load_n(&latency_scaled, __ATOMIC_RELAXED) >> SIP_OVERLOAD_EWMA_SHIFT;
+    unsigned depth_limit = (unsigned)g_sip_overload_queue_depth;
+    unsigned latency_limit = (unsigned)g_sip_overload_latency_ms * 1000;
+
+    bool expected = false;
+    if (above(depth, depth_limit) || above(latency, latency_limit)) {
+        if (__atomic_compare_exchange_n(&overloaded, &expected, true, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            __atomic_add_fetch(&episodes, 1, __ATOMIC_RELAXED);
+            LOG_WARN("SIP overload: backlog %u, %u us per message. Shedding REGISTER and OPTIONS.",
+                     depth, latency);
+        }
+    } else if (below_half(depth, depth_limit) && below_half(latency, latency_limit)) {
+        expected = true;
+        if (__atomic_compare_exchange_n(&overloaded, &expected, false, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            LOG_INFO("SIP overload cleared: backlog %u, %u us per message.", depth, latency);
+        }
+    }
+}
+
+void sip_overload_note_backlog(int received, int queued) {
+    // A full batch means the socket still had more waiting: keep counting the run
+    backlog_run = received >= SIP_BATCH_MAX ? backlog_run + received : received;
+    int depth = backlog_run + queued;
+
+    __atomic_store_n(&backlog, depth, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&max_backlog, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&max_backlog, depth, __ATOMIC_RELAXED);
+    }
+    evaluate();
+}
+
+void sip_overload_note_processing(uint64_t started_us, int messages) {
+    if (messages <= 0) {
+        return;
+    }
+    uint64_t elapsed = sip_overload_now_us() - started_us;
+    unsigned sample = (unsigned)(elapsed / (uint64_t)messages);
+
+    unsigned scaled = __atomic_load_n(&latency_scaled, __ATOMIC_RELAXED);
+    scaled = scaled - (scaled >> SIP_OVERLOAD_EWMA_SHIFT) + sample;
+    __atomic_store_n(&latency_scaled, scaled, __ATOMIC_RELAXED);
+    evaluate();
+}
+
+// In-dialog requests carry a To tag; REGISTER and out-of-dialog OPTIONS do not
+static bool has_to_tag(const sip_msg_t *req) {
+    const sip_hdr_t *to = sip_msg_header(req, SIP_HDR_TO);
+    if (!to) {
+        return false;
+    }
+    const char *v = req->buf + to->value_off;
+    for (uint32_t i = 0; i + 4 < to->value_len; i++) {
+        if (v[i] == ';' && strncasecmp(v + i + 1, "tag=", 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sip_overload_should_shed(const sip_msg_t *req) {
+    if (!__atomic_load_n(&overloaded, __ATOMIC_RELAXED) || req->is_response) {
+        return false;
+    }
+
+    unsigned long long *counter;
+    if (req->method_len == 8 && strncmp(req->buf, "REGISTER", 8) == 0) {
+        counter = &shed_register;
+    } else if (req->method_len == 7 && strncmp(req->buf, "OPTIONS", 7) == 0) {
+        counter = &shed_options;
+    } else {
+        return false;
+    }
+    if (has_to_tag(req)) {
+        return false;
+    }
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+int sip_overload_retry_after(void) {
+    // Spread the retries so the shed phones do not all come back in the same second
+    return g_sip_overload_retry_after + (int)(random() % (g_sip_overload_retry_after + 1));
+}
+
+void sip_overload_get_stats(sip_overload_stats_t *stats) {
+    stats->active = __atomic_load_n(&overloaded, __ATOMIC_RELAXED);
+    stats->episodes = __atomic_load_n(&episodes, __ATOMIC_RELAXED);
+    stats->shed_register = __atomic_load_n(&shed_register, __ATOMIC_RELAXED);
+    stats->shed_options = __atomic_load_n(&shed_options, __ATOMIC_RELAXED);
+    stats->backlog = __atomic_load_n(&backlog, __ATOMIC_RELAXED);
+    stats->max_backlog = __atomic_load_n(&max_backlog, __ATOMIC_RELAXED);
+    stats->latency_us = __atomic_load_n(&latency_scaled, __ATOMIC_RELAXED) >> SIP_OVERLOAD_EWMA_SHIFT;
+}
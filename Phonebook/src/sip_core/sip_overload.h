@@ -0,0 +1,49 @@
+// sip_core/sip_overload.h
+#ifndef SIP_OVERLOAD_H
+#define SIP_OVERLOAD_H
+
+#include "../common.h"
+#include "sip_message.h"
+#include <stdint.h>
+
+// Overload control for request floods, e.g. every phone re-REGISTERing when a
+// mesh partition heals. Two signals are tracked:
+//  - backlog: datagrams drained in back-to-back full receive batches (the
+//    socket was still not empty) plus messages waiting in worker queues
+//  - latency: moving average of the processing time per message, reported by
+//    every SIP thread for each batch it handles
+// When either crosses its SIP_OVERLOAD_* threshold the server is overloaded.
+// Out-of-dialog REGISTER and OPTIONS are then answered with 503 and a
+// randomized Retry-After (RFC 3261 section 21.5.4), and are not processed.
+// INVITE, BYE, CANCEL, ACK, responses and in-dialog requests are always
+// processed. Overload ends once both signals drop below half their threshold.
+
+#define SIP_OVERLOAD_EWMA_SHIFT 3   // Latency average weights each batch 1/8
+
+typedef struct {
+    bool active;
+    unsigned long long episodes;        // Times overload was entered
+    unsigned long long shed_register;
+    unsigned long long shed_options;
+    int backlog;                        // Last backlog seen by the main loop
+    int max_backlog;
+    unsigned latency_us;                // Average processing time per message
+} sip_overload_stats_t;
+
+// Main loop, once per SIP socket wakeup: datagrams received and messages
+// still queued for workers
+void sip_overload_note_backlog(int received, int queued);
+
+// Any SIP thread: messages processed since started_us (from sip_overload_now_us)
+uint64_t sip_overload_now_us(void);
+void sip_overload_note_processing(uint64_t started_us, int messages);
+
+// True if the request should be answered with 503 instead of processed
+bool sip_overload_should_shed(const sip_msg_t *req);
+
+// Retry-After for a shed request: SIP_OVERLOAD_RETRY_AFTER plus up to as much again
+int sip_overload_retry_after(void);
+
+void sip_overload_get_stats(sip_overload_stats_t *stats);
+
+#endif // SIP_OVERLOAD_H
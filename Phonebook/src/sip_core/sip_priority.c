@@ -0,0 +1,55 @@
+// sip_core/sip_priority.c - Lane ordering of a receive batch by SIP method
+#include "sip_priority.h"
+
+#define MODULE_NAME "SIP_PRIORITY"
+
+static bool starts_with(const char *buf, size_t len, const char *token, size_t token_len) {
+    // The method must be followed by the space before the Request-URI
+    return len > token_len && memcmp(buf, token, token_len) == 0 && buf[token_len] == ' ';
+}
+
+sip_lane_t sip_priority_classify(const char *buf, size_t len) {
+    if (len >= 8 && memcmp(buf, "SIP/2.0 ", 8) == 0) {
+        return SIP_LANE_RESPONSE;
+    }
+    if (starts_with(buf, len, "BYE", 3) || starts_with(buf, len, "ACK", 3) ||
+        starts_with(buf, len, "CANCEL", 6)) {
+        return SIP_LANE_DIALOG;
+    }
+    if (starts_with(buf, len, "REGISTER", 8) || starts_with(buf, len, "OPTIONS", 7)) {
+        return SIP_LANE_KEEPALIVE;
+    }
+    return SIP_LANE_SETUP;
+}
+
+static bool same_source(const sip_datagram_t *a, const sip_datagram_t *b) {
+    return a->addr.sin_addr.s_addr == b->addr.sin_addr.s_addr && a->addr.sin_port == b->addr.sin_port;
+}
+
+void sip_priority_order(const sip_datagram_t *batch, int count, int *order) {
+    int lane[SIP_BATCH_MAX];
+    int per_lane[SIP_LANE_COUNT] = {0};
+
+    for (int i = 0; i < count; i++) {
+        lane[i] = batch[i].len > 0 ? (int)sip_priority_classify(batch[i].buffer, (size_t)batch[i].len)
+                                   : SIP_LANE_KEEPALIVE;
+        // Never ahead of an earlier datagram from the same phone: share its lane at least
+        for (int j = 0; j < i; j++) {
+            if (lane[j] > lane[i] && same_source(&batch[j], &batch[i])) {
+                lane[i] = lane[j];
+            }
+        }
+        per_lane[lane[i]]++;
+    }
+
+    // Stable counting sort: arrival order is kept within a lane
+    int next[SIP_LANE_COUNT];
+    int start = 0;
+    for (int l = 0; l < SIP_LANE_COUNT; l++) {
+        next[l] = start;
+        start += per_lane[l];
+    }
+    for (int i = 0; i < count; i++) {
+        order[next[lane[i]]++] = i;
+    }
+}
@@ -0,0 +1,32 @@
+// sip_core/sip_priority.h
+#ifndef SIP_PRIORITY_H
+#define SIP_PRIORITY_H
+
+#include "../common.h"
+#include "sip_transport.h"
+
+// Method priority within one receive batch. Each datagram is classified from
+// the first bytes of its start line (no parse) into a lane, and the batch is
+// handled lane by lane: BYE/ACK/CANCEL, then responses, then INVITE and other
+// requests, then REGISTER/OPTIONS. A hangup or call setup that arrives behind
+// a burst of keepalives is thus handled first.
+// Two rules keep this safe:
+//  - a datagram never overtakes an earlier one from the same source address,
+//    so a phone's INVITE is still handled before its CANCEL
+//  - the whole batch is drained every time, so the low lanes wait at most
+//    SIP_BATCH_MAX - 1 messages and cannot starve
+
+typedef enum {
+    SIP_LANE_DIALOG = 0,    // BYE, ACK, CANCEL
+    SIP_LANE_RESPONSE,
+    SIP_LANE_SETUP,         // INVITE and every other request
+    SIP_LANE_KEEPALIVE,     // REGISTER, OPTIONS
+    SIP_LANE_COUNT
+} sip_lane_t;
+
+sip_lane_t sip_priority_classify(const char *buf, size_t len);
+
+// Fill order[0..count) (count <= SIP_BATCH_MAX) with batch indexes in the order they should be handled
+void sip_priority_order(const sip_datagram_t *batch, int count, int *order);
+
+#endif // SIP_PRIORITY_H
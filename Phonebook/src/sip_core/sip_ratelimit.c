@@ -0,0 +1,146 @@
+// sip_core/sip_ratelimit.c - Per-source token buckets checked before parsing
+#include "sip_ratelimit.h"
+#include "sip_priority.h"                       // For the cheap method classification
+#include "sip_core.h"                           // For send_retry_later_response
+#include "../config_loader/config_loader.h"
+
+#define MODULE_NAME "SIP_RATELIMIT"
+
+#define MILLI_TOKENS 1000   // Buckets count thousandths so a 1 ms refill is not lost
+
+enum { BUCKET_KEEPALIVE = 0, BUCKET_OTHER, BUCKET_COUNT };
+
+typedef struct {
+    bool in_use;
+    bool limited;            // Currently over the rate (logged once per episode)
+    in_addr_t ip;
+    uint64_t last_seen_ms;   // LRU within the set, and the refill clock
+    uint64_t last_503_ms;
+    uint32_t tokens[BUCKET_COUNT];
+} RateEntry;
+
+static RateEntry table[SIP_RATELIMIT_SETS][SIP_RATELIMIT_WAYS];
+static sip_ratelimit_stats_t counters; // Updated with atomics; the health thread reads them
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int bucket_rate(int bucket) {
+    return bucket == BUCKET_KEEPALIVE ? g_sip_rate_limit_keepalive : g_sip_rate_limit_other;
+}
+
+static uint32_t capacity(int rate) {
+    return (uint32_t)rate * SIP_RATELIMIT_BURST_SECONDS * MILLI_TOKENS;
+}
+
+// Integer mix of the address; sources on a mesh differ mostly in the low octets
+static unsigned set_of(in_addr_t ip) {
+    uint32_t h = (uint32_t)ip * 2654435761u;
+    return (h >> 16) % SIP_RATELIMIT_SETS;
+}
+
+static RateEntry *lookup(in_addr_t ip, uint64_t now) {
+    RateEntry *set = table[set_of(ip)];
+
+    // The source's own entry, else a free one, else the least recently seen
+    RateEntry *victim = &set[0];
+    for (int i = 0; i < SIP_RATELIMIT_WAYS; i++) {
+        RateEntry *e = &set[i];
+        if (e->in_use && e->ip == ip) {
+            return e;
+        }
+        if (!victim->in_use) {
+            continue;
+        }
+        if (!e->in_use || e->last_seen_ms < victim->last_seen_ms) {
+            victim = e;
+        }
+    }
+
+    if (victim->in_use) {
+        __atomic_add_fetch(&counters.evictions, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&counters.sources, 1, __ATOMIC_RELAXED);
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->in_use = true;
+    victim->ip = ip;
+    victim->last_seen_ms = now;
+    for (int b = 0; b < BUCKET_COUNT; b++) {
+        victim->tokens[b] = capacity(bucket_rate(b));
+    }
+    return victim;
+}
+
+// Add the tokens earned since the source was last seen, up to the burst size
+static void refill(RateEntry *e, uint64_t now) {
+    uint64_t elapsed = now - e->last_seen_ms;
+    e->last_seen_ms = now;
+    if (elapsed == 0) {
+        return;
+    }
+    for (int b = 0; b < BUCKET_COUNT; b++) {
+        uint32_t cap = capacity(bucket_rate(b));
+        uint64_t tokens = e->tokens[b] + elapsed * (uint64_t)bucket_rate(b);
+        e->tokens[b] = tokens > cap ? cap : (uint32_t)tokens;
+    }
+}
+
+int sip_ratelimit_filter(int sockfd, sip_datagram_t *batch, int count) {
+    if (g_sip_rate_limit_keepalive == 0 && g_sip_rate_limit_other == 0) {
+        return 0;
+    }
+
+    uint64_t now = now_ms();
+    int limited = 0;
+
+    for (int i = 0; i < count; i++) {
+        sip_datagram_t *d = &batch[i];
+        if (d->len <= 0) {
+            continue;
+        }
+
+        sip_lane_t lane = sip_priority_classify(d->buffer, (size_t)d->len);
+        bool keepalive = lane == SIP_LANE_KEEPALIVE;
+        int bucket = keepalive ? BUCKET_KEEPALIVE : BUCKET_OTHER;
+        int rate = bucket_rate(bucket);
+
+        RateEntry *e = lookup(d->addr.sin_addr.s_addr, now);
+        refill(e, now);
+        if (rate == 0 || e->tokens[bucket] >= MILLI_TOKENS) {
+            if (rate > 0) e->tokens[bucket] -= MILLI_TOKENS;
+            e->limited = false;
+            continue;
+        }
+
+        if (!e->limited) {
+            e->limited = true;
+            LOG_WARN("Rate limiting SIP %s from %s (over %d/s).", keepalive ? "REGISTER/OPTIONS" : "traffic",
+                     sockaddr_to_ip_str(&d->addr), rate);
+        }
+        __atomic_add_fetch(keepalive ? &counters.limited_keepalive : &counters.limited_other, 1,
+                           __ATOMIC_RELAXED);
+
+        // Requests only: there is nobody to tell about a dropped response or ACK
+        bool is_request = lane != SIP_LANE_RESPONSE && strncmp(d->buffer, "ACK ", 4) != 0;
+        if (g_sip_rate_limit_503 && is_request && now - e->last_503_ms >= SIP_RATELIMIT_503_INTERVAL_MS) {
+            e->last_503_ms = now;
+            send_retry_later_response(sockfd, d->buffer, d->len, &d->addr, d->addr_len);
+            __atomic_add_fetch(&counters.rejected, 1, __ATOMIC_RELAXED);
+        }
+        d->len = 0;
+        limited++;
+    }
+    return limited;
+}
+
+void sip_ratelimit_get_stats(sip_ratelimit_stats_t *stats) {
+    stats->limited_keepalive = __atomic_load_n(&counters.limited_keepalive, __ATOMIC_RELAXED);
+    stats->limited_other = __atomic_load_n(&counters.limited_other, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&counters.rejected, __ATOMIC_RELAXED);
+    stats->evictions = __atomic_load_n(&counters.evictions, __ATOMIC_RELAXED);
+    stats->sources = __atomic_load_n(&counters.sources, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,40 @@
+// sip_core/sip_ratelimit.h
+#ifndef SIP_RATELIMIT_H
+#define SIP_RATELIMIT_H
+
+#include "../common.h"
+#include "sip_transport.h"
+#include <stdint.h>
+
+// Per-source-IP token buckets on the SIP ingress path, checked before any
+// parsing so a phone stuck in a REGISTER loop or a scanner on port 5060
+// costs one table lookup per datagram. Each source has two buckets:
+// REGISTER/OPTIONS (SIP_RATE_LIMIT_KEEPALIVE per second), and everything else
+// including responses (SIP_RATE_LIMIT_OTHER per second). Each bucket holds
+// SIP_RATELIMIT_BURST_SECONDS worth of tokens. Excess datagrams are dropped.
+// With SIP_RATE_LIMIT_503=1, excess requests instead get a 503 with
+// Retry-After, at most one per source per second so a spoofed flood is not
+// reflected. Memory is fixed: a set-associative table that evicts the
+// least recently seen source of a set. Main loop only.
+
+#define SIP_RATELIMIT_SETS            64
+#define SIP_RATELIMIT_WAYS            4     // Sources per set; SIP_RATELIMIT_SETS * SIP_RATELIMIT_WAYS tracked
+#define SIP_RATELIMIT_BURST_SECONDS   2
+#define SIP_RATELIMIT_503_INTERVAL_MS 1000
+
+typedef struct {
+    unsigned long long limited_keepalive;   // REGISTER/OPTIONS over the rate
+    unsigned long long limited_other;
+    unsigned long long rejected;            // Of those, answered with 503
+    unsigned long long evictions;           // Tracked source replaced by a new one
+    int sources;
+} sip_ratelimit_stats_t;
+
+// Charge every datagram of a receive batch to its source. Limited datagrams
+// are answered or dropped here and their len set to 0 so callers skip them.
+// Returns the number limited.
+int sip_ratelimit_filter(int sockfd, sip_datagram_t *batch, int count);
+
+void sip_ratelimit_get_stats(sip_ratelimit_stats_t *stats);
+
+#endif // SIP_RATELIMIT_H
@@ -0,0 +1,55 @@
+// sip_core/sip_splice.c - iovec builder for proxied SIP messages
+#include "sip_splice.h"
+#include "../config_loader/config_loader.h" // For g_sip_max_message_size
+#include <stdarg.h>
+
+#define MODULE_NAME "SIP_SPLICE"
+
+void sip_splice_init(sip_splice_t *sp) {
+    sp->iovcnt = 0;
+    sp->len = 0;
+    sp->scratch_used = 0;
+}
+
+int sip_splice_append(sip_splice_t *sp, const char *data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (sp->len + len > (size_t)g_sip_max_message_size) {
+        return -1;
+    }
+
+    if (sp->iovcnt > 0) {
+        struct iovec *last = &sp->iov[sp->iovcnt - 1];
+        if ((const char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            sp->len += len;
+            return 0;
+        }
+    }
+    if (sp->iovcnt == SIP_SPLICE_MAX_IOV) {
+        return -1;
+    }
+
+    sp->iov[sp->iovcnt].iov_base = (void *)data;
+    sp->iov[sp->iovcnt].iov_len = len;
+    sp->iovcnt++;
+    sp->len += len;
+    return 0;
+}
+
+int sip_splice_appendf(sip_splice_t *sp, const char *fmt, ...) {
+    size_t room = sizeof(sp->scratch) - sp->scratch_used;
+    char *out = sp->scratch + sp->scratch_used;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out, room, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t)n >= room) {
+        return -1;
+    }
+    sp->scratch_used += n;
+    return sip_splice_append(sp, out, n);
+}
@@ -0,0 +1,36 @@
+// sip_core/sip_splice.h
+#ifndef SIP_SPLICE_H
+#define SIP_SPLICE_H
+
+#include "../common.h"
+#include <sys/uio.h>
+
+// Outgoing SIP message as a scatter/gather list.
+// A proxied message is mostly the received datagram with a line swapped or
+// inserted. Instead of copying it into a second buffer, the splice records
+// segments of the original buffer plus a few small generated fragments
+// (Request-URI line, Record-Route, Content-Length) held in scratch, and the
+// transport hands the list to sendmsg(). Referenced buffers must stay valid
+// until the message is sent.
+
+#define SIP_SPLICE_MAX_IOV      16
+#define SIP_SPLICE_SCRATCH_LEN  512  // Generated fragments; a start line with a max-length URI fits
+
+typedef struct {
+    struct iovec iov[SIP_SPLICE_MAX_IOV];
+    int iovcnt;
+    size_t len;             // Total bytes across all segments
+    size_t scratch_used;
+    char scratch[SIP_SPLICE_SCRATCH_LEN];
+} sip_splice_t;
+
+void sip_splice_init(sip_splice_t *sp);
+
+// Reference len bytes at data (not copied). A segment that starts where the
+// previous one ends is merged into it. Returns 0, or -1 if the list is full.
+int sip_splice_append(sip_splice_t *sp, const char *data, size_t len);
+
+// Format a fragment into scratch and append it. Returns 0, or -1 if it does not fit.
+int sip_splice_appendf(sip_splice_t *sp, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // SIP_SPLICE_H
@@ -0,0 +1,681 @@
+// sip_core/sip_tcp.c - SIP over TCP: listener, Content-Length framer, connection reuse
+#define _GNU_SOURCE // For accept4, memmem
+#include "sip_tcp.h"
+#include "sip_core.h"
+#include "sip_transport.h"
+#include "../sip_workers/sip_workers.h"
+#include "../event_loop/event_loop.h"
+#include "../config_loader/config_loader.h" // For g_sip_max_message_size
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+
+#define MODULE_NAME "SIP_TCP"
+
+#define SIP_TCP_LISTEN_BACKLOG  16
+#define MAX_REFUSED_PEERS       8
+
+typedef enum {
+    CONN_FREE = 0,
+    CONN_PENDING,       // Outbound, queued by a sender; the main loop connects it
+    CONN_CONNECTING,
+    CONN_OPEN
+} ConnState;
+
+typedef struct {
+    ConnState state;
+    int fd;
+    bool outbound;
+    bool registered;            // With the event loop (main loop only)
+    struct sockaddr_in peer;
+    char *rx_buf;               // Pool buffer, SIP_MAX_MESSAGE_SIZE + 1 (main loop only)
+    size_t rx_len;
+    char *tx_buf;               // Bytes the kernel has not taken yet
+    size_t tx_len;
+    size_t tx_cap;
+    uint64_t last_activity_ms;
+    uint64_t connect_deadline_ms;
+} TcpConnection;
+
+typedef struct {
+    struct in_addr addr;
+    in_port_t port;
+    uint64_t until_ms;
+} RefusedPeer;
+
+// tcp_mutex covers the connection table, every connection's tx side and the
+// stats. The rx side and closing belong to the main loop alone.
+static pthread_mutex_t tcp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TcpConnection conns[SIP_TCP_MAX_CONNECTIONS];
+static int num_conns = 0;                   // Read without the lock on the UDP fast path
+static bool tcp_running = false;
+static int listen_fd = -1;
+static int sip_udp_sockfd = -1;
+static RefusedPeer refused_peers[MAX_REFUSED_PEERS];
+static char *rx_pool[SIP_TCP_MAX_CONNECTIONS];  // Receive buffers of closed connections, for reuse
+static int rx_pool_count = 0;
+static sip_tcp_stats_t tcp_stats;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t tx_limit(void) {
+    return (size_t)g_sip_max_message_size * 4; // A peer this far behind is not reading
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// --- Connection table (caller holds tcp_mutex) ---
+
+static TcpConnection *find_conn(const struct sockaddr_in *peer) {
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        TcpConnection *c = &conns[i];
+        if (c->state != CONN_FREE && c->peer.sin_port == peer->sin_port &&
+            c->peer.sin_addr.s_addr == peer->sin_addr.s_addr) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static TcpConnection *alloc_conn(int fd, const struct sockaddr_in *peer, bool outbound) {
+    TcpConnection *c = NULL;
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        if (conns[i].state == CONN_FREE) {
+            c = &conns[i];
+            break;
+        }
+    }
+    if (!c) {
+        return NULL;
+    }
+
+    char *rx = rx_pool_count > 0 ? rx_pool[--rx_pool_count] : malloc((size_t)g_sip_max_message_size + 1);
+    if (!rx) {
+        LOG_ERROR("Failed to allocate TCP receive buffer.");
+        return NULL;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->outbound = outbound;
+    c->peer = *peer;
+    c->rx_buf = rx;
+    c->last_activity_ms = monotonic_ms();
+    c->state = outbound ? CONN_PENDING : CONN_OPEN;
+    __atomic_store_n(&num_conns, num_conns + 1, __ATOMIC_RELEASE);
+    return c;
+}
+
+static bool peer_refused(const struct sockaddr_in *peer, uint64_t now) {
+    for (int i = 0; i < MAX_REFUSED_PEERS; i++) {
+        if (refused_peers[i].until_ms > now && refused_peers[i].port == peer->sin_port &&
+            refused_peers[i].addr.s_addr == peer->sin_addr.s_addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void remember_refused(const struct sockaddr_in *peer) {
+    RefusedPeer *slot = &refused_peers[0];
+    for (int i = 1; i < MAX_REFUSED_PEERS; i++) {
+        if (refused_peers[i].until_ms < slot->until_ms) {
+            slot = &refused_peers[i];
+        }
+    }
+    slot->addr = peer->sin_addr;
+    slot->port = peer->sin_port;
+    slot->until_ms = monotonic_ms() + SIP_TCP_REFUSED_HOLD_MS;
+}
+
+static int append_tx(TcpConnection *c, const struct iovec *iov, int iovcnt, size_t skip) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+    size_t need = c->tx_len + (total - skip);
+    if (need > tx_limit()) {
+        return -1;
+    }
+    if (need > c->tx_cap) {
+        size_t cap = c->tx_cap ? c->tx_cap : 4096;
+        while (cap < need) cap *= 2;
+        char *grown = realloc(c->tx_buf, cap);
+        if (!grown) {
+            return -1;
+        }
+        c->tx_buf = grown;
+        c->tx_cap = cap;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n = iov[i].iov_len;
+        const char *src = iov[i].iov_base;
+        if (skip >= n) {
+            skip -= n;
+            continue;
+        }
+        memcpy(c->tx_buf + c->tx_len, src + skip, n - skip);
+        c->tx_len += n - skip;
+        skip = 0;
+    }
+    return 0;
+}
+
+// Write now if nothing is queued ahead, queue whatever the kernel does not take.
+// On failure the socket is shut down; the main loop sees the hangup and closes it.
+static int conn_write(TcpConnection *c, const struct iovec *iov, int iovcnt) {
+    size_t written = 0;
+    if (c->state == CONN_OPEN && c->tx_len == 0) {
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = (struct iovec *)iov;
+        mh.msg_iovlen = iovcnt;
+        ssize_t n = sendmsg(c->fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_WARN("TCP send to %s:%d failed: %s", sockaddr_to_ip_str(&c->peer),
+                     ntohs(c->peer.sin_port), strerror(errno));
+            shutdown(c->fd, SHUT_RDWR);
+            return -1;
+        }
+        if (n > 0) written = (size_t)n;
+    }
+    if (append_tx(c, iov, iovcnt, written) != 0) {
+        LOG_WARN("TCP send queue to %s:%d over %zu bytes; dropping the connection.",
+                 sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port), tx_limit());
+        if (c->fd >= 0) shutdown(c->fd, SHUT_RDWR);
+        return -1;
+    }
+    return 0;
+}
+
+static int flush_tx(TcpConnection *c) {
+    if (c->tx_len == 0) {
+        return 0;
+    }
+    size_t off = 0;
+    while (off < c->tx_len) {
+        ssize_t n = send(c->fd, c->tx_buf + off, c->tx_len - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    memmove(c->tx_buf, c->tx_buf + off, c->tx_len - off);
+    c->tx_len -= off;
+    return 0;
+}
+
+// --- Main loop side ---
+
+// Value of Content-Length (or compact "l") in the header block, 0 if absent, -1 if malformed
+static long content_length(const char *head, size_t head_len) {
+    const char *end = head + head_len;
+    for (const char *line = head; line < end; ) {
+        const char *eol = memmem(line, end - line, "\r\n", 2);
+        if (!eol) break;
+        size_t name_len = 0;
+        if ((size_t)(eol - line) > 15 && strncasecmp(line, "Content-Length", 14) == 0) {
+            name_len = 14;
+        } else if (eol - line > 1 && (line[0] == 'l' || line[0] == 'L') &&
+                   (line[1] == ':' || line[1] == ' ' || line[1] == '\t')) {
+            name_len = 1;
+        }
+        if (name_len) {
+            const char *p = line + name_len;
+            while (p < eol && (*p == ' ' || *p == '\t')) p++;
+            if (p < eol && *p == ':') {
+                p++;
+                while (p < eol && (*p == ' ' || *p == '\t')) p++;
+                long value = 0;
+                int digits = 0;
+                while (p < eol && *p >= '0' && *p <= '9' && digits < 6) {
+                    value = value * 10 + (*p - '0');
+                    p++;
+                    digits++;
+                }
+                return digits > 0 ? value : -1;
+            }
+        }
+        line = eol + 2;
+    }
+    return 0; // Mandatory on TCP (RFC 3261 18.3), but treat a missing one as no body
+}
+
+// A connection that never opened has sent none of its queue. Its senders
+// were told the messages went out, so retry each one over UDP, as RFC 3261
+// 18.1.1 asks when the TCP attempt fails (caller holds tcp_mutex).
+static void send_queued_over_udp(TcpConnection *c) {
+    size_t off = 0;
+    int resent = 0;
+    while (off < c->tx_len) {
+        char *p = c->tx_buf + off;
+        size_t avail = c->tx_len - off;
+        char *blank = memmem(p, avail, "\r\n\r\n", 4);
+        if (!blank) {
+            break;
+        }
+        size_t head_len = (size_t)(blank - p) + 4;
+        long body_len = content_length(p, head_len);
+        if (body_len < 0 || head_len + (size_t)body_len > avail) {
+            break;
+        }
+        size_t total = head_len + (size_t)body_len;
+        if (sendto(sip_udp_sockfd, p, total, MSG_DONTWAIT,
+                   (const struct sockaddr *)&c->peer, sizeof(c->peer)) < 0) {
+            LOG_WARN("UDP fallback send to %s:%d failed: %s", sockaddr_to_ip_str(&c->peer),
+                     ntohs(c->peer.sin_port), strerror(errno));
+        } else {
+            resent++;
+        }
+        off += total;
+    }
+    LOG_INFO("Sent %d queued message(s) for %s:%d over UDP instead.", resent,
+             sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+    if (off < c->tx_len) {
+        LOG_DEBUG("Dropping %zu unframeable queued bytes for %s:%d.", c->tx_len - off,
+                  sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+    }
+}
+
+static void close_conn(TcpConnection *c) {
+    if (c->registered) {
+        event_loop_remove_fd(c->fd);
+        c->registered = false;
+    }
+    pthread_mutex_lock(&tcp_mutex);
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    if (c->tx_len > 0 && c->state != CONN_OPEN) {
+        send_queued_over_udp(c);
+    } else if (c->tx_len > 0) {
+        LOG_DEBUG("Dropping %zu unsent bytes for %s:%d.", c->tx_len,
+                  sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+    }
+    rx_pool[rx_pool_count++] = c->rx_buf; // At most one buffer per slot is ever out
+    free(c->tx_buf);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->state = CONN_FREE;
+    __atomic_store_n(&num_conns, num_conns - 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tcp_mutex);
+}
+
+static void deliver(TcpConnection *c, char *msg, size_t len) {
+    char saved = msg[len];
+    msg[len] = '\0'; // sip_core expects a NUL-terminated message; rx_buf has room for it
+
+    if (sip_workers_enabled()) {
+        sip_datagram_t view = { .buffer = msg, .capacity = len + 1, .len = (ssize_t)len,
+                                .addr = c->peer, .addr_len = sizeof(c->peer) };
+        sip_workers_dispatch(&view);
+    } else {
+        process_incoming_sip_message(sip_udp_sockfd, msg, (ssize_t)len, &c->peer, sizeof(c->peer));
+    }
+    msg[len] = saved;
+
+    pthread_mutex_lock(&tcp_mutex);
+    tcp_stats.rx_messages++;
+    pthread_mutex_unlock(&tcp_mutex);
+}
+
+static bool only_line_ends(const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != '\r' && p[i] != '\n') return false;
+    }
+    return true;
+}
+
+// Cut complete messages off the front of rx_buf. -1 if the stream cannot be framed.
+static int frame_messages(TcpConnection *c) {
+    size_t off = 0;
+    while (off < c->rx_len) {
+        char *p = c->rx_buf + off;
+        size_t avail = c->rx_len - off;
+
+        // RFC 5626 keepalive: answer a CRLFCRLF ping with a CRLF pong; skip stray line ends
+        if (*p == '\r' || *p == '\n') {
+            if (avail >= 4 && memcmp(p, "\r\n\r\n", 4) == 0) {
+                struct iovec pong = { .iov_base = "\r\n", .iov_len = 2 };
+                pthread_mutex_lock(&tcp_mutex);
+                conn_write(c, &pong, 1);
+                pthread_mutex_unlock(&tcp_mutex);
+                off += 4;
+            } else if (avail < 4 && only_line_ends(p, avail)) {
+                break; // Maybe the start of a ping
+            } else {
+                off++;
+            }
+            continue;
+        }
+
+        char *blank = memmem(p, avail, "\r\n\r\n", 4);
+        if (!blank) {
+            break;
+        }
+        size_t head_len = (size_t)(blank - p) + 4;
+        long body_len = content_length(p, head_len);
+        if (body_len < 0 || head_len + (size_t)body_len > (size_t)g_sip_max_message_size) {
+            LOG_WARN("Unframeable or oversize (> %d bytes) SIP message over TCP from %s:%d; closing.",
+                     g_sip_max_message_size, sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+            return -1;
+        }
+        size_t total = head_len + (size_t)body_len;
+        if (avail < total) {
+            break;
+        }
+        deliver(c, p, total);
+        off += total;
+    }
+
+    if (off > 0) {
+        memmove(c->rx_buf, c->rx_buf + off, c->rx_len - off);
+        c->rx_len -= off;
+    }
+    return 0;
+}
+
+// Drain the socket (edge-triggered). -1 when the connection is finished.
+static int read_connection(TcpConnection *c) {
+    for (;;) {
+        size_t room = (size_t)g_sip_max_message_size - c->rx_len;
+        if (room == 0) {
+            LOG_WARN("SIP message over TCP from %s:%d exceeds %d bytes; closing.",
+                     sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port), g_sip_max_message_size);
+            return -1;
+        }
+        ssize_t n = recv(c->fd, c->rx_buf + c->rx_len, room, MSG_DONTWAIT);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        c->rx_len += (size_t)n;
+        __atomic_store_n(&c->last_activity_ms, monotonic_ms(), __ATOMIC_RELAXED);
+        if (frame_messages(c) != 0) {
+            return -2;
+        }
+    }
+}
+
+static void on_connection_event(int fd, uint32_t events, void *arg) {
+    TcpConnection *c = (TcpConnection *)arg;
+    if (c->state == CONN_FREE || c->fd != fd) {
+        return; // Stale event for a slot closed earlier in this pass
+    }
+
+    if (c->state == CONN_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            return;
+        }
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        if (err != 0) {
+            LOG_INFO("TCP connect to %s:%d failed (%s); using UDP for it.",
+                     sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port), strerror(err));
+            pthread_mutex_lock(&tcp_mutex);
+            remember_refused(&c->peer);
+            pthread_mutex_unlock(&tcp_mutex);
+            close_conn(c);
+            return;
+        }
+        pthread_mutex_lock(&tcp_mutex);
+        c->state = CONN_OPEN;
+        tcp_stats.connected++;
+        pthread_mutex_unlock(&tcp_mutex);
+        LOG_DEBUG("TCP connection to %s:%d established.", sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+    }
+
+    if (events & EPOLLOUT) {
+        pthread_mutex_lock(&tcp_mutex);
+        int rc = flush_tx(c);
+        pthread_mutex_unlock(&tcp_mutex);
+        if (rc != 0) {
+            close_conn(c);
+            return;
+        }
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        sip_transport_begin_batch();
+        int rc = read_connection(c);
+        sip_transport_flush();
+        sip_workers_kick();
+        if (rc != 0) {
+            if (rc == -2) {
+                pthread_mutex_lock(&tcp_mutex);
+                tcp_stats.rx_rejected++;
+                pthread_mutex_unlock(&tcp_mutex);
+            }
+            close_conn(c);
+        }
+    }
+}
+
+static void register_conn(TcpConnection *c) {
+    if (event_loop_add_fd(c->fd, EPOLLIN | EPOLLOUT | EPOLLET, on_connection_event, c) != 0) {
+        close_conn(c);
+        return;
+    }
+    c->registered = true;
+}
+
+static void on_listen_readable(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int cfd = accept4(fd, (struct sockaddr *)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("accept() on SIP TCP listener failed: %s", strerror(errno));
+            }
+            return;
+        }
+        set_nodelay(cfd);
+
+        pthread_mutex_lock(&tcp_mutex);
+        TcpConnection *c = alloc_conn(cfd, &peer, false);
+        if (c) tcp_stats.accepted++;
+        pthread_mutex_unlock(&tcp_mutex);
+        if (!c) {
+            LOG_WARN("TCP connection limit (%d) reached; refusing %s:%d.", SIP_TCP_MAX_CONNECTIONS,
+                     sockaddr_to_ip_str(&peer), ntohs(peer.sin_port));
+            close(cfd);
+            continue;
+        }
+        LOG_DEBUG("Accepted SIP TCP connection from %s:%d.", sockaddr_to_ip_str(&peer), ntohs(peer.sin_port));
+        register_conn(c);
+    }
+}
+
+static void start_connect(TcpConnection *c) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int rc = -1;
+    if (fd >= 0) {
+        set_nodelay(fd);
+        rc = connect(fd, (const struct sockaddr *)&c->peer, sizeof(c->peer));
+    }
+    if (fd < 0 || (rc < 0 && errno != EINPROGRESS)) {
+        LOG_INFO("TCP connect to %s:%d failed (%s); using UDP for it.",
+                 sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port), strerror(errno));
+        pthread_mutex_lock(&tcp_mutex);
+        c->fd = fd;
+        remember_refused(&c->peer);
+        pthread_mutex_unlock(&tcp_mutex);
+        close_conn(c);
+        return;
+    }
+
+    pthread_mutex_lock(&tcp_mutex);
+    c->fd = fd;
+    c->state = rc == 0 ? CONN_OPEN : CONN_CONNECTING;
+    c->connect_deadline_ms = monotonic_ms() + SIP_TCP_CONNECT_TIMEOUT_MS;
+    if (rc == 0) tcp_stats.connected++;
+    pthread_mutex_unlock(&tcp_mutex);
+    register_conn(c); // The first EPOLLOUT flushes what senders queued meanwhile
+}
+
+// --- Public API ---
+
+int sip_tcp_start(int udp_sockfd) {
+    sip_udp_sockfd = udp_sockfd;
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        conns[i].fd = -1;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOG_ERROR("Failed to create SIP TCP socket: %s", strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(SIP_PORT);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, SIP_TCP_LISTEN_BACKLOG) < 0 ||
+        event_loop_add_fd(listen_fd, EPOLLIN, on_listen_readable, NULL) != 0) {
+        LOG_ERROR("Failed to listen for SIP over TCP on port %d: %s", SIP_PORT, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    __atomic_store_n(&tcp_running, true, __ATOMIC_RELEASE);
+    LOG_INFO("Listening for SIP over TCP on port %d (max message %d bytes, %d connections).",
+             SIP_PORT, g_sip_max_message_size, SIP_TCP_MAX_CONNECTIONS);
+    return 0;
+}
+
+void sip_tcp_stop(void) {
+    if (!tcp_running) {
+        return;
+    }
+    __atomic_store_n(&tcp_running, false, __ATOMIC_RELEASE);
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        if (conns[i].state != CONN_FREE) {
+            close_conn(&conns[i]);
+        }
+    }
+    event_loop_remove_fd(listen_fd);
+    close(listen_fd);
+    listen_fd = -1;
+    while (rx_pool_count > 0) {
+        free(rx_pool[--rx_pool_count]);
+    }
+}
+
+bool sip_tcp_try_sendv(const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                       const struct iovec *iov, int iovcnt, size_t len, ssize_t *sent) {
+    if (!__atomic_load_n(&tcp_running, __ATOMIC_ACQUIRE) || dest_len < sizeof(struct sockaddr_in)) {
+        return false;
+    }
+    bool is_response = iovcnt > 0 && iov[0].iov_len >= 8 && memcmp(iov[0].iov_base, "SIP/2.0 ", 8) == 0;
+    bool wants_tcp = !is_response && len > SIP_UDP_MTU_THRESHOLD;
+    if (!wants_tcp && __atomic_load_n(&num_conns, __ATOMIC_ACQUIRE) == 0) {
+        return false; // No connections: plain UDP without touching the lock
+    }
+
+    uint64_t now = monotonic_ms();
+    bool opened = false;
+    pthread_mutex_lock(&tcp_mutex);
+    TcpConnection *c = find_conn(dest_addr);
+    if (!c) {
+        if (!wants_tcp || peer_refused(dest_addr, now) || !(c = alloc_conn(-1, dest_addr, true))) {
+            pthread_mutex_unlock(&tcp_mutex);
+            return false;
+        }
+        opened = true;
+    }
+    int rc = conn_write(c, iov, iovcnt);
+    __atomic_store_n(&c->last_activity_ms, now, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tcp_mutex);
+
+    if (opened) {
+        LOG_DEBUG("Opening TCP connection to %s:%d for a %zu-byte request.",
+                  sockaddr_to_ip_str(dest_addr), ntohs(dest_addr->sin_port), len);
+        event_loop_wakeup(); // The main loop connects it from its timer pass
+    }
+    *sent = rc == 0 ? (ssize_t)len : -1;
+    return true;
+}
+
+int sip_tcp_next_timeout_ms(void) {
+    if (!tcp_running) {
+        return -1;
+    }
+    uint64_t now = monotonic_ms();
+    int64_t earliest = -1;
+    pthread_mutex_lock(&tcp_mutex);
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        const TcpConnection *c = &conns[i];
+        uint64_t due;
+        if (c->state == CONN_PENDING) {
+            due = now;
+        } else if (c->state == CONN_CONNECTING) {
+            due = c->connect_deadline_ms;
+        } else if (c->state == CONN_OPEN) {
+            due = __atomic_load_n(&c->last_activity_ms, __ATOMIC_RELAXED) + SIP_TCP_IDLE_TIMEOUT_MS;
+        } else {
+            continue;
+        }
+        int64_t ms = due > now ? (int64_t)(due - now) : 0;
+        if (earliest < 0 || ms < earliest) earliest = ms;
+    }
+    pthread_mutex_unlock(&tcp_mutex);
+    return (int)earliest;
+}
+
+void sip_tcp_process_timeouts(void) {
+    if (!tcp_running) {
+        return;
+    }
+    uint64_t now = monotonic_ms();
+    for (int i = 0; i < SIP_TCP_MAX_CONNECTIONS; i++) {
+        TcpConnection *c = &conns[i];
+        pthread_mutex_lock(&tcp_mutex);
+        ConnState state = c->state;
+        uint64_t idle_since = c->last_activity_ms;
+        pthread_mutex_unlock(&tcp_mutex);
+
+        if (state == CONN_PENDING) {
+            start_connect(c);
+        } else if (state == CONN_CONNECTING && now >= c->connect_deadline_ms) {
+            LOG_INFO("TCP connect to %s:%d timed out; using UDP for it.",
+                     sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+            pthread_mutex_lock(&tcp_mutex);
+            remember_refused(&c->peer);
+            pthread_mutex_unlock(&tcp_mutex);
+            close_conn(c);
+        } else if (state == CONN_OPEN && now >= idle_since + SIP_TCP_IDLE_TIMEOUT_MS) {
+            LOG_DEBUG("Closing idle TCP connection with %s:%d.", sockaddr_to_ip_str(&c->peer), ntohs(c->peer.sin_port));
+            close_conn(c);
+        }
+    }
+}
+
+void sip_tcp_get_stats(sip_tcp_stats_t *stats) {
+    pthread_mutex_lock(&tcp_mutex);
+    *stats = tcp_stats;
+    stats->connections = num_conns;
+    pthread_mutex_unlock(&tcp_mutex);
+}
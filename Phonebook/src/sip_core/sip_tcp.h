@@ -0,0 +1,53 @@
+// sip_core/sip_tcp.h
+#ifndef SIP_TCP_H
+#define SIP_TCP_H
+
+#include "../common.h"
+#include <sys/uio.h> // For struct iovec
+
+// SIP over TCP (RFC 3261 section 18) next to the UDP socket.
+// A listener on SIP_PORT accepts phones. Each connection's byte stream is cut
+// into messages at the blank line after the headers plus Content-Length body
+// bytes. Each message is then handled exactly like a UDP datagram from the
+// connection's peer address. Sending is keyed on that address: sip_transport
+// hands every message to sip_tcp_try_sendv() first. If a connection to the
+// destination exists, responses and in-dialog requests go over it. A request
+// larger than SIP_UDP_MTU_THRESHOLD with no connection yet opens one to the
+// callee (RFC 3261 section 18.1.1), and later messages to that callee reuse it.
+// If that connect fails or times out, what was queued on it goes out over UDP.
+// Receive buffers come from a pool bounded by SIP_TCP_MAX_CONNECTIONS, each
+// SIP_MAX_MESSAGE_SIZE bytes. A message that would not fit closes the connection.
+// Connections and the listener live on the main loop. Any SIP thread may send.
+
+#define SIP_TCP_MAX_CONNECTIONS     32
+#define SIP_UDP_MTU_THRESHOLD       1300    // Larger requests go over TCP (RFC 3261 18.1.1)
+#define SIP_TCP_IDLE_TIMEOUT_MS     300000  // Close connections silent this long
+#define SIP_TCP_CONNECT_TIMEOUT_MS  5000
+#define SIP_TCP_REFUSED_HOLD_MS     300000  // Send to a peer that refused TCP over UDP meanwhile
+
+typedef struct {
+    int connections;                   // Currently open or connecting
+    unsigned long long accepted;
+    unsigned long long connected;      // Outbound connections established
+    unsigned long long rx_messages;
+    unsigned long long rx_rejected;    // Oversize or unframeable: connection closed
+} sip_tcp_stats_t;
+
+// Listen on SIP_PORT and register with the event loop. udp_sockfd is handed
+// to sip_core along with each TCP message. 0, or -1 if TCP is unavailable (UDP keeps working).
+int sip_tcp_start(int udp_sockfd);
+void sip_tcp_stop(void);
+
+// Called by sip_transport for every outgoing message. Returns true if the
+// message went to (or was queued on) a TCP connection, with the result in
+// *sent (len, or -1 on error). False means: send it over UDP.
+bool sip_tcp_try_sendv(const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                       const struct iovec *iov, int iovcnt, size_t len, ssize_t *sent);
+
+// Event loop timer source: outbound connects, connect timeouts, idle connections
+int sip_tcp_next_timeout_ms(void);
+void sip_tcp_process_timeouts(void);
+
+void sip_tcp_get_stats(sip_tcp_stats_t *stats);
+
+#endif // SIP_TCP_H
@@ -0,0 +1,149 @@
+// sip_core/sip_template.c - Precompiled responses filled from the request's header index
+#include "sip_template.h"
+#include <strings.h> // For strncasecmp
+
+#define MODULE_NAME "SIP_TEMPLATE"
+
+typedef struct {
+    sip_hdr_id_t id;
+    const char *prefix;
+    size_t prefix_len;
+    bool all_values;    // Multi-valued: every line joined with ", "
+} EchoSlot;
+
+static const EchoSlot echo_slots[] = {
+    { SIP_HDR_VIA,     "Via: ",     5, true  },
+    { SIP_HDR_FROM,    "From: ",    6, false },
+    { SIP_HDR_TO,      "To: ",      4, false },
+    { SIP_HDR_CALL_ID, "Call-ID: ", 9, false },
+    { SIP_HDR_CSEQ,    "CSeq: ",    6, false },
+    { SIP_HDR_CONTACT, "Contact: ", 9, false }, // Only with SIP_TEMPLATE_ECHO_CONTACT
+};
+
+#define NUM_ECHO_SLOTS (sizeof(echo_slots) / sizeof(echo_slots[0]))
+
+int sip_template_compile(sip_response_template_t *t, const char *status_line,
+                         const char *extra_headers, unsigned flags) {
+    int n = snprintf(t->head, sizeof(t->head), "%s\r\n", status_line);
+    if (n < 0 || (size_t)n >= sizeof(t->head)) {
+        LOG_ERROR("Status line too long for template: %s", status_line);
+        return -1;
+    }
+    t->head_len = n;
+
+    n = snprintf(t->tail, sizeof(t->tail), "%s%sContent-Length: 0\r\n\r\n",
+                 extra_headers ? extra_headers : "", (extra_headers && *extra_headers) ? "\r\n" : "");
+    if (n < 0 || (size_t)n >= sizeof(t->tail)) {
+        LOG_ERROR("Extra headers too long for template: %s", status_line);
+        return -1;
+    }
+    t->tail_len = n;
+    t->flags = flags;
+    return 0;
+}
+
+// Copies a Contact value with its own ";expires=" parameters dropped and the
+// granted one appended. UAs take the Contact parameter before the Expires
+// header (RFC 3261 10.2.4), so echoing the requested value would override
+// the grant. Parameters inside <...> belong to the URI and are kept; a
+// wildcard "*" is copied as is. Returns the new length, or -1 if out is full.
+static int append_contact_expires(const char *value, size_t value_len, int expires,
+                                  char *out, size_t len, size_t out_size) {
+    bool wildcard = (value_len == 1 && value[0] == '*');
+    bool in_angle = false, in_quotes = false;
+    size_t i = 0;
+    while (i < value_len) {
+        char c = value[i];
+        if (!wildcard && !in_angle && !in_quotes && c == ';' &&
+            value_len - i > 8 && strncasecmp(value + i + 1, "expires=", 8) == 0) {
+            i += 9;
+            while (i < value_len && value[i] != ';' && value[i] != ',') i++;
+            continue;
+        }
+        if (c == '"' && !in_angle) in_quotes = !in_quotes;
+        else if (c == '<' && !in_quotes) in_angle = true;
+        else if (c == '>' && !in_quotes) in_angle = false;
+        if (len + 1 > out_size) return -1;
+        out[len++] = c;
+        i++;
+    }
+    if (!wildcard) {
+        char param[24];
+        int n = snprintf(param, sizeof(param), ";expires=%d", expires);
+        if (len + (size_t)n > out_size) return -1;
+        memcpy(out + len, param, (size_t)n);
+        len += (size_t)n;
+    }
+    return (int)len;
+}
+
+// value_name NULL: no per-request "<name>: <value>" line. contact_expires < 0:
+// the Contact is echoed untouched.
+static int render(const sip_response_template_t *t, const sip_msg_t *req,
+                  const char *value_name, int value, int contact_expires, char *out, size_t out_size) {
+    size_t len = 0;
+
+#define APPEND(src, n) do {                          \
+        if (len + (n) > out_size) return -1;         \
+        memcpy(out + len, (src), (n));               \
+        len += (n);                                  \
+    } while (0)
+
+    APPEND(t->head, t->head_len);
+
+    for (size_t s = 0; s < NUM_ECHO_SLOTS; s++) {
+        const EchoSlot *slot = &echo_slots[s];
+        if (slot->id == SIP_HDR_CONTACT && !(t->flags & SIP_TEMPLATE_ECHO_CONTACT)) {
+            continue;
+        }
+
+        const sip_hdr_t *h = sip_msg_header(req, slot->id);
+        // An absent or empty header is left out entirely, as send_sip_response() does
+        if (!h || (h->value_len == 0 && !(slot->all_values && sip_msg_next_header(req, h)))) {
+            continue;
+        }
+
+        APPEND(slot->prefix, slot->prefix_len);
+        if (slot->id == SIP_HDR_CONTACT && contact_expires >= 0) {
+            int n = append_contact_expires(req->buf + h->value_off, h->value_len, contact_expires,
+                                           out, len, out_size);
+            if (n < 0) return -1;
+            len = (size_t)n;
+        } else {
+            APPEND(req->buf + h->value_off, h->value_len);
+        }
+        if (slot->all_values) {
+            for (h = sip_msg_next_header(req, h); h; h = sip_msg_next_header(req, h)) {
+                APPEND(", ", 2);
+                APPEND(req->buf + h->value_off, h->value_len);
+            }
+        }
+        APPEND("\r\n", 2);
+    }
+
+    if (value_name) {
+        char line[48];
+        int n = snprintf(line, sizeof(line), "%s: %d\r\n", value_name, value);
+        APPEND(line, (size_t)n);
+    }
+
+    APPEND(t->tail, t->tail_len);
+#undef APPEND
+
+    return (int)len;
+}
+
+int sip_template_render(const sip_response_template_t *t, const sip_msg_t *req,
+                        char *out, size_t out_size) {
+    return render(t, req, NULL, 0, -1, out, out_size);
+}
+
+int sip_template_render_expires(const sip_response_template_t *t, const sip_msg_t *req, int expires,
+                                char *out, size_t out_size) {
+    return render(t, req, "Expires", expires, expires, out, out_size);
+}
+
+int sip_template_render_retry_after(const sip_response_template_t *t, const sip_msg_t *req, int seconds,
+                                    char *out, size_t out_size) {
+    return render(t, req, "Retry-After", seconds, -1, out, out_size);
+}
@@ -0,0 +1,48 @@
+// sip_core/sip_template.h
+#ifndef SIP_TEMPLATE_H
+#define SIP_TEMPLATE_H
+
+#include "../common.h"
+#include "sip_message.h"
+
+// Precompiled SIP responses for the high-volume replies (OPTIONS keepalives,
+// REGISTER refreshes). The status line and the trailing static headers
+// (Allow, Expires, Content-Length, blank line) are formatted once at startup;
+// per request only the echoed header values are copied in, straight from the
+// request's header index with memcpy of known lengths. The output is the same
+// as send_sip_response() builds for those headers.
+
+#define SIP_TEMPLATE_HEAD_LEN  64
+#define SIP_TEMPLATE_TAIL_LEN  256
+
+// Request headers echoed into the response, in this order
+#define SIP_TEMPLATE_ECHO_CONTACT 0x01  // Via, From, To, Call-ID, CSeq are always echoed
+
+typedef struct {
+    char head[SIP_TEMPLATE_HEAD_LEN];   // Status line + CRLF
+    size_t head_len;
+    unsigned flags;                     // SIP_TEMPLATE_ECHO_*
+    char tail[SIP_TEMPLATE_TAIL_LEN];   // Extra headers, Content-Length: 0, blank line
+    size_t tail_len;
+} sip_response_template_t;
+
+// Returns 0, or -1 if the status line or extra headers do not fit
+int sip_template_compile(sip_response_template_t *t, const char *status_line,
+                         const char *extra_headers, unsigned flags);
+
+// Fill the template from req into out (not NUL-terminated).
+// Returns the message length, or -1 if it does not fit in out_size.
+int sip_template_render(const sip_response_template_t *t, const sip_msg_t *req,
+                        char *out, size_t out_size);
+
+// Same, with an "Expires: <expires>" line ahead of the static tail (REGISTER
+// replies, where the granted value varies per request). An echoed Contact
+// carries ";expires=<expires>" in place of the one the request asked for.
+int sip_template_render_expires(const sip_response_template_t *t, const sip_msg_t *req, int expires,
+                                char *out, size_t out_size);
+
+// Same, with a "Retry-After: <seconds>" line (503 while shedding load)
+int sip_template_render_retry_after(const sip_response_template_t *t, const sip_msg_t *req, int seconds,
+                                    char *out, size_t out_size);
+
+#endif // SIP_TEMPLATE_H
@@ -0,0 +1,343 @@
+// sip_core/sip_transaction.c - Per-thread server transaction table absorbing retransmissions
+#include "sip_transaction.h"
+#include "sip_transport.h"
+#include <strings.h> // For strncasecmp
+
+#define MODULE_NAME "SIP_TXN"
+
+#define RFC3261_BRANCH_COOKIE "z9hG4bK"
+
+typedef enum {
+    TXN_FREE = 0,
+    TXN_PROCEEDING,   // No final response yet (maybe a provisional one cached)
+    TXN_COMPLETED,    // Final response sent (non-INVITE, or INVITE non-2xx)
+    TXN_CONFIRMED,    // INVITE non-2xx final was ACKed (Timer I)
+    TXN_ACCEPTED      // INVITE 2xx sent (RFC 6026, Timer L)
+} TxnState;
+
+typedef struct {
+    TxnState state;
+    bool is_invite;
+    uint32_t hash;
+    sip_txn_key_t key;
+    uint64_t expires_ms;
+    char *response;     // Last response sent, heap copy
+    size_t response_len;
+} SipTxn;
+
+typedef struct {
+    uint32_t hash;
+    int32_t entry;      // Index into entries, -1 = empty
+} TxnSlot;
+
+#define TXN_INDEX_SIZE (SIP_TXN_MAX * 2) // Power of two, load factor <= 0.5
+#define TXN_INDEX_MASK (TXN_INDEX_SIZE - 1)
+
+typedef struct {
+    SipTxn entries[SIP_TXN_MAX];
+    int free_entries[SIP_TXN_MAX];
+    int num_free;
+    TxnSlot slots[TXN_INDEX_SIZE];
+    int sweep_hand;     // Incremental expiry cursor over entries
+} TxnTable;
+
+// Allocated on first use by each SIP thread
+static __thread TxnTable *txn_table = NULL;
+
+static sip_txn_stats_t txn_stats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void count_stat(unsigned long long *counter) {
+    pthread_mutex_lock(&stats_mutex);
+    (*counter)++;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static TxnTable *get_table(void) {
+    if (!txn_table) {
+        txn_table = calloc(1, sizeof(TxnTable));
+        if (!txn_table) {
+            LOG_ERROR("Failed to allocate transaction table.");
+            return NULL;
+        }
+        for (int i = 0; i < TXN_INDEX_SIZE; i++) {
+            txn_table->slots[i].entry = -1;
+        }
+        for (int i = SIP_TXN_MAX - 1; i >= 0; i--) {
+            txn_table->free_entries[txn_table->num_free++] = i;
+        }
+    }
+    return txn_table;
+}
+
+static uint32_t hash_key(const sip_txn_key_t *key) {
+    uint32_t h = 2166136261u; // FNV-1a over branch, method and CSeq number
+    for (const char *p = key->branch; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    for (const char *p = key->method; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    h ^= key->cseq;
+    h *= 16777619u;
+    return h;
+}
+
+static bool key_equal(const sip_txn_key_t *a, const sip_txn_key_t *b) {
+    return a->cseq == b->cseq && strcmp(a->method, b->method) == 0 && strcmp(a->branch, b->branch) == 0;
+}
+
+int sip_txn_key_from_values(const char *via, size_t via_len, const char *cseq, size_t cseq_len,
+                            sip_txn_key_t *key) {
+    // Top Via only: a Via line may carry several comma-separated values
+    const char *via_end = memchr(via, ',', via_len);
+    if (via_end) via_len = via_end - via;
+
+    const char *branch = NULL;
+    for (size_t i = 0; i + 8 <= via_len; i++) {
+        if (via[i] == ';' && strncasecmp(via + i + 1, "branch=", 7) == 0) {
+            branch = via + i + 8;
+            break;
+        }
+    }
+    if (!branch) {
+        return -1;
+    }
+    size_t branch_len = 0;
+    while (branch + branch_len < via + via_len &&
+           !strchr("; \t\r\n", branch[branch_len])) {
+        branch_len++;
+    }
+    if (branch_len <= strlen(RFC3261_BRANCH_COOKIE) || branch_len >= sizeof(key->branch) ||
+        strncmp(branch, RFC3261_BRANCH_COOKIE, strlen(RFC3261_BRANCH_COOKIE)) != 0) {
+        return -1;
+    }
+    memcpy(key->branch, branch, branch_len);
+    key->branch[branch_len] = '\0';
+
+    // CSeq: "<number> <METHOD>"
+    size_t i = 0;
+    uint32_t number = 0;
+    int digits = 0;
+    while (i < cseq_len && cseq[i] >= '0' && cseq[i] <= '9') {
+        number = number * 10 + (uint32_t)(cseq[i] - '0');
+        i++;
+        digits++;
+    }
+    while (i < cseq_len && (cseq[i] == ' ' || cseq[i] == '\t')) i++;
+    size_t method_len = 0;
+    while (i + method_len < cseq_len && cseq[i + method_len] > ' ') method_len++;
+    if (digits == 0 || method_len == 0 || method_len >= sizeof(key->method)) {
+        return -1;
+    }
+    memcpy(key->method, cseq + i, method_len);
+    key->method[method_len] = '\0';
+    key->cseq = number;
+    return 0;
+}
+
+int sip_txn_key_from_msg(const sip_msg_t *msg, sip_txn_key_t *key) {
+    const sip_hdr_t *via = sip_msg_header(msg, SIP_HDR_VIA);
+    const sip_hdr_t *cseq = sip_msg_header(msg, SIP_HDR_CSEQ);
+    if (!via || !cseq) {
+        return -1;
+    }
+    return sip_txn_key_from_values(msg->buf + via->value_off, via->value_len,
+                                   msg->buf + cseq->value_off, cseq->value_len, key);
+}
+
+static int find_slot(const TxnTable *t, const sip_txn_key_t *key, uint32_t h) {
+    for (uint32_t i = h & TXN_INDEX_MASK; t->slots[i].entry >= 0; i = (i + 1) & TXN_INDEX_MASK) {
+        if (t->slots[i].hash == h && key_equal(&t->entries[t->slots[i].entry].key, key)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Linear-probing delete with backward shift, as in the call-session index
+static void remove_slot(TxnTable *t, uint32_t i) {
+    for (uint32_t j = (i + 1) & TXN_INDEX_MASK; t->slots[j].entry >= 0; j = (j + 1) & TXN_INDEX_MASK) {
+        uint32_t home = t->slots[j].hash & TXN_INDEX_MASK;
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            t->slots[i] = t->slots[j];
+            i = j;
+        }
+    }
+    t->slots[i].entry = -1;
+}
+
+static void release_txn(TxnTable *t, int entry) {
+    SipTxn *txn = &t->entries[entry];
+    int slot = find_slot(t, &txn->key, txn->hash);
+    if (slot >= 0) {
+        remove_slot(t, (uint32_t)slot);
+    }
+    free(txn->response);
+    txn->response = NULL;
+    txn->response_len = 0;
+    txn->state = TXN_FREE;
+    t->free_entries[t->num_free++] = entry;
+}
+
+// Expire a few entries per call so the table never needs its own timer
+static void sweep(TxnTable *t, uint64_t now, int budget) {
+    for (int n = 0; n < budget; n++) {
+        int entry = t->sweep_hand;
+        t->sweep_hand = (t->sweep_hand + 1) % SIP_TXN_MAX;
+        if (t->entries[entry].state != TXN_FREE && t->entries[entry].expires_ms <= now) {
+            release_txn(t, entry);
+        }
+    }
+}
+
+static SipTxn *lookup(TxnTable *t, const sip_txn_key_t *key, uint64_t now) {
+    int slot = find_slot(t, key, hash_key(key));
+    if (slot < 0) {
+        return NULL;
+    }
+    int entry = t->slots[slot].entry;
+    if (t->entries[entry].expires_ms <= now) {
+        release_txn(t, entry);
+        return NULL;
+    }
+    return &t->entries[entry];
+}
+
+sip_txn_result_t sip_txn_on_request(int sockfd, const sip_msg_t *req,
+                                    const struct sockaddr_in *src, socklen_t src_len) {
+    sip_txn_key_t key;
+    TxnTable *t = get_table();
+    if (!t || sip_txn_key_from_msg(req, &key) != 0) {
+        count_stat(&txn_stats.untracked);
+        return SIP_TXN_NEW;
+    }
+    uint64_t now = now_ms();
+
+    // ACK for a non-2xx final shares the INVITE's branch; it ends the wait for it (Timer I)
+    if (strcmp(key.method, "ACK") == 0) {
+        snprintf(key.method, sizeof(key.method), "INVITE");
+        SipTxn *invite = lookup(t, &key, now);
+        if (invite && invite->state == TXN_COMPLETED) {
+            invite->state = TXN_CONFIRMED;
+            invite->expires_ms = now + SIP_T4_MS;
+        }
+        return SIP_TXN_NEW;
+    }
+
+    SipTxn *txn = lookup(t, &key, now);
+    if (txn) {
+        if (txn->state == TXN_ACCEPTED || txn->state == TXN_CONFIRMED) {
+            // RFC 6026: the UAS retransmits its own 2xx; nothing for us to resend
+            count_stat(&txn_stats.absorbed);
+            return SIP_TXN_ABSORBED;
+        }
+        if (txn->response) {
+            sip_transport_send(sockfd, src, src_len, txn->response, txn->response_len);
+            count_stat(&txn_stats.absorbed);
+            LOG_DEBUG("Absorbed %s retransmission (branch %s); resent last response.",
+                      key.method, key.branch);
+            return SIP_TXN_ABSORBED;
+        }
+        return SIP_TXN_NEW; // Nothing to answer with yet: let it through again
+    }
+
+    sweep(t, now, 2);
+    if (t->num_free == 0) {
+        sweep(t, now, SIP_TXN_MAX);
+        if (t->num_free == 0) {
+            count_stat(&txn_stats.untracked);
+            return SIP_TXN_NEW;
+        }
+    }
+
+    int entry = t->free_entries[--t->num_free];
+    txn = &t->entries[entry];
+    txn->key = key;
+    txn->hash = hash_key(&key);
+    txn->is_invite = strcmp(key.method, "INVITE") == 0;
+    txn->state = TXN_PROCEEDING;
+    txn->expires_ms = now + (txn->is_invite ? SIP_TIMER_C_MS : 64 * SIP_T1_MS);
+    txn->response = NULL;
+    txn->response_len = 0;
+
+    uint32_t i = txn->hash & TXN_INDEX_MASK;
+    while (t->slots[i].entry >= 0) {
+        i = (i + 1) & TXN_INDEX_MASK;
+    }
+    t->slots[i].hash = txn->hash;
+    t->slots[i].entry = entry;
+
+    count_stat(&txn_stats.created);
+    return SIP_TXN_NEW;
+}
+
+void sip_txn_record_response(const sip_txn_key_t *key, const struct iovec *iov, int iovcnt) {
+    TxnTable *t = txn_table;
+    if (!t || iovcnt <= 0) {
+        return;
+    }
+    uint64_t now = now_ms();
+    SipTxn *txn = lookup(t, key, now);
+    if (!txn || txn->state == TXN_CONFIRMED || txn->state == TXN_ACCEPTED) {
+        return;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    // "SIP/2.0 NNN ..." - the status code is always at offset 8
+    const char *first = iov[0].iov_base;
+    if (iov[0].iov_len < 12) {
+        return;
+    }
+    int status = atoi(first + 8);
+    if (status < 100 || status > 699) {
+        return;
+    }
+    // Never let a late provisional overwrite the final response
+    if (status < 200 && txn->state != TXN_PROCEEDING) {
+        return;
+    }
+
+    char *copy = realloc(txn->response, len);
+    if (!copy) {
+        return;
+    }
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(copy + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    txn->response = copy;
+    txn->response_len = len;
+
+    if (status < 200) {
+        if (txn->is_invite) txn->expires_ms = now + SIP_TIMER_C_MS;
+    } else if (txn->is_invite && status < 300) {
+        txn->state = TXN_ACCEPTED;
+        txn->expires_ms = now + 64 * SIP_T1_MS; // Timer L
+        free(txn->response); // Absorbed silently from here on
+        txn->response = NULL;
+        txn->response_len = 0;
+    } else {
+        txn->state = TXN_COMPLETED;
+        txn->expires_ms = now + 64 * SIP_T1_MS; // Timer H (INVITE) / Timer J (non-INVITE)
+    }
+}
+
+void sip_txn_get_stats(sip_txn_stats_t *stats) {
+    pthread_mutex_lock(&stats_mutex);
+    *stats = txn_stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
@@ -0,0 +1,63 @@
+// sip_core/sip_transaction.h
+#ifndef SIP_TRANSACTION_H
+#define SIP_TRANSACTION_H
+
+#include "../common.h"
+#include "sip_message.h"
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Lightweight server transaction table (RFC 3261 section 17.2).
+// Requests are keyed on the top Via branch, CSeq method and CSeq number.
+// The last response sent for a request (local or proxied) is kept. A
+// retransmitted request is answered from it and goes no further, so it is
+// not resolved, proxied or applied to the user table again.
+// A retransmission with nothing cached yet (e.g. a proxied BYE whose answer
+// has not come back) is processed as before, because the proxy does not
+// retransmit on its own.
+// Only RFC 3261 branches ("z9hG4bK...") are tracked. Tables are per thread:
+// every message of a Call-ID is handled by the same SIP thread.
+
+#define SIP_TXN_MAX         512   // Live transactions per SIP thread
+#define SIP_TXN_BRANCH_LEN  64
+#define SIP_TXN_METHOD_LEN  16
+
+// RFC 3261 timer bases (UDP)
+#define SIP_T1_MS           500
+#define SIP_T4_MS           5000
+#define SIP_TIMER_C_MS      180000  // INVITE still proceeding (ringing)
+
+typedef struct {
+    char branch[SIP_TXN_BRANCH_LEN];
+    char method[SIP_TXN_METHOD_LEN];
+    uint32_t cseq;
+} sip_txn_key_t;
+
+typedef enum {
+    SIP_TXN_NEW = 0,      // First copy (or untracked): process it
+    SIP_TXN_ABSORBED      // Retransmission answered from the cache or dropped
+} sip_txn_result_t;
+
+typedef struct {
+    unsigned long long created;
+    unsigned long long absorbed;
+    unsigned long long untracked;   // No RFC 3261 branch, or table full
+} sip_txn_stats_t;
+
+// Key from the top Via value and the CSeq value. Returns 0, or -1 if the
+// Via carries no RFC 3261 branch or the CSeq is malformed.
+int sip_txn_key_from_values(const char *via, size_t via_len, const char *cseq, size_t cseq_len,
+                            sip_txn_key_t *key);
+int sip_txn_key_from_msg(const sip_msg_t *msg, sip_txn_key_t *key);
+
+// Call for every incoming request before acting on it. ACKs never create a
+// transaction; one for a non-2xx final moves the INVITE transaction on.
+sip_txn_result_t sip_txn_on_request(int sockfd, const sip_msg_t *req,
+                                    const struct sockaddr_in *src, socklen_t src_len);
+
+// Remember a response sent for the transaction (status code read from the data)
+void sip_txn_record_response(const sip_txn_key_t *key, const struct iovec *iov, int iovcnt);
+
+void sip_txn_get_stats(sip_txn_stats_t *stats);
+
+#endif // SIP_TRANSACTION_H
@@ -0,0 +1,206 @@
+// sip_core/sip_transport.c - recvmmsg/sendmmsg batching for the SIP main loop
+#define _GNU_SOURCE
+#include "sip_transport.h"
+#include "sip_tcp.h"
+#include "../config_loader/config_loader.h" // For g_sip_max_message_size
+
+#define MODULE_NAME "SIP_IO"
+
+typedef struct {
+    struct sockaddr_in dest;
+    socklen_t dest_len;
+    size_t len;
+    char buffer[MAX_SIP_MSG_LEN];
+} QueuedDatagram;
+
+// Each thread that opens batches (main loop or SIP worker) gets its own queue,
+// allocated on its first batch so threads that never send pay nothing
+static __thread QueuedDatagram *tx_queue = NULL;
+static __thread int tx_count = 0;
+static __thread int tx_sockfd = -1;
+static __thread bool batch_open = false;
+
+static sip_transport_stats_t io_stats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER; // Health reporter reads from its own thread
+
+int sip_datagram_alloc(sip_datagram_t *datagram) {
+    memset(datagram, 0, sizeof(*datagram));
+    datagram->capacity = (size_t)g_sip_max_message_size + 1;
+    datagram->buffer = malloc(datagram->capacity);
+    return datagram->buffer ? 0 : -1;
+}
+
+void sip_datagram_free(sip_datagram_t *datagram) {
+    free(datagram->buffer);
+    datagram->buffer = NULL;
+    datagram->capacity = 0;
+}
+
+int sip_transport_recv_batch(int sockfd, sip_datagram_t *datagrams, int max) {
+    struct mmsghdr msgs[SIP_BATCH_MAX];
+    struct iovec iovs[SIP_BATCH_MAX];
+
+    if (max > SIP_BATCH_MAX) max = SIP_BATCH_MAX;
+    memset(msgs, 0, sizeof(msgs[0]) * max);
+    for (int i = 0; i < max; i++) {
+        iovs[i].iov_base = datagrams[i].buffer;
+        iovs[i].iov_len = datagrams[i].capacity - 1;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &datagrams[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(datagrams[i].addr);
+    }
+
+    int received = recvmmsg(sockfd, msgs, max, MSG_DONTWAIT, NULL);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        return -1;
+    }
+
+    int oversize = 0;
+    for (int i = 0; i < received; i++) {
+        datagrams[i].len = msgs[i].msg_len;
+        datagrams[i].addr_len = msgs[i].msg_hdr.msg_namelen;
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            LOG_WARN("Dropped SIP datagram from %s:%d larger than SIP_MAX_MESSAGE_SIZE (%d).",
+                     sockaddr_to_ip_str(&datagrams[i].addr), ntohs(datagrams[i].addr.sin_port),
+                     g_sip_max_message_size);
+            datagrams[i].len = 0;
+            oversize++;
+        }
+        datagrams[i].buffer[datagrams[i].len] = '\0';
+    }
+
+    if (received > 0) {
+        pthread_mutex_lock(&stats_mutex);
+        io_stats.rx_oversize += oversize;
+        io_stats.rx_batches++;
+        io_stats.rx_datagrams += received;
+        if (received > io_stats.rx_max_batch) io_stats.rx_max_batch = received;
+        pthread_mutex_unlock(&stats_mutex);
+    }
+    return received;
+}
+
+void sip_transport_begin_batch(void) {
+    if (!tx_queue) {
+        tx_queue = calloc(SIP_BATCH_MAX, sizeof(QueuedDatagram));
+        if (!tx_queue) {
+            return; // Sends go out one sendto() at a time
+        }
+    }
+    batch_open = true;
+}
+
+static void flush_queue(void) {
+    if (tx_count == 0) {
+        return;
+    }
+
+    struct mmsghdr msgs[SIP_BATCH_MAX];
+    struct iovec iovs[SIP_BATCH_MAX];
+    memset(msgs, 0, sizeof(msgs[0]) * tx_count);
+    for (int i = 0; i < tx_count; i++) {
+        iovs[i].iov_base = tx_queue[i].buffer;
+        iovs[i].iov_len = tx_queue[i].len;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &tx_queue[i].dest;
+        msgs[i].msg_hdr.msg_namelen = tx_queue[i].dest_len;
+    }
+
+    // sendmmsg() stops at the first failing datagram; report it and carry on with the rest
+    int sent_total = 0;
+    int errors = 0;
+    int next = 0;
+    while (next < tx_count) {
+        int sent = sendmmsg(tx_sockfd, &msgs[next], tx_count - next, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("SIP: Error sending SIP message to %s:%d: %s",
+                      sockaddr_to_ip_str(&tx_queue[next].dest),
+                      ntohs(tx_queue[next].dest.sin_port), strerror(errno));
+            errors++;
+            next++;
+            continue;
+        }
+        sent_total += sent;
+        next += sent;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    io_stats.tx_batches++;
+    io_stats.tx_datagrams += sent_total;
+    io_stats.tx_errors += errors;
+    if (tx_count > io_stats.tx_max_batch) io_stats.tx_max_batch = tx_count;
+    pthread_mutex_unlock(&stats_mutex);
+
+    tx_count = 0;
+    tx_sockfd = -1;
+}
+
+void sip_transport_flush(void) {
+    flush_queue();
+    batch_open = false;
+}
+
+ssize_t sip_transport_sendv(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                            const struct iovec *iov, int iovcnt) {
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    ssize_t tcp_result;
+    if (sip_tcp_try_sendv(dest_addr, dest_len, iov, iovcnt, len, &tcp_result)) {
+        return tcp_result;
+    }
+
+    if (!batch_open || len > MAX_SIP_MSG_LEN) {
+        // Straight from the caller's segments; the kernel gathers them
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_name = (void *)dest_addr;
+        mh.msg_namelen = dest_len;
+        mh.msg_iov = (struct iovec *)iov;
+        mh.msg_iovlen = iovcnt;
+        ssize_t sent = sendmsg(sockfd, &mh, 0);
+        pthread_mutex_lock(&stats_mutex);
+        if (sent < 0) io_stats.tx_errors++;
+        else io_stats.tx_datagrams++;
+        pthread_mutex_unlock(&stats_mutex);
+        return sent;
+    }
+
+    // One sendmmsg() per socket; flush early if the queue is full or the socket changes
+    if (tx_count == SIP_BATCH_MAX || (tx_count > 0 && tx_sockfd != sockfd)) {
+        flush_queue();
+    }
+
+    // The segments may point into buffers that are reused before the flush, so gather them now
+    QueuedDatagram *q = &tx_queue[tx_count++];
+    memcpy(&q->dest, dest_addr, dest_len < sizeof(q->dest) ? dest_len : sizeof(q->dest));
+    q->dest_len = dest_len < sizeof(q->dest) ? dest_len : sizeof(q->dest);
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(q->buffer + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    q->len = len;
+    tx_sockfd = sockfd;
+    return (ssize_t)len;
+}
+
+ssize_t sip_transport_send(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                           const char *data, size_t len) {
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    return sip_transport_sendv(sockfd, dest_addr, dest_len, &iov, 1);
+}
+
+void sip_transport_get_stats(sip_transport_stats_t *stats) {
+    pthread_mutex_lock(&stats_mutex);
+    *stats = io_stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
@@ -0,0 +1,61 @@
+// sip_core/sip_transport.h
+#ifndef SIP_TRANSPORT_H
+#define SIP_TRANSPORT_H
+
+#include "../common.h"
+#include <sys/uio.h> // For struct iovec
+
+// Batched datagram I/O for the SIP main loop.
+// The loop drains up to SIP_BATCH_MAX datagrams per wakeup with one
+// recvmmsg(), processes them between sip_transport_begin_batch() and
+// sip_transport_flush(), and everything sent in between leaves in a single
+// sendmmsg(). Outside a batch sip_transport_send() is a plain sendto().
+// Batches are per thread, so SIP worker threads can each run their own.
+
+#define SIP_BATCH_MAX 16
+
+typedef struct {
+    char *buffer;                   // NUL-terminated payload, from sip_datagram_alloc()
+    size_t capacity;                // SIP_MAX_MESSAGE_SIZE + 1
+    ssize_t len;
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+} sip_datagram_t;
+
+typedef struct {
+    unsigned long long rx_batches;     // recvmmsg() calls that returned data
+    unsigned long long rx_datagrams;
+    int rx_max_batch;
+    unsigned long long tx_batches;     // sendmmsg() flushes
+    unsigned long long tx_datagrams;   // Datagrams sent (batched or direct)
+    int tx_max_batch;
+    unsigned long long tx_errors;
+    unsigned long long rx_oversize;    // Datagrams over SIP_MAX_MESSAGE_SIZE, dropped
+} sip_transport_stats_t;
+
+// Give a datagram a buffer for the largest message accepted (SIP_MAX_MESSAGE_SIZE). 0, or -1 if out of memory.
+int sip_datagram_alloc(sip_datagram_t *datagram);
+void sip_datagram_free(sip_datagram_t *datagram);
+
+// Receive up to max (<= SIP_BATCH_MAX) datagrams without blocking.
+// Returns the number received, 0 if none were waiting, -1 on error.
+// A datagram larger than its buffer is dropped (len 0), not processed truncated.
+int sip_transport_recv_batch(int sockfd, sip_datagram_t *datagrams, int max);
+
+void sip_transport_begin_batch(void);
+void sip_transport_flush(void);
+
+// Send or queue one message. It goes over TCP when sip_tcp has (or, for a
+// large request, opens) a connection to dest_addr; otherwise as a UDP datagram.
+// Returns len if sent/queued, -1 on error.
+ssize_t sip_transport_send(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                           const char *data, size_t len);
+
+// Same for a message given as segments. Outside a batch they go straight to
+// sendmsg() without being copied; inside one they are gathered into the queue.
+ssize_t sip_transport_sendv(int sockfd, const struct sockaddr_in *dest_addr, socklen_t dest_len,
+                            const struct iovec *iov, int iovcnt);
+
+void sip_transport_get_stats(sip_transport_stats_t *stats);
+
+#endif // SIP_TRANSPORT_H
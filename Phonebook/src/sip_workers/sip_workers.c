@@ -0,0 +1,268 @@
+// sip_workers/sip_workers.c - Call-ID sharded SIP worker threads fed by the main loop
+#include "sip_workers.h"
+#include "../sip_core/sip_core.h"              // For process_parsed_sip_message
+#include "../call-sessions/call_sessions.h"    // For call_sessions_shard_of
+#include "../dns_resolver/dns_resolver.h"      // Each worker resolves callees itself
+#include "../config_loader/config_loader.h"    // For g_sip_max_message_size
+#include "../sip_core/sip_overload.h"          // Workers report their processing latency
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define MODULE_NAME "SIP_WORKERS"
+
+typedef struct {
+    sip_datagram_t datagram;    // Buffer allocated once per slot, SIP_MAX_MESSAGE_SIZE + 1
+    sip_msg_t msg;              // Indexed by the dispatcher; msg.buf points at datagram.buffer
+} QueuedMessage;
+
+// Single producer (main loop), single consumer (the worker). The producer only
+// writes the slot past head + count, the consumer only reads slots it has not
+// released yet, so the mutex is held just long enough to move the counters.
+typedef struct {
+    pthread_t tid;
+    int index;
+    int wake_fd;
+    bool kick_pending;          // Main loop only
+    bool stop;
+    pthread_mutex_t mutex;
+    QueuedMessage *queue;
+    int head;
+    int count;
+    unsigned long long dispatched;
+    unsigned long long dropped;
+    int max_depth;
+} SipWorker;
+
+static SipWorker workers[SIP_WORKERS_MAX];
+static int num_workers = 0;
+static int sip_sockfd = -1;
+
+// Main loop only; too large for the stack
+static sip_msg_t dispatch_msg;
+
+static void drain_queue(SipWorker *w) {
+    for (;;) {
+        pthread_mutex_lock(&w->mutex);
+        int head = w->head;
+        int count = w->count;
+        pthread_mutex_unlock(&w->mutex);
+
+        if (count == 0) {
+            return;
+        }
+        if (count > SIP_BATCH_MAX) count = SIP_BATCH_MAX;
+
+        uint64_t started_us = sip_overload_now_us();
+        sip_transport_begin_batch();
+        for (int i = 0; i < count; i++) {
+            QueuedMessage *q = &w->queue[(head + i) % SIP_WORKER_QUEUE_LEN];
+            process_parsed_sip_message(sip_sockfd, &q->msg, &q->datagram.addr, q->datagram.addr_len);
+        }
+        sip_transport_flush();
+        sip_overload_note_processing(started_us, count);
+
+        pthread_mutex_lock(&w->mutex);
+        w->head = (head + count) % SIP_WORKER_QUEUE_LEN;
+        w->count -= count;
+        pthread_mutex_unlock(&w->mutex);
+    }
+}
+
+static void *sip_worker_thread(void *arg) {
+    SipWorker *w = (SipWorker *)arg;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        LOG_ERROR("Worker %d: epoll_create1 failed: %s", w->index, strerror(errno));
+        return NULL;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = w->wake_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, w->wake_fd, &ev);
+
+    // Resolver state is per thread, so this worker's INVITE lookups use their own socket
+    if (dns_resolver_init() == 0) {
+        ev.data.fd = dns_resolver_get_fd();
+        epoll_ctl(epfd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+    } else {
+        LOG_WARN("Worker %d: DNS resolver init failed. INVITEs will be rejected with 503.", w->index);
+    }
+
+    LOG_INFO("SIP worker %d running.", w->index);
+
+    while (g_keep_running && !__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epfd, events, 2, dns_resolver_next_timeout_ms());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Worker %d: epoll_wait failed: %s", w->index, strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == w->wake_fd) {
+                uint64_t value;
+                if (read(w->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    LOG_WARN("Worker %d: eventfd read failed: %s", w->index, strerror(errno));
+                }
+            } else {
+                dns_resolver_handle_readable();
+            }
+        }
+        dns_resolver_process_timeouts();
+        drain_queue(w);
+    }
+
+    dns_resolver_shutdown();
+    close(epfd);
+    LOG_INFO("SIP worker %d exiting.", w->index);
+    return NULL;
+}
+
+static int alloc_queue_buffers(SipWorker *w) {
+    for (int i = 0; i < SIP_WORKER_QUEUE_LEN; i++) {
+        if (sip_datagram_alloc(&w->queue[i].datagram) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_queue(SipWorker *w) {
+    if (!w->queue) {
+        return;
+    }
+    for (int i = 0; i < SIP_WORKER_QUEUE_LEN; i++) {
+        sip_datagram_free(&w->queue[i].datagram);
+    }
+    free(w->queue);
+    w->queue = NULL;
+}
+
+int sip_workers_start(int sockfd, int count) {
+    if (count > SIP_WORKERS_MAX) count = SIP_WORKERS_MAX;
+    sip_sockfd = sockfd;
+
+    for (int i = 0; i < count; i++) {
+        SipWorker *w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->index = i;
+        pthread_mutex_init(&w->mutex, NULL);
+        w->queue = calloc(SIP_WORKER_QUEUE_LEN, sizeof(QueuedMessage));
+        w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (!w->queue || w->wake_fd < 0 || alloc_queue_buffers(w) != 0) {
+            LOG_ERROR("Failed to set up SIP worker %d.", i);
+            free_queue(w);
+            if (w->wake_fd >= 0) close(w->wake_fd);
+            break;
+        }
+        if (pthread_create(&w->tid, NULL, sip_worker_thread, w) != 0) {
+            LOG_ERROR("Failed to create SIP worker thread %d.", i);
+            free_queue(w);
+            close(w->wake_fd);
+            break;
+        }
+        num_workers++;
+    }
+
+    if (num_workers == 0) {
+        return -1;
+    }
+    LOG_INFO("Started %d SIP worker thread%s (%d call-session shard%s).", num_workers,
+             num_workers == 1 ? "" : "s", call_sessions_shard_count(),
+             call_sessions_shard_count() == 1 ? "" : "s");
+    return 0;
+}
+
+void sip_workers_stop(void) {
+    int count = num_workers;
+    num_workers = 0; // The main loop has stopped dispatching; stats readers see no workers from here on
+
+    for (int i = 0; i < count; i++) {
+        __atomic_store_n(&workers[i].stop, true, __ATOMIC_RELEASE);
+        uint64_t one = 1;
+        if (write(workers[i].wake_fd, &one, sizeof(one)) < 0) {
+            LOG_WARN("Failed to wake SIP worker %d: %s", i, strerror(errno));
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i].tid, NULL);
+        close(workers[i].wake_fd);
+        free_queue(&workers[i]);
+    }
+}
+
+bool sip_workers_enabled(void) {
+    return num_workers > 0;
+}
+
+void sip_workers_dispatch(const sip_datagram_t *datagram) {
+    if (datagram->len < 10 || datagram->len > g_sip_max_message_size) {
+        return;
+    }
+    if (sip_msg_parse(&dispatch_msg, datagram->buffer, (size_t)datagram->len) != 0) {
+        LOG_DEBUG("Received malformed SIP start line from %s:%d. Ignoring.",
+                    sockaddr_to_ip_str(&datagram->addr), ntohs(datagram->addr.sin_port));
+        return;
+    }
+
+    // Messages without a Call-ID all hash to the same worker; sip_core rejects them there
+    char call_id[MAX_CONTACT_URI_LEN];
+    sip_msg_copy_header(&dispatch_msg, SIP_HDR_CALL_ID, call_id, sizeof(call_id));
+    SipWorker *w = &workers[call_sessions_shard_of(call_id) % num_workers];
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->count == SIP_WORKER_QUEUE_LEN) {
+        w->dropped++;
+        pthread_mutex_unlock(&w->mutex);
+        return;
+    }
+    QueuedMessage *q = &w->queue[(w->head + w->count) % SIP_WORKER_QUEUE_LEN];
+    memcpy(q->datagram.buffer, datagram->buffer, (size_t)datagram->len + 1);
+    q->datagram.len = datagram->len;
+    q->datagram.addr = datagram->addr;
+    q->datagram.addr_len = datagram->addr_len;
+    q->msg = dispatch_msg;
+    q->msg.buf = q->datagram.buffer;
+    w->count++;
+    w->dispatched++;
+    if (w->count > w->max_depth) w->max_depth = w->count;
+    pthread_mutex_unlock(&w->mutex);
+
+    w->kick_pending = true;
+}
+
+void sip_workers_kick(void) {
+    for (int i = 0; i < num_workers; i++) {
+        if (!workers[i].kick_pending) continue;
+        workers[i].kick_pending = false;
+        uint64_t one = 1;
+        if (write(workers[i].wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARN("Failed to wake SIP worker %d: %s", i, strerror(errno));
+        }
+    }
+}
+
+int sip_workers_queued(void) {
+    int queued = 0;
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_lock(&workers[i].mutex);
+        queued += workers[i].count;
+        pthread_mutex_unlock(&workers[i].mutex);
+    }
+    return queued;
+}
+
+void sip_workers_get_stats(sip_workers_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->workers = num_workers;
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_lock(&workers[i].mutex);
+        stats->dispatched += workers[i].dispatched;
+        stats->dropped += workers[i].dropped;
+        if (workers[i].max_depth > stats->max_queue_depth) stats->max_queue_depth = workers[i].max_depth;
+        pthread_mutex_unlock(&workers[i].mutex);
+    }
+}
@@ -0,0 +1,43 @@
+// sip_workers/sip_workers.h
+#ifndef SIP_WORKERS_H
+#define SIP_WORKERS_H
+
+#include "../common.h"
+#include "../sip_core/sip_transport.h"
+
+// Optional multi-threaded SIP processing (SIP_WORKER_THREADS > 0).
+// The main loop still owns the SIP socket and drains it with recvmmsg(); each
+// datagram is indexed once, hashed on its Call-ID and handed to the worker
+// that owns that Call-ID's call-session shard. Every message of a dialog
+// therefore lands on the same worker, in arrival order, and workers never
+// touch each other's sessions. Each worker runs its own DNS resolver and
+// sendmmsg() batch and replies through the shared SIP socket.
+// Registrations stay in the user_manager store (lock-free reads).
+
+#define SIP_WORKER_QUEUE_LEN 32 // Datagrams queued per worker; more are dropped (UDP peers retransmit)
+
+typedef struct {
+    int workers;
+    unsigned long long dispatched;
+    unsigned long long dropped;      // Worker queue full
+    int max_queue_depth;
+} sip_workers_stats_t;
+
+// Start count workers replying on sockfd. Returns 0 on success, -1 if none
+// could be started (the caller keeps processing in the main loop).
+int sip_workers_start(int sockfd, int count);
+void sip_workers_stop(void);
+bool sip_workers_enabled(void);
+
+// Main loop only: parse one datagram and queue it for its worker
+void sip_workers_dispatch(const sip_datagram_t *datagram);
+
+// Wake the workers that received datagrams since the last call
+void sip_workers_kick(void);
+
+// Main loop only: messages waiting in all worker queues
+int sip_workers_queued(void);
+
+void sip_workers_get_stats(sip_workers_stats_t *stats);
+
+#endif // SIP_WORKERS_H
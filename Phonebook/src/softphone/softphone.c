@@ -1,6 +1,7 @@
 // softphone.c - SIP User Agent Client Core Implementation
 #include "softphone.h"
 #include "../common.h"
+#include "../event_loop/event_loop.h" // Wake the main loop to re-arm the call timeout
 #include <stdlib.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -194,6 +195,7 @@ int softphone_make_call(const char *target_number, const char *server_ip) {
 
     g_softphone_ctx.call.state = SOFTPHONE_STATE_CALLING;
     g_softphone_ctx.call.state_timestamp = time(NULL);
+    event_loop_wakeup(); // Called from the bulk tester thread; the main loop owns the timer
     LOG_INFO("[SOFTPHONE_CALL] ✓ INVITE sent to %s for %s (Call-ID: %s, state: %s)",
              server_ip, target_number, g_softphone_ctx.call.call_id,
              softphone_state_to_string(g_softphone_ctx.call.state));
@@ -272,6 +274,7 @@ int softphone_cancel_call(void) {
     LOG_INFO("[SOFTPHONE_CANCEL] ✓ CANCEL sent successfully (%zd bytes)", sent);
     g_softphone_ctx.call.state = SOFTPHONE_STATE_TERMINATING;
     g_softphone_ctx.call.state_timestamp = time(NULL);
+    event_loop_wakeup();
     return 0;
 }
 
@@ -308,6 +311,7 @@ int softphone_hang_up(void) {
 
     g_softphone_ctx.call.state = SOFTPHONE_STATE_TERMINATING;
     g_softphone_ctx.call.state_timestamp = time(NULL);
+    event_loop_wakeup();
     LOG_INFO("[SOFTPHONE_BYE] ✓ BYE sent successfully (%zd bytes, state: %s)",
              sent, softphone_state_to_string(g_softphone_ctx.call.state));
     return 0;
@@ -322,14 +326,15 @@ int softphone_process_response(const char *response, size_t response_len) {
         return -1;
     }
 
-    // Parse status line
-    int status_code = 0;
-    if (sscanf(response, "SIP/2.0 %d", &status_code) != 1) {
+    // Index status line and headers once; tag lookups below read from the table
+    sip_msg_t msg;
+    if (sip_msg_parse(&msg, response, response_len) != 0 || !msg.is_response) {
         LOG_ERROR("[SOFTPHONE_RESPONSE] Failed to parse SIP response status line");
         int preview_len = (response_len < 200) ? (int)response_len : 200;
         LOG_DEBUG("[SOFTPHONE_RESPONSE] Response: %.*s", preview_len, response);
         return -1;
     }
+    int status_code = msg.status_code;
 
     LOG_INFO("[SOFTPHONE_RESPONSE] ← Received %d response (state: %s)", status_code,
              softphone_state_to_string(g_softphone_ctx.call.state));
@@ -363,7 +368,7 @@ int softphone_process_response(const char *response, size_t response_len) {
 
                 // Extract To tag from 200 OK
                 LOG_DEBUG("[SOFTPHONE_RESPONSE] Extracting To tag from response");
-                if (softphone_extract_to_tag(response, g_softphone_ctx.call.to_tag,
+                if (softphone_extract_to_tag(&msg, g_softphone_ctx.call.to_tag,
                                        sizeof(g_softphone_ctx.call.to_tag)) < 0) {
                     LOG_WARN("[SOFTPHONE_RESPONSE] Failed to extract To tag from 200 OK");
                 } else {
@@ -401,7 +406,7 @@ int softphone_process_response(const char *response, size_t response_len) {
         case 486:  // Busy Here
             LOG_WARN("[SOFTPHONE_RESPONSE] Target phone busy (486 Busy Here)");
             // Extract To tag and send ACK to complete transaction
-            if (softphone_extract_to_tag(response, g_softphone_ctx.call.to_tag,
+            if (softphone_extract_to_tag(&msg, g_softphone_ctx.call.to_tag,
                                    sizeof(g_softphone_ctx.call.to_tag)) >= 0) {
                 softphone_send_ack();
             }
@@ -413,7 +418,7 @@ int softphone_process_response(const char *response, size_t response_len) {
         case 487:  // Request Terminated
             LOG_WARN("[SOFTPHONE_RESPONSE] Request terminated (487)");
             // Extract To tag and send ACK to complete transaction
-            if (softphone_extract_to_tag(response, g_softphone_ctx.call.to_tag,
+            if (softphone_extract_to_tag(&msg, g_softphone_ctx.call.to_tag,
                                    sizeof(g_softphone_ctx.call.to_tag)) >= 0) {
                 softphone_send_ack();
             }
@@ -426,7 +431,7 @@ int softphone_process_response(const char *response, size_t response_len) {
             // All error responses to INVITE require ACK (RFC 3261)
             LOG_WARN("[SOFTPHONE_RESPONSE] Error response code: %d", status_code);
             // Extract To tag and send ACK to complete transaction
-            if (softphone_extract_to_tag(response, g_softphone_ctx.call.to_tag,
+            if (softphone_extract_to_tag(&msg, g_softphone_ctx.call.to_tag,
                                    sizeof(g_softphone_ctx.call.to_tag)) >= 0) {
                 LOG_DEBUG("[SOFTPHONE_RESPONSE] Sending ACK for error response");
                 softphone_send_ack();
@@ -502,3 +507,28 @@ int softphone_check_timeout(void) {
 
     return 0;
 }
+
+// Seconds a call may stay in state before softphone_check_timeout() resets it; -1 = no limit
+static int state_timeout_seconds(softphone_call_state_t state) {
+    switch (state) {
+        case SOFTPHONE_STATE_CALLING:     return SOFTPHONE_RESPONSE_TIMEOUT;
+        case SOFTPHONE_STATE_RINGING:     return SOFTPHONE_RINGING_TIMEOUT;
+        case SOFTPHONE_STATE_ESTABLISHED: return SOFTPHONE_CALL_TIMEOUT;
+        case SOFTPHONE_STATE_TERMINATING: return SOFTPHONE_RESPONSE_TIMEOUT;
+        case SOFTPHONE_STATE_TERMINATED:  return 0;
+        default:                          return -1;
+    }
+}
+
+int softphone_next_timeout_ms(void) {
+    int limit = state_timeout_seconds(g_softphone_ctx.call.state);
+    if (limit < 0) {
+        return -1;
+    }
+    // softphone_check_timeout() fires once elapsed > limit, i.e. at state_timestamp + limit + 1
+    time_t remaining = g_softphone_ctx.call.state_timestamp + limit + 1 - time(NULL);
+    if (g_softphone_ctx.call.state == SOFTPHONE_STATE_TERMINATED || remaining <= 0) {
+        return 0;
+    }
+    return (int)remaining * 1000;
+}
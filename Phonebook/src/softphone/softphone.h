@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <time.h>
+#include "../sip_core/sip_message.h"
 
 // Softphone Configuration
 #define SOFTPHONE_SIP_PORT 5070
@@ -57,7 +58,7 @@ int softphone_init(const char *local_ip);
 void softphone_shutdown(void);
 
 /**
- * Get softphone socket file descriptor (for select loop)
+ * Get softphone socket file descriptor (for the main event loop)
  * @return Softphone socket fd
  */
 int softphone_get_sockfd(void);
@@ -116,6 +117,12 @@ void softphone_reset_state(void);
  */
 int softphone_check_timeout(void);
 
+/**
+ * Time until softphone_check_timeout() has work to do
+ * @return Milliseconds until the current state times out, -1 if idle
+ */
+int softphone_next_timeout_ms(void);
+
 // Internal helper functions (used by SIP builder/parser)
 int softphone_build_invite(char *buffer, size_t buffer_size, softphone_call_t *call,
                            const char *local_ip, int local_port);
@@ -123,6 +130,6 @@ int softphone_build_ack(char *buffer, size_t buffer_size, softphone_call_t *call
                         const char *local_ip, int local_port);
 int softphone_build_bye(char *buffer, size_t buffer_size, softphone_call_t *call,
                         const char *local_ip, int local_port);
-int softphone_extract_to_tag(const char *response, char *to_tag_out, size_t out_size);
+int softphone_extract_to_tag(const sip_msg_t *msg, char *to_tag_out, size_t out_size);
 
 #endif // SOFTPHONE_H
@@ -1,46 +1,38 @@
 // softphone_sip_parser.c - SIP Response Parser for Softphone
 #include "softphone.h"
 #include "../common.h"
+#include <strings.h>
 
 #define MODULE_NAME "SOFTPHONE_PARSER"
 
-// Extract To tag from SIP response
-int softphone_extract_to_tag(const char *response, char *to_tag_out, size_t out_size) {
+// Extract To tag from an indexed SIP response
+int softphone_extract_to_tag(const sip_msg_t *msg, char *to_tag_out, size_t out_size) {
     LOG_DEBUG("[SOFTPHONE_PARSER] Extracting To tag from response");
 
-    if (!response || !to_tag_out || out_size == 0) {
+    if (!msg || !to_tag_out || out_size == 0) {
         LOG_ERROR("[SOFTPHONE_PARSER] Invalid parameters to softphone_extract_to_tag");
         return -1;
     }
 
-    LOG_DEBUG("[SOFTPHONE_PARSER] Searching for To header in response");
-
-    // Find To header (case variations: "To:", "t:")
-    const char *to_line = strstr(response, "\nTo:");
-    if (!to_line) {
-        LOG_DEBUG("[SOFTPHONE_PARSER] No '\\nTo:' found, trying '\\nt:'");
-        to_line = strstr(response, "\nt:");
-    }
-    if (!to_line) {
-        // Try at beginning of response
-        if (strncmp(response, "To:", 3) == 0) {
-            LOG_DEBUG("[SOFTPHONE_PARSER] Found 'To:' at start of response");
-            to_line = response - 1; // Compensate for \n search
-        } else if (strncmp(response, "t:", 2) == 0) {
-            LOG_DEBUG("[SOFTPHONE_PARSER] Found 't:' at start of response");
-            to_line = response - 1;
-        }
-    }
-
-    if (!to_line) {
+    // To header (long or compact form) comes straight from the header index
+    const sip_hdr_t *to_hdr = sip_msg_header(msg, SIP_HDR_TO);
+    if (!to_hdr) {
         LOG_ERROR("[SOFTPHONE_PARSER] No To header found in response");
         return -1;
     }
 
     LOG_DEBUG("[SOFTPHONE_PARSER] To header found, searching for tag parameter");
 
-    // Find tag parameter
-    const char *tag_start = strstr(to_line, "tag=");
+    // Find tag parameter, bounded to the To value
+    const char *value = msg->buf + to_hdr->value_off;
+    const char *value_end = value + to_hdr->value_len;
+    const char *tag_start = NULL;
+    for (const char *p = value; p + 4 <= value_end; p++) {
+        if (strncasecmp(p, "tag=", 4) == 0) {
+            tag_start = p;
+            break;
+        }
+    }
     if (!tag_start) {
         LOG_DEBUG("[SOFTPHONE_PARSER] No tag in To header (initial INVITE response)");
         to_tag_out[0] = '\0';
@@ -50,10 +42,10 @@ int softphone_extract_to_tag(const char *response, char *to_tag_out, size_t out_
     tag_start += 4;  // Skip "tag="
     LOG_DEBUG("[SOFTPHONE_PARSER] Tag parameter found, extracting value");
 
-    // Find end of tag (delimiter: semicolon, CRLF, space, or end of string)
-    const char *tag_end = strpbrk(tag_start, ";\r\n ");
-    if (!tag_end) {
-        tag_end = tag_start + strlen(tag_start);
+    // Find end of tag (delimiter: semicolon, space, or end of header value)
+    const char *tag_end = tag_start;
+    while (tag_end < value_end && *tag_end != ';' && *tag_end != ' ' && *tag_end != '\t') {
+        tag_end++;
     }
 
     size_t tag_len = tag_end - tag_start;
@@ -62,7 +54,7 @@ int softphone_extract_to_tag(const char *response, char *to_tag_out, size_t out_
         tag_len = out_size - 1;
     }
 
-    strncpy(to_tag_out, tag_start, tag_len);
+    memcpy(to_tag_out, tag_start, tag_len);
     to_tag_out[tag_len] = '\0';
 
     LOG_DEBUG("[SOFTPHONE_PARSER] ✓ Extracted To tag: '%s' (%zu bytes)", to_tag_out, tag_len);
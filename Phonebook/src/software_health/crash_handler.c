@@ -7,6 +7,7 @@
 #include "software_health.h"
 #include "../common.h"
 #include "../log_manager/log_manager.h"
+#include "../call-sessions/call_sessions.h"
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
@@ -172,14 +173,7 @@ void health_crash_signal_handler(int sig) {
     g_crash_context.cpu_at_crash_pct = g_cpu_metrics.current_cpu_pct;
 
     // Get active calls count
-    extern CallSession call_sessions[MAX_CALL_SESSIONS];
-    int active_calls = 0;
-    for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-        if (call_sessions[i].in_use) {
-            active_calls++;
-        }
-    }
-    g_crash_context.active_calls = active_calls;
+    g_crash_context.active_calls = get_active_call_count();
 
     // Get crash count from process health
     extern process_health_t g_process_health;
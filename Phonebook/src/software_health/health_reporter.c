@@ -7,6 +7,14 @@
 #include "software_health.h"
 #include "../common.h"
 #include "../log_manager/log_manager.h"
+#include "../dns_resolver/dns_cache.h"
+#include "../sip_core/sip_transport.h"
+#include "../sip_workers/sip_workers.h"
+#include "../sip_core/sip_transaction.h"
+#include "../sip_core/sip_tcp.h"
+#include "../sip_core/sip_overload.h"
+#include "../sip_core/sip_ratelimit.h"
+#include "../call-sessions/call_sessions.h"
 #include <unistd.h>
 #include <math.h>
 
@@ -184,7 +192,6 @@ void* health_reporter_thread(void *arg) {
         extern service_metrics_t g_service_metrics;
         extern int num_registered_users;
         extern int num_directory_entries;
-        extern CallSession call_sessions[MAX_CALL_SESSIONS];
         extern pthread_mutex_t g_health_mutex;
 
         pthread_mutex_lock(&g_health_mutex);
@@ -192,14 +199,58 @@ void* health_reporter_thread(void *arg) {
         g_service_metrics.registered_users_count = num_registered_users;
         g_service_metrics.directory_entries_count = num_directory_entries;
 
-        // Count active calls
-        int active_calls = 0;
-        for (int i = 0; i < MAX_CALL_SESSIONS; i++) {
-            if (call_sessions[i].in_use) {
-                active_calls++;
-            }
-        }
-        g_service_metrics.active_calls_count = active_calls;
+        g_service_metrics.active_calls_count = get_active_call_count();
+
+        dns_cache_stats_t dns_stats;
+        dns_cache_get_stats(&dns_stats);
+        g_service_metrics.dns_cache_hits = dns_stats.hits;
+        g_service_metrics.dns_cache_negative_hits = dns_stats.negative_hits;
+        g_service_metrics.dns_cache_misses = dns_stats.misses;
+        g_service_metrics.dns_cache_evictions = dns_stats.evictions;
+        g_service_metrics.dns_cache_entries = dns_stats.entries;
+
+        sip_transport_stats_t io_stats;
+        sip_transport_get_stats(&io_stats);
+        g_service_metrics.sip_rx_batches = io_stats.rx_batches;
+        g_service_metrics.sip_rx_datagrams = io_stats.rx_datagrams;
+        g_service_metrics.sip_rx_max_batch = io_stats.rx_max_batch;
+        g_service_metrics.sip_tx_batches = io_stats.tx_batches;
+        g_service_metrics.sip_tx_datagrams = io_stats.tx_datagrams;
+        g_service_metrics.sip_tx_max_batch = io_stats.tx_max_batch;
+        g_service_metrics.sip_tx_errors = io_stats.tx_errors;
+        g_service_metrics.sip_rx_oversize = io_stats.rx_oversize;
+
+        sip_workers_stats_t worker_stats;
+        sip_workers_get_stats(&worker_stats);
+        g_service_metrics.sip_workers = worker_stats.workers;
+        g_service_metrics.sip_dispatched = worker_stats.dispatched;
+        g_service_metrics.sip_dispatch_drops = worker_stats.dropped;
+
+        sip_txn_stats_t txn_stats;
+        sip_txn_get_stats(&txn_stats);
+        g_service_metrics.sip_txn_created = txn_stats.created;
+        g_service_metrics.sip_txn_absorbed = txn_stats.absorbed;
+
+        sip_tcp_stats_t tcp_stats;
+        sip_tcp_get_stats(&tcp_stats);
+        g_service_metrics.sip_tcp_connections = tcp_stats.connections;
+        g_service_metrics.sip_tcp_messages = tcp_stats.rx_messages;
+        g_service_metrics.sip_tcp_rejected = tcp_stats.rx_rejected;
+
+        sip_overload_stats_t overload_stats;
+        sip_overload_get_stats(&overload_stats);
+        g_service_metrics.sip_overloaded = overload_stats.active;
+        g_service_metrics.sip_overload_episodes = overload_stats.episodes;
+        g_service_metrics.sip_shed_register = overload_stats.shed_register;
+        g_service_metrics.sip_shed_options = overload_stats.shed_options;
+        g_service_metrics.sip_queue_depth = overload_stats.backlog;
+        g_service_metrics.sip_max_queue_depth = overload_stats.max_backlog;
+        g_service_metrics.sip_latency_us = overload_stats.latency_us;
+
+        sip_ratelimit_stats_t rate_stats;
+        sip_ratelimit_get_stats(&rate_stats);
+        g_service_metrics.sip_rate_limited = rate_stats.limited_keepalive + rate_stats.limited_other;
+        g_service_metrics.sip_rate_limit_sources = rate_stats.sources;
 
         pthread_mutex_unlock(&g_health_mutex);
 
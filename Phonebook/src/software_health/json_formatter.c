@@ -164,6 +164,78 @@ int health_format_agent_health_json(char *buffer, size_t buffer_size,
                       g_service_metrics.active_calls_count);
     offset += snprintf(buffer + offset, buffer_size - offset, "  },\n");
 
+    // Shared DNS cache counters
+    offset += snprintf(buffer + offset, buffer_size - offset, "  \"dns_cache\": {\n");
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"hits\": %llu,\n",
+                      g_service_metrics.dns_cache_hits);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"negative_hits\": %llu,\n",
+                      g_service_metrics.dns_cache_negative_hits);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"misses\": %llu,\n",
+                      g_service_metrics.dns_cache_misses);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"evictions\": %llu,\n",
+                      g_service_metrics.dns_cache_evictions);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"entries\": %d\n",
+                      g_service_metrics.dns_cache_entries);
+    offset += snprintf(buffer + offset, buffer_size - offset, "  },\n");
+
+    // SIP socket batching counters (datagrams / batches = average batch size)
+    offset += snprintf(buffer + offset, buffer_size - offset, "  \"sip_io\": {\n");
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rx_batches\": %llu,\n",
+                      g_service_metrics.sip_rx_batches);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rx_datagrams\": %llu,\n",
+                      g_service_metrics.sip_rx_datagrams);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rx_max_batch\": %d,\n",
+                      g_service_metrics.sip_rx_max_batch);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tx_batches\": %llu,\n",
+                      g_service_metrics.sip_tx_batches);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tx_datagrams\": %llu,\n",
+                      g_service_metrics.sip_tx_datagrams);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tx_max_batch\": %d,\n",
+                      g_service_metrics.sip_tx_max_batch);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tx_errors\": %llu,\n",
+                      g_service_metrics.sip_tx_errors);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"workers\": %d,\n",
+                      g_service_metrics.sip_workers);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"dispatched\": %llu,\n",
+                      g_service_metrics.sip_dispatched);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"dispatch_drops\": %llu,\n",
+                      g_service_metrics.sip_dispatch_drops);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"txn_created\": %llu,\n",
+                      g_service_metrics.sip_txn_created);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"txn_absorbed\": %llu,\n",
+                      g_service_metrics.sip_txn_absorbed);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rx_oversize\": %llu,\n",
+                      g_service_metrics.sip_rx_oversize);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tcp_connections\": %d,\n",
+                      g_service_metrics.sip_tcp_connections);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tcp_messages\": %llu,\n",
+                      g_service_metrics.sip_tcp_messages);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"tcp_rejected\": %llu\n",
+                      g_service_metrics.sip_tcp_rejected);
+    offset += snprintf(buffer + offset, buffer_size - offset, "  },\n");
+
+    // Overload control: backlog, latency and what was shed with 503
+    offset += snprintf(buffer + offset, buffer_size - offset, "  \"sip_overload\": {\n");
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"active\": %s,\n",
+                      g_service_metrics.sip_overloaded ? "true" : "false");
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"episodes\": %llu,\n",
+                      g_service_metrics.sip_overload_episodes);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"queue_depth\": %d,\n",
+                      g_service_metrics.sip_queue_depth);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"max_queue_depth\": %d,\n",
+                      g_service_metrics.sip_max_queue_depth);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"latency_us\": %u,\n",
+                      g_service_metrics.sip_latency_us);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"shed_register\": %llu,\n",
+                      g_service_metrics.sip_shed_register);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"shed_options\": %llu,\n",
+                      g_service_metrics.sip_shed_options);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rate_limited\": %llu,\n",
+                      g_service_metrics.sip_rate_limited);
+    offset += snprintf(buffer + offset, buffer_size - offset, "    \"rate_limit_sources\": %d\n",
+                      g_service_metrics.sip_rate_limit_sources);
+    offset += snprintf(buffer + offset, buffer_size - offset, "  },\n");
+
     // Phonebook status - use heap allocation (stack-safe)
     char *csv_hash_escaped = malloc(64);
     if (!csv_hash_escaped) {
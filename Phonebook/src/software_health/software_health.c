@@ -255,7 +255,7 @@ int health_write_status_file(health_report_reason_t reason) {
         return -1;
     }
 
-    char *json_buffer = malloc(2048);
+    char *json_buffer = malloc(HEALTH_JSON_BUFFER_SIZE);
     if (!json_buffer) {
         LOG_ERROR("Failed to allocate memory for JSON buffer");
         return -1;
@@ -263,7 +263,7 @@ int health_write_status_file(health_report_reason_t reason) {
 
 
 
-    int result = health_format_agent_health_json(json_buffer, 2048, reason);
+    int result = health_format_agent_health_json(json_buffer, HEALTH_JSON_BUFFER_SIZE, reason);
 
 
     if (result != 0) {
@@ -307,13 +307,13 @@ int health_send_to_collector(health_report_reason_t reason) {
         return 0; // Not an error, just disabled
     }
 
-    char *json_buffer = malloc(2048);
+    char *json_buffer = malloc(HEALTH_JSON_BUFFER_SIZE);
     if (!json_buffer) {
         LOG_ERROR("Failed to allocate memory for JSON buffer");
         return -1;
     }
 
-    int result = health_format_agent_health_json(json_buffer, 2048, reason);
+    int result = health_format_agent_health_json(json_buffer, HEALTH_JSON_BUFFER_SIZE, reason);
     if (result != 0) {
         LOG_ERROR("Failed to format health JSON for collector");
         free(json_buffer);
@@ -365,14 +365,14 @@ bool health_load_crash_state(void) {
 
 
         // Crash state found - save as JSON for dashboard
-        char *json_buffer = malloc(2048);
+        char *json_buffer = malloc(HEALTH_JSON_BUFFER_SIZE);
         if (!json_buffer) {
             LOG_ERROR("Failed to allocate memory for crash report JSON buffer");
             return false;
         }
 
 
-        health_format_crash_report_json(json_buffer, 2048, &ctx);
+        health_format_crash_report_json(json_buffer, HEALTH_JSON_BUFFER_SIZE, &ctx);
 
         FILE *fp = fopen(CRASH_REPORT_JSON_PATH, "w");
         if (fp) {
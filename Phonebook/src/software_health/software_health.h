@@ -18,6 +18,7 @@
 #define HEALTH_MAX_THREAD_NAME_LEN 32
 #define HEALTH_MAX_NODE_NAME_LEN 64
 #define HEALTH_BACKTRACE_MAX_DEPTH 10
+#define HEALTH_JSON_BUFFER_SIZE 4096     // agent_health / crash_report JSON
 
 // Health score thresholds
 #define HEALTH_SCORE_EXCELLENT 90
@@ -92,6 +93,36 @@ typedef struct {
     char phonebook_fetch_status[32]; // SUCCESS, FAILED, STALE
     char phonebook_csv_hash[33];     // Current CSV hash (hex)
     int phonebook_entries_loaded;    // Entries in memory
+    unsigned long long dns_cache_hits;          // Shared hostname cache
+    unsigned long long dns_cache_negative_hits;
+    unsigned long long dns_cache_misses;
+    unsigned long long dns_cache_evictions;
+    int dns_cache_entries;
+    unsigned long long sip_rx_batches;          // recvmmsg/sendmmsg batching on the SIP socket
+    unsigned long long sip_rx_datagrams;
+    int sip_rx_max_batch;
+    unsigned long long sip_tx_batches;
+    unsigned long long sip_tx_datagrams;
+    int sip_tx_max_batch;
+    unsigned long long sip_tx_errors;
+    int sip_workers;                            // SIP worker threads (0 = main loop)
+    unsigned long long sip_dispatched;          // Datagrams handed to workers
+    unsigned long long sip_dispatch_drops;      // Dropped on a full worker queue
+    unsigned long long sip_txn_created;         // Server transactions tracked
+    unsigned long long sip_txn_absorbed;        // Retransmitted requests answered from the table
+    unsigned long long sip_rx_oversize;         // UDP datagrams over SIP_MAX_MESSAGE_SIZE
+    int sip_tcp_connections;                    // SIP over TCP connections open or connecting
+    unsigned long long sip_tcp_messages;        // SIP messages received over TCP
+    unsigned long long sip_tcp_rejected;        // TCP connections closed on an unframeable message
+    bool sip_overloaded;                        // Shedding REGISTER/OPTIONS right now
+    unsigned long long sip_overload_episodes;   // Times overload was entered
+    unsigned long long sip_shed_register;       // REGISTERs answered with 503
+    unsigned long long sip_shed_options;        // OPTIONS answered with 503
+    int sip_queue_depth;                        // SIP messages backed up at the last wakeup
+    int sip_max_queue_depth;
+    unsigned sip_latency_us;                    // Average processing time per SIP message
+    unsigned long long sip_rate_limited;        // Datagrams over a source's token bucket
+    int sip_rate_limit_sources;                 // Source IPs tracked by the rate limiter
 } service_metrics_t;
 
 /**
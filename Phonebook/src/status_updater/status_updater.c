@@ -7,6 +7,7 @@
 #include "../file_utils/file_utils.h" // For trim_whitespace
 #include "../passive_safety/passive_safety.h" // For heartbeat tracking
 #include "../software_health/software_health.h" // For health monitoring
+#include "../dns_resolver/dns_cache.h" // For shared hostname cache
 
 
 typedef struct {
@@ -122,15 +123,7 @@ void *status_updater_thread(void *arg) {
                 char hostname[MAX_USER_ID_LEN + sizeof(AREDN_MESH_DOMAIN) + 1];
                 snprintf(hostname, sizeof(hostname), "%s.%s", current_entry.telephone, AREDN_MESH_DOMAIN);
 
-                bool is_active = false;
-                struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM}, *res;
-
-                int gai_status = getaddrinfo(hostname, NULL, &hints, &res);
-
-                if (gai_status == 0) {
-                    is_active = true;
-                    freeaddrinfo(res);
-                }
+                bool is_active = (dns_cache_resolve(hostname, NULL) == 0);
 
                 strip_leading_asterisks(current_entry.name);
 
@@ -0,0 +1,165 @@
+// timer_wheel/timer_wheel.c - Hierarchical timer wheel with O(1) schedule and cancel
+#include "timer_wheel.h"
+
+#define MODULE_NAME "TIMER_WHEEL"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static unsigned slot_index(uint32_t tick, int level) {
+    return (tick >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+}
+
+static void unlink_node(timer_wheel_t *w, int id) {
+    timer_wheel_node_t *n = &w->nodes[id];
+    if (n->prev >= 0) {
+        w->nodes[n->prev].next = n->next;
+    } else {
+        w->heads[n->level][n->slot] = n->next;
+        if (n->next < 0) {
+            w->occupied[n->level] &= ~(1ULL << n->slot);
+        }
+    }
+    if (n->next >= 0) {
+        w->nodes[n->next].prev = n->prev;
+    }
+    n->armed = false;
+    w->armed_count--;
+}
+
+// Place an armed node by its distance from w->now. A node in level L sits in
+// the slot of its expiry at that level, so it is cascaded at the first tick
+// whose lower bits are zero and whose level-L index matches, never late.
+static void link_node(timer_wheel_t *w, int id) {
+    timer_wheel_node_t *n = &w->nodes[id];
+    uint32_t delta = n->expires - w->now;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (1u << ((level + 1) * TIMER_WHEEL_SLOT_BITS))) {
+        level++;
+    }
+    unsigned slot = slot_index(n->expires, level);
+
+    n->level = (uint8_t)level;
+    n->slot = (uint8_t)slot;
+    n->prev = -1;
+    n->next = w->heads[level][slot];
+    if (n->next >= 0) {
+        w->nodes[n->next].prev = id;
+    }
+    w->heads[level][slot] = id;
+    w->occupied[level] |= 1ULL << slot;
+    n->armed = true;
+    w->armed_count++;
+}
+
+void timer_wheel_init(timer_wheel_t *w, timer_wheel_node_t *nodes, int num_nodes, uint32_t now) {
+    memset(w, 0, sizeof(*w));
+    w->nodes = nodes;
+    w->num_nodes = num_nodes;
+    w->now = now;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        for (int s = 0; s < TIMER_WHEEL_SLOTS; s++) {
+            w->heads[l][s] = -1;
+        }
+    }
+    memset(nodes, 0, sizeof(*nodes) * (size_t)num_nodes);
+}
+
+void timer_wheel_schedule(timer_wheel_t *w, int id, uint32_t expires, uint32_t now) {
+    if (id < 0 || id >= w->num_nodes) {
+        return;
+    }
+    if (w->nodes[id].armed) {
+        unlink_node(w, id);
+    }
+    if (w->armed_count == 0 && (int32_t)(now - w->now) > 0) {
+        w->now = now; // Idle since the last advance; nothing to fire on the way
+    }
+    int32_t delta = (int32_t)(expires - w->now);
+    if (delta < 1) {
+        expires = w->now + 1;
+    } else if ((uint32_t)delta > TIMER_WHEEL_MAX_DELAY) {
+        expires = w->now + TIMER_WHEEL_MAX_DELAY;
+    }
+    w->nodes[id].expires = expires;
+    link_node(w, id);
+}
+
+void timer_wheel_cancel(timer_wheel_t *w, int id) {
+    if (id >= 0 && id < w->num_nodes && w->nodes[id].armed) {
+        unlink_node(w, id);
+    }
+}
+
+bool timer_wheel_is_armed(const timer_wheel_t *w, int id) {
+    return id >= 0 && id < w->num_nodes && w->nodes[id].armed;
+}
+
+uint32_t timer_wheel_expires(const timer_wheel_t *w, int id) {
+    return w->nodes[id].expires;
+}
+
+// Re-place every node of an upper-level slot relative to the new w->now
+static void cascade(timer_wheel_t *w, int level, unsigned slot) {
+    int32_t id = w->heads[level][slot];
+    w->heads[level][slot] = -1;
+    w->occupied[level] &= ~(1ULL << slot);
+    while (id >= 0) {
+        int32_t next = w->nodes[id].next;
+        w->armed_count--;
+        link_node(w, id);
+        id = next;
+    }
+}
+
+void timer_wheel_advance(timer_wheel_t *w, uint32_t now, timer_wheel_expire_cb_t cb, void *arg) {
+    if (w->armed_count == 0) {
+        w->now = now; // Nothing to fire or cascade on the way
+        return;
+    }
+
+    while ((int32_t)(now - w->now) > 0) {
+        w->now++;
+
+        // Cascade from the top so nodes can fall through more than one level
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            uint32_t lower_mask = (1u << (level * TIMER_WHEEL_SLOT_BITS)) - 1;
+            if ((w->now & lower_mask) == 0) {
+                cascade(w, level, slot_index(w->now, level));
+            }
+        }
+
+        unsigned slot = slot_index(w->now, 0);
+        int32_t id;
+        while ((id = w->heads[0][slot]) >= 0) {
+            unlink_node(w, id);
+            cb(arg, id);
+        }
+
+        if (w->armed_count == 0) {
+            w->now = now;
+            return;
+        }
+    }
+}
+
+int timer_wheel_next_ticks(const timer_wheel_t *w) {
+    if (w->armed_count == 0) {
+        return -1;
+    }
+
+    // Level-0 slots after now, in firing order: rotate so bit 0 is the next tick
+    unsigned cur = slot_index(w->now, 0);
+    uint64_t pending = w->occupied[0];
+    unsigned shift = (cur + 1) & SLOT_MASK;
+    uint64_t rotated = shift ? (pending >> shift) | (pending << (TIMER_WHEEL_SLOTS - shift)) : pending;
+    int to_wrap = TIMER_WHEEL_SLOTS - (int)cur;    // Ticks until the next cascade point
+    if (rotated) {
+        int ticks = __builtin_ctzll(rotated) + 1;
+        if (ticks < to_wrap) {
+            return ticks;
+        }
+    }
+    return to_wrap;
+}
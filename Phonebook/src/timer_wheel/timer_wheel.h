@@ -0,0 +1,56 @@
+// timer_wheel/timer_wheel.h
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// Hierarchical timer wheel (Varghese & Lauck) over a caller-owned node array.
+// Timers are identified by their node index, so the owner can key them on a
+// table slot without any allocation. Scheduling, refreshing and cancelling
+// are O(1). Three levels of 64 slots cover 64^3 ticks; a slot of an upper
+// level is cascaded down one level when the lower level wraps.
+// Not thread-safe: the owner serializes all calls.
+
+#define TIMER_WHEEL_LEVELS      3
+#define TIMER_WHEEL_SLOT_BITS   6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_MAX_DELAY   ((1u << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1) // Longer delays are clamped
+
+typedef struct {
+    int32_t next;           // Node index, -1 = end of slot list
+    int32_t prev;           // Node index, -1 = slot head
+    uint32_t expires;       // Absolute tick
+    uint8_t level;
+    uint8_t slot;
+    bool armed;
+} timer_wheel_node_t;
+
+typedef struct {
+    timer_wheel_node_t *nodes;
+    int num_nodes;
+    uint32_t now;                                           // Last tick processed
+    int armed_count;
+    int32_t heads[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];                  // Bit per non-empty slot
+} timer_wheel_t;
+
+typedef void (*timer_wheel_expire_cb_t)(void *arg, int id);
+
+void timer_wheel_init(timer_wheel_t *w, timer_wheel_node_t *nodes, int num_nodes, uint32_t now);
+
+// Arm (or re-arm) timer id to fire at tick expires; a tick already processed fires on the next one.
+// now is the current tick: a wheel with nothing armed is not being advanced, so it catches up here.
+void timer_wheel_schedule(timer_wheel_t *w, int id, uint32_t expires, uint32_t now);
+void timer_wheel_cancel(timer_wheel_t *w, int id);
+bool timer_wheel_is_armed(const timer_wheel_t *w, int id);
+uint32_t timer_wheel_expires(const timer_wheel_t *w, int id);
+
+// Process every tick up to and including now, calling cb for each timer that
+// fires. The callback may schedule or cancel any timer, including its own.
+void timer_wheel_advance(timer_wheel_t *w, uint32_t now, timer_wheel_expire_cb_t cb, void *arg);
+
+// Ticks until the wheel next has work (a timer firing or a cascade), or -1 if nothing is armed
+int timer_wheel_next_ticks(const timer_wheel_t *w);
+
+#endif // TIMER_WHEEL_H
@@ -1,24 +1,272 @@
 #include "user_manager.h" // This include remains the same, as the header will be in the same new directory
 #include "../common.h" // This now includes necessary system headers and core types
 #include "../file_utils/file_utils.h" // For trim_whitespace
+#include "../config_loader/config_loader.h" // For the registration expiry settings
+#include "../event_loop/event_loop.h"     // The main loop's timer drives expiry
+#include <stdint.h>
 
 #define MODULE_NAME "USER"
 
+#define USER_INDEX_SIZE        (2 * MAX_REGISTERED_USERS) // Power of two, load factor <= 0.5
+#define USER_READ_MAX_RETRIES  8  // Seqlock retries before a snapshot falls back to the mutex
+
+typedef struct {
+    uint32_t hash;
+    uint16_t slot;  // entries[] index + 1; 0 = empty
+} UserIndexSlot;
+
+typedef struct {
+    RegisteredUser entries[MAX_REGISTERED_USERS];
+    UserIndexSlot index[USER_INDEX_SIZE];
+    uint16_t free_slots[MAX_REGISTERED_USERS]; // Slots vacated by expired dynamic registrations
+    int num_free_slots;
+    int next_unused_slot;                      // Slots at or above this were never used
+    timer_wheel_node_t expiry_nodes[MAX_REGISTERED_USERS]; // Per slot; dynamic registrations only
+    timer_wheel_t expiry_wheel;                // Ticks are monotonic seconds
+} UserTable;
+
+// Two tables: the live one, and the one a phonebook reload builds into before
+// swapping current_users. Writers (REGISTER handling, the swap) serialize on
+// registered_users_mutex and bracket every change with users_seq going
+// odd/even. Readers never take the mutex: they copy what they need and retry
+// if the sequence moved, which also covers a reader still on the old table
+// when it is swapped out and reused for the next build.
+static UserTable user_tables[2];
+static UserTable *current_users = &user_tables[0];
+static unsigned int users_seq = 0;
+static pthread_mutex_t directory_build_mutex = PTHREAD_MUTEX_INITIALIZER; // One reload at a time
+static unsigned long long registrations_expired = 0; // Under registered_users_mutex
+static bool registrations_dirty = false;            // Under registered_users_mutex: snapshot is stale
+static uint64_t snapshot_saved_ms = 0;              // Main loop only
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;   // sizeof(RegistrationRecord) of the writer
+    uint32_t count;
+    uint32_t checksum;      // FNV-1a over the records
+    int64_t written_at;     // time(NULL)
+} RegistrationSnapshotHeader;
+
+typedef struct {
+    char user_id[MAX_PHONE_NUMBER_LEN];
+    char display_name[MAX_DISPLAY_NAME_LEN];
+    int64_t deadline;       // Wall-clock second the registration lapses, grace included
+} RegistrationRecord;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t expiry_tick_now(void) {
+    return (uint32_t)(monotonic_ms() / 1000);
+}
+
+static uint32_t hash_user_id(const char *user_id) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (const char *p = user_id; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void users_write_begin(void) {
+    __atomic_store_n(&users_seq, users_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void users_write_end(void) {
+    __atomic_store_n(&users_seq, users_seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int users_read_begin(void) {
+    unsigned int seq;
+    while ((seq = __atomic_load_n(&users_seq, __ATOMIC_ACQUIRE)) & 1) {
+        sched_yield();
+    }
+    return seq;
+}
+
+static bool users_read_retry(unsigned int seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&users_seq, __ATOMIC_RELAXED) != seq;
+}
+
+static UserTable *live_table(void) {
+    return __atomic_load_n(&current_users, __ATOMIC_ACQUIRE);
+}
+
+// Returns the entries[] index for user_id, or -1. Bounded so a reader racing
+// a writer cannot loop; the caller validates with users_read_retry().
+static int index_lookup(const UserTable *t, const char *user_id, uint32_t h) {
+    uint32_t i = h & (USER_INDEX_SIZE - 1);
+    for (int probes = 0; probes < USER_INDEX_SIZE; probes++) {
+        UserIndexSlot entry = t->index[i];
+        if (entry.slot == 0) {
+            return -1;
+        }
+        if (entry.hash == h && entry.slot <= MAX_REGISTERED_USERS &&
+            strncmp(t->entries[entry.slot - 1].user_id, user_id, MAX_PHONE_NUMBER_LEN) == 0) {
+            return entry.slot - 1;
+        }
+        i = (i + 1) & (USER_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+static void index_insert(UserTable *t, int slot) {
+    uint32_t h = hash_user_id(t->entries[slot].user_id);
+    uint32_t i = h & (USER_INDEX_SIZE - 1);
+    while (t->index[i].slot != 0) {
+        i = (i + 1) & (USER_INDEX_SIZE - 1);
+    }
+    t->index[i].hash = h;
+    t->index[i].slot = (uint16_t)(slot + 1);
+}
+
+// Linear-probing delete with backward shift, so no tombstones accumulate
+static void index_remove(UserTable *t, int slot) {
+    uint32_t i = hash_user_id(t->entries[slot].user_id) & (USER_INDEX_SIZE - 1);
+    while (t->index[i].slot != 0 && t->index[i].slot != slot + 1) {
+        i = (i + 1) & (USER_INDEX_SIZE - 1);
+    }
+    if (t->index[i].slot == 0) {
+        return;
+    }
+
+    for (uint32_t j = (i + 1) & (USER_INDEX_SIZE - 1); t->index[j].slot != 0; j = (j + 1) & (USER_INDEX_SIZE - 1)) {
+        uint32_t home = t->index[j].hash & (USER_INDEX_SIZE - 1);
+        // Move j back into the hole at i unless its home lies cyclically in (i, j]
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            t->index[i] = t->index[j];
+            i = j;
+        }
+    }
+    t->index[i].slot = 0;
+}
+
+static void reset_user_table(UserTable *t) {
+    memset(t->entries, 0, sizeof(t->entries));
+    memset(t->index, 0, sizeof(t->index));
+    t->num_free_slots = 0;
+    t->next_unused_slot = 0;
+    timer_wheel_init(&t->expiry_wheel, t->expiry_nodes, MAX_REGISTERED_USERS, expiry_tick_now());
+}
+
+// Claim an empty slot, fill in the key and index it. For the live table the
+// caller holds the mutex and is inside a write section. NULL when full.
+static RegisteredUser *allocate_user_slot(UserTable *t, const char *user_id, const char *display_name) {
+    int slot;
+    if (t->num_free_slots > 0) {
+        slot = t->free_slots[--t->num_free_slots];
+    } else if (t->next_unused_slot < MAX_REGISTERED_USERS) {
+        slot = t->next_unused_slot++;
+    } else {
+        return NULL;
+    }
+
+    RegisteredUser *u = &t->entries[slot];
+    strncpy(u->user_id, user_id, MAX_PHONE_NUMBER_LEN - 1);
+    u->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
+    strncpy(u->display_name, display_name, MAX_DISPLAY_NAME_LEN - 1);
+    u->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
+    index_insert(t, slot);
+    return u;
+}
+
+// Unindex a slot and make it available again
+static void release_user_slot(UserTable *t, RegisteredUser *user) {
+    int slot = (int)(user - t->entries);
+    timer_wheel_cancel(&t->expiry_wheel, slot);
+    index_remove(t, slot);
+    user->user_id[0] = '\0';
+    user->display_name[0] = '\0';
+    t->free_slots[t->num_free_slots++] = (uint16_t)slot;
+    registrations_dirty = true;
+}
+
+// Writer-side lookup; the caller owns t (holds the mutex, or is building it)
+static RegisteredUser *find_user_locked(UserTable *t, const char *user_id) {
+    int slot = index_lookup(t, user_id, hash_user_id(user_id));
+    return slot >= 0 ? &t->entries[slot] : NULL;
+}
+
+// (Re)arm the expiry of a dynamic registration; the caller holds the mutex
+static void schedule_registration_expiry(UserTable *t, RegisteredUser *user, int expires) {
+    uint32_t now = expiry_tick_now();
+    uint32_t deadline = now + (uint32_t)expires + REGISTRATION_GRACE_SECONDS;
+    timer_wheel_schedule(&t->expiry_wheel, (int)(user - t->entries), deadline, now);
+    registrations_dirty = true;
+}
 
 RegisteredUser* find_registered_user(const char *user_id) {
-    pthread_mutex_lock(&registered_users_mutex);
-    for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-        // Only consider active users for find_registered_user logic
-        if (registered_users[i].user_id[0] != '\0' &&
-            registered_users[i].is_active) { // Still check is_active
-            if (strcmp(registered_users[i].user_id, user_id) == 0) {
-                pthread_mutex_unlock(&registered_users_mutex);
-                return &registered_users[i];
-            }
+    uint32_t h = hash_user_id(user_id);
+    UserTable *t;
+    int slot;
+    bool active;
+    unsigned int seq;
+    do {
+        seq = users_read_begin();
+        t = live_table();
+        slot = index_lookup(t, user_id, h);
+        active = slot >= 0 && t->entries[slot].is_active;
+    } while (users_read_retry(seq));
+
+    return active ? &t->entries[slot] : NULL;
+}
+
+bool lookup_registered_user(const char *user_id, RegisteredUser *out) {
+    uint32_t h = hash_user_id(user_id);
+    int slot;
+    unsigned int seq;
+    do {
+        seq = users_read_begin();
+        UserTable *t = live_table();
+        slot = index_lookup(t, user_id, h);
+        if (slot >= 0) {
+            memcpy(out, &t->entries[slot], sizeof(*out));
+        }
+    } while (users_read_retry(seq));
+
+    if (slot < 0 || !out->is_active) {
+        return false;
+    }
+    out->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
+    out->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
+    return true;
+}
+
+static int copy_registered_users(const UserTable *t, RegisteredUser *out, int max_users) {
+    int count = 0;
+    for (int i = 0; i < MAX_REGISTERED_USERS && count < max_users; i++) {
+        if (t->entries[i].user_id[0] != '\0') {
+            memcpy(&out[count], &t->entries[i], sizeof(RegisteredUser));
+            out[count].user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
+            out[count].display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
+            count++;
+        }
+    }
+    return count;
+}
+
+int snapshot_registered_users(RegisteredUser *out, int max_users) {
+    for (int attempt = 0; attempt < USER_READ_MAX_RETRIES; attempt++) {
+        unsigned int seq = users_read_begin();
+        int count = copy_registered_users(live_table(), out, max_users);
+        if (!users_read_retry(seq)) {
+            return count;
         }
     }
+
+    // Registrations keep landing mid-copy; take the writer lock instead of spinning
+    pthread_mutex_lock(&registered_users_mutex);
+    int count = copy_registered_users(current_users, out, max_users);
     pthread_mutex_unlock(&registered_users_mutex);
-    return NULL;
+    return count;
 }
 
 // Simplified add_or_update_registered_user
@@ -30,24 +278,12 @@ RegisteredUser* add_or_update_registered_user(const char *user_id,
 
     pthread_mutex_lock(&registered_users_mutex);
 
-    RegisteredUser *user = NULL;
-    // Try to find an existing user slot
-    for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-        if (registered_users[i].user_id[0] != '\0' &&
-            strcmp(registered_users[i].user_id, user_id) == 0) {
-            user = &registered_users[i];
-            break;
-        }
-    }
+    RegisteredUser *user = find_user_locked(current_users, user_id);
 
     if (user) {
         // User found
+        users_write_begin();
         if (expires > 0) {
-            // user->user_id is already MAX_PHONE_NUMBER_LEN, assumed to be same as user_id from REGISTER
-            // strncpy(user->user_id, user_id, MAX_PHONE_NUMBER_LEN - 1); // Not needed here, user_id is the key
-            user->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0'; // Ensure null-termination if user_id was updated
-            // No longer storing contact_uri, ip_address, port, registration_time here
-            
             if (strlen(display_name) > 0 && strcmp(user->display_name, display_name) != 0) {
                 strncpy(user->display_name, display_name, MAX_DISPLAY_NAME_LEN - 1);
                 user->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
@@ -64,15 +300,17 @@ RegisteredUser* add_or_update_registered_user(const char *user_id,
             } else {
                 LOG_INFO("Refreshed dynamic registration for user '%s' (%s).", user_id, user->display_name);
             }
+            if (!user->is_known_from_directory) {
+                schedule_registration_expiry(current_users, user, expires);
+            }
         } else { // expires == 0, deactivate
             if (user->is_active) {
                 user->is_active = false;
                 if(!user->is_known_from_directory) { // Only decrement if it was a purely dynamic registration
                    num_registered_users--;
                    LOG_INFO("Deactivated dynamic registration for user '%s' (%s). Remaining active dynamic: %d.", user_id, user->display_name, num_registered_users);
-                   // Clear the slot if it was purely dynamic and now inactive
-                   user->user_id[0] = '\0';
-                   user->display_name[0] = '\0';
+                   // Free the slot if it was purely dynamic and now inactive
+                   release_user_slot(current_users, user);
                 } else {
                     LOG_INFO("Dynamic registration for directory user '%s' (%s) expired. Still known via directory.", user_id, user->display_name);
                 }
@@ -80,26 +318,27 @@ RegisteredUser* add_or_update_registered_user(const char *user_id,
                 LOG_DEBUG("Attempted to deactivate already inactive user '%s'.", user_id);
             }
         }
+        users_write_end();
         pthread_mutex_unlock(&registered_users_mutex);
         return user;
     } else {
         // User not found, attempt to add new dynamic registration
         if (expires > 0) {
             if (num_registered_users + num_directory_entries < MAX_REGISTERED_USERS) {
-                for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-                    if (registered_users[i].user_id[0] == '\0') { // Found empty slot
-                        RegisteredUser *newu = &registered_users[i];
-                        strncpy(newu->user_id, user_id, MAX_PHONE_NUMBER_LEN - 1);
-                        newu->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
-                        strncpy(newu->display_name, display_name, MAX_DISPLAY_NAME_LEN - 1);
-                        newu->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
-                        newu->is_active = true;
-                        newu->is_known_from_directory = false; // This is a new dynamic registration
-                        num_registered_users++;
-                        LOG_INFO("New dynamic registration for user '%s' (%s). Total active dynamic: %d.", user_id, display_name, num_registered_users);
-                        pthread_mutex_unlock(&registered_users_mutex);
-                        return newu;
-                    }
+                users_write_begin();
+                RegisteredUser *newu = allocate_user_slot(current_users, user_id, display_name);
+                if (newu) {
+                    newu->is_active = true;
+                    newu->is_known_from_directory = false; // This is a new dynamic registration
+                    num_registered_users++;
+                    schedule_registration_expiry(current_users, newu, expires);
+                }
+                users_write_end();
+                if (newu) {
+                    LOG_INFO("New dynamic registration for user '%s' (%s). Total active dynamic: %d.", user_id, display_name, num_registered_users);
+                    pthread_mutex_unlock(&registered_users_mutex);
+                    event_loop_wakeup(); // May now be the earliest expiry; REGISTERs can arrive on a SIP worker
+                    return newu;
                 }
             }
             LOG_WARN("Max registered users/directory slots reached, cannot register '%s'.", user_id);
@@ -113,19 +352,11 @@ RegisteredUser* add_or_update_registered_user(const char *user_id,
     }
 }
 
-RegisteredUser* add_csv_user_to_registered_users_table(const char *user_id_numeric,
-                                   const char *display_name) {
-    LOG_DEBUG("add_csv_user_to_registered_users_table() called with user_id='%s', display_name='%s'", user_id_numeric, display_name);
-    pthread_mutex_lock(&registered_users_mutex);
-
-    RegisteredUser *existing = NULL;
-    for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-        if (registered_users[i].user_id[0] != '\0' &&
-            strcmp(registered_users[i].user_id, user_id_numeric) == 0) {
-            existing = &registered_users[i];
-            break;
-        }
-    }
+// Add or refresh a directory entry in t. The caller owns t: it is either the
+// off-side table being built, or the live table under the mutex.
+static RegisteredUser *table_add_directory_user(UserTable *t, const char *user_id_numeric,
+                                                const char *display_name, int *num_directory) {
+    RegisteredUser *existing = find_user_locked(t, user_id_numeric);
 
     if (existing) {
         // User found (could be existing directory entry or a dynamic reg for this ID)
@@ -136,153 +367,413 @@ RegisteredUser* add_csv_user_to_registered_users_table(const char *user_id_numer
         } else {
             LOG_DEBUG("CSV/directory user '%s' already exists with same display name.", user_id_numeric);
         }
+        if (!existing->is_known_from_directory) {
+            (*num_directory)++;
+            timer_wheel_cancel(&t->expiry_wheel, (int)(existing - t->entries)); // Directory entries do not expire
+        }
         existing->is_known_from_directory = true; // Confirm it's from directory
         // Keep active, regardless of previous dynamic state (since it's in the directory)
-        if (!existing->is_active) {
-            existing->is_active = true; // Mark active if it was inactive
-            // num_registered_users not incremented as this is not a new dynamic registration
-            // num_directory_entries is incremented only when new slot is used
-            LOG_INFO("CSV/directory user '%s' (%s) marked active from phonebook.", user_id_numeric, display_name);
-        }
-
-        pthread_mutex_unlock(&registered_users_mutex);
+        existing->is_active = true;
         return existing;
     }
 
     // User not found, add as new directory entry
-    if (num_registered_users + num_directory_entries < MAX_REGISTERED_USERS) {
-        for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-            if (registered_users[i].user_id[0] == '\0') { // Found empty slot
-                RegisteredUser *u = &registered_users[i];
-                // user_id_numeric is now sanitized by populate_registered_users_from_csv before this call
-                strncpy(u->user_id, user_id_numeric, MAX_PHONE_NUMBER_LEN - 1);
-                u->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
-                strncpy(u->display_name, display_name, MAX_DISPLAY_NAME_LEN - 1);
-                u->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
-
-                u->is_active = true; // Directory users are considered active by default
-                u->is_known_from_directory = true;
-                num_directory_entries++;
-                LOG_DEBUG("Added new CSV/directory user '%s' (%s). Total directory entries now: %d", user_id_numeric, display_name, num_directory_entries);
-                pthread_mutex_unlock(&registered_users_mutex);
-                return u;
-            }
+    // user_id_numeric is sanitized by directory_build_add_csv_row before this call
+    RegisteredUser *u = allocate_user_slot(t, user_id_numeric, display_name);
+    if (!u) {
+        LOG_WARN("Failed to add CSV/directory user '%s' (%s): Max directory/registered users reached (%d).", user_id_numeric, display_name, MAX_REGISTERED_USERS);
+        return NULL;
+    }
+    u->is_active = true; // Directory users are considered active by default
+    u->is_known_from_directory = true;
+    (*num_directory)++;
+    LOG_DEBUG("Added new CSV/directory user '%s' (%s). Total directory entries now: %d", user_id_numeric, display_name, *num_directory);
+    return u;
+}
+
+RegisteredUser* add_csv_user_to_registered_users_table(const char *user_id_numeric,
+                                   const char *display_name) {
+    LOG_DEBUG("add_csv_user_to_registered_users_table() called with user_id='%s', display_name='%s'", user_id_numeric, display_name);
+    pthread_mutex_lock(&registered_users_mutex);
+
+    RegisteredUser *existing = find_user_locked(current_users, user_id_numeric);
+    if (existing && !existing->is_known_from_directory) {
+        num_registered_users--; // Dynamic registration becomes a directory entry
+    }
+
+    users_write_begin();
+    RegisteredUser *u = table_add_directory_user(current_users, user_id_numeric, display_name, &num_directory_entries);
+    users_write_end();
+
+    pthread_mutex_unlock(&registered_users_mutex);
+    return u;
+}
+
+// Carry live dynamic registrations over into a freshly built directory table.
+// Caller holds registered_users_mutex. Returns how many remain dynamic (not in
+// the new directory).
+static int merge_dynamic_registrations(UserTable *next, const UserTable *live) {
+    int num_dynamic = 0;
+    uint32_t now = expiry_tick_now();
+    for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
+        const RegisteredUser *reg = &live->entries[i];
+        if (reg->user_id[0] == '\0' || reg->is_known_from_directory || !reg->is_active) {
+            continue;
+        }
+        if (find_user_locked(next, reg->user_id)) {
+            continue; // Now listed in the directory; the directory entry covers it
+        }
+        RegisteredUser *u = allocate_user_slot(next, reg->user_id, reg->display_name);
+        if (!u) {
+            LOG_WARN("Directory full, dropping dynamic registration for '%s' on reload.", reg->user_id);
+            continue;
         }
+        u->is_active = true;
+        u->is_known_from_directory = false;
+        if (timer_wheel_is_armed(&live->expiry_wheel, i)) {
+            timer_wheel_schedule(&next->expiry_wheel, (int)(u - next->entries),
+                                 timer_wheel_expires(&live->expiry_wheel, i), now);
+        }
+        num_dynamic++;
+    }
+    return num_dynamic;
+}
+
+static void expire_registration(void *arg, int slot) {
+    UserTable *t = (UserTable *)arg;
+    RegisteredUser *user = &t->entries[slot];
+    if (user->user_id[0] == '\0' || user->is_known_from_directory || !user->is_active) {
+        return;
+    }
+    LOG_INFO("Dynamic registration for user '%s' (%s) expired without a refresh.", user->user_id, user->display_name);
+    users_write_begin();
+    user->is_active = false;
+    num_registered_users--;
+    release_user_slot(t, user);
+    users_write_end();
+    registrations_expired++;
+}
+
+int registration_expiry_next_timeout_ms(void) {
+    pthread_mutex_lock(&registered_users_mutex);
+    const timer_wheel_t *w = &current_users->expiry_wheel;
+    int ticks = timer_wheel_next_ticks(w);
+    uint64_t due_ms = (uint64_t)(w->now + (uint32_t)(ticks > 0 ? ticks : 0)) * 1000;
+    pthread_mutex_unlock(&registered_users_mutex);
+
+    if (ticks < 0) {
+        return -1;
     }
-    LOG_WARN("Failed to add CSV/directory user '%s' (%s): Max directory/registered users reached (%d).", user_id_numeric, display_name, MAX_REGISTERED_USERS);
+    uint64_t now = monotonic_ms();
+    return due_ms > now ? (int)(due_ms - now) : 0;
+}
+
+void registration_expiry_process(void) {
+    pthread_mutex_lock(&registered_users_mutex);
+    timer_wheel_advance(&current_users->expiry_wheel, expiry_tick_now(), expire_registration, current_users);
     pthread_mutex_unlock(&registered_users_mutex);
-    return NULL;
 }
 
+int registration_grant_expires(int requested) {
+    if (requested == 0) {
+        return 0;
+    }
+    int granted = (requested < 0 || requested > g_registration_max_expires) ? g_registration_max_expires : requested;
+    if (g_registration_expires_jitter_pct > 0) {
+        // Shorten by up to the jitter share so phones that booted together drift apart
+        int spread = granted * g_registration_expires_jitter_pct / 100;
+        granted -= (int)(random() % (spread + 1));
+    }
+    return granted > 0 ? granted : 1;
+}
 
-void init_registered_users_table() {
+unsigned long long registration_expired_count(void) {
+    pthread_mutex_lock(&registered_users_mutex);
+    unsigned long long count = registrations_expired;
+    pthread_mutex_unlock(&registered_users_mutex);
+    return count;
+}
+
+static uint32_t checksum_records(const RegistrationRecord *records, uint32_t count) {
+    uint32_t h = 2166136261u; // FNV-1a
+    const uint8_t *p = (const uint8_t *)records;
+    for (size_t i = 0; i < (size_t)count * sizeof(RegistrationRecord); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int registration_snapshot_save(void) {
+    RegistrationRecord *records = calloc(MAX_REGISTERED_USERS, sizeof(RegistrationRecord));
+    if (!records) {
+        LOG_ERROR("Out of memory writing the registration snapshot.");
+        return -1;
+    }
+
+    // Deadlines go to disk as wall-clock time: the monotonic clock is per boot
+    time_t now_wall = time(NULL);
+    uint32_t count = 0;
     pthread_mutex_lock(&registered_users_mutex);
+    const UserTable *t = current_users;
+    uint32_t now_tick = expiry_tick_now();
     for (int i = 0; i < MAX_REGISTERED_USERS; i++) {
-        registered_users[i].is_active = false;
-        registered_users[i].is_known_from_directory = false;
-        registered_users[i].user_id[0] = '\0';
-        registered_users[i].display_name[0] = '\0';
-        // No need to clear removed fields
+        const RegisteredUser *u = &t->entries[i];
+        if (u->user_id[0] == '\0' || u->is_known_from_directory || !u->is_active ||
+            !timer_wheel_is_armed(&t->expiry_wheel, i)) {
+            continue;
+        }
+        RegistrationRecord *r = &records[count++];
+        strncpy(r->user_id, u->user_id, MAX_PHONE_NUMBER_LEN - 1);
+        strncpy(r->display_name, u->display_name, MAX_DISPLAY_NAME_LEN - 1);
+        r->deadline = (int64_t)now_wall + (int32_t)(timer_wheel_expires(&t->expiry_wheel, i) - now_tick);
+    }
+    registrations_dirty = false;
+    pthread_mutex_unlock(&registered_users_mutex);
+
+    RegistrationSnapshotHeader header = {
+        .magic = REGISTRATION_SNAPSHOT_MAGIC,
+        .version = REGISTRATION_SNAPSHOT_VERSION,
+        .record_size = sizeof(RegistrationRecord),
+        .count = count,
+        .checksum = checksum_records(records, count),
+        .written_at = (int64_t)now_wall,
+    };
+
+    // Write aside and rename, so a reader never sees a half-written snapshot
+    char tmp_path[sizeof(REGISTRATION_SNAPSHOT_PATH) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", REGISTRATION_SNAPSHOT_PATH);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        LOG_WARN("Cannot write registration snapshot '%s': %s", tmp_path, strerror(errno));
+        free(records);
+        return -1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              (count == 0 || fwrite(records, sizeof(RegistrationRecord), count, fp) == count);
+    ok = (fclose(fp) == 0) && ok;
+    free(records);
+    if (!ok || rename(tmp_path, REGISTRATION_SNAPSHOT_PATH) != 0) {
+        LOG_WARN("Failed to write registration snapshot '%s': %s", REGISTRATION_SNAPSHOT_PATH, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    snapshot_saved_ms = monotonic_ms();
+    LOG_DEBUG("Registration snapshot written: %u dynamic registrations.", count);
+    return 0;
+}
+
+int registration_snapshot_load(void) {
+    FILE *fp = fopen(REGISTRATION_SNAPSHOT_PATH, "rb");
+    if (!fp) {
+        return 0; // First start, or after a reboot
+    }
+
+    RegistrationSnapshotHeader header;
+    RegistrationRecord *records = NULL;
+    const char *problem = NULL;
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        problem = "truncated header";
+    } else if (header.magic != REGISTRATION_SNAPSHOT_MAGIC || header.version != REGISTRATION_SNAPSHOT_VERSION ||
+               header.record_size != sizeof(RegistrationRecord)) {
+        problem = "unknown format or version";
+    } else if (header.count > MAX_REGISTERED_USERS) {
+        problem = "too many records";
+    } else if (!(records = calloc(header.count ? header.count : 1, sizeof(RegistrationRecord)))) {
+        problem = "out of memory";
+    } else if (fread(records, sizeof(RegistrationRecord), header.count, fp) != header.count ||
+               fgetc(fp) != EOF) {
+        problem = "wrong length";
+    } else if (checksum_records(records, header.count) != header.checksum) {
+        problem = "checksum mismatch";
+    }
+    fclose(fp);
+    if (problem) {
+        LOG_WARN("Ignoring registration snapshot '%s': %s.", REGISTRATION_SNAPSHOT_PATH, problem);
+        free(records);
+        unlink(REGISTRATION_SNAPSHOT_PATH);
+        return 0;
+    }
+
+    time_t now_wall = time(NULL);
+    int restored = 0;
+    pthread_mutex_lock(&registered_users_mutex);
+    users_write_begin();
+    uint32_t now_tick = expiry_tick_now();
+    for (uint32_t i = 0; i < header.count; i++) {
+        RegistrationRecord *r = &records[i];
+        r->user_id[MAX_PHONE_NUMBER_LEN - 1] = '\0';
+        r->display_name[MAX_DISPLAY_NAME_LEN - 1] = '\0';
+        int64_t remaining = r->deadline - (int64_t)now_wall;
+        if (remaining <= 0 || r->user_id[0] == '\0' || find_user_locked(current_users, r->user_id)) {
+            continue; // Lapsed while we were down
+        }
+        // Bound what a clock step between save and load can do
+        if (remaining > (int64_t)g_registration_max_expires + REGISTRATION_GRACE_SECONDS) {
+            remaining = (int64_t)g_registration_max_expires + REGISTRATION_GRACE_SECONDS;
+        }
+        RegisteredUser *u = allocate_user_slot(current_users, r->user_id, r->display_name);
+        if (!u) {
+            break;
+        }
+        u->is_active = true;
+        u->is_known_from_directory = false;
+        timer_wheel_schedule(&current_users->expiry_wheel, (int)(u - current_users->entries),
+                             now_tick + (uint32_t)remaining, now_tick);
+        num_registered_users++;
+        restored++;
+    }
+    users_write_end();
+    pthread_mutex_unlock(&registered_users_mutex);
+    free(records);
+
+    LOG_INFO("Restored %d of %u dynamic registrations from the snapshot written %llds ago.",
+             restored, header.count, (long long)(now_wall - header.written_at));
+    return restored;
+}
+
+int registration_snapshot_next_timeout_ms(void) {
+    if (g_registration_snapshot_seconds == 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&registered_users_mutex);
+    bool dirty = registrations_dirty;
+    pthread_mutex_unlock(&registered_users_mutex);
+    if (!dirty) {
+        return -1;
+    }
+    uint64_t due = snapshot_saved_ms + (uint64_t)g_registration_snapshot_seconds * 1000;
+    uint64_t now = monotonic_ms();
+    return due > now ? (int)(due - now) : 0;
+}
+
+void registration_snapshot_process(void) {
+    if (registration_snapshot_next_timeout_ms() == 0) {
+        registration_snapshot_save();
     }
+}
+
+void init_registered_users_table() {
+    pthread_mutex_lock(&registered_users_mutex);
+    users_write_begin();
+    reset_user_table(current_users);
     num_registered_users = 0; // Reset dynamic count
     num_directory_entries = 0; // Reset directory count
+    users_write_end();
     LOG_DEBUG("Initialized user tables (cleared all entries).");
     pthread_mutex_unlock(&registered_users_mutex);
 }
 
-void populate_registered_users_from_csv(const char *filepath) {
-    LOG_DEBUG("populate_registered_users_from_csv() ENTERED with filepath='%s'", filepath);
-    FILE *fp = fopen(filepath, "r");
-    if (!fp) {
-        LOG_ERROR("Failed to open CSV phonebook file '%s' for populating registered users. errno=%d (%s)",
-                    filepath, errno, strerror(errno));
-        return;
-    }
-    LOG_DEBUG("CSV file '%s' opened successfully. About to call init_registered_users_table()", filepath);
-    LOG_INFO("Populating registered users from CSV '%s'...", filepath);
-
-    init_registered_users_table(); // Clear all existing entries first
-    LOG_DEBUG("init_registered_users_table() completed. Starting CSV parsing loop.");
-
-    char line[2048];
-    int ln = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        ln++;
-        // CSV has NO header - all rows are data
-        // CSV format: FirstName,LastName,Callsign,PhoneNumber (4 columns)
-        char *cols[4] = {NULL};
-        char *p = line;
-        for (int i=0; i<4; i++) {
-            if (i<3) {
-                char *c = strchr(p, ',');
-                if (c) {
-                    *c = '\0';
-                    cols[i] = p;
-                    p = c+1;
-                } else {
-                    cols[i] = p;
-                    p = NULL;
-                }
+// A directory rebuild in progress: the spare table, filled row by row while
+// the live one keeps serving lookups. Owned by whoever holds directory_build_mutex.
+static UserTable *building = NULL;
+static int building_count = 0;
+
+void directory_build_begin(void) {
+    pthread_mutex_lock(&directory_build_mutex);
+    // Only a reload swaps current_users, and reloads hold directory_build_mutex
+    building = (current_users == &user_tables[0]) ? &user_tables[1] : &user_tables[0];
+    reset_user_table(building);
+    building_count = 0;
+    LOG_DEBUG("Spare user table cleared for a directory rebuild.");
+}
+
+void directory_build_add_csv_row(char *line, int ln) {
+    // CSV has NO header - all rows are data
+    // CSV format: FirstName,LastName,Callsign,PhoneNumber (4 columns)
+    char *cols[4] = {NULL};
+    char *p = line;
+    for (int i=0; i<4; i++) {
+        if (i<3) {
+            char *c = strchr(p, ',');
+            if (c) {
+                *c = '\0';
+                cols[i] = p;
+                p = c+1;
             } else {
                 cols[i] = p;
+                p = NULL;
             }
-            if (!p && i < 3) { // Only break if missing expected columns before the last one
-                LOG_WARN("Line %d has fewer than 4 columns. Missing column %d and subsequent. Line: '%.*s'", ln, i+1, (int)strcspn(line, "\r\n"), line);
-                break;
-            }
-        }
-
-        if (cols[3]) {
-            char *e = strchr(cols[3], ','); // Handle potential extra commas in last field
-            if (e) *e = '\0';
-            cols[3][strcspn(cols[3], "\r\n")] = '\0'; // Remove newline
+        } else {
+            cols[i] = p;
         }
-        if (!cols[3] || !*cols[3]) {
-            LOG_WARN("Skipping CSV row %d due to missing or empty Telephone number (column 4). Line: '%.*s'", ln, (int)strcspn(line, "\r\n"), line);
-            continue;
+        if (!p && i < 3) { // Only break if missing expected columns before the last one
+            LOG_WARN("Line %d has fewer than 4 columns. Missing column %d and subsequent. Line: '%.*s'", ln, i+1, (int)strcspn(line, "\r\n"), line);
+            break;
         }
+    }
 
-        char s0[MAX_FIRST_NAME_LEN]={0}, s1[MAX_NAME_LEN]={0}, s2[MAX_CALLSIGN_LEN]={0};
-        char sanitized_user_id_numeric[MAX_PHONE_NUMBER_LEN] = {0}; // New buffer for sanitized user_id
-
-        sanitize_utf8(cols[0] ? cols[0] : "", s0, sizeof(s0));
-        sanitize_utf8(cols[1] ? cols[1] : "", s1, sizeof(s1));
-        sanitize_utf8(cols[2] ? cols[2] : "", s2, sizeof(s2));
-        sanitize_utf8(cols[3] ? cols[3] : "", sanitized_user_id_numeric, sizeof(sanitized_user_id_numeric)); // Sanitize user ID (Phone number is column 4, index 3)
-
-        trim_whitespace(s0);
-        trim_whitespace(s1);
-        trim_whitespace(s2);
-        trim_whitespace(sanitized_user_id_numeric); // Also trim whitespace from the sanitized user ID
-
-        char full_name[MAX_DISPLAY_NAME_LEN];
-        if (s0[0] && s1[0] && s2[0]) {
-            snprintf(full_name, sizeof(full_name), "%s %s (%s)", s0, s1, s2);
-        } else if (s0[0] && s1[0]) {
-            snprintf(full_name, sizeof(full_name), "%s %s", s0, s1);
-        } else if (s0[0]) {
-            strncpy(full_name, s0, sizeof(full_name) - 1);
-            full_name[sizeof(full_name) - 1] = '\0';
-        } else if (s1[0]) {
-            strncpy(full_name, s1, sizeof(full_name) - 1);
-            full_name[sizeof(full_name) - 1] = '\0';
-        } else if (s2[0]) {
-            strncpy(full_name, s2, sizeof(full_name) - 1);
-            full_name[sizeof(full_name) - 1] = '\0';
-        }
-        else {
-            strncpy(full_name, "Unnamed", sizeof(full_name) - 1);
-            full_name[sizeof(full_name) - 1] = '\0';
-        }
+    if (cols[3]) {
+        char *e = strchr(cols[3], ','); // Handle potential extra commas in last field
+        if (e) *e = '\0';
+        cols[3][strcspn(cols[3], "\r\n")] = '\0'; // Remove newline
+    }
+    if (!cols[3] || !*cols[3]) {
+        LOG_WARN("Skipping CSV row %d due to missing or empty Telephone number (column 4). Line: '%.*s'", ln, (int)strcspn(line, "\r\n"), line);
+        return;
+    }
+
+    char s0[MAX_FIRST_NAME_LEN]={0}, s1[MAX_NAME_LEN]={0}, s2[MAX_CALLSIGN_LEN]={0};
+    char sanitized_user_id_numeric[MAX_PHONE_NUMBER_LEN] = {0}; // New buffer for sanitized user_id
 
-        // Pass the new, sanitized_user_id_numeric buffer
-        add_csv_user_to_registered_users_table(sanitized_user_id_numeric, full_name);
+    sanitize_utf8(cols[0] ? cols[0] : "", s0, sizeof(s0));
+    sanitize_utf8(cols[1] ? cols[1] : "", s1, sizeof(s1));
+    sanitize_utf8(cols[2] ? cols[2] : "", s2, sizeof(s2));
+    sanitize_utf8(cols[3] ? cols[3] : "", sanitized_user_id_numeric, sizeof(sanitized_user_id_numeric)); // Sanitize user ID (Phone number is column 4, index 3)
+
+    trim_whitespace(s0);
+    trim_whitespace(s1);
+    trim_whitespace(s2);
+    trim_whitespace(sanitized_user_id_numeric); // Also trim whitespace from the sanitized user ID
+
+    char full_name[MAX_DISPLAY_NAME_LEN];
+    if (s0[0] && s1[0] && s2[0]) {
+        snprintf(full_name, sizeof(full_name), "%s %s (%s)", s0, s1, s2);
+    } else if (s0[0] && s1[0]) {
+        snprintf(full_name, sizeof(full_name), "%s %s", s0, s1);
+    } else if (s0[0]) {
+        strncpy(full_name, s0, sizeof(full_name) - 1);
+        full_name[sizeof(full_name) - 1] = '\0';
+    } else if (s1[0]) {
+        strncpy(full_name, s1, sizeof(full_name) - 1);
+        full_name[sizeof(full_name) - 1] = '\0';
+    } else if (s2[0]) {
+        strncpy(full_name, s2, sizeof(full_name) - 1);
+        full_name[sizeof(full_name) - 1] = '\0';
     }
-    fclose(fp);
-    LOG_DEBUG("CSV parsing loop completed. Total lines processed: %d", ln);
-    LOG_DEBUG("Final count: num_directory_entries=%d", num_directory_entries);
-    LOG_INFO("Finished populating registered users from CSV. Total directory entries: %d.", num_directory_entries);
-    LOG_DEBUG("populate_registered_users_from_csv() EXITING normally");
+    else {
+        strncpy(full_name, "Unnamed", sizeof(full_name) - 1);
+        full_name[sizeof(full_name) - 1] = '\0';
+    }
+
+    // Pass the new, sanitized_user_id_numeric buffer
+    table_add_directory_user(building, sanitized_user_id_numeric, full_name, &building_count);
+}
+
+int directory_build_commit(void) {
+    pthread_mutex_lock(&registered_users_mutex);
+    int dynamic_count = merge_dynamic_registrations(building, current_users);
+    users_write_begin();
+    __atomic_store_n(&current_users, building, __ATOMIC_RELEASE);
+    num_directory_entries = building_count;
+    num_registered_users = dynamic_count;
+    users_write_end();
+    registrations_dirty = true; // Registrations now listed in the directory are no longer dynamic
+    pthread_mutex_unlock(&registered_users_mutex);
+
+    int directory_count = building_count;
+    building = NULL;
+    pthread_mutex_unlock(&directory_build_mutex);
+
+    LOG_INFO("Directory swapped in. Total directory entries: %d, dynamic registrations kept: %d.",
+             directory_count, dynamic_count);
+    return directory_count;
+}
+
+void directory_build_abort(void) {
+    building = NULL;
+    pthread_mutex_unlock(&directory_build_mutex);
+    LOG_DEBUG("Directory rebuild discarded; live table unchanged.");
 }
 
 void load_directory_from_xml(const char *filepath) {
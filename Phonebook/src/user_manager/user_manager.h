@@ -3,14 +3,63 @@
 #define USER_MANAGER_H
 
 #include "../common.h" // For RegisteredUser type and other common definitions
+#include "../timer_wheel/timer_wheel.h"
+
+// The user table is indexed by a hash on user_id. Updates serialize on
+// registered_users_mutex; lookups and snapshots never take it (seqlock read
+// path), so the SIP thread does not wait on the phonebook or bulk tester threads.
+// A phonebook reload builds a complete second table, carries live dynamic
+// registrations over, and swaps it in at once.
+// Each dynamic registration has a timer in the table's timer wheel. It is armed
+// for the granted Expires plus REGISTRATION_GRACE_SECONDS and re-armed on every
+// refresh. When it fires, the slot is reclaimed. Directory entries never expire.
+
+#define REGISTRATION_GRACE_SECONDS 32  // A refresh still in flight when Expires runs out
+
+// Dynamic registrations are checkpointed to REGISTRATION_SNAPSHOT_PATH every
+// REGISTRATION_SNAPSHOT_SECONDS while they change, and once more on shutdown.
+// The file is a versioned header plus fixed-size records with wall-clock
+// deadlines, protected by a checksum. It is read back at startup before the
+// SIP port opens, so registrations survive a daemon restart.
+#define REGISTRATION_SNAPSHOT_MAGIC   0x53524250u // "PBRS" on disk (little-endian)
+#define REGISTRATION_SNAPSHOT_VERSION 1
 
 // Function prototypes for user management
+// Returns a pointer into the live table; its fields may change under a concurrent update
 RegisteredUser* find_registered_user(const char *user_id);
+// Copy an active user's entry into out. Returns false if unknown or inactive.
+bool lookup_registered_user(const char *user_id, RegisteredUser *out);
+// Copy up to max_users occupied entries into out; returns the number copied
+int snapshot_registered_users(RegisteredUser *out, int max_users);
 // Corrected prototype to match simplified RegisteredUser struct and logic
 RegisteredUser* add_or_update_registered_user(const char *user_id, const char *display_name, int expires);
 RegisteredUser* add_csv_user_to_registered_users_table(const char *user_id_numeric, const char *display_name);
 void init_registered_users_table();
-void populate_registered_users_from_csv(const char *filepath);
+
+// Registration expiry, driven by the main loop's timer (event_loop timer source)
+int registration_expiry_next_timeout_ms(void);
+void registration_expiry_process(void);
+// Expires to grant for a REGISTER asking for requested seconds (-1 = none given):
+// capped at REGISTRATION_MAX_EXPIRES, then shortened by up to REGISTRATION_EXPIRES_JITTER percent
+int registration_grant_expires(int requested);
+unsigned long long registration_expired_count(void);
+
+// Registration snapshot. load returns the number of registrations restored (0 if
+// there was no usable snapshot); save writes the file now; the timer source
+// pair writes it when registrations changed and the interval has passed.
+int registration_snapshot_load(void);
+int registration_snapshot_save(void);
+int registration_snapshot_next_timeout_ms(void);
+void registration_snapshot_process(void);
+
+// Streaming directory rebuild. begin claims the spare table (one rebuild at a
+// time); add_csv_row parses one CSV line (modified in place) into it; commit
+// merges in the live dynamic registrations, swaps the table in and returns the
+// directory size; abort drops it. Every begin is paired with one commit or abort.
+void directory_build_begin(void);
+void directory_build_add_csv_row(char *line, int line_no);
+int directory_build_commit(void);
+void directory_build_abort(void);
 void load_directory_from_xml(const char *filepath); // Deprecated but retained prototype
 
 #endif // USER_MANAGER_H